@@ -93,6 +93,7 @@ public:
   };
 
   void Init(id_t v_num, id_t d_max) {
+    Clear();
     this->v_num = v_num;
     this->d_max = d_max;
     size_t num_bytes = 1llu * sizeof(id_t) * v_num * (d_max + 1);
@@ -104,17 +105,18 @@ public:
     d_max = 0;
     if (indices)
       MemoryPool::Global().free(indices);
+    indices = nullptr;
   }
   ~NSWGraph() {
     Clear();
   };
 
-  __force_inline__ id_t get_d_max() { return d_max; };
-  __force_inline__ id_t get_v_num() { return v_num; };
+  __force_inline__ id_t get_d_max() const { return d_max; };
+  __force_inline__ id_t get_v_num() const { return v_num; };
   __force_inline__ id_t *get_indices() { return indices; };
 
   // 0-th index is reserved for degree
-  __force_inline__ id_t get_deg(id_t vid) {
+  __force_inline__ id_t get_deg(id_t vid) const {
     return *(indices + 1llu * vid * (d_max + 1));
   };
 
@@ -122,6 +124,9 @@ public:
   __force_inline__ id_t *get_adj(id_t vid) {
     return indices + 1llu * vid * (d_max + 1) + 1;
   };
+  __force_inline__ const id_t *get_adj(id_t vid) const {
+    return indices + 1llu * vid * (d_max + 1) + 1;
+  };
 
   // Swap function
   friend void swap(NSWGraph &first, NSWGraph &second) noexcept {
@@ -182,6 +187,7 @@ public:
     d_max = 0;
     if (indices)
       MemoryPool::Global().free(indices);
+    indices = nullptr;
   }
 
   __force_inline__ id_t get_d_max() { return d_max; };
@@ -1,22 +1,32 @@
 #pragma once
 #include "graph.hpp"
 #include "matrix2d.hpp"
+#include "space.hpp"
 #include "util.hpp"
 #include "memory_pool.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <oneapi/tbb/blocked_range.h>
 #include <oneapi/tbb/concurrent_map.h>
+#include <oneapi/tbb/parallel_for.h>
 #include <queue>
+#include <random>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace ann {
 
 struct HNSWBuildConfig {
-  id_t ef{0};
-  id_t M{0};
-  id_t M_base{0};
+  id_t ef{0};         // candidates of the searches of the insertions
+  id_t M{0};          // max degree of the upper layers
+  id_t M_base{0};     // max degree of the base layer, 2 * M when 0
+  uint64_t seed{100}; // seed of the insertion order and of the levels
 };
 
 struct HNSWSearchConfig {
@@ -32,14 +42,69 @@ struct HNSWLoadconfig {
   bool merge_index_data{false};
 };
 
-template <typename data_t, DistanceType distance_type, bool profiling>
+/**
+ * @brief
+ * Per thread visited marks of a search, cleared in O(1) by moving to the
+ * next epoch.
+ */
+class VisitedTable {
+public:
+  void Reset(id_t v_num) {
+    if (marks.size() < static_cast<size_t>(v_num)) {
+      marks.assign(v_num, 0);
+      epoch = 0;
+    }
+    if (++epoch == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      epoch = 1;
+    }
+  };
+
+  // marks vid, returns whether it was already visited
+  __force_inline__ bool Visit(id_t vid) {
+    if (marks[vid] == epoch)
+      return true;
+    marks[vid] = epoch;
+    return false;
+  };
+
+  static VisitedTable &Local() {
+    static thread_local VisitedTable table{};
+    return table;
+  };
+
+private:
+  std::vector<uint32_t> marks;
+  uint32_t epoch{0};
+};
+
+/**
+ * @brief
+ * HNSW built once over a Matrix2D and then frozen for the searches.
+ * The elements are inserted concurrently, the upper layers are
+ * tbb::concurrent_map dynamic graphs from the vertex to its adjacency and
+ * the base layer is a fixed array indexed by vertex. Freeze copies every
+ * layer into a contiguous NSWGraph. The vertices of an upper layer are
+ * renumbered densely in the order of their ids, with their vectors copied
+ * next to each other, so the descent reads a few small arrays.
+ * The results are (distance, vid) max heaps, the distance of Ip is the
+ * negated inner product so that smaller is always closer.
+ *
+ * @tparam data_t float, float16 or uint8_t
+ * @tparam profiling count the hops and the distances of the searches per layer
+ */
+template <typename data_t, DistanceType distance_type, bool profiling = false>
 class HNSW {
 public:
+  using ResultQueue = std::priority_queue<std::pair<float, id_t>>;
+
   void SetBuildConfig(HNSWBuildConfig config) {
     build_config = config;
+    if (build_config.M_base == 0)
+      build_config.M_base = 2 * build_config.M;
+    ALWAYS_ASSERT(build_config.M > 1 && build_config.ef > 0);
     cum_probs.clear();
     cum_edges.clear();
-    dynamic_graphs.clear();
     int num_edges = 0;
     int cur_level = 0;
     double rlogm = 1.0 / log(build_config.M);
@@ -49,55 +114,431 @@ public:
       if (delta < 1e-9)
         break;
       prob += delta;
-      cur_level += 1;
       num_edges += (cur_level == 0) ? build_config.M_base : build_config.M;
       cum_probs.push_back(prob);
       cum_edges.push_back(num_edges);
+      cur_level += 1;
     }
     n_layers = cum_probs.size();
-    dynamic_graphs.resize(n_layers);
   }
 
   void SetSearchConfig(HNSWSearchConfig config) { search_config = config; }
 
-  void BuildIndex(Matrix2D<data_t> matrix) {
+  // inserts all the vectors concurrently in a random order, then freezes the index
+  void BuildIndex(const Matrix2D<data_t> &matrix) {
+    using namespace tbb;
+    InitBuild(matrix);
     auto idx2vid = get_random_indices(matrix.num_elem);
-    // build indices
-    for (id_t i = 0; i < data.num_elem; i++) {
-      auto vid = idx2vid.at(i);
-      AddPoint(vid, matrix.get_feat_span(vid));
-    }
-  }
-
-  void AddPoint(id_t vid, std::span<data_t> vdata) {
-    int insert_level = get_random_level(cum_probs);
-    id_t entry_point = -1;
-    int search_level = -1;
-    for (int visit_level = n_layers - 1; visit_level >= insert_level; visit_level--) {
-      DGraph &g = dynamic_graphs.at(visit_level);
-      if (g.empty()) continue;
-      else {
-        entry_point = g.begin()->first;
-        search_level = visit_level;
-        break;
+    parallel_for(blocked_range<id_t>(0, matrix.num_elem),
+                 [&](const blocked_range<id_t> &r) {
+                   for (id_t i = r.begin(); i < r.end(); i++)
+                     AddPoint(idx2vid.at(i));
+                 });
+    Freeze();
+  }
+
+  // the vectors stay owned by the caller and are read until the index is destroyed
+  void InitBuild(const Matrix2D<data_t> &matrix) {
+    ALWAYS_ASSERT(n_layers > 0);
+    data = matrix;
+    frozen = false;
+    entry_point = -1;
+    max_level = -1;
+    levels.assign(data.num_elem, -1);
+    locks = std::vector<std::mutex>(data.num_elem);
+    base_adj.assign(1llu * data.num_elem * (build_config.M_base + 1), 0);
+    dynamic_graphs.clear();
+    dynamic_graphs.resize(n_layers);
+    arena_chunks.clear();
+    arena_used = 0;
+  }
+
+  // inserts the vector vid of the matrix, thread-safe until Freeze
+  void AddPoint(id_t vid) {
+    ALWAYS_ASSERT(!frozen && vid >= 0 && vid < data.num_elem);
+    std::mt19937_64 rng(build_config.seed + vid);
+    const int level = get_random_level(cum_probs, rng);
+    levels[vid] = level;
+    for (int l = 1; l <= level; l++)
+      dynamic_graphs[l].emplace(vid, AllocateAdj(build_config.M));
+
+    // an element above the current top keeps the entry lock until it becomes the entry point
+    std::unique_lock<std::mutex> entry_guard(entry_lock);
+    id_t cur = entry_point;
+    const int top = max_level;
+    if (cur < 0) {
+      entry_point = vid;
+      max_level = level;
+      return;
+    }
+    if (level <= top)
+      entry_guard.unlock();
+
+    const data_t *query = data.get_feat(vid);
+    float cur_dist = Distance(query, data.get_feat(cur));
+    std::vector<id_t> adj;
+    std::vector<id_t> buffer;
+    for (int l = top; l > level; l--) {
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        CopyAdj(cur, l, adj);
+        for (id_t n : adj) {
+          float d = Distance(query, data.get_feat(n));
+          if (d < cur_dist) {
+            cur_dist = d;
+            cur = n;
+            changed = true;
+          }
+        }
       }
     }
 
-    if (entry_point == -1) {
-        // didn't find entry point insert directly at this level
-        DGraph &g = dynamic_graphs.at(search_level);
-        g[vid] = std::span<id_t>();
+    for (int l = std::min(level, top); l >= 0; l--) {
+      auto candidates = SearchLayer(query, cur, build_config.ef, [&](id_t u, auto &&visit) {
+        CopyAdj(u, l, buffer);
+        for (id_t n : buffer)
+          visit(n);
+      });
+      const id_t max_degree = l == 0 ? build_config.M_base : build_config.M;
+      auto neighbors = SelectNeighbors(std::move(candidates), max_degree, vid);
+      {
+        std::unique_lock<std::mutex> guard(locks[vid]);
+        std::span<id_t> own = GetDynamicAdj(vid, l);
+        own[0] = neighbors.size();
+        for (size_t i = 0; i < neighbors.size(); i++)
+          own[i + 1] = neighbors[i].second;
+      }
+      for (auto &neighbor : neighbors)
+        AddLink(neighbor.second, vid, neighbor.first, l, max_degree);
+      cur = neighbors.front().second;
+    }
+
+    if (level > top) {
+      entry_point = vid;
+      max_level = level;
     }
   };
 
-  std::priority_queue<std::pair<float, id_t>>
-  SearchKnn(HNSWSearchConfig config, std::span<data_t> query);
-  std::priority_queue<std::pair<float, id_t>>
-  SearchKnnBatch(HNSWSearchConfig config, const Matrix2D<data_t> &queries);
+  // copies the layers into contiguous NSWGraphs and releases the dynamic graphs
+  void Freeze() {
+    using namespace tbb;
+    ALWAYS_ASSERT(!frozen);
+    const int num_layers = std::max(max_level + 1, 1);
+    graph = std::vector<NSWGraph>(num_layers);
+    layer_vids.assign(num_layers, {});
+    layer_down.assign(num_layers, {});
+    layer_feats.assign(num_layers, {});
+
+    NSWGraph &base = graph[0];
+    base.Init(data.num_elem, build_config.M_base);
+    std::memcpy(base.get_indices(), base_adj.data(), base_adj.size() * sizeof(id_t));
+
+    for (int l = 1; l < num_layers; l++) {
+      // the concurrent map iterates in the order of the ids, which is the dense numbering
+      std::vector<id_t> &vids = layer_vids[l];
+      for (auto &entry : dynamic_graphs[l])
+        vids.push_back(entry.first);
+      const id_t num_vertices = vids.size();
+      graph[l].Init(num_vertices, build_config.M);
+      layer_feats[l].resize(1llu * num_vertices * data.dim);
+      layer_down[l].resize(num_vertices);
+      parallel_for(blocked_range<id_t>(0, num_vertices), [&](const blocked_range<id_t> &r) {
+        for (id_t local = r.begin(); local < r.end(); local++) {
+          const id_t vid = vids[local];
+          // same [degree, neighbors...] layout, the neighbors renumbered
+          std::span<id_t> adj = dynamic_graphs[l].find(vid)->second;
+          id_t *frozen_adj = graph[l].get_adj(local) - 1;
+          frozen_adj[0] = adj[0];
+          for (id_t i = 1; i <= adj[0]; i++)
+            frozen_adj[i] = LocalId(l, adj[i]);
+          std::memcpy(layer_feats[l].data() + 1llu * local * data.dim, data.get_feat(vid),
+                      data.dim * sizeof(data_t));
+          layer_down[l][local] = l == 1 ? vid : LocalId(l - 1, vid);
+        }
+      });
+    }
+    frozen_entry = entry_point < 0 ? -1 : (max_level > 0 ? LocalId(max_level, entry_point) : entry_point);
+
+    num_hops = std::vector<std::atomic<int64_t>>(num_layers);
+    num_dists = std::vector<std::atomic<int64_t>>(num_layers);
+    dynamic_graphs.clear();
+    std::vector<id_t>().swap(base_adj);
+    std::vector<std::mutex>().swap(locks);
+    arena_chunks.clear();
+    arena_used = 0;
+    frozen = true;
+  }
+
+  ResultQueue SearchKnn(HNSWSearchConfig config, std::span<const data_t> query) const {
+    ALWAYS_ASSERT(frozen);
+    ResultQueue ret;
+    if (frozen_entry < 0)
+      return ret;
+    const data_t *q = query.data();
+
+    // greedy descent of the upper layers on their dense copies
+    const int top = graph.size() - 1;
+    id_t cur = frozen_entry;
+    if (top > 0) {
+      float cur_dist = Distance(q, layer_feats[top].data() + 1llu * cur * data.dim);
+      for (int l = top; l > 0; l--) {
+        const NSWGraph &g = graph[l];
+        const data_t *feats = layer_feats[l].data();
+        int64_t hops = 0, dists = 0;
+        bool changed = true;
+        while (changed) {
+          changed = false;
+          hops++;
+          const id_t deg = g.get_deg(cur);
+          const id_t *adj = g.get_adj(cur);
+          for (id_t i = 0; i < deg; i++) {
+            float d = Distance(q, feats + 1llu * adj[i] * data.dim);
+            if (d < cur_dist) {
+              cur_dist = d;
+              cur = adj[i];
+              changed = true;
+            }
+          }
+          dists += deg;
+        }
+        if constexpr (profiling) {
+          num_hops[l].fetch_add(hops, std::memory_order_relaxed);
+          num_dists[l].fetch_add(dists, std::memory_order_relaxed);
+        }
+        cur = layer_down[l][cur];
+      }
+    }
+
+    const NSWGraph &base = graph[0];
+    const id_t ef = std::max(config.ef, config.k);
+    auto top_candidates = SearchLayer(q, cur, ef, [&](id_t u, auto &&visit) {
+      const id_t deg = base.get_deg(u);
+      const id_t *adj = base.get_adj(u);
+      for (id_t i = 0; i < deg; i++)
+        __builtin_prefetch(data.get_feat(adj[i]));
+      for (id_t i = 0; i < deg; i++)
+        visit(adj[i]);
+    }, true);
+    while (top_candidates.size() > static_cast<size_t>(config.k))
+      top_candidates.pop();
+    return top_candidates;
+  }
+
+  ResultQueue SearchKnn(std::span<const data_t> query) const {
+    return SearchKnn(search_config, query);
+  }
+
+  std::vector<ResultQueue> SearchKnnBatch(HNSWSearchConfig config, const Matrix2D<data_t> &queries) const {
+    using namespace tbb;
+    std::vector<ResultQueue> ret(queries.num_elem);
+    parallel_for(blocked_range<id_t>(0, queries.num_elem), [&](const blocked_range<id_t> &r) {
+      for (id_t i = r.begin(); i < r.end(); i++)
+        ret[i] = SearchKnn(config, std::span<const data_t>(queries.get_feat(i), queries.dim));
+    });
+    return ret;
+  }
+
+  bool IsFrozen() const { return frozen; }
+  int GetNumLayers() const { return frozen ? graph.size() : max_level + 1; }
+  id_t GetLayerSize(int level) const {
+    return level == 0 ? data.num_elem : static_cast<id_t>(layer_vids.at(level).size());
+  }
+  int GetLevel(id_t vid) const { return levels.at(vid); }
+  // bytes of the frozen graphs and of the dense copies of the upper layer vectors
+  size_t GetMemoryUsage() const {
+    size_t total = 0;
+    for (size_t l = 0; l < graph.size(); l++) {
+      total += 1llu * graph[l].get_v_num() * (graph[l].get_d_max() + 1) * sizeof(id_t);
+      total += layer_feats[l].size() * sizeof(data_t) + 2 * layer_vids[l].size() * sizeof(id_t);
+    }
+    return total;
+  }
+
+  // neighbors of vid in the frozen layer, as vertex ids
+  std::vector<id_t> GetNeighbors(id_t vid, int level) const {
+    ALWAYS_ASSERT(frozen);
+    std::vector<id_t> ret;
+    const NSWGraph &g = graph.at(level);
+    const id_t local = level == 0 ? vid : LocalId(level, vid);
+    for (id_t i = 0; i < g.get_deg(local); i++)
+      ret.push_back(level == 0 ? g.get_adj(local)[i] : layer_vids[level][g.get_adj(local)[i]]);
+    return ret;
+  }
+
+  int64_t GetNumHops(int level) const { return num_hops.at(level).load(); }
+  int64_t GetNumDists(int level) const { return num_dists.at(level).load(); }
+  void ResetProfile() {
+    for (auto &hops : num_hops)
+      hops = 0;
+    for (auto &dists : num_dists)
+      dists = 0;
+  }
 
 private:
+  __force_inline__ float Distance(const data_t *a, const data_t *b) const {
+    float d = get_distance<distance_type, data_t>(a, b, data.dim);
+    if constexpr (is_min_close(distance_type)) {
+      return d;
+    } else {
+      return -d;
+    }
+  }
+
+  id_t LocalId(int level, id_t vid) const {
+    const std::vector<id_t> &vids = layer_vids[level];
+    return std::lower_bound(vids.begin(), vids.end(), vid) - vids.begin();
+  }
+
+  // [degree, neighbors...] of vid in the dynamic layer
+  std::span<id_t> GetDynamicAdj(id_t vid, int level) {
+    if (level == 0)
+      return std::span<id_t>(base_adj.data() + 1llu * vid * (build_config.M_base + 1), build_config.M_base + 1);
+    return dynamic_graphs[level].find(vid)->second;
+  }
+
+  void CopyAdj(id_t vid, int level, std::vector<id_t> &out) {
+    std::unique_lock<std::mutex> guard(locks[vid]);
+    std::span<id_t> adj = GetDynamicAdj(vid, level);
+    out.assign(adj.begin() + 1, adj.begin() + 1 + adj[0]);
+  }
+
+  std::span<id_t> AllocateAdj(id_t max_degree) {
+    constexpr size_t chunk_size = 1 << 20;
+    const size_t size = max_degree + 1;
+    std::unique_lock<std::mutex> guard(arena_lock);
+    if (arena_chunks.empty() || arena_used + size > chunk_size) {
+      arena_chunks.emplace_back(new id_t[chunk_size]());
+      arena_used = 0;
+    }
+    id_t *adj = arena_chunks.back().get() + arena_used;
+    arena_used += size;
+    return std::span<id_t>(adj, size);
+  }
+
+  /*
+   * Best-first search of a layer from entry with ef candidates. for_each_adj(u, visit)
+   * calls visit on the neighbors of u, during the build on a copy taken under the lock of u.
+   */
+  template <typename adj_func_t>
+  ResultQueue SearchLayer(const data_t *query, id_t entry, id_t ef, adj_func_t &&for_each_adj,
+                          bool is_search = false) const {
+    VisitedTable &visited = VisitedTable::Local();
+    visited.Reset(data.num_elem);
+    ResultQueue top_candidates;
+    std::priority_queue<std::pair<float, id_t>> candidates; // negated distances, closest on top
+    float d = Distance(query, data.get_feat(entry));
+    top_candidates.emplace(d, entry);
+    candidates.emplace(-d, entry);
+    visited.Visit(entry);
+    int64_t hops = 0, dists = 1;
+    float lower_bound = d;
+
+    auto visit = [&](id_t n) {
+      if (visited.Visit(n))
+        return;
+      float dist = Distance(query, data.get_feat(n));
+      dists++;
+      if (top_candidates.size() < static_cast<size_t>(ef) || dist < lower_bound) {
+        candidates.emplace(-dist, n);
+        top_candidates.emplace(dist, n);
+        if (top_candidates.size() > static_cast<size_t>(ef))
+          top_candidates.pop();
+        lower_bound = top_candidates.top().first;
+      }
+    };
+
+    while (!candidates.empty()) {
+      auto current = candidates.top();
+      if (-current.first > lower_bound && top_candidates.size() >= static_cast<size_t>(ef))
+        break;
+      candidates.pop();
+      hops++;
+      for_each_adj(current.second, visit);
+    }
+    if constexpr (profiling) {
+      if (is_search) {
+        num_hops[0].fetch_add(hops, std::memory_order_relaxed);
+        num_dists[0].fetch_add(dists, std::memory_order_relaxed);
+      }
+    }
+    return top_candidates;
+  }
+
+  // the neighbor heuristic of HNSW: a candidate closer to a kept neighbor than to the query is dropped
+  std::vector<std::pair<float, id_t>> SelectNeighbors(ResultQueue candidates, id_t max_degree, id_t self) const {
+    std::vector<std::pair<float, id_t>> sorted;
+    while (!candidates.empty()) {
+      if (candidates.top().second != self)
+        sorted.push_back(candidates.top());
+      candidates.pop();
+    }
+    std::reverse(sorted.begin(), sorted.end());
+    if (sorted.size() <= static_cast<size_t>(max_degree))
+      return sorted;
+    std::vector<std::pair<float, id_t>> selected;
+    for (auto &candidate : sorted) {
+      if (selected.size() >= static_cast<size_t>(max_degree))
+        break;
+      bool good = true;
+      for (auto &kept : selected) {
+        if (Distance(data.get_feat(candidate.second), data.get_feat(kept.second)) < candidate.first) {
+          good = false;
+          break;
+        }
+      }
+      if (good)
+        selected.push_back(candidate);
+    }
+    return selected;
+  }
+
+  // links vid back from neighbor, shrinking the neighbors with the heuristic on overflow
+  void AddLink(id_t neighbor, id_t vid, float dist, int level, id_t max_degree) {
+    std::unique_lock<std::mutex> guard(locks[neighbor]);
+    std::span<id_t> adj = GetDynamicAdj(neighbor, level);
+    const id_t deg = adj[0];
+    for (id_t i = 0; i < deg; i++) {
+      if (adj[i + 1] == vid)
+        return;
+    }
+    if (deg < max_degree) {
+      adj[deg + 1] = vid;
+      adj[0] = deg + 1;
+      return;
+    }
+    ResultQueue candidates;
+    candidates.emplace(dist, vid);
+    const data_t *feat = data.get_feat(neighbor);
+    for (id_t i = 0; i < deg; i++)
+      candidates.emplace(Distance(feat, data.get_feat(adj[i + 1])), adj[i + 1]);
+    auto selected = SelectNeighbors(std::move(candidates), max_degree, neighbor);
+    adj[0] = selected.size();
+    for (size_t i = 0; i < selected.size(); i++)
+      adj[i + 1] = selected[i].second;
+  }
+
+  Matrix2D<data_t> data{0, 0, nullptr};
+  bool frozen{false};
+
+  // frozen layers, the upper layers are numbered densely
   std::vector<NSWGraph> graph;
+  std::vector<std::vector<id_t>> layer_vids;   // dense id -> vid
+  std::vector<std::vector<id_t>> layer_down;   // dense id -> id in the layer below
+  std::vector<std::vector<data_t>> layer_feats; // vectors of the upper layers by dense id
+  id_t frozen_entry{-1};
+
+  // construction
   std::vector<std::mutex> locks;
+  std::mutex entry_lock;
+  id_t entry_point{-1};
+  int max_level{-1};
+  std::vector<int> levels;
+  std::vector<id_t> base_adj;
+  std::mutex arena_lock;
+  std::vector<std::unique_ptr<id_t[]>> arena_chunks;
+  size_t arena_used{0};
+
   int n_layers{0};
   std::vector<double>
       cum_probs; // cummulative probability of insertion at each level
@@ -106,12 +547,17 @@ private:
   HNSWBuildConfig build_config;
   HNSWSearchConfig search_config;
   // profiling metric
-  std::vector<std::atomic<int64_t>> num_hops;
-  std::vector<std::atomic<int64_t>> num_dists;
+  mutable std::vector<std::atomic<int64_t>> num_hops;
+  mutable std::vector<std::atomic<int64_t>> num_dists;
 
   using DGraph = tbb::concurrent_map<id_t, std::span<id_t>>;
   std::vector<DGraph> dynamic_graphs;
-  std::vector<std::span<data_t>> data;
 };
 
-} // namespace ann
\ No newline at end of file
+extern template class HNSW<float, DistanceType::L2, false>;
+extern template class HNSW<float, DistanceType::Ip, false>;
+extern template class HNSW<float16, DistanceType::L2, false>;
+extern template class HNSW<float16, DistanceType::Ip, false>;
+extern template class HNSW<uint8_t, DistanceType::L2, false>;
+
+} // namespace ann
@@ -7,14 +7,75 @@
 #include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <oneapi/tbb/blocked_range.h>
 #include <oneapi/tbb/parallel_for.h>
 #include <priority_queue.hpp>
+#include <span>
 #include <tbb/parallel_for.h>
 #include <vector>
 
 namespace ann {
 
+// tiles of the brute force search: the features of a block of candidates stay
+// in cache while a block of queries is compared to them
+constexpr int64_t kBruteForceQueryBlock = 64;
+constexpr int64_t kBruteForceDataBlock = 1024;
+
+/**
+ * @brief
+ * TopK keeps the k smallest keys pushed to it. Keys below the current k-th
+ * smallest are buffered and the buffer is cut back to k with nth_element when
+ * it holds 2k of them, instead of sorting all the distances.
+ */
+class TopK {
+public:
+  void reset(int _k) {
+    k = _k;
+    threshold = std::numeric_limits<float>::max();
+    entries.clear();
+    entries.reserve(2llu * k);
+  };
+
+  // keys at or above the threshold are not in the top k
+  __force_inline__ float get_threshold() const { return threshold; };
+
+  __force_inline__ void push(float key, id_t id) {
+    if (key >= threshold)
+      return;
+    entries.emplace_back(key, id);
+    if (entries.size() == 2llu * k)
+      compact();
+  };
+
+  // writes the ids of the top k, smallest key first
+  void get_sorted(std::span<id_t> out) {
+    compact();
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i < std::min(out.size(), entries.size()); i++)
+      out[i] = entries[i].second;
+  };
+
+private:
+  void compact() {
+    if (entries.size() < (size_t)k)
+      return;
+    std::nth_element(entries.begin(), entries.begin() + k - 1, entries.end());
+    entries.resize(k);
+    threshold = entries[k - 1].first;
+  };
+
+  int k{0};
+  float threshold{std::numeric_limits<float>::max()};
+  std::vector<std::pair<float, id_t>> entries;
+};
+
+/**
+ * @brief
+ * Exact kNN graph. Every vertex is compared to all the vertices, itself
+ * included (its first neighbor for L2), in tiles of
+ * kBruteForceQueryBlock x kBruteForceDataBlock vertices.
+ */
 template <typename data_t, DistanceType dist_type>
 FixedDegreeGraph knn_brute_force(int num_iterations, int d_max,
                                  const Matrix2D<data_t> &data) {
@@ -22,36 +83,31 @@ FixedDegreeGraph knn_brute_force(int num_iterations, int d_max,
   using namespace tbb;
 
   int64_t v_num = data.num_elem;
-  int64_t e_num = data.num_elem * d_max;
-
-  auto DistFunc = get_distance<dist_type, data_t>;
 
   FixedDegreeGraph ret(d_max, v_num);
   for (int i = 0; i < num_iterations; i++) {
     parallel_for(
-        blocked_range<int64_t>(0, v_num), [&](const blocked_range<int64_t> &r) {
-          std::vector<std::pair<float, id_t>> distances(data.num_elem);
-          for (int64_t vid = r.begin(); vid < r.end(); vid++) {
-            auto n_list = ret.get_adj(vid);
-            for (int64_t n = 0; n < v_num; n++) {
-              float d =
-                  DistFunc(data.get_feat(vid), data.get_feat(n), data.dim);
-              distances.at(n) = std::make_pair(d, n);
-            }
-            if (is_min_close(dist_type)) {
-              std::sort(distances.begin(), distances.end());
-            } else {
-              std::sort(distances.begin(), distances.end(),
-                        std::greater<std::pair<float, int>>());
-            }
-            auto new_n_list = ret.get_adj(vid);
-            for (int i = 0; i < d_max; i++) {
-              new_n_list[i] = distances.at(i).second;
+        blocked_range<int64_t>(0, v_num, kBruteForceQueryBlock),
+        [&](const blocked_range<int64_t> &r) {
+          std::vector<TopK> top(r.size());
+          for (auto &t : top)
+            t.reset(d_max);
+          for (int64_t begin = 0; begin < v_num; begin += kBruteForceDataBlock) {
+            int64_t end = std::min(begin + kBruteForceDataBlock, v_num);
+            for (int64_t vid = r.begin(); vid < r.end(); vid++) {
+              TopK &t = top[vid - r.begin()];
+              const data_t *feat = data.get_feat(vid);
+              for (int64_t n = begin; n < end; n++) {
+                float d = get_distance<dist_type, data_t>(feat, data.get_feat(n), data.dim);
+                t.push(is_min_close(dist_type) ? d : -d, n);
+              }
             }
           }
+          for (int64_t vid = r.begin(); vid < r.end(); vid++)
+            top[vid - r.begin()].get_sorted(ret.get_adj(vid));
         });
   }
 
   return ret;
 };
-} // namespace ann
\ No newline at end of file
+} // namespace ann
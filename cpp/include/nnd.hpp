@@ -3,80 +3,299 @@
 #include "space.hpp"
 #include "util.hpp"
 #include "matrix2d.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/combinable.h>
 #include <oneapi/tbb/parallel_for.h>
 #include <priority_queue.hpp>
 #include <random>
+#include <span>
 #include <tbb/parallel_for.h>
+#include <vector>
 
 namespace ann {
 
-template< typename data_t, DistanceType dist_type>
-FixedDegreeGraph build_nnd(int num_iterations, int d_max,
-                                 const Matrix2D<data_t> &data) {
+struct NNDParam {
+  int num_iterations{10}; // upper bound on the number of rounds of local joins
+  int k{32};              // neighbors kept per vertex
+  int sample_size{16};    // new (resp. old) candidates joined per vertex per round
+  float delta{0.001};     // stop when a round updates fewer than delta * v_num * k neighbors
+  uint64_t seed{42};
+};
+
+/**
+ * @brief
+ * NNDPool holds the k closest neighbors found so far for every vertex,
+ * sorted by distance. A neighbor is flagged new until it took part in a
+ * local join, so that every pair of neighbors is compared only once.
+ * The candidate lists are sampled per round and bounded by sample_size.
+ */
+class NNDPool {
+public:
+  struct Neighbor {
+    id_t id;
+    float distance; // smaller is closer
+    bool is_new;
+  };
+
+  NNDPool(id_t _v_num, int _k, int _sample_size)
+      : v_num{_v_num}, k{_k}, sample_size{_sample_size},
+        neighbors(1llu * _v_num * _k), sizes(_v_num, 0),
+        locks(new std::atomic_flag[_v_num]),
+        new_cands(1llu * _v_num * _sample_size), old_cands(1llu * _v_num * _sample_size),
+        new_sizes(_v_num, 0), old_sizes(_v_num, 0),
+        rnew_cands(1llu * _v_num * _sample_size), rold_cands(1llu * _v_num * _sample_size),
+        rnew_seen(_v_num, 0), rold_seen(_v_num, 0) {
+    for (id_t i = 0; i < v_num; i++)
+      locks[i].clear();
+  };
+
+  __force_inline__ Neighbor *get_neighbors(id_t vid) {
+    return neighbors.data() + 1llu * vid * k;
+  };
+  __force_inline__ int get_size(id_t vid) { return sizes[vid]; };
+
+  __force_inline__ void lock(id_t vid) {
+    while (locks[vid].test_and_set(std::memory_order_acquire))
+      ;
+  };
+  __force_inline__ void unlock(id_t vid) { locks[vid].clear(std::memory_order_release); };
+
+  // insert id into the neighbors of vid, returns 1 if the neighbors changed
+  int insert(id_t vid, id_t id, float distance) {
+    Neighbor *adj = get_neighbors(vid);
+    int size = sizes[vid];
+    if (size == k && distance >= adj[k - 1].distance)
+      return 0;
+    int pos = size;
+    while (pos > 0 && adj[pos - 1].distance > distance)
+      pos--;
+    for (int i = 0; i < size; i++) {
+      if (adj[i].id == id)
+        return 0;
+    }
+    for (int i = std::min(size, k - 1); i > pos; i--)
+      adj[i] = adj[i - 1];
+    adj[pos] = Neighbor{id, distance, true};
+    sizes[vid] = std::min(size + 1, k);
+    return 1;
+  };
+
+  int locked_insert(id_t vid, id_t id, float distance) {
+    lock(vid);
+    int ret = insert(vid, id, distance);
+    unlock(vid);
+    return ret;
+  };
+
+  // new and old candidates of vid in the current round
+  __force_inline__ std::span<id_t> get_new(id_t vid) {
+    return std::span(new_cands.data() + 1llu * vid * sample_size, new_sizes[vid]);
+  };
+  __force_inline__ std::span<id_t> get_old(id_t vid) {
+    return std::span(old_cands.data() + 1llu * vid * sample_size, old_sizes[vid]);
+  };
+  __force_inline__ std::span<id_t> get_reverse_new(id_t vid) {
+    return std::span(rnew_cands.data() + 1llu * vid * sample_size,
+                     std::min<int64_t>(rnew_seen[vid], sample_size));
+  };
+  __force_inline__ std::span<id_t> get_reverse_old(id_t vid) {
+    return std::span(rold_cands.data() + 1llu * vid * sample_size,
+                     std::min<int64_t>(rold_seen[vid], sample_size));
+  };
+
+  // samples the forward candidates of vid and marks the sampled new ones old
+  template <typename rng_t> void sample(id_t vid, rng_t &rng) {
+    Neighbor *adj = get_neighbors(vid);
+    id_t *new_list = new_cands.data() + 1llu * vid * sample_size;
+    id_t *old_list = old_cands.data() + 1llu * vid * sample_size;
+    int num_new = 0, num_old = 0;
+    int seen_new = 0, seen_old = 0;
+    // reservoir sampling, the positions of the new neighbors are kept to flag them
+    for (int i = 0; i < sizes[vid]; i++) {
+      if (adj[i].is_new) {
+        int j = seen_new++;
+        if (j >= sample_size)
+          j = rng() % seen_new;
+        if (j < sample_size) {
+          new_list[j] = i;
+          num_new = std::min(num_new + 1, sample_size);
+        }
+      } else {
+        int j = seen_old++;
+        if (j >= sample_size)
+          j = rng() % seen_old;
+        if (j < sample_size) {
+          old_list[j] = adj[i].id;
+          num_old = std::min(num_old + 1, sample_size);
+        }
+      }
+    }
+    for (int j = 0; j < num_new; j++) {
+      Neighbor &neighbor = adj[new_list[j]];
+      new_list[j] = neighbor.id;
+      neighbor.is_new = false;
+    }
+    new_sizes[vid] = num_new;
+    old_sizes[vid] = num_old;
+  };
+
+  // adds vid to the reverse candidates of id, bounded by reservoir sampling
+  template <typename rng_t> void add_reverse(id_t id, id_t vid, bool is_new, rng_t &rng) {
+    id_t *list = (is_new ? rnew_cands.data() : rold_cands.data()) + 1llu * id * sample_size;
+    auto &seen = is_new ? rnew_seen[id] : rold_seen[id];
+    lock(id);
+    int64_t j = seen++;
+    if (j >= sample_size)
+      j = rng() % seen;
+    if (j < sample_size)
+      list[j] = vid;
+    unlock(id);
+  };
+
+  void reset_reverse() {
+    std::fill(rnew_seen.begin(), rnew_seen.end(), 0);
+    std::fill(rold_seen.begin(), rold_seen.end(), 0);
+  };
+
+private:
+  id_t v_num;
+  int k;
+  int sample_size;
+  std::vector<Neighbor> neighbors;
+  std::vector<int> sizes;
+  std::unique_ptr<std::atomic_flag[]> locks;
+  std::vector<id_t> new_cands, old_cands;
+  std::vector<int> new_sizes, old_sizes;
+  std::vector<id_t> rnew_cands, rold_cands;
+  std::vector<int64_t> rnew_seen, rold_seen;
+};
+
+/**
+ * @brief
+ * NN-Descent (Dong et al.) approximate kNN graph construction.
+ * Every round samples the new and old neighbors of each vertex, adds the
+ * reverse neighbors and compares all new-new and new-old pairs of the
+ * candidates (the local join). The neighbors of a vertex are improved by
+ * its neighbors' neighbors until a round changes few of them.
+ *
+ * @tparam dist_func_t callable (const data_t *, const data_t *, int dim),
+ * smaller is closer
+ * @return the kNN graph, the neighbors of a vertex are sorted closest first
+ */
+template <typename data_t, typename dist_func_t>
+FixedDegreeGraph build_nnd(const NNDParam &param, const Matrix2D<data_t> &data,
+                           dist_func_t &&dist_func, int64_t *num_updates = nullptr) {
   using namespace tbb;
-  int64_t v_num = data.num_elem;
-  int64_t e_num = data.num_elem * d_max;
-
-  auto DistFunc = get_distance<dist_type, data_t>;
-
-  FixedDegreeGraph ret(d_max, v_num);
-  parallel_for(blocked_range<int64_t>(0, v_num),
-               [&](const blocked_range<int64_t> &r) {
-                 for (int64_t i = r.begin(); i < r.end(); i++) {
-                   auto adj = ret.get_adj(i);
-                   std::mt19937 rng(std::random_device{}());
-                   std::vector<int> vec(v_num);
-                   std::iota(begin(vec), end(vec), 0);
-                   std::shuffle(begin(vec), end(vec), rng);
-
-                   for (int i = 0; i < d_max; i++) {
-                     adj[i] = vec[i];
-                   }
-                 }
-               });
-
-  for (int i = 0; i < num_iterations; i++) {
-    FixedDegreeGraph tmp(d_max, v_num);
-    parallel_for(
-        blocked_range<int64_t>(0, v_num), [&](const blocked_range<int64_t> &r) {
-          for (int64_t vid = r.begin(); vid < r.end(); vid++) {
-            // find all the neighbors of v
-            // and the neighbors of those neighbors
-
-            std::vector<std::pair<float, id_t>> distances;
-            auto n_list = ret.get_adj(vid);
-            for (auto n : n_list) {
-              float d =
-                  DistFunc(data.get_feat(vid), data.get_feat(n), data.dim);
-              distances.push_back(std::make_pair(d, n));
-
-              auto nn_list = ret.get_adj(n);
-              for (auto nn : nn_list) {
-                float dd =
-                    DistFunc(data.get_feat(vid), data.get_feat(nn), data.dim);
-                distances.push_back(std::make_pair(dd, nn));
-              }
-
-              if (is_min_close(dist_type)) {
-                std::sort(distances.begin(), distances.end());
-              } else {
-                std::sort(distances.begin(), distances.end(),
-                          std::greater<std::pair<float, int>>());
-              }
-              distances.erase( unique( distances.begin(), distances.end() ), distances.end() );
-
-              auto new_n_list = tmp.get_adj(vid);
-              for (int i = 0; i < d_max; i++) {
-                new_n_list[i] = distances.at(i).second;
-              }
-            }
+  const id_t v_num = data.num_elem;
+  const int k = param.k;
+  const int sample_size = param.sample_size;
+  ALWAYS_ASSERT(v_num > k && k > 0 && sample_size > 0);
+
+  NNDPool pool(v_num, k, sample_size);
+
+  // random initial neighbors, drawn by rejection instead of a shuffle of all ids
+  parallel_for(blocked_range<id_t>(0, v_num), [&](const blocked_range<id_t> &r) {
+    for (id_t vid = r.begin(); vid < r.end(); vid++) {
+      std::mt19937_64 rng(param.seed + vid);
+      while (pool.get_size(vid) < k) {
+        id_t id = rng() % v_num;
+        if (id == vid)
+          continue;
+        pool.insert(vid, id, dist_func(data.get_feat(vid), data.get_feat(id), data.dim));
+      }
+    }
+  });
+
+  int64_t total_updates = 0;
+  for (int iter = 0; iter < param.num_iterations; iter++) {
+    pool.reset_reverse();
+    parallel_for(blocked_range<id_t>(0, v_num), [&](const blocked_range<id_t> &r) {
+      std::mt19937_64 rng(param.seed ^ (1llu * iter << 32) ^ r.begin());
+      for (id_t vid = r.begin(); vid < r.end(); vid++) {
+        pool.sample(vid, rng);
+        for (id_t id : pool.get_new(vid))
+          pool.add_reverse(id, vid, true, rng);
+        for (id_t id : pool.get_old(vid))
+          pool.add_reverse(id, vid, false, rng);
+      }
+    });
+
+    combinable<int64_t> updates(0);
+    parallel_for(blocked_range<id_t>(0, v_num), [&](const blocked_range<id_t> &r) {
+      std::vector<id_t> new_list, old_list;
+      int64_t &local_updates = updates.local();
+      for (id_t vid = r.begin(); vid < r.end(); vid++) {
+        new_list.assign(pool.get_new(vid).begin(), pool.get_new(vid).end());
+        for (id_t id : pool.get_reverse_new(vid))
+          new_list.push_back(id);
+        std::sort(new_list.begin(), new_list.end());
+        new_list.erase(std::unique(new_list.begin(), new_list.end()), new_list.end());
+
+        old_list.assign(pool.get_old(vid).begin(), pool.get_old(vid).end());
+        for (id_t id : pool.get_reverse_old(vid))
+          old_list.push_back(id);
+        std::sort(old_list.begin(), old_list.end());
+        old_list.erase(std::unique(old_list.begin(), old_list.end()), old_list.end());
+
+        // local join, the old pairs were compared in an earlier round
+        for (size_t i = 0; i < new_list.size(); i++) {
+          const id_t a = new_list[i];
+          const data_t *feat_a = data.get_feat(a);
+          for (size_t j = i + 1; j < new_list.size(); j++) {
+            const id_t b = new_list[j];
+            float d = dist_func(feat_a, data.get_feat(b), data.dim);
+            local_updates += pool.locked_insert(a, b, d);
+            local_updates += pool.locked_insert(b, a, d);
+          }
+          for (const id_t b : old_list) {
+            if (a == b)
+              continue;
+            float d = dist_func(feat_a, data.get_feat(b), data.dim);
+            local_updates += pool.locked_insert(a, b, d);
+            local_updates += pool.locked_insert(b, a, d);
           }
-        });
-    ret = tmp;
+        }
+      }
+    });
+    int64_t round_updates = updates.combine(std::plus<int64_t>());
+    total_updates += round_updates;
+    if (round_updates <= param.delta * v_num * k)
+      break;
   }
+  if (num_updates)
+    *num_updates = total_updates;
 
+  FixedDegreeGraph ret(k, v_num);
+  parallel_for(blocked_range<id_t>(0, v_num), [&](const blocked_range<id_t> &r) {
+    for (id_t vid = r.begin(); vid < r.end(); vid++) {
+      auto adj = ret.get_adj(vid);
+      auto *neighbors = pool.get_neighbors(vid);
+      for (int i = 0; i < k; i++)
+        adj[i] = neighbors[i].id;
+    }
+  });
   return ret;
 };
+
+template <typename data_t, DistanceType dist_type>
+FixedDegreeGraph build_nnd(const NNDParam &param, const Matrix2D<data_t> &data) {
+  return build_nnd(param, data, [](const data_t *a, const data_t *b, int dim) {
+    float d = get_distance<dist_type, data_t>(a, b, dim);
+    return is_min_close(dist_type) ? d : -d;
+  });
+};
+
+template <typename data_t, DistanceType dist_type>
+FixedDegreeGraph build_nnd(int num_iterations, int d_max, const Matrix2D<data_t> &data) {
+  NNDParam param;
+  param.num_iterations = num_iterations;
+  param.k = d_max;
+  param.sample_size = std::min(param.sample_size, d_max);
+  return build_nnd<data_t, dist_type>(param, data);
+};
 } // namespace ann
@@ -23,7 +23,7 @@ typedef int32_t id_t;
 
 #ifdef __clang__
 #define float16 __fp16
-#elifdef __GNUC__
+#elif defined(__GNUC__)
 #define float16 _Float16
 #endif
 
@@ -85,8 +85,8 @@ inline constexpr bool is_min_close(DistanceType metric) {
   return select_min;
 }
 
-inline int get_random_level(const std::vector<double>& cum_probs) {
-  std::default_random_engine gen(100);
+template <typename rng_t>
+inline int get_random_level(const std::vector<double>& cum_probs, rng_t &gen) {
   std::uniform_real_distribution<double> distribution(0.0, 1.0);
   double prob = distribution(gen);
   for (size_t i = 0; i < cum_probs.size(); i++){
@@ -0,0 +1,11 @@
+#include "hnsw.hpp"
+
+namespace ann {
+
+template class HNSW<float, DistanceType::L2, false>;
+template class HNSW<float, DistanceType::Ip, false>;
+template class HNSW<float16, DistanceType::L2, false>;
+template class HNSW<float16, DistanceType::Ip, false>;
+template class HNSW<uint8_t, DistanceType::L2, false>;
+
+} // namespace ann
@@ -1,21 +1,23 @@
 #include "memory_pool.hpp"
+#include <algorithm>
 #include <oneapi/tbb/scalable_allocator.h>
 
 namespace ann {
 
 MemoryPool::~MemoryPool() {
   for (auto container : allocated_ptrs) {
-    free(container.ptr);
+    scalable_aligned_free(container.ptr);
   }
   for (auto container : free_ptrs) {
-    free(container.ptr);
+    scalable_aligned_free(container.ptr);
   }
   allocated_ptrs.clear();
+  free_ptrs.clear();
 };
 
 void *MemoryPool::malloc(uint64_t num_bytes, uint64_t alignment) {
   void *container = scalable_aligned_malloc(num_bytes, alignment);
-  num_bytes += num_bytes;
+  this->num_bytes += num_bytes;
   num_calls += 1;
   allocated_ptrs.push_back({num_bytes, container});
   return container;
@@ -28,7 +30,9 @@ void MemoryPool::free(void *ptr) {
   auto alloc_itr =
       std::find_if(allocated_ptrs.begin(), allocated_ptrs.end(), ptr_eq);
 
-  allocated_ptrs.erase(alloc_itr);
+  // memory allocated by the pool of another thread is not tracked here
+  if (alloc_itr != allocated_ptrs.end())
+    allocated_ptrs.erase(alloc_itr);
 
   scalable_aligned_free(ptr);
 };
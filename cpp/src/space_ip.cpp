@@ -91,8 +91,8 @@ __force_inline__ float InnerProduct(const float16 *pVect1,
 #pragma unroll
     for (int i = 0; i < get_main<scale, dimension>(dim); i += scale) {
       const auto diff =
-          _mm512_mul_ps(_mm512_cvtph_ps(_mm256_loadu_si256(pVect1 + i)),
-                        _mm512_cvtph_ps(_mm256_loadu_si256(pVect2 + i)));
+          _mm512_mul_ps(_mm512_cvtph_ps(_mm256_loadu_si256((__m256i_u *)(pVect1 + i))),
+                        _mm512_cvtph_ps(_mm256_loadu_si256((__m256i_u *)(pVect2 + i))));
       temp = _mm512_add_ps(temp, diff);
     }
     _mm512_store_ps(TmpRes, temp);
@@ -219,9 +219,9 @@ __force_inline__ dist_t InnerProduct(const data_t *pVect1, const data_t *pVect2,
   case 96:
     return impl::InnerProduct<dist_t, data_t, 96>(pVect1, pVect2, dim);
   case 64:
-    return impl::InnerProduct<dist_t, data_t, 96>(pVect1, pVect2, dim);
+    return impl::InnerProduct<dist_t, data_t, 64>(pVect1, pVect2, dim);
   case 32:
-    return impl::InnerProduct<dist_t, data_t, 96>(pVect1, pVect2, dim);
+    return impl::InnerProduct<dist_t, data_t, 32>(pVect1, pVect2, dim);
   case 16:
     return impl::InnerProduct<dist_t, data_t, 16>(pVect1, pVect2, dim);
   default:
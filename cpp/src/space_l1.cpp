@@ -95,8 +95,8 @@ __force_inline__ float L1Distance(const float16 *pVect1, const float16 *pVect2,
 #pragma unroll
     for (int i = 0; i < get_main<scale, dimension>(dim); i += scale) {
       const __m512 diff =
-          _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256(pVect1 + i)),
-                        _mm512_cvtph_ps(_mm256_loadu_si256(pVect2 + i)));
+          _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256((__m256i_u *)(pVect1 + i))),
+                        _mm512_cvtph_ps(_mm256_loadu_si256((__m256i_u *)(pVect2 + i))));
       temp = _mm512_add_ps(temp, _mm512_abs_ps(diff));
     }
     _mm512_store_ps(TmpRes, temp);
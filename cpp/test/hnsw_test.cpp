@@ -0,0 +1,102 @@
+#include "hnsw.hpp"
+#include "knn.hpp"
+#include "test_util.hpp"
+#include "util.hpp"
+#include <gtest/gtest.h>
+#include <unordered_set>
+
+template <typename data_t, ann::DistanceType distance_type>
+void check_hnsw(int v_num, int num_queries, int dim, float min_recall) {
+  using namespace ann;
+  int k = 10;
+  // the queries are the last vectors, the exact neighbors come from the brute force over all of them
+  auto vec = generateRandomVector<data_t>((v_num + num_queries) * dim, 0, 100, 45);
+  auto all = Matrix2D(v_num + num_queries, dim, vec.data());
+  auto data = Matrix2D(v_num, dim, vec.data());
+  auto queries = Matrix2D(num_queries, dim, all.get_feat(v_num));
+
+  HNSW<data_t, distance_type, true> index;
+  index.SetBuildConfig(HNSWBuildConfig{100, 16, 32});
+  index.BuildIndex(data);
+  EXPECT_TRUE(index.IsFrozen());
+  EXPECT_GT(index.GetNumLayers(), 1);
+  EXPECT_EQ(index.GetLayerSize(0), v_num);
+  for (int l = 1; l < index.GetNumLayers(); l++) {
+    EXPECT_GT(index.GetLayerSize(l), 0);
+    EXPECT_LT(index.GetLayerSize(l), index.GetLayerSize(l - 1));
+  }
+  // the frozen neighbors are valid vertices of the same layer
+  for (ann::id_t vid = 0; vid < v_num; vid++) {
+    for (int l = 0; l <= index.GetLevel(vid); l++) {
+      auto adj = index.GetNeighbors(vid, l);
+      EXPECT_LE(adj.size(), l == 0 ? 32 : 16);
+      for (ann::id_t n : adj) {
+        EXPECT_NE(n, vid);
+        EXPECT_GE(index.GetLevel(n), l);
+      }
+    }
+  }
+
+  HNSWSearchConfig config{64, k};
+  auto results = index.SearchKnnBatch(config, queries);
+  size_t matched = 0;
+  for (int i = 0; i < num_queries; i++) {
+    // exact top k from the brute force over the data plus the query itself
+    std::vector<std::pair<float, ann::id_t>> exact;
+    for (ann::id_t vid = 0; vid < v_num; vid++) {
+      float d = get_distance<distance_type, data_t>(queries.get_feat(i), data.get_feat(vid), dim);
+      exact.emplace_back(is_min_close(distance_type) ? d : -d, vid);
+    }
+    std::partial_sort(exact.begin(), exact.begin() + k, exact.end());
+    float kth = exact[k - 1].first;
+
+    auto result = results[i];
+    EXPECT_EQ(result.size(), k);
+    auto single = index.SearchKnn(config, std::span<const data_t>(queries.get_feat(i), dim));
+    EXPECT_EQ(single.size(), result.size());
+    while (!result.empty()) {
+      // ties at the k-th distance count as found
+      matched += result.top().first <= kth;
+      EXPECT_EQ(result.top().first, single.top().first);
+      result.pop();
+      single.pop();
+    }
+  }
+  float recall = 1.0 * matched / (k * num_queries);
+  std::cout << "recall:" << recall << " layers:" << index.GetNumLayers()
+            << " base hops:" << index.GetNumHops(0) << " base dists:" << index.GetNumDists(0)
+            << " memory:" << index.GetMemoryUsage() << std::endl;
+  EXPECT_GT(recall, min_recall);
+  EXPECT_GT(index.GetNumHops(0), num_queries);
+  index.ResetProfile();
+  EXPECT_EQ(index.GetNumDists(0), 0);
+  std::free(vec.data());
+}
+
+TEST(HNSW, L2Float32) {
+  check_hnsw<float, ann::DistanceType::L2>(5000, 100, 16, 0.95);
+}
+
+TEST(HNSW, IpFloat32) {
+  check_hnsw<float, ann::DistanceType::Ip>(5000, 100, 16, 0.9);
+}
+
+TEST(HNSW, L2Float16) {
+  check_hnsw<float16, ann::DistanceType::L2>(5000, 100, 32, 0.9);
+}
+
+TEST(HNSW, L2Uint8) {
+  check_hnsw<uint8_t, ann::DistanceType::L2>(5000, 100, 32, 0.9);
+}
+
+TEST(HNSW, SingleElement) {
+  using namespace ann;
+  std::vector<float> vec(8, 1.0f);
+  auto data = Matrix2D(1, 8, vec.data());
+  HNSW<float, DistanceType::L2> index;
+  index.SetBuildConfig(HNSWBuildConfig{10, 4});
+  index.BuildIndex(data);
+  auto result = index.SearchKnn(HNSWSearchConfig{10, 5}, std::span<const float>(vec.data(), 8));
+  EXPECT_EQ(result.size(), 1);
+  EXPECT_EQ(result.top().second, 0);
+}
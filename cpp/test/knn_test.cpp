@@ -0,0 +1,44 @@
+#include "knn.hpp"
+#include "test_util.hpp"
+#include "util.hpp"
+#include <gtest/gtest.h>
+
+// the tiled search returns the neighbors of a full sort of the distances
+template <typename data_t, ann::DistanceType distance_type>
+void check_knn(int v_num, int dim, int d_max) {
+  using namespace ann;
+  auto vec = generateRandomVector<data_t>(v_num * dim, -1024, 1024);
+  auto data = Matrix2D(v_num, dim, vec.data());
+  auto graph = knn_brute_force<data_t, distance_type>(1, d_max, data);
+  EXPECT_EQ(graph.v_num, v_num);
+  EXPECT_EQ(graph.d_max, d_max);
+
+  std::vector<std::pair<float, ann::id_t>> distances(v_num);
+  for (ann::id_t vid = 0; vid < v_num; vid += 7) {
+    for (ann::id_t n = 0; n < v_num; n++) {
+      float d = get_distance<distance_type, data_t>(data.get_feat(vid), data.get_feat(n), dim);
+      distances[n] = {is_min_close(distance_type) ? d : -d, n};
+    }
+    std::sort(distances.begin(), distances.end());
+    auto adj = graph.get_adj(vid);
+    for (int i = 0; i < d_max; i++)
+      EXPECT_EQ(adj[i], distances[i].second);
+  }
+  std::free(vec.data());
+}
+
+TEST(KNN, L2Float32) {
+  check_knn<float, ann::DistanceType::L2>(3000, 16, 20);
+}
+
+TEST(KNN, IpFloat32) {
+  check_knn<float, ann::DistanceType::Ip>(3000, 16, 20);
+}
+
+TEST(KNN, L2Uint8) {
+  check_knn<uint8_t, ann::DistanceType::L2>(3000, 32, 20);
+}
+
+TEST(KNN, SmallDegree) {
+  check_knn<float, ann::DistanceType::L2>(100, 8, 1);
+}
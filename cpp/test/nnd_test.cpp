@@ -2,28 +2,114 @@
 #include "nnd.hpp"
 #include "test_util.hpp"
 #include "util.hpp"
+#include <atomic>
 #include <gtest/gtest.h>
+#include <unordered_set>
 
-TEST(NND, L2Float32) {
+// fraction of the exact neighbors found, the exact graph holds the vertex itself first
+static float knn_recall(const ann::FixedDegreeGraph &pred,
+                        const ann::FixedDegreeGraph &gt) {
+  size_t matched = 0;
+  for (ann::id_t vid = 0; vid < pred.v_num; vid++) {
+    auto adj = pred.get_adj(vid);
+    std::unordered_set<ann::id_t> found(adj.begin(), adj.end());
+    auto gt_adj = gt.get_adj(vid);
+    for (int i = 1; i <= pred.d_max; i++)
+      matched += found.count(gt_adj[i]);
+  }
+  return 1.0 * matched / (pred.v_num * pred.d_max);
+}
+
+template <typename data_t, ann::DistanceType distance_type>
+void check_nnd(int v_num, int dim, int d_max) {
+  using namespace ann;
+  auto vec = generateRandomVector<data_t>(v_num * dim, -1024, 1024);
+  auto data = Matrix2D(v_num, dim, vec.data());
+
+  NNDParam param;
+  param.k = d_max;
+  int64_t num_updates = 0;
+  auto pred = build_nnd(param, data, [](const data_t *a, const data_t *b, int dim) {
+    float d = get_distance<distance_type, data_t>(a, b, dim);
+    return is_min_close(distance_type) ? d : -d;
+  }, &num_updates);
+  auto gt = knn_brute_force<data_t, distance_type>(1, d_max + 1, data);
+  EXPECT_EQ(pred.v_num, v_num);
+  EXPECT_EQ(pred.d_max, d_max);
+  EXPECT_GT(num_updates, 0);
+
+  for (ann::id_t vid = 0; vid < v_num; vid++) {
+    auto adj = pred.get_adj(vid);
+    std::unordered_set<ann::id_t> distinct(adj.begin(), adj.end());
+    EXPECT_EQ(distinct.size(), d_max);
+    EXPECT_EQ(distinct.count(vid), 0);
+    // sorted closest first
+    for (int i = 1; i < d_max; i++) {
+      float prev = get_distance<distance_type, data_t>(data.get_feat(vid), data.get_feat(adj[i - 1]), dim);
+      float cur = get_distance<distance_type, data_t>(data.get_feat(vid), data.get_feat(adj[i]), dim);
+      EXPECT_TRUE(is_min_close(distance_type) ? prev <= cur : prev >= cur);
+    }
+  }
+  float recall = knn_recall(pred, gt);
+  std::cout << "recall:" << recall << " updates:" << num_updates << std::endl;
+  EXPECT_GT(recall, 0.98);
+  std::free(vec.data());
+}
+
+// the rounds refine the graph, with fewer distances than all the pairs
+TEST(NND, SampledRounds) {
   using namespace ann;
-  using data_t = float;
-  using dist_t = float;
-  using id_t = uint32_t;
-  int v_num = 100;
+  int v_num = 5000;
+  int dim = 16;
   int d_max = 20;
-  int num_iteration = 15;
-  constexpr DistanceType distance_type = DistanceType::L2;
-  auto vec = generateRandomVector<data_t>(v_num * ArraySize, -1024, 1024);
-
-  auto data = Matrix2D(v_num, ArraySize, vec.data());
-  auto pred =
-      build_nnd<id_t, data_t, distance_type>(num_iteration, d_max, data);
-  auto gt =
-      knn_brute_force<id_t, data_t, distance_type>(num_iteration, d_max, data);
-  EXPECT_EQ(pred.indices, gt.indices);
-  if (pred != gt) {
-    std::cout << "recall:" << gt.recall(pred) << std::endl;
-  } else {
-    std::cout << "recall:" << 1 << std::endl;
+  auto vec = generateRandomVector<float>(v_num * dim, -1024, 1024);
+  auto data = Matrix2D(v_num, dim, vec.data());
+  auto gt = knn_brute_force<float, DistanceType::L2>(1, d_max + 1, data);
+
+  std::vector<float> recalls;
+  std::vector<int64_t> computations;
+  for (int num_iterations : {1, 3, 20}) {
+    NNDParam param;
+    param.k = d_max;
+    param.num_iterations = num_iterations;
+    std::atomic<int64_t> num_computations{0};
+    auto pred = build_nnd(param, data, [&](const float *a, const float *b, int dim) {
+      num_computations++;
+      return get_distance<DistanceType::L2, float>(a, b, dim);
+    });
+    recalls.push_back(knn_recall(pred, gt));
+    computations.push_back(num_computations);
+    std::cout << "rounds:" << num_iterations << " recall:" << recalls.back()
+              << " distances:" << computations.back() << std::endl;
   }
-}
\ No newline at end of file
+  EXPECT_LT(recalls[0], recalls[1]);
+  EXPECT_LE(recalls[1], recalls[2]);
+  EXPECT_GT(recalls[2], 0.98);
+  // only the new neighbors are joined, the rounds get cheaper as the graph converges
+  EXPECT_LT(computations[2], 1ll * v_num * (v_num - 1) / 2);
+  EXPECT_LT(computations[2] - computations[1], computations[1] - computations[0]);
+  std::free(vec.data());
+}
+
+TEST(NND, L2Float32) {
+  check_nnd<float, ann::DistanceType::L2>(5000, 16, 20);
+}
+
+TEST(NND, L2Uint8) {
+  check_nnd<uint8_t, ann::DistanceType::L2>(5000, 16, 20);
+}
+
+TEST(NND, LegacySignature) {
+  using namespace ann;
+  int v_num = 1000;
+  int dim = 8;
+  int d_max = 10;
+  auto vec = generateRandomVector<float>(v_num * dim, -1024, 1024);
+  auto data = Matrix2D(v_num, dim, vec.data());
+  auto pred = build_nnd<float, DistanceType::L2>(15, d_max, data);
+  auto gt = knn_brute_force<float, DistanceType::L2>(1, d_max + 1, data);
+  float recall = knn_recall(pred, gt);
+  std::cout << "recall:" << recall << std::endl;
+  EXPECT_GT(recall, 0.95);
+  std::free(vec.data());
+}
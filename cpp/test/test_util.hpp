@@ -81,11 +81,11 @@ generateRandomVectors(size_t arr_len, float min, float max) {
   return std::make_pair(r1, r2);
 };
 
+// a fixed seed makes the data, and the recall of a test over it, reproducible
 template <typename data_t>
-std::span<data_t> generateRandomVector(size_t arr_len, float min, float max) {
-  // Seed the random number generator (optional for better randomness)
-  std::random_device rd;
-  std::mt19937 gen(rd());
+std::span<data_t> generateRandomVector(size_t arr_len, float min, float max,
+                                       unsigned seed = std::random_device{}()) {
+  std::mt19937 gen(seed);
   // Allocate aligned memory for vectors
   data_t *vec1 = (data_t *)std::aligned_alloc(64, arr_len * sizeof(data_t));
 
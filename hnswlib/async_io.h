@@ -0,0 +1,612 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// IORING_FEAT_RW_CUR_POS comes with IORING_OP_READ and IORING_OP_WRITE (Linux 5.6)
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define HNSWLIB_IO_URING
+#endif
+
+namespace hnswlib {
+
+// One read or write of an AsyncIO queue
+struct IORequest {
+    enum Type {
+        READ = 0,
+        WRITE,
+    };
+
+    IORequest() {}
+
+    IORequest(Type type_i, int fd_i, char *buffer_i, size_t size_i, uint64_t offset_i, int buffer_index_i = -1)
+        : type(type_i), fd(fd_i), buffer(buffer_i), size(size_i), offset(offset_i), buffer_index(buffer_index_i) {}
+
+    Type type{READ};
+    int fd{-1};
+    char *buffer{nullptr};
+    size_t size{0};
+    uint64_t offset{0};
+    int buffer_index{-1};  // index of the registered buffer holding buffer, -1 when not registered
+    void *user_data{nullptr};
+
+    // set on completion: bytes transferred, or -errno; a short transfer happens only at the end of the file
+    int64_t result{0};
+    size_t transferred{0};  // internal, bytes done by the previous submissions
+};
+
+
+/*
+* Asynchronous file I/O queue. Requests are queued with submit(), at most queueDepth() of them are in flight,
+* and completed ones are collected with poll(). Short transfers are resubmitted for the remaining bytes.
+* Uses io_uring on Linux (registered buffers use the fixed-buffer operations), otherwise, or when the kernel
+* refuses io_uring, a pool of threads running pread/pwrite. A queue is used by one thread at a time.
+*/
+class AsyncIO {
+ public:
+    enum Engine {
+        ENGINE_AUTO = 0,     // io_uring when available, else the thread pool
+        ENGINE_IO_URING,     // io_uring, throws when unavailable
+        ENGINE_THREAD_POOL,  // threads running pread/pwrite
+    };
+
+    static const size_t DEFAULT_QUEUE_DEPTH = 32;
+    static const size_t DEFAULT_CHUNK_SIZE = (size_t) 1 << 20;  // bytes per request of readFile and writeFile
+    static const size_t MAX_POOL_THREADS = 64;
+
+    explicit AsyncIO(size_t queue_depth = DEFAULT_QUEUE_DEPTH, Engine engine = ENGINE_AUTO, size_t num_threads = 0)
+        : queue_depth_(std::max(queue_depth, (size_t) 1)) {
+        if (engine != ENGINE_THREAD_POOL && setupRing()) {
+            engine_ = ENGINE_IO_URING;
+            return;
+        }
+        if (engine == ENGINE_IO_URING)
+            throw std::runtime_error("io_uring is not available");
+        engine_ = ENGINE_THREAD_POOL;
+        if (num_threads == 0)
+            num_threads = std::min(queue_depth_, (size_t) MAX_POOL_THREADS);
+        for (size_t i = 0; i < num_threads; i++)
+            workers_.push_back(std::thread(&AsyncIO::workerLoop, this));
+    }
+
+    AsyncIO(const AsyncIO &) = delete;
+    AsyncIO &operator=(const AsyncIO &) = delete;
+
+    ~AsyncIO() {
+        if (engine_ == ENGINE_THREAD_POOL) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            work_cv_.notify_all();
+            for (auto &worker : workers_)
+                worker.join();
+        }
+        releaseRing();
+    }
+
+
+    // engine in use, ENGINE_IO_URING or ENGINE_THREAD_POOL
+    Engine engine() const { return engine_; }
+
+
+    size_t queueDepth() const { return queue_depth_; }
+
+
+    /*
+    * Registers buffers with the kernel, so requests with a buffer_index skip the page pinning on each I/O.
+    * Replaces the previous registration. Returns false when the buffers were not registered (thread pool,
+    * memory lock limit), the requests then run as regular ones. No request may be in flight.
+    */
+    bool registerBuffers(const std::vector<std::pair<char *, size_t>> &buffers) {
+        unregisterBuffers();
+#ifdef HNSWLIB_IO_URING
+        if (engine_ == ENGINE_IO_URING && !buffers.empty()) {
+            std::vector<struct iovec> iovecs(buffers.size());
+            for (size_t i = 0; i < buffers.size(); i++) {
+                iovecs[i].iov_base = buffers[i].first;
+                iovecs[i].iov_len = buffers[i].second;
+            }
+            registered_buffers_ = syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                                          iovecs.data(), (unsigned) iovecs.size()) == 0;
+        }
+#endif
+        return registered_buffers_;
+    }
+
+
+    void unregisterBuffers() {
+#ifdef HNSWLIB_IO_URING
+        if (registered_buffers_)
+            syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+#endif
+        registered_buffers_ = false;
+    }
+
+
+    bool hasRegisteredBuffers() const { return registered_buffers_; }
+
+
+    // queues requests, they are handed to the engine by submit and poll as the queue depth allows
+    void submit(IORequest *requests, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            requests[i].result = 0;
+            requests[i].transferred = 0;
+            queued_.push_back(&requests[i]);
+        }
+        flush();
+    }
+
+
+    void submit(IORequest *request) { submit(request, 1); }
+
+
+    // requests queued or in flight, not yet returned by poll
+    size_t pending() const { return queued_.size() + in_flight_; }
+
+
+    /*
+    * Appends completed requests to completed, waiting until at least min_complete of them
+    * (or all the pending ones) completed. Returns the number appended.
+    */
+    size_t poll(std::vector<IORequest *> &completed, size_t min_complete = 0) {
+        size_t appended = 0;
+        min_complete = std::min(min_complete, pending());
+        while (true) {
+            flush();
+            appended += reap(completed, appended < min_complete);
+            if (appended >= min_complete)
+                break;
+        }
+        flush();
+        return appended;
+    }
+
+
+    // waits for all the pending requests, so their buffers can be released
+    void drain() {
+        std::vector<IORequest *> completed;
+        while (pending())
+            poll(completed, pending());
+    }
+
+
+    // runs the requests with the queue depth in flight, throws if one of them fails or is short
+    void run(IORequest *requests, size_t count) {
+        submit(requests, count);
+        drain();
+        for (size_t i = 0; i < count; i++) {
+            if (requests[i].result != (int64_t) requests[i].size)
+                throw std::runtime_error(std::string("Async I/O failed: ") +
+                                         (requests[i].result < 0 ? strerror((int) -requests[i].result) : "end of file"));
+        }
+    }
+
+
+    // reads size bytes at offset of the file in requests of chunk_size bytes
+    void readFile(int fd, uint64_t offset, char *data, size_t size, size_t chunk_size = DEFAULT_CHUNK_SIZE) {
+        std::vector<IORequest> requests = chunkRequests(IORequest::READ, fd, offset, data, size, chunk_size);
+        run(requests.data(), requests.size());
+    }
+
+
+    void writeFile(int fd, uint64_t offset, const char *data, size_t size, size_t chunk_size = DEFAULT_CHUNK_SIZE) {
+        std::vector<IORequest> requests = chunkRequests(IORequest::WRITE, fd, offset, (char *) data, size, chunk_size);
+        run(requests.data(), requests.size());
+    }
+
+ private:
+    static std::vector<IORequest> chunkRequests(IORequest::Type type, int fd, uint64_t offset, char *data,
+                                                size_t size, size_t chunk_size) {
+        std::vector<IORequest> requests;
+        for (size_t done = 0; done < size; done += chunk_size)
+            requests.push_back(IORequest(type, fd, data + done, std::min(chunk_size, size - done), offset + done));
+        return requests;
+    }
+
+
+    // hands queued requests to the engine up to the queue depth
+    void flush() {
+        if (queued_.empty() || in_flight_ >= queue_depth_)
+            return;
+        if (engine_ == ENGINE_IO_URING) {
+#ifdef HNSWLIB_IO_URING
+            unsigned submitted = 0;
+            while (!queued_.empty() && in_flight_ < queue_depth_) {
+                IORequest *request = queued_.front();
+                queued_.pop_front();
+                pushSqe(request);
+                in_flight_++;
+                submitted++;
+            }
+            while (submitted) {
+                int ret = (int) syscall(__NR_io_uring_enter, ring_fd_, submitted, 0, 0, nullptr, 0);
+                if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+                    continue;
+                if (ret < 0)
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+                submitted -= ret;
+            }
+#endif
+        } else {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!queued_.empty() && in_flight_ < queue_depth_) {
+                    work_.push_back(queued_.front());
+                    queued_.pop_front();
+                    in_flight_++;
+                }
+            }
+            work_cv_.notify_all();
+        }
+    }
+
+
+    // collects the completed requests, waiting for one if wait, and requeues the short transfers
+    size_t reap(std::vector<IORequest *> &completed, bool wait) {
+        std::vector<std::pair<IORequest *, int64_t>> results;
+        if (engine_ == ENGINE_IO_URING) {
+#ifdef HNSWLIB_IO_URING
+            while (true) {
+                unsigned head = *cq_head_;
+                unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++) {
+                    struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+                    results.push_back({(IORequest *) (uintptr_t) cqe->user_data, cqe->res});
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+                if (!results.empty() || !wait)
+                    break;
+                int ret = (int) syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+            }
+#endif
+        } else {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (wait)
+                done_cv_.wait(lock, [&] { return !done_.empty(); });
+            results.swap(done_);
+        }
+
+        size_t appended = 0;
+        for (auto &result : results) {
+            IORequest *request = result.first;
+            in_flight_--;
+            if (result.second > 0 && request->transferred + result.second < request->size) {
+                request->transferred += result.second;
+                queued_.push_back(request);
+                continue;
+            }
+            request->result = result.second < 0 ? result.second : (int64_t) (request->transferred + result.second);
+            completed.push_back(request);
+            appended++;
+        }
+        return appended;
+    }
+
+
+    void workerLoop() {
+        while (true) {
+            IORequest *request;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [&] { return stop_ || !work_.empty(); });
+                if (stop_)
+                    return;
+                request = work_.front();
+                work_.pop_front();
+            }
+            int64_t result = 0;
+            while (request->transferred + result < request->size) {
+                char *buffer = request->buffer + request->transferred + result;
+                size_t size = request->size - request->transferred - result;
+                off_t offset = (off_t) (request->offset + request->transferred + result);
+                ssize_t count = request->type == IORequest::READ ? pread(request->fd, buffer, size, offset)
+                                                                 : pwrite(request->fd, buffer, size, offset);
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count < 0) {
+                    result = -errno;
+                    break;
+                }
+                if (count == 0)
+                    break;
+                result += count;
+            }
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                done_.push_back({request, result});
+            }
+            done_cv_.notify_one();
+        }
+    }
+
+
+#ifdef HNSWLIB_IO_URING
+    bool setupRing() {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        // the completion ring holds twice the submission ring, enough for the requests in flight
+        int fd = (int) syscall(__NR_io_uring_setup, (unsigned) queue_depth_, &params);
+        if (fd < 0)
+            return false;
+        ring_fd_ = fd;
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || params.cq_entries < queue_depth_) {
+            releaseRing();
+            return false;
+        }
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            releaseRing();
+            return false;
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                releaseRing();
+                return false;
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            releaseRing();
+            return false;
+        }
+        sqes_ = (struct io_uring_sqe *) sqes;
+
+        char *sq = (char *) sq_ring_;
+        char *cq = (char *) cq_ring_;
+        sq_tail_ = (unsigned *) (sq + params.sq_off.tail);
+        sq_mask_ = (unsigned *) (sq + params.sq_off.ring_mask);
+        sq_array_ = (unsigned *) (sq + params.sq_off.array);
+        cq_head_ = (unsigned *) (cq + params.cq_off.head);
+        cq_tail_ = (unsigned *) (cq + params.cq_off.tail);
+        cq_mask_ = (unsigned *) (cq + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+        return true;
+    }
+
+
+    // the submission ring has room: at most queue_depth_ requests are in flight
+    void pushSqe(IORequest *request) {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        struct io_uring_sqe *sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        bool fixed = registered_buffers_ && request->buffer_index >= 0;
+        if (request->type == IORequest::READ) {
+            sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        } else {
+            sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        }
+        sqe->fd = request->fd;
+        sqe->addr = (uint64_t) (uintptr_t) (request->buffer + request->transferred);
+        sqe->len = (unsigned) (request->size - request->transferred);
+        sqe->off = request->offset + request->transferred;
+        if (fixed)
+            sqe->buf_index = (uint16_t) request->buffer_index;
+        sqe->user_data = (uint64_t) (uintptr_t) request;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    }
+
+
+    void releaseRing() {
+        if (sqes_)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_)
+            munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_)
+            munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0)
+            close(ring_fd_);
+        sqes_ = nullptr;
+        sq_ring_ = cq_ring_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+    int ring_fd_{-1};
+    void *sq_ring_{nullptr};
+    void *cq_ring_{nullptr};
+    size_t sq_ring_size_{0};
+    size_t cq_ring_size_{0};
+    size_t sqes_size_{0};
+    struct io_uring_sqe *sqes_{nullptr};
+    unsigned *sq_tail_{nullptr};
+    unsigned *sq_mask_{nullptr};
+    unsigned *sq_array_{nullptr};
+    unsigned *cq_head_{nullptr};
+    unsigned *cq_tail_{nullptr};
+    unsigned *cq_mask_{nullptr};
+    struct io_uring_cqe *cqes_{nullptr};
+#else
+    bool setupRing() { return false; }
+
+    void releaseRing() {}
+#endif
+
+    Engine engine_{ENGINE_THREAD_POOL};
+    size_t queue_depth_;
+    bool registered_buffers_{false};
+    std::deque<IORequest *> queued_;  // not yet handed to the engine
+    size_t in_flight_{0};
+
+    // thread pool engine
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<IORequest *> work_;
+    std::vector<std::pair<IORequest *, int64_t>> done_;
+    bool stop_{false};
+};
+
+
+/*
+* Transfers [offset, offset + size) of fd in chunks of chunk_size bytes through an AsyncIO queue with
+* queue_depth buffers: fill(begin, chunk, length) runs before a chunk is submitted and done(begin, chunk, length)
+* after it completed, begin being relative to offset. The requests in flight are waited for on errors.
+*/
+template<class Fill, class Done>
+void transferFileChunks(int fd, IORequest::Type type, uint64_t offset, size_t size, size_t chunk_size,
+                        size_t queue_depth, Fill fill, Done done) {
+    size_t num_chunks = (size + chunk_size - 1) / chunk_size;
+    queue_depth = std::max(std::min(queue_depth, num_chunks), (size_t) 1);
+    std::vector<char> buffers(queue_depth * chunk_size);
+    std::vector<IORequest> requests(queue_depth);
+    AsyncIO io(queue_depth);
+    size_t next = 0;
+    auto submitChunk = [&](IORequest *request) {
+        char *buffer = buffers.data() + (request - requests.data()) * chunk_size;
+        size_t begin = next * chunk_size;
+        size_t length = std::min(chunk_size, size - begin);
+        fill(begin, buffer, length);
+        *request = IORequest(type, fd, buffer, length, offset + begin);
+        next++;
+        io.submit(request);
+    };
+    try {
+        std::vector<IORequest *> completed;
+        while (next < num_chunks && next < queue_depth)
+            submitChunk(&requests[next]);
+        while (io.pending()) {
+            completed.clear();
+            io.poll(completed, 1);
+            for (IORequest *request : completed) {
+                if (request->result != (int64_t) request->size)
+                    throw std::runtime_error(type == IORequest::READ ? "Cannot read file" : "Cannot write file");
+                done(request->offset - offset, request->buffer, request->size);
+                if (next < num_chunks)
+                    submitChunk(request);
+            }
+        }
+    } catch (...) {
+        try {
+            io.drain();
+        } catch (...) {
+        }
+        throw;
+    }
+}
+
+
+/*
+* Reads size bytes at offset of the file at location in chunks of chunk_size bytes, with at most
+* queue_depth chunks read at once. fn(begin, chunk, length) is called for each chunk as it completes, in any order.
+*/
+template<class Function>
+void readFileChunks(const std::string &location, uint64_t offset, size_t size, size_t chunk_size,
+                    Function fn, size_t queue_depth = AsyncIO::DEFAULT_QUEUE_DEPTH) {
+    if (size == 0)
+        return;
+    int fd = open(location.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file");
+    try {
+        transferFileChunks(fd, IORequest::READ, offset, size, chunk_size, queue_depth,
+                           [](size_t, char *, size_t) {}, fn);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+
+/*
+* Writes size bytes at offset of the existing file at location in chunks of chunk_size bytes, with at most
+* queue_depth chunks written at once. fn(begin, chunk, length) fills each chunk, in order.
+*/
+template<class Function>
+void writeFileChunks(const std::string &location, uint64_t offset, size_t size, size_t chunk_size,
+                     Function fn, size_t queue_depth = AsyncIO::DEFAULT_QUEUE_DEPTH) {
+    if (size == 0)
+        return;
+    int fd = open(location.c_str(), O_WRONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file");
+    try {
+        transferFileChunks(fd, IORequest::WRITE, offset, size, chunk_size, queue_depth,
+                           fn, [](size_t, const char *, size_t) {});
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+
+// reads size bytes at offset of the file at location into data with queue_depth requests in flight
+inline void readFileAsync(const std::string &location, uint64_t offset, char *data, size_t size,
+                          size_t queue_depth = AsyncIO::DEFAULT_QUEUE_DEPTH,
+                          size_t chunk_size = AsyncIO::DEFAULT_CHUNK_SIZE) {
+    if (size == 0)
+        return;
+    int fd = open(location.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file");
+    try {
+        AsyncIO io(queue_depth);
+        io.readFile(fd, offset, data, size, chunk_size);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+
+// writes size bytes of data at offset of the existing file at location with queue_depth requests in flight
+inline void writeFileAsync(const std::string &location, uint64_t offset, const char *data, size_t size,
+                           size_t queue_depth = AsyncIO::DEFAULT_QUEUE_DEPTH,
+                           size_t chunk_size = AsyncIO::DEFAULT_CHUNK_SIZE) {
+    if (size == 0)
+        return;
+    int fd = open(location.c_str(), O_WRONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file");
+    try {
+        AsyncIO io(queue_depth);
+        io.writeFile(fd, offset, data, size, chunk_size);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+}  // namespace hnswlib
@@ -3,9 +3,268 @@
 #include <fstream>
 #include <mutex>
 #include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
 #include <assert.h>
 
 namespace hnswlib {
+// Tiles of the blocked search: a block of queries is compared to a block of elements while it is in cache
+static const size_t BRUTEFORCE_QUERY_BLOCK = 32;
+static const size_t BRUTEFORCE_DATA_BLOCK = 512;
+// Extra candidates selected with the dot product distances and re-ranked with the distance function,
+// so that rounding does not swap elements close to the k-th distance
+static const size_t BRUTEFORCE_RERANK = 8;
+
+// Distances computed from dot products by the blocked kernels, other spaces use their distance function
+enum BruteforceMetric {
+    BRUTEFORCE_GENERIC = 0,
+    BRUTEFORCE_L2,  // L2Space: |x|^2 - 2 x.y + |y|^2
+    BRUTEFORCE_IP,  // InnerProductSpace: 1 - x.y
+};
+
+
+template<typename dist_t>
+BruteforceMetric getBruteforceMetric(SpaceInterface<dist_t> *s) {
+    if (!std::is_same<dist_t, float>::value)
+        return BRUTEFORCE_GENERIC;
+    if (dynamic_cast<L2Space *>(s))
+        return BRUTEFORCE_L2;
+    if (dynamic_cast<InnerProductSpace *>(s))
+        return BRUTEFORCE_IP;
+    return BRUTEFORCE_GENERIC;
+}
+
+
+#if defined(USE_AVX)
+static inline __m256 multiplyAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+
+static inline float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+
+static inline float dotProductFloat(const float *a, const float *b, size_t dim) {
+    size_t t = 0;
+    float sum = 0;
+#if defined(USE_AVX)
+    __m256 acc = _mm256_setzero_ps();
+    for (; t + 8 <= dim; t += 8)
+        acc = multiplyAdd(_mm256_loadu_ps(a + t), _mm256_loadu_ps(b + t), acc);
+    sum = horizontalSum(acc);
+#endif
+    for (; t < dim; t++)
+        sum += a[t] * b[t];
+    return sum;
+}
+
+
+/*
+* Dot products of a tile of float vectors, out[i * out_stride + j] = queries[i] . data[j].
+* Register blocks of 4 queries x 3 elements: every load of a query is used for 3 elements
+* and every load of an element for 4 queries, with the 12 sums kept in registers.
+*/
+static void dotProductTile(const float *queries, size_t num_queries, size_t dim,
+                           const char *data, size_t num_data, size_t data_stride, float *out, size_t out_stride) {
+    size_t i = 0;
+    for (; i + 4 <= num_queries; i += 4) {
+        const float *q0 = queries + i * dim;
+        const float *q1 = q0 + dim;
+        const float *q2 = q1 + dim;
+        const float *q3 = q2 + dim;
+        size_t j = 0;
+        for (; j + 3 <= num_data; j += 3) {
+            const float *x0 = (const float *) (data + j * data_stride);
+            const float *x1 = (const float *) (data + (j + 1) * data_stride);
+            const float *x2 = (const float *) (data + (j + 2) * data_stride);
+            float sums[4][3] = {};
+            size_t t = 0;
+#if defined(USE_AVX)
+            __m256 s00 = _mm256_setzero_ps(), s01 = _mm256_setzero_ps(), s02 = _mm256_setzero_ps();
+            __m256 s10 = _mm256_setzero_ps(), s11 = _mm256_setzero_ps(), s12 = _mm256_setzero_ps();
+            __m256 s20 = _mm256_setzero_ps(), s21 = _mm256_setzero_ps(), s22 = _mm256_setzero_ps();
+            __m256 s30 = _mm256_setzero_ps(), s31 = _mm256_setzero_ps(), s32 = _mm256_setzero_ps();
+            for (; t + 8 <= dim; t += 8) {
+                __m256 v0 = _mm256_loadu_ps(x0 + t);
+                __m256 v1 = _mm256_loadu_ps(x1 + t);
+                __m256 v2 = _mm256_loadu_ps(x2 + t);
+                __m256 q = _mm256_loadu_ps(q0 + t);
+                s00 = multiplyAdd(q, v0, s00);
+                s01 = multiplyAdd(q, v1, s01);
+                s02 = multiplyAdd(q, v2, s02);
+                q = _mm256_loadu_ps(q1 + t);
+                s10 = multiplyAdd(q, v0, s10);
+                s11 = multiplyAdd(q, v1, s11);
+                s12 = multiplyAdd(q, v2, s12);
+                q = _mm256_loadu_ps(q2 + t);
+                s20 = multiplyAdd(q, v0, s20);
+                s21 = multiplyAdd(q, v1, s21);
+                s22 = multiplyAdd(q, v2, s22);
+                q = _mm256_loadu_ps(q3 + t);
+                s30 = multiplyAdd(q, v0, s30);
+                s31 = multiplyAdd(q, v1, s31);
+                s32 = multiplyAdd(q, v2, s32);
+            }
+            sums[0][0] = horizontalSum(s00);
+            sums[0][1] = horizontalSum(s01);
+            sums[0][2] = horizontalSum(s02);
+            sums[1][0] = horizontalSum(s10);
+            sums[1][1] = horizontalSum(s11);
+            sums[1][2] = horizontalSum(s12);
+            sums[2][0] = horizontalSum(s20);
+            sums[2][1] = horizontalSum(s21);
+            sums[2][2] = horizontalSum(s22);
+            sums[3][0] = horizontalSum(s30);
+            sums[3][1] = horizontalSum(s31);
+            sums[3][2] = horizontalSum(s32);
+#endif
+            for (; t < dim; t++) {
+                float a[4] = {q0[t], q1[t], q2[t], q3[t]};
+                float b[3] = {x0[t], x1[t], x2[t]};
+                for (int r = 0; r < 4; r++) {
+                    for (int c = 0; c < 3; c++)
+                        sums[r][c] += a[r] * b[c];
+                }
+            }
+            for (int r = 0; r < 4; r++) {
+                for (int c = 0; c < 3; c++)
+                    out[(i + r) * out_stride + j + c] = sums[r][c];
+            }
+        }
+        for (; j < num_data; j++) {
+            const float *x = (const float *) (data + j * data_stride);
+            for (int r = 0; r < 4; r++)
+                out[(i + r) * out_stride + j] = dotProductFloat(queries + (i + r) * dim, x, dim);
+        }
+    }
+    for (; i < num_queries; i++) {
+        for (size_t j = 0; j < num_data; j++)
+            out[i * out_stride + j] = dotProductFloat(queries + i * dim, (const float *) (data + j * data_stride), dim);
+    }
+}
+
+
+/*
+* Distances between a block of queries (contiguous, data_size bytes each) and a block of elements
+* (data_stride bytes apart), out[i * out_stride + j] is the distance of query i to element j.
+* For BRUTEFORCE_L2 the squared norms of the queries and the elements are needed.
+*/
+template<typename dist_t>
+void computeDistanceTile(BruteforceMetric metric, DISTFUNC<dist_t> fstdistfunc, void *dist_func_param, size_t data_size,
+                         const char *queries, size_t num_queries, const float *query_norms,
+                         const char *data, size_t num_data, size_t data_stride, const float *data_norms,
+                         dist_t *out, size_t out_stride) {
+    if (metric == BRUTEFORCE_GENERIC) {
+        for (size_t i = 0; i < num_queries; i++) {
+            for (size_t j = 0; j < num_data; j++)
+                out[i * out_stride + j] = fstdistfunc(queries + i * data_size, data + j * data_stride, dist_func_param);
+        }
+        return;
+    }
+    float *distances = (float *) out;
+    dotProductTile((const float *) queries, num_queries, data_size / sizeof(float),
+                   data, num_data, data_stride, distances, out_stride);
+    for (size_t i = 0; i < num_queries; i++) {
+        float *row = distances + i * out_stride;
+        if (metric == BRUTEFORCE_L2) {
+            for (size_t j = 0; j < num_data; j++)
+                row[j] = std::max(query_norms[i] + data_norms[j] - 2 * row[j], 0.0f);
+        } else {
+            for (size_t j = 0; j < num_data; j++)
+                row[j] = 1.0f - row[j];
+        }
+    }
+}
+
+
+/*
+* Keeps the k closest of the candidates pushed to it. The candidates closer than the current k-th one
+* are buffered and the buffer is cut back to k with nth_element when it holds 2k of them.
+* pushBlock compares 8 distances at a time to the threshold, most of a block is rejected without a branch.
+*/
+template<typename dist_t>
+class TopKSelector {
+ public:
+    void reset(size_t k) {
+        k_ = k;
+        threshold_ = k ? std::numeric_limits<dist_t>::max() : std::numeric_limits<dist_t>::lowest();
+        candidates_.clear();
+        candidates_.reserve(2 * k);
+    }
+
+
+    // the candidates at or above the threshold are not in the top k
+    dist_t threshold() const { return threshold_; }
+
+
+    void push(dist_t dist, size_t id) {
+        if (!(dist < threshold_))
+            return;
+        candidates_.emplace_back(dist, id);
+        if (candidates_.size() >= 2 * k_)
+            compact();
+    }
+
+
+    // pushes distances[j] with id first_id + j, allowed(id) is only called for the candidates below the threshold
+    template<typename Allowed>
+    void pushBlock(const dist_t *distances, size_t count, size_t first_id, Allowed allowed) {
+        size_t j = 0;
+#if defined(USE_AVX)
+        if (std::is_same<dist_t, float>::value) {
+            const float *d = (const float *) distances;
+            for (; j + 8 <= count; j += 8) {
+                __m256 threshold = _mm256_set1_ps((float) threshold_);
+                unsigned int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(d + j), threshold, _CMP_LT_OQ));
+                while (mask) {
+                    size_t c = j + countTrailingZeros(mask);
+                    mask &= mask - 1;
+                    if (distances[c] < threshold_ && allowed(first_id + c))
+                        push(distances[c], first_id + c);
+                }
+            }
+        }
+#endif
+        for (; j < count; j++) {
+            if (distances[j] < threshold_ && allowed(first_id + j))
+                push(distances[j], first_id + j);
+        }
+    }
+
+
+    // the selected (distance, id), closer first
+    const std::vector<std::pair<dist_t, size_t>> &finish() {
+        compact();
+        std::sort(candidates_.begin(), candidates_.end());
+        return candidates_;
+    }
+
+ private:
+    void compact() {
+        if (k_ == 0 || candidates_.size() < k_)
+            return;
+        std::nth_element(candidates_.begin(), candidates_.begin() + (k_ - 1), candidates_.end());
+        candidates_.resize(k_);
+        threshold_ = candidates_[k_ - 1].first;
+    }
+
+    size_t k_{0};
+    dist_t threshold_{std::numeric_limits<dist_t>::max()};
+    std::vector<std::pair<dist_t, size_t>> candidates_;
+};
+
+
 template<typename dist_t>
 class BruteforceSearch : public AlgorithmInterface<dist_t> {
  public:
@@ -21,6 +280,9 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
 
     std::unordered_map<labeltype, size_t > dict_external_to_internal;
 
+    BruteforceMetric metric_{BRUTEFORCE_GENERIC};
+    std::vector<float> norms_;  // squared norms of the elements for BRUTEFORCE_L2
+
 
     BruteforceSearch(SpaceInterface <dist_t> *s)
         : data_(nullptr),
@@ -53,6 +315,9 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         if (data_ == nullptr)
             throw std::runtime_error("Not enough memory: BruteforceSearch failed to allocate data");
         cur_element_count = 0;
+        metric_ = getBruteforceMetric(s);
+        if (metric_ == BRUTEFORCE_L2)
+            norms_.resize(maxElements);
     }
 
 
@@ -80,6 +345,8 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         }
         memcpy(data_ + size_per_element_ * idx + data_size_, &label, sizeof(labeltype));
         memcpy(data_ + size_per_element_ * idx, datapoint, data_size_);
+        if (metric_ == BRUTEFORCE_L2)
+            norms_[idx] = squaredNorm(datapoint);
     }
 
 
@@ -91,47 +358,147 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
             return;
         }
 
+        size_t cur_c = found->second;
         dict_external_to_internal.erase(found);
 
-        size_t cur_c = found->second;
-        labeltype label = *((labeltype*)(data_ + size_per_element_ * (cur_element_count-1) + data_size_));
-        dict_external_to_internal[label] = cur_c;
-        memcpy(data_ + size_per_element_ * cur_c,
-                data_ + size_per_element_ * (cur_element_count-1),
-                data_size_+sizeof(labeltype));
+        // the last element is moved into the freed slot
+        if (cur_c != cur_element_count - 1) {
+            labeltype label = *((labeltype*)(data_ + size_per_element_ * (cur_element_count-1) + data_size_));
+            dict_external_to_internal[label] = cur_c;
+            memcpy(data_ + size_per_element_ * cur_c,
+                    data_ + size_per_element_ * (cur_element_count-1),
+                    data_size_+sizeof(labeltype));
+            if (metric_ == BRUTEFORCE_L2)
+                norms_[cur_c] = norms_[cur_element_count - 1];
+        }
         cur_element_count--;
     }
 
 
+    /*
+    * Creates a filter over internal ids (positions in data_) that allows the elements with the given labels.
+    * Unknown labels are ignored. The filter is valid until the index is modified.
+    */
+    BitsetFilterFunctor createInternalIdFilter(const labeltype *labels, size_t num_labels) {
+        BitsetFilterFunctor filter(maxelements_, BitsetFilterFunctor::INTERNAL_IDS);
+        std::unique_lock<std::mutex> lock(index_lock);
+        for (size_t i = 0; i < num_labels; i++) {
+            auto search = dict_external_to_internal.find(labels[i]);
+            if (search != dict_external_to_internal.end()) {
+                filter.set(search->second);
+            }
+        }
+        return filter;
+    }
+
+
+    inline bool isAllowed(size_t internal_id, labeltype label, BaseFilterFunctor* isIdAllowed, const BitsetFilterFunctor *bitset) const {
+        if (bitset) {
+            return bitset->test(bitset->isInternal() ? internal_id : label);
+        }
+        return (!isIdAllowed) || (*isIdAllowed)(label);
+    }
+
+
     std::priority_queue<std::pair<dist_t, labeltype >>
     searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
-        assert(k <= cur_element_count);
-        std::priority_queue<std::pair<dist_t, labeltype >> topResults;
-        if (cur_element_count == 0) return topResults;
-        for (int i = 0; i < k; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-            labeltype label = *((labeltype*) (data_ + size_per_element_ * i + data_size_));
-            if ((!isIdAllowed) || (*isIdAllowed)(label)) {
-                topResults.emplace(dist, label);
+        return std::move(searchKnnBatch(query_data, 1, k, isIdAllowed)[0]);
+    }
+
+
+    /*
+    * Exact k-NN of num_queries queries stored one after the other. The queries are processed in blocks of
+    * BRUTEFORCE_QUERY_BLOCK against blocks of BRUTEFORCE_DATA_BLOCK elements: for L2Space and InnerProductSpace
+    * the distances of a tile come from register-blocked dot products, then the top k of every query is
+    * selected with a TopKSelector. For L2Space and InnerProductSpace BRUTEFORCE_RERANK extra candidates are
+    * selected and re-ranked with the distance function of the space. The search runs on the calling thread,
+    * run blocks of queries on several threads in parallel.
+    */
+    std::vector<std::priority_queue<std::pair<dist_t, labeltype >>>
+    searchKnnBatch(const void *queries, size_t num_queries, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::priority_queue<std::pair<dist_t, labeltype >>> results(num_queries);
+        if (cur_element_count == 0 || k == 0) return results;
+        // internal ids of the bitset filter are the positions in data_
+        const BitsetFilterFunctor *bitset = isIdAllowed ? dynamic_cast<const BitsetFilterFunctor *>(isIdAllowed) : nullptr;
+        auto allowed = [&](size_t i) {
+            return isAllowed(i, getExternalLabel(i), isIdAllowed, bitset);
+        };
+
+        size_t block_size = std::min(num_queries, BRUTEFORCE_QUERY_BLOCK);
+        std::vector<dist_t> distances(block_size * BRUTEFORCE_DATA_BLOCK);
+        std::vector<float> query_norms(block_size);
+        std::vector<TopKSelector<dist_t>> selectors(block_size);
+        for (size_t begin = 0; begin < num_queries; begin += block_size) {
+            size_t count = std::min(block_size, num_queries - begin);
+            const char *block = (const char *) queries + begin * data_size_;
+            for (size_t i = 0; i < count; i++) {
+                selectors[i].reset(metric_ == BRUTEFORCE_GENERIC ? k : k + BRUTEFORCE_RERANK);
+                if (metric_ == BRUTEFORCE_L2)
+                    query_norms[i] = squaredNorm(block + i * data_size_);
             }
-        }
-        dist_t lastdist = topResults.empty() ? std::numeric_limits<dist_t>::max() : topResults.top().first;
-        for (int i = k; i < cur_element_count; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-            if (dist <= lastdist) {
-                labeltype label = *((labeltype *) (data_ + size_per_element_ * i + data_size_));
-                if ((!isIdAllowed) || (*isIdAllowed)(label)) {
-                    topResults.emplace(dist, label);
+            for (size_t first = 0; first < cur_element_count; first += BRUTEFORCE_DATA_BLOCK) {
+                size_t num_data = std::min(BRUTEFORCE_DATA_BLOCK, cur_element_count - first);
+                computeDistanceTile<dist_t>(metric_, fstdistfunc_, dist_func_param_, data_size_,
+                                            block, count, query_norms.data(),
+                                            data_ + size_per_element_ * first, num_data, size_per_element_,
+                                            metric_ == BRUTEFORCE_L2 ? norms_.data() + first : nullptr,
+                                            distances.data(), BRUTEFORCE_DATA_BLOCK);
+                for (size_t i = 0; i < count; i++)
+                    selectors[i].pushBlock(distances.data() + i * BRUTEFORCE_DATA_BLOCK, num_data, first, allowed);
+            }
+            for (size_t i = 0; i < count; i++) {
+                const void *query = block + i * data_size_;
+                std::vector<std::pair<dist_t, size_t>> candidates = selectors[i].finish();
+                if (metric_ != BRUTEFORCE_GENERIC) {
+                    for (auto &candidate : candidates)
+                        candidate.first = fstdistfunc_(query, data_ + size_per_element_ * candidate.second, dist_func_param_);
+                    std::sort(candidates.begin(), candidates.end());
+                    if (candidates.size() > k)
+                        candidates.resize(k);
                 }
-                if (topResults.size() > k)
-                    topResults.pop();
+                for (auto &candidate : candidates)
+                    results[begin + i].emplace(candidate.first, getExternalLabel(candidate.second));
+            }
+        }
+        return results;
+    }
 
-                if (!topResults.empty()) {
-                    lastdist = topResults.top().first;
-                }
+
+    labeltype getExternalLabel(size_t internal_id) const {
+        labeltype label;
+        memcpy(&label, data_ + size_per_element_ * internal_id + data_size_, sizeof(labeltype));
+        return label;
+    }
+
+
+    float squaredNorm(const void *datapoint) const {
+        return dotProductFloat((const float *) datapoint, (const float *) datapoint, data_size_ / sizeof(float));
+    }
+
+
+    /*
+    * Returns all the elements within radius of the query (closer first, at most max_results, 0 means no limit).
+    */
+    std::vector<std::pair<dist_t, labeltype >>
+    searchRange(const void *query_data, dist_t radius, size_t max_results = 0, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<dist_t, labeltype >> result;
+        const BitsetFilterFunctor *bitset = isIdAllowed ? dynamic_cast<const BitsetFilterFunctor *>(isIdAllowed) : nullptr;
+        for (size_t i = 0; i < cur_element_count; i++) {
+            char *element = data_ + size_per_element_ * i;
+#ifdef USE_SSE
+            _mm_prefetch(element + size_per_element_, _MM_HINT_T0);
+#endif
+            dist_t dist = fstdistfunc_(query_data, element, dist_func_param_);
+            if (dist <= radius) {
+                labeltype label = *((labeltype *) (element + data_size_));
+                if (isAllowed(i, label, isIdAllowed, bitset))
+                    result.emplace_back(dist, label);
             }
         }
-        return topResults;
+        std::sort(result.begin(), result.end());
+        if (max_results && result.size() > max_results)
+            result.resize(max_results);
+        return result;
     }
 
 
@@ -168,6 +535,14 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         input.read(data_, maxelements_ * size_per_element_);
 
         input.close();
+
+        metric_ = getBruteforceMetric(s);
+        norms_.clear();
+        if (metric_ == BRUTEFORCE_L2) {
+            norms_.resize(maxelements_);
+            for (size_t i = 0; i < cur_element_count; i++)
+                norms_[i] = squaredNorm(data_ + size_per_element_ * i);
+        }
     }
 };
 }  // namespace hnswlib
@@ -0,0 +1,617 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "async_io.h"
+#include "huge_pages.h"
+#include "quantizer.h"
+
+namespace hnswlib {
+
+// Unit of the reads of the disk index, the records are packed into sectors of this size
+static const size_t DISK_SECTOR_SIZE = 4096;
+static const uint64_t DISK_INDEX_MAGIC = 0x4b53494457534e48;  // "HNSWDISK"
+static const uint64_t DISK_INDEX_VERSION = 1;
+
+/*
+* First sector of a disk index file. The file has:
+* - the header, padded to one sector;
+* - the level 0 records of the saved index format (link list, vector, label), packed into sectors:
+*   records_per_sector records per sector, or one record over record_span bytes of sectors when it does not fit;
+* - the section loaded in memory: the quantizer (minimum and step per dimension), the SQ4 code of every element
+*   and the upper layer link lists in the saved index format (size, then the lists of levels 1 and up).
+*/
+struct DiskIndexHeader {
+    uint64_t magic{DISK_INDEX_MAGIC};
+    uint64_t version{DISK_INDEX_VERSION};
+    uint64_t element_count{0};
+    uint64_t record_size{0};
+    uint64_t offset_data{0};
+    uint64_t label_offset{0};
+    uint64_t data_size{0};
+    uint64_t max_m{0};
+    uint64_t max_m0{0};
+    uint64_t m{0};
+    uint64_t ef_construction{0};
+    double mult{0};
+    int64_t maxlevel{0};
+    uint64_t enterpoint_node{0};
+    uint64_t records_per_sector{0};  // 0 when a record spans several sectors
+    uint64_t record_span{0};         // bytes read to get one record
+    uint64_t records_offset{0};
+    uint64_t memory_offset{0};
+    uint64_t code_dim{0};
+};
+
+
+static const tableint DISK_VISITED_EMPTY = (tableint) -1;  // free slot of a DiskVisitedSet
+
+/*
+* Ids visited by a search of the disk index, open addressing with linear probing. It is sized for
+* about ef * max_m0 ids and grows with the search, instead of spanning the whole index like a VisitedList.
+*/
+class DiskVisitedSet {
+ public:
+    void reset(size_t expected) {
+        size_t bits = 4;
+        while (((size_t) 1 << bits) < 2 * expected)
+            bits++;
+        if (bits == bits_)
+            std::fill(slots_.begin(), slots_.end(), DISK_VISITED_EMPTY);
+        else
+            allocate(bits);
+        size_ = 0;
+    }
+
+    // false when id was already in the set
+    bool insert(tableint id) {
+        if (2 * (size_ + 1) > slots_.size())
+            grow();
+        size_t mask = slots_.size() - 1;
+        for (size_t i = slot(id); ; i = (i + 1) & mask) {
+            if (slots_[i] == id)
+                return false;
+            if (slots_[i] == DISK_VISITED_EMPTY) {
+                slots_[i] = id;
+                size_++;
+                return true;
+            }
+        }
+    }
+
+ private:
+    size_t slot(tableint id) const {
+        return (size_t) (((uint64_t) id * 0x9e3779b97f4a7c15ULL) >> (64 - bits_));
+    }
+
+    void allocate(size_t bits) {
+        bits_ = bits;
+        slots_.assign((size_t) 1 << bits, DISK_VISITED_EMPTY);
+    }
+
+    void grow() {
+        std::vector<tableint> old_slots;
+        old_slots.swap(slots_);
+        allocate(bits_ + 1);
+        size_t mask = slots_.size() - 1;
+        for (tableint id : old_slots) {
+            if (id == DISK_VISITED_EMPTY)
+                continue;
+            size_t i = slot(id);
+            while (slots_[i] != DISK_VISITED_EMPTY)
+                i = (i + 1) & mask;
+            slots_[i] = id;
+        }
+    }
+
+    size_t bits_{0};
+    size_t size_{0};
+    std::vector<tableint> slots_;
+};
+
+
+/*
+* Read-only out-of-core HierarchicalNSW, DiskANN-style. The base layer graph and the full vectors stay
+* in a file of sector aligned records, only the SQ4 codes and the upper layers are loaded in memory.
+* The search descends the upper layers on the codes, then runs a beam search on the base layer:
+* every step reads the records of the beam_width closest unexpanded candidates in one batch of
+* asynchronous reads (io_uring into a registered buffer, or the thread pool fallback of AsyncIO),
+* ranks their neighbors with the codes and the read elements with their full vectors.
+* Built with build() from a HierarchicalNSW or from a saved index file, which is streamed,
+* so the index does not need to fit in memory. Only for float vectors. Needs a POSIX system.
+*/
+template<typename dist_t>
+class DiskIndex : public AlgorithmInterface<dist_t> {
+ public:
+    mutable std::atomic<long> metric_distance_computations{0};  // on the codes
+    mutable std::atomic<long> metric_full_distance_computations{0};
+    mutable std::atomic<long> metric_hops{0};                   // batches of base layer reads
+    mutable std::atomic<long> metric_disk_reads{0};             // records read
+
+    /*
+    * Opens a disk index file. With direct_io the records are read with O_DIRECT, bypassing the page cache,
+    * it falls back to buffered reads when the file system does not support it, see isDirectIO().
+    */
+    DiskIndex(SpaceInterface<dist_t> *s, const std::string &location, bool direct_io = false) {
+        if (!std::is_same<dist_t, float>::value)
+            throw std::runtime_error("DiskIndex needs float vectors");
+        data_size_ = s->get_data_size();
+        fstdistfunc_ = s->get_dist_func();
+        dist_func_param_ = s->get_dist_func_param();
+        loadMemorySection(location);
+        if (header_.data_size != data_size_)
+            throw std::runtime_error("Disk index does not match the space");
+
+#ifdef O_DIRECT
+        if (direct_io) {
+            fd_ = open(location.c_str(), O_RDONLY | O_DIRECT);
+            direct_io_ = fd_ >= 0;
+        }
+#endif
+        if (fd_ < 0)
+            fd_ = open(location.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::runtime_error("Cannot open file");
+    }
+
+
+    ~DiskIndex() {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+
+    // writes the disk index of an index in memory, only the saved state of the index is used
+    static void build(const HierarchicalNSW<dist_t> &index, const std::string &location) {
+        if (!std::is_same<dist_t, float>::value)
+            throw std::runtime_error("DiskIndex needs float vectors");
+        DiskIndexHeader header;
+        header.element_count = index.cur_element_count;
+        header.record_size = index.size_data_per_element_;
+        header.offset_data = index.offsetData_;
+        header.label_offset = index.label_offset_;
+        header.data_size = index.data_size_;
+        header.max_m = index.maxM_;
+        header.max_m0 = index.maxM0_;
+        header.m = index.M_;
+        header.ef_construction = index.ef_construction_;
+        header.mult = index.mult_;
+        header.maxlevel = index.maxlevel_;
+        header.enterpoint_node = index.enterpoint_node_;
+        writeFile(location, header,
+            [&](char *records, size_t begin, size_t count) { index.getLevel0Records(records, begin, count); },
+            [&](size_t i, std::vector<char> &links) {
+                size_t size = index.element_levels_[i] > 0 ? index.size_links_per_element_ * index.element_levels_[i] : 0;
+                links.assign(index.linkLists_[i], index.linkLists_[i] + size);
+            });
+    }
+
+
+    // writes the disk index of an index saved with saveIndex, reading the saved file sequentially
+    static void build(const std::string &index_location, const std::string &location) {
+        if (!std::is_same<dist_t, float>::value)
+            throw std::runtime_error("DiskIndex needs float vectors");
+        std::ifstream input(index_location, std::ios::binary);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open file");
+
+        DiskIndexHeader header;
+        size_t offset_level0, max_elements, element_count, record_size, label_offset, offset_data;
+        size_t max_m, max_m0, m, ef_construction;
+        int maxlevel;
+        tableint enterpoint_node;
+        readBinaryPOD(input, offset_level0);
+        readBinaryPOD(input, max_elements);
+        readBinaryPOD(input, element_count);
+        readBinaryPOD(input, record_size);
+        readBinaryPOD(input, label_offset);
+        readBinaryPOD(input, offset_data);
+        readBinaryPOD(input, maxlevel);
+        readBinaryPOD(input, enterpoint_node);
+        readBinaryPOD(input, max_m);
+        readBinaryPOD(input, max_m0);
+        readBinaryPOD(input, m);
+        readBinaryPOD(input, header.mult);
+        readBinaryPOD(input, ef_construction);
+        if (!input)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        header.element_count = element_count;
+        header.record_size = record_size;
+        header.offset_data = offset_data;
+        header.label_offset = label_offset;
+        header.data_size = label_offset - offset_data;
+        header.max_m = max_m;
+        header.max_m0 = max_m0;
+        header.m = m;
+        header.ef_construction = ef_construction;
+        header.maxlevel = maxlevel;
+        header.enterpoint_node = enterpoint_node;
+
+        std::streampos records_position = input.tellg();
+        std::ifstream links_input(index_location, std::ios::binary);
+        links_input.seekg(records_position + (std::streamoff) (element_count * record_size));
+        writeFile(location, header,
+            [&](char *records, size_t begin, size_t count) {
+                input.seekg(records_position + (std::streamoff) (begin * record_size));
+                input.read(records, count * record_size);
+                if (!input)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+            },
+            [&](size_t, std::vector<char> &links) {
+                unsigned int size = 0;
+                readBinaryPOD(links_input, size);
+                links.resize(size);
+                if (size)
+                    links_input.read(links.data(), size);
+                if (!links_input)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+            });
+    }
+
+
+    void addPoint(const void *, labeltype, bool = false) {
+        throw std::runtime_error("DiskIndex is read-only, rebuild it with DiskIndex::build");
+    }
+
+
+    void saveIndex(const std::string &) {
+        throw std::runtime_error("DiskIndex is read-only, rebuild it with DiskIndex::build");
+    }
+
+
+    // candidate list size of the base layer search
+    void setEf(size_t ef) { ef_ = ef; }
+
+
+    size_t getEf() const { return ef_; }
+
+
+    // records read per step of the beam search
+    void setBeamWidth(size_t beam_width) { beam_width_ = std::max(beam_width, (size_t) 1); }
+
+
+    size_t getBeamWidth() const { return beam_width_; }
+
+
+    bool isDirectIO() const { return direct_io_; }
+
+
+    // engine of the reads, applies to the following searches
+    void setIOEngine(AsyncIO::Engine engine) {
+        std::unique_lock<std::mutex> lock(readers_mutex_);
+        io_engine_ = engine;
+        readers_.clear();
+    }
+
+
+    // engine used by the searches, ENGINE_IO_URING or ENGINE_THREAD_POOL
+    AsyncIO::Engine getIOEngine() const {
+        std::unique_ptr<RecordReader> reader = getReader();
+        AsyncIO::Engine engine = reader->io.engine();
+        releaseReader(std::move(reader));
+        return engine;
+    }
+
+
+    size_t getCurrentElementCount() const { return header_.element_count; }
+
+
+    // bytes kept in memory: codes and upper layers
+    size_t getMemoryUsage() const { return codes_.size() + upper_links_.size(); }
+
+
+    const DiskIndexHeader &getHeader() const { return header_; }
+
+
+    // position of the sectors holding the record of internal_id in the file
+    size_t getRecordSpanOffset(tableint internal_id) const {
+        if (header_.records_per_sector)
+            return header_.records_offset + internal_id / header_.records_per_sector * DISK_SECTOR_SIZE;
+        return header_.records_offset + (size_t) internal_id * header_.record_span;
+    }
+
+
+    // position of the record of internal_id in its sectors
+    size_t getRecordOffsetInSpan(tableint internal_id) const {
+        if (header_.records_per_sector)
+            return internal_id % header_.records_per_sector * header_.record_size;
+        return 0;
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype>>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor *isIdAllowed = nullptr) const {
+        std::priority_queue<std::pair<dist_t, labeltype>> result;
+        if (header_.element_count == 0 || k == 0)
+            return result;
+
+        std::vector<float> decoded(quantizer_.dim());
+        auto code_distance = [&](tableint id) {
+            quantizer_.decode(codes_.data() + (size_t) id * quantizer_.codeSize(), decoded.data());
+            return fstdistfunc_(query_data, decoded.data(), dist_func_param_);
+        };
+
+        tableint cur_obj = (tableint) header_.enterpoint_node;
+        dist_t cur_dist = code_distance(cur_obj);
+        for (int level = (int) header_.maxlevel; level > 0; level--) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                linklistsizeint *ll = getUpperLinkList(cur_obj, level);
+                size_t size = *((unsigned short int *) ll);
+                tableint *datal = (tableint *) (ll + 1);
+                metric_distance_computations += size;
+                for (size_t i = 0; i < size; i++) {
+                    dist_t d = code_distance(datal[i]);
+                    if (d < cur_dist) {
+                        cur_dist = d;
+                        cur_obj = datal[i];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // candidates sorted by code distance, at most ef
+        struct Candidate {
+            dist_t distance;
+            tableint id;
+            bool expanded;
+        };
+        size_t ef = std::max(ef_, k);
+        std::vector<Candidate> candidates;
+        candidates.reserve(ef + 1);
+        candidates.push_back({cur_dist, cur_obj, false});
+
+        std::unique_ptr<RecordReader> reader = getReader();
+        DiskVisitedSet &visited = reader->visited;
+        visited.reset(ef * header_.max_m0);
+        visited.insert(cur_obj);
+        const char *buffer = reader->buffer.data();
+        std::vector<tableint> batch;
+        batch.reserve(beam_width_);
+        size_t distance_computations = 0;
+        while (true) {
+            batch.clear();
+            for (Candidate &candidate : candidates) {
+                if (candidate.expanded)
+                    continue;
+                candidate.expanded = true;
+                batch.push_back(candidate.id);
+                if (batch.size() == beam_width_)
+                    break;
+            }
+            if (batch.empty())
+                break;
+            readRecords(batch, *reader);
+
+            for (size_t j = 0; j < batch.size(); j++) {
+                const char *record = buffer + j * header_.record_span + getRecordOffsetInSpan(batch[j]);
+                labeltype label;
+                memcpy(&label, record + header_.label_offset, sizeof(labeltype));
+                bool deleted = *((const unsigned char *) record + 2) & HierarchicalNSW<dist_t>::DELETE_MARK;
+                if (!deleted && (!isIdAllowed || (*isIdAllowed)(label))) {
+                    dist_t d = fstdistfunc_(query_data, record + header_.offset_data, dist_func_param_);
+                    if (result.size() < k || d < result.top().first) {
+                        result.emplace(d, label);
+                        if (result.size() > k)
+                            result.pop();
+                    }
+                }
+
+                size_t size = *((const unsigned short int *) record);
+                const tableint *datal = (const tableint *) (record + sizeof(linklistsizeint));
+                for (size_t i = 0; i < size; i++) {
+                    tableint candidate_id = datal[i];
+                    if (!visited.insert(candidate_id))
+                        continue;
+                    dist_t d = code_distance(candidate_id);
+                    distance_computations++;
+                    if (candidates.size() == ef && !(d < candidates.back().distance))
+                        continue;
+                    auto position = std::upper_bound(candidates.begin(), candidates.end(), d,
+                        [](dist_t value, const Candidate &c) { return value < c.distance; });
+                    candidates.insert(position, {d, candidate_id, false});
+                    if (candidates.size() > ef)
+                        candidates.pop_back();
+                }
+            }
+            metric_hops++;
+            metric_disk_reads += batch.size();
+            metric_full_distance_computations += batch.size();
+        }
+        metric_distance_computations += distance_computations;
+        releaseReader(std::move(reader));
+        return result;
+    }
+
+ private:
+    template<class ReadRecords, class ReadUpperLinks>
+    static void writeFile(const std::string &location, DiskIndexHeader header,
+                          ReadRecords read_records, ReadUpperLinks read_upper_links) {
+        const size_t chunk = HierarchicalNSW<dist_t>::LEVEL0_RECORDS_CHUNK;
+        size_t element_count = header.element_count;
+        size_t record_size = header.record_size;
+        header.code_dim = header.data_size / sizeof(float);
+        header.records_per_sector = DISK_SECTOR_SIZE / record_size;
+        header.record_span = header.records_per_sector ? DISK_SECTOR_SIZE
+                                                       : (record_size + DISK_SECTOR_SIZE - 1) / DISK_SECTOR_SIZE * DISK_SECTOR_SIZE;
+        header.records_offset = DISK_SECTOR_SIZE;
+        size_t num_spans = header.records_per_sector
+                           ? (element_count + header.records_per_sector - 1) / header.records_per_sector
+                           : element_count;
+        header.memory_offset = header.records_offset + num_spans * header.record_span;
+
+        std::vector<char> records(chunk * record_size);
+        ScalarQuantizer4 quantizer;
+        quantizer.reset(header.code_dim);
+        for (size_t i = 0; i < element_count; i += chunk) {
+            size_t count = std::min(chunk, element_count - i);
+            read_records(records.data(), i, count);
+            for (size_t j = 0; j < count; j++)
+                quantizer.observe((const float *) (records.data() + j * record_size + header.offset_data));
+        }
+        quantizer.finish();
+
+        std::ofstream output(location, std::ios::binary);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open file");
+        std::vector<char> span(std::max((size_t) header.record_span, DISK_SECTOR_SIZE), 0);
+        memcpy(span.data(), &header, sizeof(header));
+        output.write(span.data(), DISK_SECTOR_SIZE);
+
+        // records packed into sectors, the codes are kept for the memory section
+        std::vector<unsigned char> codes(element_count * quantizer.codeSize());
+        size_t in_span = 0;
+        memset(span.data(), 0, span.size());
+        for (size_t i = 0; i < element_count; i += chunk) {
+            size_t count = std::min(chunk, element_count - i);
+            read_records(records.data(), i, count);
+            for (size_t j = 0; j < count; j++) {
+                const char *record = records.data() + j * record_size;
+                quantizer.encode((const float *) (record + header.offset_data),
+                                 codes.data() + (i + j) * quantizer.codeSize());
+                memcpy(span.data() + in_span * record_size, record, record_size);
+                in_span++;
+                if (in_span == std::max(header.records_per_sector, (uint64_t) 1)) {
+                    output.write(span.data(), header.record_span);
+                    memset(span.data(), 0, span.size());
+                    in_span = 0;
+                }
+            }
+        }
+        if (in_span)
+            output.write(span.data(), header.record_span);
+
+        output.write((const char *) quantizer.minValues(), header.code_dim * sizeof(float));
+        output.write((const char *) quantizer.steps(), header.code_dim * sizeof(float));
+        output.write((const char *) codes.data(), codes.size());
+        std::vector<char> links;
+        for (size_t i = 0; i < element_count; i++) {
+            read_upper_links(i, links);
+            unsigned int size = links.size();
+            writeBinaryPOD(output, size);
+            output.write(links.data(), size);
+        }
+        output.close();
+        if (!output)
+            throw std::runtime_error("Cannot write the disk index");
+    }
+
+
+    void loadMemorySection(const std::string &location) {
+        std::ifstream input(location, std::ios::binary);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open file");
+        readBinaryPOD(input, header_);
+        if (!input || header_.magic != DISK_INDEX_MAGIC || header_.version != DISK_INDEX_VERSION)
+            throw std::runtime_error("Disk index seems to be corrupted or unsupported");
+
+        size_links_per_element_ = header_.max_m * sizeof(tableint) + sizeof(linklistsizeint);
+        input.seekg(header_.memory_offset, input.beg);
+        std::vector<float> min_values(header_.code_dim), steps(header_.code_dim);
+        input.read((char *) min_values.data(), header_.code_dim * sizeof(float));
+        input.read((char *) steps.data(), header_.code_dim * sizeof(float));
+        quantizer_.setParameters(header_.code_dim, min_values.data(), steps.data());
+        codes_.resize(header_.element_count * quantizer_.codeSize());
+        input.read((char *) codes_.data(), codes_.size());
+        for (size_t i = 0; i < header_.element_count; i++) {
+            unsigned int size = 0;
+            readBinaryPOD(input, size);
+            if (size == 0)
+                continue;
+            size_t offset = upper_links_.size();
+            upper_offsets_.emplace_back(i, offset);
+            upper_links_.resize(offset + size);
+            input.read(upper_links_.data() + offset, size);
+        }
+        if (!input)
+            throw std::runtime_error("Disk index seems to be corrupted or unsupported");
+    }
+
+
+    linklistsizeint *getUpperLinkList(tableint internal_id, int level) const {
+        auto it = std::lower_bound(upper_offsets_.begin(), upper_offsets_.end(), internal_id,
+            [](const std::pair<tableint, size_t> &entry, tableint id) { return entry.first < id; });
+        if (it == upper_offsets_.end() || it->first != internal_id)
+            throw std::out_of_range("Element has no upper layers");
+        return (linklistsizeint *) (upper_links_.data() + it->second + (level - 1) * size_links_per_element_);
+    }
+
+
+    // I/O queue of a search, its buffer of beam_width record spans, registered with the queue, and its visited ids
+    struct RecordReader {
+        RecordReader(size_t beam_width, size_t record_span, AsyncIO::Engine engine) : io(beam_width, engine) {
+            buffer.allocate(beam_width * record_span, PAGES_DEFAULT, false, DISK_SECTOR_SIZE);
+            io.registerBuffers({{buffer.data(), buffer.size()}});
+            requests.resize(beam_width);
+        }
+
+        AsyncIO io;
+        LargeMemoryBlock buffer;
+        std::vector<IORequest> requests;
+        DiskVisitedSet visited;
+    };
+
+
+    std::unique_ptr<RecordReader> getReader() const {
+        std::unique_ptr<RecordReader> reader;
+        {
+            std::unique_lock<std::mutex> lock(readers_mutex_);
+            if (!readers_.empty()) {
+                reader = std::move(readers_.back());
+                readers_.pop_back();
+            }
+        }
+        if (!reader || reader->requests.size() < beam_width_)
+            reader.reset(new RecordReader(beam_width_, header_.record_span, io_engine_));
+        return reader;
+    }
+
+
+    void releaseReader(std::unique_ptr<RecordReader> reader) const {
+        std::unique_lock<std::mutex> lock(readers_mutex_);
+        readers_.push_back(std::move(reader));
+    }
+
+
+    // reads the sectors of the records of ids, the ones of ids[j] at reader.buffer + j * record_span
+    void readRecords(const std::vector<tableint> &ids, RecordReader &reader) const {
+        for (size_t j = 0; j < ids.size(); j++) {
+            reader.requests[j] = IORequest(IORequest::READ, fd_, reader.buffer.data() + j * header_.record_span,
+                                           header_.record_span, getRecordSpanOffset(ids[j]), 0);
+        }
+        reader.io.run(reader.requests.data(), ids.size());
+    }
+
+    DiskIndexHeader header_;
+    size_t data_size_{0};
+    size_t size_links_per_element_{0};
+    DISTFUNC<dist_t> fstdistfunc_;
+    void *dist_func_param_{nullptr};
+
+    ScalarQuantizer4 quantizer_;
+    std::vector<unsigned char> codes_;
+    std::vector<char> upper_links_;
+    std::vector<std::pair<tableint, size_t>> upper_offsets_;  // (id, offset in upper_links_) of the elements with upper layers, by id
+
+    size_t ef_{10};
+    size_t beam_width_{4};
+    int fd_{-1};
+    bool direct_io_{false};
+    AsyncIO::Engine io_engine_{AsyncIO::ENGINE_AUTO};
+    mutable std::mutex readers_mutex_;
+    mutable std::vector<std::unique_ptr<RecordReader>> readers_;  // idle readers, one per concurrent search
+};
+}  // namespace hnswlib
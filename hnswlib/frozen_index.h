@@ -0,0 +1,517 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "huge_pages.h"
+#include "visited_list_pool.h"
+
+namespace hnswlib {
+
+static const uint64_t FROZEN_INDEX_MAGIC = 0x4e5a524657534e48;  // "HNSWFRZN"
+static const uint64_t FROZEN_INDEX_VERSION = 1;
+static const size_t FROZEN_SECTION_ALIGNMENT = 64;
+static const tableint FROZEN_NO_ID = (tableint) -1;  // dropped element, or label not in the index
+
+/*
+* Start of a frozen index file, the offsets are in bytes from the start of the file.
+* The sections follow the header, each aligned on FROZEN_SECTION_ALIGNMENT:
+* - the FrozenLevel of each level, 0 to maxlevel;
+* - the links of each level;
+* - the vectors, element i at i * data_size;
+* - the label of each element;
+* - the labels sorted, and the element of each sorted label.
+*/
+struct FrozenIndexHeader {
+    uint64_t magic{FROZEN_INDEX_MAGIC};
+    uint64_t version{FROZEN_INDEX_VERSION};
+    uint64_t file_size{0};
+    uint64_t element_count{0};
+    uint64_t data_size{0};
+    uint64_t max_m{0};
+    uint64_t max_m0{0};
+    uint64_t m{0};
+    uint64_t ef_construction{0};
+    int64_t maxlevel{0};
+    uint64_t enterpoint_node{0};
+    uint64_t levels_offset{0};
+    uint64_t vectors_offset{0};
+    uint64_t labels_offset{0};
+    uint64_t sorted_labels_offset{0};
+    uint64_t sorted_ids_offset{0};
+};
+
+
+/*
+* Links of one level. The elements of a level are the ids [0, size): the ids are ordered by
+* decreasing level. Element i has a row of stride tableints at links_offset + i * stride * sizeof(tableint),
+* its degree first, then its neighbors, like ann::NSWGraph.
+*/
+struct FrozenLevel {
+    uint64_t size{0};
+    uint64_t stride{0};
+    uint64_t links_offset{0};
+};
+
+
+/*
+* Immutable, read-optimized HierarchicalNSW created with HierarchicalNSW::freeze().
+* The whole index is one block in the layout of its file: fixed-stride degree-prefixed link rows per level,
+* the contiguous vectors and a sorted label array for the lookups by label. There are no locks,
+* no deletion marks and no per-element allocations, the search is the bare-bone search of HierarchicalNSW.
+* Saved with saveIndex and opened with mmap, so replicas share the pages of the file.
+* The filters of searchKnn are called with the labels.
+*/
+template<typename dist_t>
+class FrozenHNSW : public AlgorithmInterface<dist_t> {
+ public:
+    typedef std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>,
+                                typename HierarchicalNSW<dist_t>::CompareByFirst> CandidateQueue;
+
+    mutable std::atomic<long> metric_distance_computations{0};
+    mutable std::atomic<long> metric_hops{0};
+
+    // compacts an index, see HierarchicalNSW::freeze()
+    explicit FrozenHNSW(const HierarchicalNSW<dist_t> &index) {
+        if (index.namespaces_enabled_)
+            throw std::runtime_error("Cannot freeze an index with namespaces");
+        data_size_ = index.data_size_;
+        fstdistfunc_ = index.fstdistfunc_;
+        dist_func_param_ = index.dist_func_param_;
+        ef_ = std::max(index.ef_, (size_t) 1);
+
+        // live elements, higher levels first, in the order of the index within a level
+        size_t count = index.cur_element_count;
+        std::vector<tableint> order;
+        order.reserve(count);
+        for (tableint i = 0; i < count; i++) {
+            if (!index.isMarkedDeleted(i))
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](tableint a, tableint b) {
+            return index.element_levels_[a] > index.element_levels_[b];
+        });
+        std::vector<tableint> new_ids(count, FROZEN_NO_ID);
+        for (size_t i = 0; i < order.size(); i++)
+            new_ids[order[i]] = i;
+
+        FrozenIndexHeader header;
+        header.element_count = order.size();
+        header.data_size = data_size_;
+        header.max_m = index.maxM_;
+        header.max_m0 = index.maxM0_;
+        header.m = index.M_;
+        header.ef_construction = index.ef_construction_;
+        header.maxlevel = order.empty() ? 0 : index.element_levels_[order[0]];
+        // a deleted entry point is replaced by an element of the top level
+        header.enterpoint_node = order.empty() || new_ids[index.enterpoint_node_] == FROZEN_NO_ID
+                                 ? 0 : new_ids[index.enterpoint_node_];
+
+        std::vector<FrozenLevel> levels(header.maxlevel + 1);
+        size_t offset = alignSection(sizeof(header));
+        header.levels_offset = offset;
+        offset = alignSection(offset + levels.size() * sizeof(FrozenLevel));
+        for (size_t level = 0; level < levels.size(); level++) {
+            while (levels[level].size < order.size() &&
+                   index.element_levels_[order[levels[level].size]] >= (int) level)
+                levels[level].size++;
+            levels[level].stride = (level == 0 ? index.maxM0_ : index.maxM_) + 1;
+            levels[level].links_offset = offset;
+            offset = alignSection(offset + levels[level].size * levels[level].stride * sizeof(tableint));
+        }
+        header.vectors_offset = offset;
+        offset = alignSection(offset + order.size() * data_size_);
+        header.labels_offset = offset;
+        offset = alignSection(offset + order.size() * sizeof(labeltype));
+        header.sorted_labels_offset = offset;
+        offset = alignSection(offset + order.size() * sizeof(labeltype));
+        header.sorted_ids_offset = offset;
+        offset = alignSection(offset + order.size() * sizeof(tableint));
+        header.file_size = offset;
+
+        block_.allocate(header.file_size, PAGES_DEFAULT, false, FROZEN_SECTION_ALIGNMENT);
+        memset(block_.data(), 0, header.file_size);
+        memcpy(block_.data(), &header, sizeof(header));
+        memcpy(block_.data() + header.levels_offset, levels.data(), levels.size() * sizeof(FrozenLevel));
+        setSections();
+
+        for (size_t level = 0; level < levels.size(); level++) {
+            for (tableint i = 0; i < levels[level].size; i++)
+                copyLinks(index, new_ids, order[i], level, (tableint *) getLinks(i, level));
+        }
+        labeltype *labels = (labeltype *) (block_.data() + header.labels_offset);
+        labeltype *sorted_labels = (labeltype *) (block_.data() + header.sorted_labels_offset);
+        tableint *sorted_ids = (tableint *) (block_.data() + header.sorted_ids_offset);
+        for (tableint i = 0; i < order.size(); i++) {
+            memcpy(block_.data() + header.vectors_offset + i * data_size_, index.getDataByInternalId(order[i]), data_size_);
+            labels[i] = index.getExternalLabel(order[i]);
+            sorted_ids[i] = i;
+        }
+        std::sort(sorted_ids, sorted_ids + order.size(), [&](tableint a, tableint b) { return labels[a] < labels[b]; });
+        for (size_t i = 0; i < order.size(); i++)
+            sorted_labels[i] = labels[sorted_ids[i]];
+        visited_list_pool_.reset(new VisitedListPool(1, order.size()));
+    }
+
+
+    /*
+    * Opens a frozen index file, mapped read-only with use_mmap (where mmap is available),
+    * otherwise read into memory. page_mode applies to the mapping or the memory, see LargeMemoryBlock::mapFile.
+    * The header, the sections and the ids of the file are checked before any search.
+    */
+    FrozenHNSW(SpaceInterface<dist_t> *s, const std::string &location, bool use_mmap = true,
+               PageMode page_mode = PAGES_DEFAULT) {
+        data_size_ = s->get_data_size();
+        fstdistfunc_ = s->get_dist_func();
+        dist_func_param_ = s->get_dist_func_param();
+        if (use_mmap) {
+            block_.mapFile(location, FROZEN_SECTION_ALIGNMENT, page_mode);
+        } else {
+            std::ifstream input(location, std::ios::binary | std::ios::ate);
+            if (!input.is_open())
+                throw std::runtime_error("Cannot open file");
+            size_t size = input.tellg();
+            block_.allocate(size, page_mode, false, FROZEN_SECTION_ALIGNMENT);
+            input.seekg(0, input.beg);
+            input.read(block_.data(), size);
+            if (!input)
+                throw std::runtime_error("Cannot read file");
+        }
+        mapped_ = block_.isFileMapping();
+
+        FrozenIndexHeader header;
+        if (block_.size() < sizeof(header))
+            throw std::runtime_error("Frozen index seems to be corrupted or unsupported");
+        memcpy(&header, block_.data(), sizeof(header));
+        if (header.magic != FROZEN_INDEX_MAGIC || header.version != FROZEN_INDEX_VERSION)
+            throw std::runtime_error("Frozen index seems to be corrupted or unsupported");
+        if (header.data_size != data_size_)
+            throw std::runtime_error("Frozen index does not match the space");
+        checkFile(header);
+        setSections();
+        visited_list_pool_.reset(new VisitedListPool(1, element_count_));
+    }
+
+
+    void addPoint(const void *, labeltype, bool = false) {
+        throw std::runtime_error("FrozenHNSW is read-only, freeze the updated HierarchicalNSW again");
+    }
+
+
+    // writes the index file, the block is already in the file layout
+    void saveIndex(const std::string &location) {
+        std::ofstream output(location, std::ios::binary);
+        if (!output.is_open())
+            throw std::runtime_error("Cannot open file");
+        output.write(block_.data(), block_.size());
+        output.close();
+        if (!output)
+            throw std::runtime_error("Cannot write the frozen index");
+    }
+
+
+    void setEf(size_t ef) { ef_ = ef; }
+
+
+    size_t getEf() const { return ef_; }
+
+
+    size_t getCurrentElementCount() const { return element_count_; }
+
+
+    int getMaxLevel() const { return maxlevel_; }
+
+
+    tableint getEnterpointNode() const { return enterpoint_node_; }
+
+
+    // number of elements at level or above, their ids are [0, getLevelSize(level))
+    size_t getLevelSize(int level) const { return level <= maxlevel_ ? levels_[level].size : 0; }
+
+
+    // bytes of the index, the size of its file
+    size_t getMemoryUsage() const { return block_.size(); }
+
+
+    // true if the index is a read-only mapping of its file
+    bool isMapped() const { return mapped_; }
+
+
+    // row of internal_id at level: the degree, then the neighbors
+    const tableint *getLinks(tableint internal_id, int level) const {
+        const FrozenLevel &l = levels_[level];
+        return (const tableint *) (block_.data() + l.links_offset) + (size_t) internal_id * l.stride;
+    }
+
+
+    const char *getDataByInternalId(tableint internal_id) const {
+        return vectors_ + (size_t) internal_id * data_size_;
+    }
+
+
+    labeltype getExternalLabel(tableint internal_id) const { return labels_[internal_id]; }
+
+
+    // binary search of the sorted labels, -1 when the label is not in the index
+    tableint getInternalId(labeltype label) const {
+        const labeltype *it = std::lower_bound(sorted_labels_, sorted_labels_ + element_count_, label);
+        if (it == sorted_labels_ + element_count_ || *it != label)
+            return FROZEN_NO_ID;
+        return sorted_ids_[it - sorted_labels_];
+    }
+
+
+    template<typename data_t>
+    std::vector<data_t> getDataByLabel(labeltype label) const {
+        tableint internal_id = getInternalId(label);
+        if (internal_id == FROZEN_NO_ID)
+            throw std::runtime_error("Label not found");
+        const data_t *data = (const data_t *) getDataByInternalId(internal_id);
+        return std::vector<data_t>(data, data + data_size_ / sizeof(data_t));
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype>>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor *isIdAllowed = nullptr) const {
+        std::priority_queue<std::pair<dist_t, labeltype>> result;
+        if (element_count_ == 0 || k == 0)
+            return result;
+
+        tableint ep_id = searchUpperLayers(query_data);
+        size_t ef = std::max(ef_, k);
+        CandidateQueue top_candidates = isIdAllowed ? searchBaseLayer<true>(ep_id, query_data, ef, isIdAllowed)
+                                                    : searchBaseLayer<false>(ep_id, query_data, ef, nullptr);
+        while (top_candidates.size() > k)
+            top_candidates.pop();
+        while (!top_candidates.empty()) {
+            result.emplace(top_candidates.top().first, labels_[top_candidates.top().second]);
+            top_candidates.pop();
+        }
+        return result;
+    }
+
+ private:
+    static size_t alignSection(size_t offset) {
+        return (offset + FROZEN_SECTION_ALIGNMENT - 1) / FROZEN_SECTION_ALIGNMENT * FROZEN_SECTION_ALIGNMENT;
+    }
+
+
+    // true if count items of item_size at the aligned offset end within the file
+    static bool sectionInFile(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size) {
+        return offset % FROZEN_SECTION_ALIGNMENT == 0 && offset <= file_size &&
+               count <= (file_size - offset) / item_size;
+    }
+
+
+    // throws if a section of the header is out of the file or an id is out of the elements
+    void checkFile(const FrozenIndexHeader &header) const {
+        const char *data = block_.data();
+        uint64_t file_size = header.file_size;
+        uint64_t count = header.element_count;
+        bool valid = file_size == block_.size() && header.maxlevel >= 0 && count <= FROZEN_NO_ID &&
+                     sectionInFile(header.levels_offset, (uint64_t) header.maxlevel + 1, sizeof(FrozenLevel), file_size) &&
+                     sectionInFile(header.vectors_offset, count, data_size_, file_size) &&
+                     sectionInFile(header.labels_offset, count, sizeof(labeltype), file_size) &&
+                     sectionInFile(header.sorted_labels_offset, count, sizeof(labeltype), file_size) &&
+                     sectionInFile(header.sorted_ids_offset, count, sizeof(tableint), file_size) &&
+                     (count == 0 || header.enterpoint_node < count);
+        const FrozenLevel *levels = (const FrozenLevel *) (data + header.levels_offset);
+        for (int64_t level = 0; valid && level <= header.maxlevel; level++) {
+            const FrozenLevel &l = levels[level];
+            // level 0 holds every element, each level the first elements of the level below
+            valid = l.size <= (level == 0 ? count : levels[level - 1].size) && (level > 0 || l.size == count) &&
+                    l.stride > 0 && l.stride <= std::numeric_limits<uint64_t>::max() / sizeof(tableint) &&
+                    sectionInFile(l.links_offset, l.size, l.stride * sizeof(tableint), file_size);
+            if (level == header.maxlevel)
+                valid = valid && (count == 0 || header.enterpoint_node < l.size);
+            const tableint *row = (const tableint *) (data + l.links_offset);
+            for (uint64_t i = 0; valid && i < l.size; i++, row += l.stride) {
+                valid = row[0] < l.stride;
+                for (tableint j = 1; valid && j <= row[0]; j++)
+                    valid = row[j] < l.size;
+            }
+        }
+        const tableint *sorted_ids = (const tableint *) (data + header.sorted_ids_offset);
+        for (uint64_t i = 0; valid && i < count; i++)
+            valid = sorted_ids[i] < count;
+        if (!valid)
+            throw std::runtime_error("Frozen index seems to be corrupted or unsupported");
+    }
+
+
+    // pointers into the block from its header
+    void setSections() {
+        const FrozenIndexHeader *header = (const FrozenIndexHeader *) block_.data();
+        element_count_ = header->element_count;
+        maxlevel_ = header->maxlevel;
+        enterpoint_node_ = header->enterpoint_node;
+        levels_ = (const FrozenLevel *) (block_.data() + header->levels_offset);
+        vectors_ = block_.data() + header->vectors_offset;
+        labels_ = (const labeltype *) (block_.data() + header->labels_offset);
+        sorted_labels_ = (const labeltype *) (block_.data() + header->sorted_labels_offset);
+        sorted_ids_ = (const tableint *) (block_.data() + header->sorted_ids_offset);
+    }
+
+
+    // the live neighbors of internal_id at level, then the live neighbors of its deleted neighbors up to the stride
+    void copyLinks(const HierarchicalNSW<dist_t> &index, const std::vector<tableint> &new_ids,
+                   tableint internal_id, int level, tableint *row) const {
+        size_t max_degree = levels_[level].stride - 1;
+        tableint self = new_ids[internal_id];
+        size_t degree = 0;
+        auto add = [&](tableint id) {
+            if (id == FROZEN_NO_ID || id == self || degree == max_degree)
+                return;
+            for (size_t j = 1; j <= degree; j++) {
+                if (row[j] == id)
+                    return;
+            }
+            row[++degree] = id;
+        };
+        linklistsizeint *ll = index.get_linklist_at_level(internal_id, level);
+        size_t size = index.getListCount(ll);
+        tableint *datal = (tableint *) (ll + 1);
+        for (size_t i = 0; i < size; i++)
+            add(new_ids[datal[i]]);
+        for (size_t i = 0; i < size; i++) {
+            if (new_ids[datal[i]] != FROZEN_NO_ID)
+                continue;
+            linklistsizeint *ll_deleted = index.get_linklist_at_level(datal[i], level);
+            size_t size_deleted = index.getListCount(ll_deleted);
+            tableint *datal_deleted = (tableint *) (ll_deleted + 1);
+            for (size_t j = 0; j < size_deleted; j++)
+                add(new_ids[datal_deleted[j]]);
+        }
+        row[0] = degree;
+    }
+
+
+    tableint searchUpperLayers(const void *query_data) const {
+        tableint cur_obj = enterpoint_node_;
+        dist_t cur_dist = fstdistfunc_(query_data, getDataByInternalId(cur_obj), dist_func_param_);
+        size_t hops = 0, distance_computations = 1;
+        for (int level = maxlevel_; level > 0; level--) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                const tableint *links = getLinks(cur_obj, level);
+                size_t size = links[0];
+                hops++;
+                distance_computations += size;
+                for (size_t i = 1; i <= size; i++) {
+                    dist_t d = fstdistfunc_(query_data, getDataByInternalId(links[i]), dist_func_param_);
+                    if (d < cur_dist) {
+                        cur_dist = d;
+                        cur_obj = links[i];
+                        changed = true;
+                    }
+                }
+            }
+        }
+        metric_hops += hops;
+        metric_distance_computations += distance_computations;
+        return cur_obj;
+    }
+
+
+    // searchBaseLayerST of HierarchicalNSW without deletion checks, the filter only applies to the result
+    template<bool filtered>
+    CandidateQueue searchBaseLayer(tableint ep_id, const void *data_point, size_t ef, BaseFilterFunctor *isIdAllowed) const {
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        CandidateQueue top_candidates;
+        CandidateQueue candidate_set;
+
+        dist_t dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
+        dist_t lowerBound = dist;
+        if (!filtered || (*isIdAllowed)(labels_[ep_id])) {
+            top_candidates.emplace(dist, ep_id);
+        } else {
+            lowerBound = std::numeric_limits<dist_t>::max();
+        }
+        candidate_set.emplace(-dist, ep_id);
+        visited_array[ep_id] = visited_array_tag;
+
+        size_t hops = 0, distance_computations = 1;
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            if (-current_node_pair.first > lowerBound && (!filtered || top_candidates.size() == ef))
+                break;
+            candidate_set.pop();
+
+            const tableint *links = getLinks(current_node_pair.second, 0);
+            size_t size = links[0];
+            hops++;
+#ifdef USE_SSE
+            _mm_prefetch((char *) (visited_array + links[1]), _MM_HINT_T0);
+            _mm_prefetch(getDataByInternalId(links[1]), _MM_HINT_T0);
+#endif
+            for (size_t j = 1; j <= size; j++) {
+                tableint candidate_id = links[j];
+#ifdef USE_SSE
+                if (j < size) {
+                    _mm_prefetch((char *) (visited_array + links[j + 1]), _MM_HINT_T0);
+                    _mm_prefetch(getDataByInternalId(links[j + 1]), _MM_HINT_T0);
+                }
+#endif
+                if (visited_array[candidate_id] == visited_array_tag)
+                    continue;
+                visited_array[candidate_id] = visited_array_tag;
+
+                dist_t d = fstdistfunc_(data_point, getDataByInternalId(candidate_id), dist_func_param_);
+                distance_computations++;
+                if (top_candidates.size() < ef || lowerBound > d) {
+                    candidate_set.emplace(-d, candidate_id);
+#ifdef USE_SSE
+                    _mm_prefetch((const char *) getLinks(candidate_set.top().second, 0), _MM_HINT_T0);
+#endif
+                    if (!filtered || (*isIdAllowed)(labels_[candidate_id]))
+                        top_candidates.emplace(d, candidate_id);
+                    if (top_candidates.size() > ef)
+                        top_candidates.pop();
+                    if (!top_candidates.empty())
+                        lowerBound = top_candidates.top().first;
+                }
+            }
+        }
+        metric_hops += hops;
+        metric_distance_computations += distance_computations;
+        visited_list_pool_->releaseVisitedList(vl);
+        return top_candidates;
+    }
+
+    LargeMemoryBlock block_;
+    bool mapped_{false};
+    size_t data_size_{0};
+    DISTFUNC<dist_t> fstdistfunc_;
+    void *dist_func_param_{nullptr};
+
+    size_t element_count_{0};
+    int maxlevel_{0};
+    tableint enterpoint_node_{0};
+    const FrozenLevel *levels_{nullptr};
+    const char *vectors_{nullptr};
+    const labeltype *labels_{nullptr};
+    const labeltype *sorted_labels_{nullptr};
+    const tableint *sorted_ids_{nullptr};
+
+    size_t ef_{10};
+    std::unique_ptr<VisitedListPool> visited_list_pool_{nullptr};
+};
+
+
+template<typename dist_t>
+std::unique_ptr<FrozenHNSW<dist_t>> HierarchicalNSW<dist_t>::freeze() const {
+    return std::unique_ptr<FrozenHNSW<dist_t>>(new FrozenHNSW<dist_t>(*this));
+}
+}  // namespace hnswlib
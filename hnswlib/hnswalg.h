@@ -1,18 +1,38 @@
 #pragma once
 
 #include "visited_list_pool.h"
+#include "thread_pool.h"
+#include "huge_pages.h"
+#include "quantizer.h"
+#if !defined(_WIN32)
+#include "async_io.h"
+#endif
 #include "hnswlib.h"
 #include <atomic>
+#include <cmath>
 #include <random>
 #include <stdlib.h>
 #include <assert.h>
 #include <unordered_set>
 #include <list>
 #include <memory>
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+#include <thread>
+#include <condition_variable>
+#include <shared_mutex>
+#include <exception>
+#include <type_traits>
 
 namespace hnswlib {
 typedef unsigned int tableint;
 typedef unsigned int linklistsizeint;
+typedef unsigned int attributetype;
+typedef unsigned int namespacetype;
+
+template<typename dist_t>
+class FrozenHNSW;
 
 template<typename dist_t>
 class HierarchicalNSW : public AlgorithmInterface<dist_t> {
@@ -20,6 +40,89 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     static const tableint MAX_LABEL_OPERATION_LOCKS = 65536;
     static const unsigned char DELETE_MARK = 0x01;
 
+    // Optional sections appended to the saved index after the link lists
+    static const uint32_t EXTENSIONS_MAGIC = 0x48535845;  // "EXSH"
+    enum ExtensionSection : uint32_t {
+        SECTION_END = 0,
+        SECTION_ATTRIBUTES = 1,
+        SECTION_NAMESPACES = 2,
+        SECTION_NEIGHBOR_CODES = 3,
+    };
+
+    // Namespace 0 is the default graph rooted at enterpoint_node_
+    static const namespacetype DEFAULT_NAMESPACE = 0;
+
+    // Root of the graph of a namespace
+    struct NamespaceRoot {
+        tableint enterpoint_node;
+        int maxlevel;
+        size_t element_count;
+    };
+
+    // Strategies of the filtered search planner (see planFilteredSearch)
+    enum FilteredSearchPlan {
+        PLAN_GRAPH = 0,         // regular graph search
+        PLAN_EXPANDED_EF,       // graph search, ef grows until k allowed elements are found
+        PLAN_TWO_HOP,           // graph search over allowed elements reached through 1 or 2 hops (ACORN-style)
+        PLAN_BRUTE_FORCE,       // exact scan over the allowed elements
+        NUM_FILTERED_SEARCH_PLANS
+    };
+
+    // Orderings of the internal ids computed by reorderIndex
+    enum ReorderStrategy {
+        REORDER_BFS = 0,  // breadth-first traversal of the base layer from the entry point
+        REORDER_RCM,      // reverse Cuthill-McKee, BFS visiting low degree neighbors first, reversed
+        REORDER_GORDER,   // greedy Gorder, maximizes shared neighbors within a sliding window of ids
+    };
+
+    // Storage of the base layer, see setLevel0Layout
+    enum Level0Layout {
+        LAYOUT_INTERLEAVED = 0,  // one record per element: link list, vector, label
+        LAYOUT_SPLIT,            // dense link list arena, cache line aligned vector arena and label array
+    };
+
+    // Compressed copies of the neighbor vectors stored next to the level 0 link lists, see setNeighborCodes
+    enum NeighborCodeType {
+        NEIGHBOR_CODES_NONE = 0,
+        NEIGHBOR_CODES_SQ4,  // 4-bit scalar quantization per dimension, two dimensions per byte
+    };
+
+    // Where the searches start, see setEntryStrategy
+    enum EntryStrategy {
+        ENTRY_HIERARCHY = 0,  // greedy descent of the upper layers from enterpoint_node_
+        ENTRY_MEDOID,         // descent from the element closest to the mean of the vectors
+        ENTRY_DIVERSE,        // descent from the closest of entries spread over the data by farthest point sampling
+        ENTRY_ROUTER,         // descent from the element of the closest k-means centroid
+    };
+
+    // What leads from the entry to the base layer, see setNavigation
+    enum Navigation {
+        NAVIGATION_HIERARCHY = 0,  // greedy descent of the upper layers
+        NAVIGATION_FLAT,           // greedy search of a flat graph over the level 1 elements packed in one table
+        NAVIGATION_NONE,           // the base layer search starts at the entry
+    };
+
+    // Alignment of the vector arena of LAYOUT_SPLIT
+    static const size_t VECTOR_ALIGNMENT = 64;
+    static const size_t LEVEL0_RECORDS_CHUNK = 4096;  // records converted at once when saving or loading LAYOUT_SPLIT
+    static const size_t DEFAULT_IO_QUEUE_DEPTH = 0;  // blocking file streams until setIOQueueDepth opts in
+    static const size_t ENTRY_SAMPLE_SIZE = 16384;  // elements sampled to place the diverse entries and train the router
+    static const size_t ENTRY_ROUTER_ITERATIONS = 10;
+    static const size_t PARALLEL_EXPAND_BATCH = 4;  // candidates a thread of searchKnnParallel takes from the frontier at once
+    static const size_t FILTER_LOOKUP_BATCH = 1024;  // labels of a bitset resolved at once under label_lookup_lock
+
+    // Where the link lists, vectors and labels of the base layer are: inside the records
+    // for LAYOUT_INTERLEAVED, in separate arenas for LAYOUT_SPLIT
+    struct Level0Arenas {
+        Level0Layout layout{LAYOUT_INTERLEAVED};
+        char *links{nullptr};
+        char *vectors{nullptr};
+        char *labels{nullptr};
+        size_t links_stride{0};
+        size_t vectors_stride{0};
+        size_t labels_stride{0};
+    };
+
     size_t max_elements_{0};
     mutable std::atomic<size_t> cur_element_count{0};  // current number of elements
     size_t size_data_per_element_{0};
@@ -35,6 +138,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     int maxlevel_{0};
 
     std::unique_ptr<VisitedListPool> visited_list_pool_{nullptr};
+    std::unique_ptr<ConcurrentVisitedListPool> concurrent_visited_list_pool_{nullptr};  // for searchKnnParallel
+    mutable SearchThreadPool search_thread_pool_;  // helpers of searchKnnParallel, grown to the largest num_threads
 
     // Locks operations with element by label value
     mutable std::vector<std::mutex> label_op_locks_;
@@ -47,10 +152,27 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     size_t size_links_level0_{0};
     size_t offsetData_{0}, offsetLevel0_{0}, label_offset_{ 0 };
 
-    char *data_level0_memory_{nullptr};
+    char *data_level0_memory_{nullptr};  // records of LAYOUT_INTERLEAVED, link list arena of LAYOUT_SPLIT
     char **linkLists_{nullptr};
     std::vector<int> element_levels_;  // keeps level of each element
 
+    Level0Layout level0_layout_{LAYOUT_INTERLEAVED};
+    Level0Arenas level0_;
+
+    // blocks backing data_level0_memory_, the vectors and labels of LAYOUT_SPLIT and linkLists_,
+    // allocated with page_mode_ and interleaved over the NUMA nodes with numa_interleave_
+    PageMode page_mode_{PAGES_DEFAULT};
+    bool numa_interleave_{false};
+    LargeMemoryBlock level0_block_;
+    LargeMemoryBlock vectors_block_;
+    LargeMemoryBlock labels_block_;
+    LargeMemoryBlock link_lists_block_;
+    // chunks holding the upper layer link lists pointed to by linkLists_
+    MemoryArena link_arena_;
+
+    // asynchronous requests in flight when saveIndex and loadIndex transfer the base layer, 0 for stream I/O
+    size_t io_queue_depth_{DEFAULT_IO_QUEUE_DEPTH};
+
     size_t data_size_{0};
 
     DISTFUNC<dist_t> fstdistfunc_;
@@ -68,11 +190,59 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     mutable std::atomic<long> metric_base_distance_computations{0};
     mutable std::atomic<long> metric_base_hops{0};
 
+    mutable std::atomic<long> metric_filtered_search_plans[NUM_FILTERED_SEARCH_PLANS]{};  // number of searches per plan
+
+    // filtered search planner parameters
+    double filter_brute_force_factor_{1.0};      // scan when count^2 <= factor * ef * maxM0_ * element count
+    double filter_two_hop_selectivity_{0.05};    // two-hop expansion below this fraction of allowed elements
+    double filter_expand_ef_selectivity_{0.5};   // growing ef below this fraction of allowed elements
+
+    // adaptive early termination of searchKnn, disabled when both are 0
+    size_t early_termination_patience_{0};       // stop after this many expansions without a change of the top k
+    float early_termination_distance_ratio_{0};  // stop when the closest candidate is farther than ratio * k-th distance
+    mutable std::atomic<long> metric_early_terminations{0};  // number of searches stopped by these rules
+
+    // neighbor codes of the base layer: neighbor j of element i is encoded at
+    // get_linklist0(i) + size_links_level0_ + j * neighbor_code_size_
+    NeighborCodeType neighbor_code_type_{NEIGHBOR_CODES_NONE};
+    size_t neighbor_code_size_{0};     // bytes per neighbor, 0 when disabled
+    size_t neighbor_codes_rerank_{0};  // candidates reranked with the full vectors, 0 for ef
+    bool neighbor_codes_full_refresh_{false};  // updates scan all the lists for the code of the updated element
+    ScalarQuantizer4 neighbor_quantizer_;
+    mutable std::atomic<long> metric_rerank_distance_computations{0};
+
+    // entries of the searches, empty for ENTRY_HIERARCHY; the vector of entry i is at entry_vectors_[i * data_size_]:
+    // a copy of the element for the medoid and diverse entries, the centroid for the router
+    EntryStrategy entry_strategy_{ENTRY_HIERARCHY};
+    std::vector<tableint> entry_points_;
+    std::vector<char> entry_vectors_;
+
+    // flat navigation graph: element i of the table is nav_ids_[i], its vector is at nav_vectors_[i * data_size_]
+    // and its level 1 links, as table positions, at nav_links_[i * (maxM_ + 1)] preceded by their count
+    Navigation navigation_{NAVIGATION_HIERARCHY};
+    std::vector<tableint> nav_ids_;
+    std::vector<char> nav_vectors_;
+    std::vector<tableint> nav_links_;
+
     bool allow_replace_deleted_ = false;  // flag to replace deleted elements (marked as deleted) during insertions
 
     std::mutex deleted_elements_lock;  // lock for deleted_elements
     std::unordered_set<tableint> deleted_elements;  // contains internal ids of deleted elements
 
+    // attribute-aware construction, enabled by the first element added with attributes
+    std::atomic<bool> attribute_aware_{false};
+    std::vector<std::vector<attributetype>> element_attributes_;  // sorted attributes of each element
+    // lock for attribute_entry_points_ and attribute_filters_, searches hold it shared while they read a filter
+    mutable std::shared_timed_mutex attribute_lock_;
+    std::unordered_map<attributetype, tableint> attribute_entry_points_;
+    std::unordered_map<attributetype, BitsetFilterFunctor> attribute_filters_;  // internal ids of elements with the attribute
+
+    // namespaces are independent graphs over disjoint sets of elements, sharing the storage, locks and pools of the index
+    std::atomic<bool> namespaces_enabled_{false};  // set by the first element added to a non-default namespace
+    std::vector<namespacetype> element_namespaces_;  // namespace of each element
+    mutable std::mutex namespace_lock_;  // lock for namespace_roots_, the roots are updated under global
+    std::unordered_map<namespacetype, NamespaceRoot> namespace_roots_;  // roots of the non-default namespaces
+
 
     HierarchicalNSW(SpaceInterface<dist_t> *s) {
     }
@@ -83,8 +253,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         const std::string &location,
         bool nmslib = false,
         size_t max_elements = 0,
-        bool allow_replace_deleted = false)
-        : allow_replace_deleted_(allow_replace_deleted) {
+        bool allow_replace_deleted = false,
+        PageMode page_mode = PAGES_DEFAULT)
+        : page_mode_(page_mode), allow_replace_deleted_(allow_replace_deleted) {
         loadIndex(location, s, max_elements);
     }
 
@@ -95,10 +266,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         size_t M = 16,
         size_t ef_construction = 200,
         size_t random_seed = 100,
-        bool allow_replace_deleted = false)
+        bool allow_replace_deleted = false,
+        PageMode page_mode = PAGES_DEFAULT)
         : label_op_locks_(MAX_LABEL_OPERATION_LOCKS),
             link_list_locks_(max_elements),
             element_levels_(max_elements),
+            page_mode_(page_mode),
             allow_replace_deleted_(allow_replace_deleted) {
         max_elements_ = max_elements;
         num_deleted_ = 0;
@@ -126,21 +299,22 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         label_offset_ = size_links_level0_ + data_size_;
         offsetLevel0_ = 0;
 
-        data_level0_memory_ = (char *) malloc(max_elements_ * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory");
+        level0_ = allocateLevel0(max_elements_, level0_block_, vectors_block_, labels_block_);
+        data_level0_memory_ = level0_block_.data();
 
         cur_element_count = 0;
 
         visited_list_pool_ = std::unique_ptr<VisitedListPool>(new VisitedListPool(1, max_elements));
+        concurrent_visited_list_pool_ = std::unique_ptr<ConcurrentVisitedListPool>(
+            new ConcurrentVisitedListPool(0, max_elements));
 
         // initializations for special treatment of the first node
         enterpoint_node_ = -1;
         maxlevel_ = -1;
 
-        linkLists_ = (char **) malloc(sizeof(void *) * max_elements_);
-        if (linkLists_ == nullptr)
-            throw std::runtime_error("Not enough memory: HierarchicalNSW failed to allocate linklists");
+        link_lists_block_.allocate(sizeof(void *) * max_elements_, page_mode_, numa_interleave_);
+        linkLists_ = (char **) link_lists_block_.data();
+        link_arena_.setPageMode(page_mode_, numa_interleave_);
         size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
         mult_ = 1 / log(1.0 * M_);
         revSize_ = 1.0 / mult_;
@@ -152,16 +326,31 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
     void clear() {
-        free(data_level0_memory_);
+        level0_block_.release();
+        vectors_block_.release();
+        labels_block_.release();
         data_level0_memory_ = nullptr;
-        for (tableint i = 0; i < cur_element_count; i++) {
-            if (element_levels_[i] > 0)
-                free(linkLists_[i]);
-        }
-        free(linkLists_);
+        level0_ = Level0Arenas();
+        link_arena_.release();
+        link_lists_block_.release();
         linkLists_ = nullptr;
         cur_element_count = 0;
         visited_list_pool_.reset(nullptr);
+        concurrent_visited_list_pool_.reset(nullptr);
+        attribute_aware_ = false;
+        element_attributes_.clear();
+        attribute_entry_points_.clear();
+        attribute_filters_.clear();
+        namespaces_enabled_ = false;
+        element_namespaces_.clear();
+        namespace_roots_.clear();
+        entry_strategy_ = ENTRY_HIERARCHY;
+        entry_points_.clear();
+        entry_vectors_.clear();
+        navigation_ = NAVIGATION_HIERARCHY;
+        nav_ids_.clear();
+        nav_vectors_.clear();
+        nav_links_.clear();
     }
 
 
@@ -178,6 +367,338 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Sets the thresholds of the filtered search planner. Zeros disable the corresponding plans,
+    * setFilteredSearchPlanner(0, 0, 0) makes bitset filters always use the regular graph search.
+    */
+    void setFilteredSearchPlanner(double brute_force_factor, double two_hop_selectivity, double expand_ef_selectivity) {
+        filter_brute_force_factor_ = brute_force_factor;
+        filter_two_hop_selectivity_ = two_hop_selectivity;
+        filter_expand_ef_selectivity_ = expand_ef_selectivity;
+    }
+
+
+    /*
+    * Enables the adaptive early termination of searchKnn (see PatienceSearchStopCondition).
+    * ef stays the upper bound of the search, easy queries stop before exhausting it.
+    * setEarlyTermination(0, 0) restores the regular search.
+    */
+    void setEarlyTermination(size_t patience, float distance_ratio = 0) {
+        early_termination_patience_ = patience;
+        early_termination_distance_ratio_ = distance_ratio;
+    }
+
+
+    /*
+    * Stores a compressed code of every neighbor next to its entry in the level 0 link lists
+    * (switches to LAYOUT_SPLIT). searchKnn then reads one node sequentially to get approximate
+    * distances to all its neighbors and fetches full vectors only to rerank the best candidates:
+    * rerank of them, or ef when 0. The quantizer is trained on the current elements, the codes are
+    * kept up to date by insertions; the new code of an updated element is written in the lists within
+    * two hops of it, see setNeighborCodesFullRefresh. Only for float vectors. Works with setEarlyTermination.
+    * NEIGHBOR_CODES_NONE disables the codes. The quantizer is saved with the index and the codes are
+    * rebuilt when it is loaded. Not thread-safe with any other operation on the index.
+    */
+    void setNeighborCodes(NeighborCodeType type, size_t rerank = 0) {
+        neighbor_codes_rerank_ = rerank;
+        if (type == NEIGHBOR_CODES_NONE) {
+            neighbor_code_type_ = NEIGHBOR_CODES_NONE;
+            neighbor_code_size_ = 0;
+            setPageMode(page_mode_);
+            return;
+        }
+        if (!std::is_same<dist_t, float>::value || data_size_ % sizeof(float) != 0)
+            throw std::runtime_error("Neighbor codes need float vectors");
+
+        neighbor_quantizer_.reset(data_size_ / sizeof(float));
+        for (tableint i = 0; i < cur_element_count; i++)
+            neighbor_quantizer_.observe((const float *) getDataByInternalId(i));
+        neighbor_quantizer_.finish();
+        storeNeighborCodes(type);
+    }
+
+
+    // switches to LAYOUT_SPLIT with room for the codes of the trained neighbor_quantizer_ and encodes all the lists
+    void storeNeighborCodes(NeighborCodeType type) {
+        neighbor_code_type_ = type;
+        neighbor_code_size_ = neighbor_quantizer_.codeSize();
+        level0_layout_ = LAYOUT_SPLIT;
+        setPageMode(page_mode_);
+        for (tableint i = 0; i < cur_element_count; i++)
+            refreshNeighborCodes(i);
+    }
+
+
+    /*
+    * The links are not always mutual, a few lists linking to an updated element are farther than two hops
+    * from it. They keep its previous code, which only loosens the ranking of the candidates reached
+    * through them, the results are reranked with the full vectors. With full_refresh every update scans
+    * all the level 0 link lists to write the new code in each of them.
+    */
+    void setNeighborCodesFullRefresh(bool full_refresh) { neighbor_codes_full_refresh_ = full_refresh; }
+
+
+    NeighborCodeType getNeighborCodeType() const { return neighbor_code_type_; }
+
+
+    size_t getNeighborCodeSize() const { return neighbor_code_size_; }
+
+
+    unsigned char *getNeighborCodes(tableint internal_id) const {
+        return (unsigned char *) get_linklist0(internal_id) + size_links_level0_;
+    }
+
+
+    void encodeNeighborCode(const char *data, unsigned char *code) const {
+        neighbor_quantizer_.encode((const float *) data, code);
+    }
+
+
+    void decodeNeighborCode(const unsigned char *code, float *v) const {
+        neighbor_quantizer_.decode(code, v);
+    }
+
+
+    // re-encodes all the neighbors of the level 0 list of internal_id, the caller holds its link list lock
+    void refreshNeighborCodes(tableint internal_id) {
+        linklistsizeint *ll = get_linklist0(internal_id);
+        tableint *data = (tableint *) (ll + 1);
+        unsigned char *codes = getNeighborCodes(internal_id);
+        size_t size = getListCount(ll);
+        for (size_t j = 0; j < size; j++)
+            encodeNeighborCode(getDataByInternalId(data[j]), codes + j * neighbor_code_size_);
+    }
+
+
+    /*
+    * Re-encodes the code of internal_id in the level 0 lists linking to it: the lists of its neighbors
+    * and of their neighbors, which hold most of its reverse links, or all the lists with
+    * setNeighborCodesFullRefresh. The caller holds no link list lock.
+    */
+    void refreshLinkingNeighborCodes(tableint internal_id) {
+        std::vector<unsigned char> code(neighbor_code_size_);
+        encodeNeighborCode(getDataByInternalId(internal_id), code.data());
+        if (neighbor_codes_full_refresh_) {
+            for (tableint i = 0; i < cur_element_count; i++)
+                refreshNeighborCode(i, internal_id, code.data());
+            return;
+        }
+        std::unordered_set<tableint> linking;
+        for (tableint one_hop : getConnectionsWithLock(internal_id, 0)) {
+            linking.insert(one_hop);
+            for (tableint two_hop : getConnectionsWithLock(one_hop, 0))
+                linking.insert(two_hop);
+        }
+        for (tableint i : linking)
+            refreshNeighborCode(i, internal_id, code.data());
+    }
+
+
+    // writes code in the entries of neighbor_id of the level 0 list of internal_id, which is locked only if it holds neighbor_id
+    void refreshNeighborCode(tableint internal_id, tableint neighbor_id, const unsigned char *code) {
+        linklistsizeint *ll = get_linklist0(internal_id);
+        tableint *data = (tableint *) (ll + 1);
+        size_t size = getListCount(ll);
+        for (size_t j = 0; j < size; j++) {
+            if (data[j] != neighbor_id)
+                continue;
+            std::unique_lock <std::mutex> lock(link_list_locks_[internal_id]);
+            // the list may have changed before it was locked
+            size_t locked_size = getListCount(ll);
+            for (size_t l = 0; l < locked_size; l++) {
+                if (data[l] == neighbor_id)
+                    memcpy(getNeighborCodes(internal_id) + l * neighbor_code_size_, code, neighbor_code_size_);
+            }
+            return;
+        }
+    }
+
+
+    /*
+    * Moves data_level0_memory_ and linkLists_ to blocks allocated with the page mode.
+    * Huge pages reduce the TLB misses of the random accesses of the search on large indexes.
+    * Not thread-safe with any other operation on the index.
+    */
+    void setPageMode(PageMode page_mode) {
+        page_mode_ = page_mode;
+        LargeMemoryBlock new_level0_block, new_vectors_block, new_labels_block;
+        Level0Arenas new_level0 = allocateLevel0(max_elements_, new_level0_block, new_vectors_block, new_labels_block);
+        copyLevel0(level0_, 0, new_level0, 0, cur_element_count);
+        level0_block_.swap(new_level0_block);
+        vectors_block_.swap(new_vectors_block);
+        labels_block_.swap(new_labels_block);
+        level0_ = new_level0;
+        data_level0_memory_ = level0_block_.data();
+
+        LargeMemoryBlock new_link_lists_block;
+        new_link_lists_block.allocate(sizeof(void *) * max_elements_, page_mode_, numa_interleave_);
+        if (cur_element_count)
+            memcpy(new_link_lists_block.data(), linkLists_, sizeof(void *) * cur_element_count);
+        link_lists_block_.swap(new_link_lists_block);
+        linkLists_ = (char **) link_lists_block_.data();
+
+        // the upper layer link lists are compacted into one chunk with the page mode
+        MemoryArena new_link_arena;
+        new_link_arena.setPageMode(page_mode_, numa_interleave_);
+        new_link_arena.reserve(link_arena_.allocated());
+        for (tableint i = 0; i < cur_element_count; i++) {
+            if (element_levels_[i] > 0) {
+                size_t size = size_links_per_element_ * element_levels_[i];
+                char *link_lists = new_link_arena.allocate(size);
+                memcpy(link_lists, linkLists_[i], size);
+                linkLists_[i] = link_lists;
+            }
+        }
+        link_arena_.swap(new_link_arena);
+        link_arena_.setPageMode(page_mode_, numa_interleave_);
+    }
+
+
+    // page mode in use for the base layer, PAGES_DEFAULT after a fallback from huge pages
+    PageMode getLevel0PageMode() const { return level0_block_.mode(); }
+
+
+    // size of the pages backing the base layer
+    size_t getLevel0PageSize() const { return level0_block_.pageSize(); }
+
+
+    // size of the pages backing linkLists_
+    size_t getLinkListsPageSize() const { return link_lists_block_.pageSize(); }
+
+
+    /*
+    * Moves data_level0_memory_ and linkLists_ to blocks whose pages are interleaved over
+    * the NUMA nodes, so threads on every node see the same average latency and the memory
+    * bandwidth of all the nodes is used. Also applies to later resizes and loads.
+    * Returns true if the interleave policy was applied (on one node it has no effect).
+    * Not thread-safe with any other operation on the index.
+    */
+    bool setNumaInterleave(bool numa_interleave) {
+        numa_interleave_ = numa_interleave;
+        setPageMode(page_mode_);
+        return isNumaInterleaved();
+    }
+
+
+    bool isNumaInterleaved() const { return level0_block_.numaInterleaved(); }
+
+
+    /*
+    * saveIndex and loadIndex transfer the base layer, the bulk of the index file, with queue_depth
+    * asynchronous requests in flight (io_uring, or a pread/pwrite thread pool), e.g. 32 to keep an NVMe
+    * drive busy. 0, the default, uses the blocking file streams, as on Windows where the setting is ignored.
+    */
+    void setIOQueueDepth(size_t queue_depth) { io_queue_depth_ = queue_depth; }
+
+
+    size_t getIOQueueDepth() const { return io_queue_depth_; }
+
+
+    /*
+    * Switches the storage of the base layer. LAYOUT_SPLIT keeps the link lists in a dense arena,
+    * so the hops of the search do not bring vector and label bytes into the cache, and the vectors
+    * in their own aligned arena where they can later be compressed or mapped from a file.
+    * The index file format does not depend on the layout. Also applies to later loads.
+    * Not thread-safe with any other operation on the index.
+    */
+    void setLevel0Layout(Level0Layout layout) {
+        if (layout == LAYOUT_INTERLEAVED) {
+            // the records have no room for neighbor codes
+            neighbor_code_type_ = NEIGHBOR_CODES_NONE;
+            neighbor_code_size_ = 0;
+        }
+        level0_layout_ = layout;
+        setPageMode(page_mode_);
+    }
+
+
+    Level0Layout getLevel0Layout() const { return level0_layout_; }
+
+
+    // distance between two link lists of LAYOUT_SPLIT, followed by their neighbor codes
+    size_t getSplitLinksStride() const {
+        return size_links_level0_ + maxM0_ * neighbor_code_size_;
+    }
+
+
+    // distance between two vectors of LAYOUT_SPLIT: a multiple of the cache line, or a power of two for small vectors
+    size_t getVectorStride() const {
+        size_t alignment = 1;
+        while (alignment < data_size_ && alignment < VECTOR_ALIGNMENT)
+            alignment *= 2;
+        return (data_size_ + alignment - 1) / alignment * alignment;
+    }
+
+
+    // allocates the base layer of max_elements with the layout, page mode and NUMA policy of the index
+    Level0Arenas allocateLevel0(
+        size_t max_elements,
+        LargeMemoryBlock &level0_block,
+        LargeMemoryBlock &vectors_block,
+        LargeMemoryBlock &labels_block) const {
+        if (level0_layout_ == LAYOUT_INTERLEAVED) {
+            level0_block.allocate(max_elements * size_data_per_element_, page_mode_, numa_interleave_);
+            vectors_block.release();
+            labels_block.release();
+        } else {
+            level0_block.allocate(max_elements * getSplitLinksStride(), page_mode_, numa_interleave_);
+            vectors_block.allocate(max_elements * getVectorStride(), page_mode_, numa_interleave_, VECTOR_ALIGNMENT);
+            labels_block.allocate(max_elements * sizeof(labeltype), page_mode_, numa_interleave_);
+        }
+        return getLevel0Arenas(level0_layout_, level0_block.data(), vectors_block.data(), labels_block.data());
+    }
+
+
+    Level0Arenas getLevel0Arenas(Level0Layout layout, char *level0_memory, char *vectors, char *labels) const {
+        Level0Arenas arenas;
+        arenas.layout = layout;
+        if (layout == LAYOUT_INTERLEAVED) {
+            arenas.links = level0_memory + offsetLevel0_;
+            arenas.vectors = level0_memory + offsetData_;
+            arenas.labels = level0_memory + label_offset_;
+            arenas.links_stride = arenas.vectors_stride = arenas.labels_stride = size_data_per_element_;
+        } else {
+            arenas.links = level0_memory;
+            arenas.vectors = vectors;
+            arenas.labels = labels;
+            arenas.links_stride = getSplitLinksStride();
+            arenas.vectors_stride = getVectorStride();
+            arenas.labels_stride = sizeof(labeltype);
+        }
+        return arenas;
+    }
+
+
+    // copies the link lists, vectors and labels of count elements
+    void copyLevel0(const Level0Arenas &from, size_t from_id, const Level0Arenas &to, size_t to_id, size_t count) const {
+        if (count == 0)
+            return;
+        if (from.layout == LAYOUT_INTERLEAVED && to.layout == LAYOUT_INTERLEAVED) {
+            memcpy(to.links - offsetLevel0_ + to_id * size_data_per_element_,
+                   from.links - offsetLevel0_ + from_id * size_data_per_element_, count * size_data_per_element_);
+            return;
+        }
+        // the neighbor codes are copied when both sides have room for them
+        size_t links_size = from.links_stride == to.links_stride ? from.links_stride : size_links_level0_;
+        for (size_t i = 0; i < count; i++) {
+            memcpy(to.links + (to_id + i) * to.links_stride, from.links + (from_id + i) * from.links_stride, links_size);
+            memcpy(to.vectors + (to_id + i) * to.vectors_stride, from.vectors + (from_id + i) * from.vectors_stride, data_size_);
+            memcpy(to.labels + (to_id + i) * to.labels_stride, from.labels + (from_id + i) * from.labels_stride, sizeof(labeltype));
+        }
+    }
+
+
+    // copies the base layer of the elements [begin, begin + count) to records in the format of the index file
+    void getLevel0Records(char *records, size_t begin, size_t count) const {
+        copyLevel0(level0_, begin, getLevel0Arenas(LAYOUT_INTERLEAVED, records, nullptr, nullptr), 0, count);
+    }
+
+
+    void setLevel0Records(const char *records, size_t begin, size_t count) {
+        copyLevel0(getLevel0Arenas(LAYOUT_INTERLEAVED, (char *) records, nullptr, nullptr), 0, level0_, begin, count);
+    }
+
+
     inline std::mutex& getLabelOpMutex(labeltype label) const {
         // calculate hash
         size_t lock_id = label & (MAX_LABEL_OPERATION_LOCKS - 1);
@@ -187,23 +708,57 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
     inline labeltype getExternalLabel(tableint internal_id) const {
         labeltype return_label;
-        memcpy(&return_label, (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), sizeof(labeltype));
+        memcpy(&return_label, level0_.labels + internal_id * level0_.labels_stride, sizeof(labeltype));
         return return_label;
     }
 
 
     inline void setExternalLabel(tableint internal_id, labeltype label) const {
-        memcpy((data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), &label, sizeof(labeltype));
+        memcpy(level0_.labels + internal_id * level0_.labels_stride, &label, sizeof(labeltype));
     }
 
 
     inline labeltype *getExternalLabeLp(tableint internal_id) const {
-        return (labeltype *) (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_);
+        return (labeltype *) (level0_.labels + internal_id * level0_.labels_stride);
     }
 
 
     inline char *getDataByInternalId(tableint internal_id) const {
-        return (data_level0_memory_ + internal_id * size_data_per_element_ + offsetData_);
+        return level0_.vectors + internal_id * level0_.vectors_stride;
+    }
+
+
+    static inline const BitsetFilterFunctor *asBitsetFilter(BaseFilterFunctor* isIdAllowed) {
+        return isIdAllowed ? dynamic_cast<const BitsetFilterFunctor *>(isIdAllowed) : nullptr;
+    }
+
+
+    /*
+    * Checks the filter for an element. A bitset filter is tested inline (over internal ids
+    * without reading the label), any other filter goes through the virtual call.
+    */
+    inline bool isAllowedInternal(tableint internal_id, BaseFilterFunctor* isIdAllowed, const BitsetFilterFunctor *bitset) const {
+        if (bitset) {
+            return bitset->test(bitset->isInternal() ? (size_t) internal_id : getExternalLabel(internal_id));
+        }
+        return (!isIdAllowed) || (*isIdAllowed)(getExternalLabel(internal_id));
+    }
+
+
+    /*
+    * Creates a filter over internal ids that allows the elements with the given labels.
+    * Unknown labels are ignored. The filter is valid until the index is modified.
+    */
+    BitsetFilterFunctor createInternalIdFilter(const labeltype *labels, size_t num_labels) const {
+        BitsetFilterFunctor filter(max_elements_, BitsetFilterFunctor::INTERNAL_IDS);
+        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+        for (size_t i = 0; i < num_labels; i++) {
+            auto search = label_lookup_.find(labels[i]);
+            if (search != label_lookup_.end()) {
+                filter.set(search->second);
+            }
+        }
+        return filter;
     }
 
 
@@ -309,14 +864,16 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
 
     // bare_bone_search means there is no check for deletions and stop condition is ignored in return of extra performance
-    template <bool bare_bone_search = true, bool collect_metrics = true>
+    // stop_condition_t can be a final stop condition class, its methods are then called without virtual dispatch
+    template <bool bare_bone_search = true, bool collect_metrics = true,
+              typename stop_condition_t = BaseSearchStopCondition<dist_t>>
     std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
     searchBaseLayerST(
         tableint ep_id,
         const void *data_point,
         size_t ef,
         BaseFilterFunctor* isIdAllowed = nullptr,
-        BaseSearchStopCondition<dist_t>* stop_condition = nullptr) const {
+        stop_condition_t* stop_condition = nullptr) const {
         VisitedList *vl = visited_list_pool_->getFreeVisitedList();
         vl_type *visited_array = vl->mass;
         vl_type visited_array_tag = vl->curV;
@@ -324,9 +881,11 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
 
+        const BitsetFilterFunctor *bitset = bare_bone_search ? nullptr : asBitsetFilter(isIdAllowed);
+
         dist_t lowerBound;
         if (bare_bone_search || 
-            (!isMarkedDeleted(ep_id) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(ep_id))))) {
+            (!isMarkedDeleted(ep_id) && isAllowedInternal(ep_id, isIdAllowed, bitset))) {
             char* ep_data = getDataByInternalId(ep_id);
             dist_t dist = fstdistfunc_(data_point, ep_data, dist_func_param_);
             lowerBound = dist;
@@ -373,7 +932,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 #ifdef USE_SSE
             _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
             _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-            _mm_prefetch(data_level0_memory_ + (*(data + 1)) * size_data_per_element_ + offsetData_, _MM_HINT_T0);
+            _mm_prefetch(getDataByInternalId(*(data + 1)), _MM_HINT_T0);
             _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
 #endif
 
@@ -382,7 +941,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 //                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
                 _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
-                _mm_prefetch(data_level0_memory_ + (*(data + j + 1)) * size_data_per_element_ + offsetData_,
+                _mm_prefetch(getDataByInternalId(*(data + j + 1)),
                                 _MM_HINT_T0);  ////////////
 #endif
                 if (!(visited_array[candidate_id] == visited_array_tag)) {
@@ -401,13 +960,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     if (flag_consider_candidate) {
                         candidate_set.emplace(-dist, candidate_id);
 #ifdef USE_SSE
-                        _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
-                                        offsetLevel0_,  ///////////
+                        _mm_prefetch((char *) get_linklist0(candidate_set.top().second),  ///////////
                                         _MM_HINT_T0);  ////////////////////////
 #endif
 
                         if (bare_bone_search || 
-                            (!isMarkedDeleted(candidate_id) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(candidate_id))))) {
+                            (!isMarkedDeleted(candidate_id) && isAllowedInternal(candidate_id, isIdAllowed, bitset))) {
                             top_candidates.emplace(dist, candidate_id);
                             if (!bare_bone_search && stop_condition) {
                                 stop_condition->add_point_to_result(getExternalLabel(candidate_id), currObj1, dist);
@@ -443,12 +1001,158 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Base layer search on the neighbor codes: the candidates are ranked by the distances to the
+    * decoded codes stored with the link lists, so a hop reads one node instead of its neighbors' vectors.
+    * The best candidates are then reranked with the full vectors, the result has exact distances.
+    * stop_condition ends the search early on the approximate distances, as in searchBaseLayerST.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerCodes(tableint ep_id, const void *data_point, size_t ef, size_t k, BaseFilterFunctor *isIdAllowed,
+                         PatienceSearchStopCondition<dist_t> *stop_condition = nullptr) const {
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+
+        bool bare_bone_search = !num_deleted_ && !isIdAllowed;
+        const BitsetFilterFunctor *bitset = bare_bone_search ? nullptr : asBitsetFilter(isIdAllowed);
+        std::vector<float> decoded(neighbor_quantizer_.dim());
+        std::vector<unsigned char> ep_code(neighbor_code_size_);
+        size_t num_hops = 0;
+        size_t num_computations = 1;
+
+        // the entry point is ranked through its code as well
+        encodeNeighborCode(getDataByInternalId(ep_id), ep_code.data());
+        decodeNeighborCode(ep_code.data(), decoded.data());
+        dist_t ep_dist = fstdistfunc_(data_point, decoded.data(), dist_func_param_);
+        dist_t lowerBound;
+        if (bare_bone_search || (!isMarkedDeleted(ep_id) && isAllowedInternal(ep_id, isIdAllowed, bitset))) {
+            lowerBound = ep_dist;
+            top_candidates.emplace(ep_dist, ep_id);
+            if (stop_condition)
+                stop_condition->add_point_to_result(getExternalLabel(ep_id), getDataByInternalId(ep_id), ep_dist);
+        } else {
+            lowerBound = std::numeric_limits<dist_t>::max();
+        }
+        candidate_set.emplace(-ep_dist, ep_id);
+        visited_array[ep_id] = visited_array_tag;
+
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            dist_t candidate_dist = -current_node_pair.first;
+            if (stop_condition ? stop_condition->should_stop_search(candidate_dist, lowerBound)
+                               : candidate_dist > lowerBound && top_candidates.size() == ef)
+                break;
+            candidate_set.pop();
+
+            tableint current_node_id = current_node_pair.second;
+            linklistsizeint *ll = get_linklist0(current_node_id);
+            tableint *data = (tableint *) (ll + 1);
+            const unsigned char *codes = getNeighborCodes(current_node_id);
+            size_t size = getListCount(ll);
+            num_hops++;
+#ifdef USE_SSE
+            _mm_prefetch((char *) (visited_array + *data), _MM_HINT_T0);
+#endif
+
+            for (size_t j = 0; j < size; j++) {
+                tableint candidate_id = data[j];
+                if (visited_array[candidate_id] == visited_array_tag)
+                    continue;
+                visited_array[candidate_id] = visited_array_tag;
+
+                decodeNeighborCode(codes + j * neighbor_code_size_, decoded.data());
+                dist_t dist = fstdistfunc_(data_point, decoded.data(), dist_func_param_);
+                num_computations++;
+                if (top_candidates.size() < ef || lowerBound > dist) {
+                    candidate_set.emplace(-dist, candidate_id);
+#ifdef USE_SSE
+                    _mm_prefetch((char *) get_linklist0(candidate_set.top().second), _MM_HINT_T0);
+#endif
+                    if (bare_bone_search ||
+                        (!isMarkedDeleted(candidate_id) && isAllowedInternal(candidate_id, isIdAllowed, bitset))) {
+                        top_candidates.emplace(dist, candidate_id);
+                        if (stop_condition)
+                            stop_condition->add_point_to_result(getExternalLabel(candidate_id), getDataByInternalId(candidate_id), dist);
+                        if (top_candidates.size() > ef) {
+                            if (stop_condition) {
+                                tableint id = top_candidates.top().second;
+                                stop_condition->remove_point_from_result(getExternalLabel(id), getDataByInternalId(id), top_candidates.top().first);
+                            }
+                            top_candidates.pop();
+                        }
+                    }
+                    if (!top_candidates.empty())
+                        lowerBound = top_candidates.top().first;
+                }
+            }
+        }
+        visited_list_pool_->releaseVisitedList(vl);
+
+        // rerank the closest approximate candidates with the full vectors
+        std::vector<tableint> approximate(top_candidates.size());
+        for (size_t i = approximate.size(); i > 0; i--) {
+            approximate[i - 1] = top_candidates.top().second;
+            top_candidates.pop();
+        }
+        size_t rerank = std::max(neighbor_codes_rerank_ ? neighbor_codes_rerank_ : ef, k);
+        rerank = std::min(rerank, approximate.size());
+        for (size_t i = 0; i < rerank; i++) {
+            tableint id = approximate[i];
+            top_candidates.emplace(fstdistfunc_(data_point, getDataByInternalId(id), dist_func_param_), id);
+        }
+
+        metric_base_hops += num_hops;
+        metric_base_distance_computations += num_computations;
+        metric_rerank_distance_computations += rerank;
+        return top_candidates;
+    }
+
+
+    /*
+    * Checks that the attributes shared by a and b are all present in covering.
+    */
+    bool coversSharedAttributes(tableint covering, tableint a, tableint b) const {
+        const std::vector<attributetype> &attr_a = element_attributes_[a];
+        const std::vector<attributetype> &attr_b = element_attributes_[b];
+        const std::vector<attributetype> &attr_covering = element_attributes_[covering];
+        auto it_a = attr_a.begin();
+        auto it_b = attr_b.begin();
+        while (it_a != attr_a.end() && it_b != attr_b.end()) {
+            if (*it_a < *it_b) {
+                ++it_a;
+            } else if (*it_b < *it_a) {
+                ++it_b;
+            } else {
+                if (!std::binary_search(attr_covering.begin(), attr_covering.end(), *it_a))
+                    return false;
+                ++it_a;
+                ++it_b;
+            }
+        }
+        return true;
+    }
+
+
+    /*
+    * With attributes and a known base element the pruning follows Filtered-DiskANN:
+    * a candidate is only dominated by a closer selected neighbor that has all the
+    * attributes the candidate shares with the base element, so every attribute keeps its edges.
+    * alpha > 1 is the RobustPrune of Vamana: a candidate is dropped only when alpha times its distance
+    * to a selected neighbor is below its distance to the base, which keeps longer edges.
+    */
     void getNeighborsByHeuristic2(
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates,
-        const size_t M) {
+        const size_t M,
+        tableint base_id = -1,
+        float alpha = 1.0f) {
         if (top_candidates.size() < M) {
             return;
         }
+        bool check_attributes = attribute_aware_ && (signed) base_id != -1;
 
         std::priority_queue<std::pair<dist_t, tableint>> queue_closest;
         std::vector<std::pair<dist_t, tableint>> return_list;
@@ -470,7 +1174,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                         fstdistfunc_(getDataByInternalId(second_pair.second),
                                         getDataByInternalId(curent_pair.second),
                                         dist_func_param_);
-                if (curdist < dist_to_query) {
+                if (alpha * (double) curdist < (double) dist_to_query) {
+                    if (check_attributes && !coversSharedAttributes(second_pair.second, base_id, curent_pair.second))
+                        continue;
                     good = false;
                     break;
                 }
@@ -487,12 +1193,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
 
     linklistsizeint *get_linklist0(tableint internal_id) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+        return (linklistsizeint *) (level0_.links + internal_id * level0_.links_stride);
     }
 
 
-    linklistsizeint *get_linklist0(tableint internal_id, char *data_level0_memory_) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+    linklistsizeint *get_linklist0(tableint internal_id, const Level0Arenas &arenas) const {
+        return (linklistsizeint *) (arenas.links + internal_id * arenas.links_stride);
     }
 
 
@@ -513,7 +1219,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         int level,
         bool isUpdate) {
         size_t Mcurmax = level ? maxM_ : maxM0_;
-        getNeighborsByHeuristic2(top_candidates, M_);
+        getNeighborsByHeuristic2(top_candidates, M_, cur_c);
         if (top_candidates.size() > M_)
             throw std::runtime_error("Should be not be more than M_ candidates returned by the heuristic");
 
@@ -552,6 +1258,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
                 data[idx] = selectedNeighbors[idx];
             }
+            if (level == 0 && neighbor_code_size_)
+                refreshNeighborCodes(cur_c);
         }
 
         for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
@@ -588,6 +1296,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             if (!is_cur_c_present) {
                 if (sz_link_list_other < Mcurmax) {
                     data[sz_link_list_other] = cur_c;
+                    if (level == 0 && neighbor_code_size_)
+                        encodeNeighborCode(getDataByInternalId(cur_c),
+                                           getNeighborCodes(selectedNeighbors[idx]) + sz_link_list_other * neighbor_code_size_);
                     setListCount(ll_other, sz_link_list_other + 1);
                 } else {
                     // finding the "weakest" element to replace it with the new one
@@ -603,7 +1314,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                                                 dist_func_param_), data[j]);
                     }
 
-                    getNeighborsByHeuristic2(candidates, Mcurmax);
+                    getNeighborsByHeuristic2(candidates, Mcurmax, selectedNeighbors[idx]);
 
                     int indx = 0;
                     while (candidates.size() > 0) {
@@ -613,6 +1324,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     }
 
                     setListCount(ll_other, indx);
+                    if (level == 0 && neighbor_code_size_)
+                        refreshNeighborCodes(selectedNeighbors[idx]);
                     // Nearest K:
                     /*int indx = -1;
                     for (int j = 0; j < sz_link_list_other; j++) {
@@ -638,22 +1351,32 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
 
         visited_list_pool_.reset(new VisitedListPool(1, new_max_elements));
+        concurrent_visited_list_pool_.reset(new ConcurrentVisitedListPool(0, new_max_elements));
 
         element_levels_.resize(new_max_elements);
 
         std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
 
         // Reallocate base layer
-        char * data_level0_memory_new = (char *) realloc(data_level0_memory_, new_max_elements * size_data_per_element_);
-        if (data_level0_memory_new == nullptr)
-            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate base layer");
-        data_level0_memory_ = data_level0_memory_new;
+        level0_block_.resize(new_max_elements * level0_.links_stride, cur_element_count * level0_.links_stride);
+        if (level0_.layout == LAYOUT_SPLIT) {
+            vectors_block_.resize(new_max_elements * level0_.vectors_stride, cur_element_count * level0_.vectors_stride);
+            labels_block_.resize(new_max_elements * level0_.labels_stride, cur_element_count * level0_.labels_stride);
+        }
+        level0_ = getLevel0Arenas(level0_.layout, level0_block_.data(), vectors_block_.data(), labels_block_.data());
+        data_level0_memory_ = level0_block_.data();
 
         // Reallocate all other layers
-        char ** linkLists_new = (char **) realloc(linkLists_, sizeof(void *) * new_max_elements);
-        if (linkLists_new == nullptr)
-            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate other layers");
-        linkLists_ = linkLists_new;
+        link_lists_block_.resize(sizeof(void *) * new_max_elements, sizeof(void *) * cur_element_count);
+        linkLists_ = (char **) link_lists_block_.data();
+
+        if (attribute_aware_) {
+            element_attributes_.resize(new_max_elements);
+            for (auto &filter : attribute_filters_)
+                filter.second.resize(new_max_elements);
+        }
+        if (namespaces_enabled_)
+            element_namespaces_.resize(new_max_elements, (namespacetype) DEFAULT_NAMESPACE);
 
         max_elements_ = new_max_elements;
     }
@@ -682,37 +1405,261 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             size += sizeof(linkListSize);
             size += linkListSize;
         }
+        size += serializeExtensions().size();
         return size;
     }
 
-    void saveIndex(const std::string &location) {
-        std::ofstream output(location, std::ios::binary);
-        std::streampos position;
 
-        writeBinaryPOD(output, offsetLevel0_);
-        writeBinaryPOD(output, max_elements_);
-        writeBinaryPOD(output, cur_element_count);
-        writeBinaryPOD(output, size_data_per_element_);
-        writeBinaryPOD(output, label_offset_);
-        writeBinaryPOD(output, offsetData_);
-        writeBinaryPOD(output, maxlevel_);
-        writeBinaryPOD(output, enterpoint_node_);
-        writeBinaryPOD(output, maxM_);
+    /*
+    * Serializes the optional sections stored after the link lists.
+    * Returns an empty string when no optional feature is used, so the file stays readable by older versions.
+    */
+    std::string serializeExtensions() const {
+        std::ostringstream sections;
+        if (attribute_aware_) {
+            std::ostringstream payload;
+            writeBinaryPOD(payload, (size_t) cur_element_count);
+            for (size_t i = 0; i < cur_element_count; i++) {
+                uint32_t num_attributes = element_attributes_[i].size();
+                writeBinaryPOD(payload, num_attributes);
+                payload.write((const char *) element_attributes_[i].data(), num_attributes * sizeof(attributetype));
+            }
+            writeExtensionSection(sections, SECTION_ATTRIBUTES, payload.str());
+        }
+        if (namespaces_enabled_) {
+            std::ostringstream payload;
+            writeBinaryPOD(payload, (size_t) cur_element_count);
+            payload.write((const char *) element_namespaces_.data(), cur_element_count * sizeof(namespacetype));
+            std::unique_lock <std::mutex> lock(namespace_lock_);
+            writeBinaryPOD(payload, (size_t) namespace_roots_.size());
+            for (auto &root : namespace_roots_) {
+                writeBinaryPOD(payload, root.first);
+                writeBinaryPOD(payload, root.second.enterpoint_node);
+                writeBinaryPOD(payload, root.second.maxlevel);
+            }
+            writeExtensionSection(sections, SECTION_NAMESPACES, payload.str());
+        }
+        if (neighbor_code_size_) {
+            // the codes are rebuilt from the vectors, only the quantizer is saved
+            std::ostringstream payload;
+            writeBinaryPOD(payload, (uint32_t) neighbor_code_type_);
+            writeBinaryPOD(payload, neighbor_codes_rerank_);
+            writeBinaryPOD(payload, neighbor_quantizer_.dim());
+            payload.write((const char *) neighbor_quantizer_.minValues(), neighbor_quantizer_.dim() * sizeof(float));
+            payload.write((const char *) neighbor_quantizer_.steps(), neighbor_quantizer_.dim() * sizeof(float));
+            writeExtensionSection(sections, SECTION_NEIGHBOR_CODES, payload.str());
+        }
 
-        writeBinaryPOD(output, maxM0_);
+        std::string body = sections.str();
+        if (body.empty())
+            return body;
+        std::ostringstream output;
+        writeBinaryPOD(output, (uint32_t) EXTENSIONS_MAGIC);
+        output.write(body.data(), body.size());
+        writeBinaryPOD(output, (uint32_t) SECTION_END);
+        return output.str();
+    }
+
+
+    static void writeExtensionSection(std::ostream &output, uint32_t section, const std::string &payload) {
+        writeBinaryPOD(output, section);
+        writeBinaryPOD(output, (uint64_t) payload.size());
+        output.write(payload.data(), payload.size());
+    }
+
+
+    /*
+    * Reads the optional sections, unknown sections are skipped.
+    */
+    void loadExtensions(std::istream &input, std::streampos total_filesize) {
+        if (input.tellg() == total_filesize)
+            return;
+        uint32_t magic = 0;
+        readBinaryPOD(input, magic);
+        if (magic != EXTENSIONS_MAGIC)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        while (true) {
+            uint32_t section = SECTION_END;
+            readBinaryPOD(input, section);
+            if (!input)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            if (section == SECTION_END)
+                break;
+            uint64_t payload_size;
+            readBinaryPOD(input, payload_size);
+            std::streampos payload_end = input.tellg() + (std::streamoff) payload_size;
+            if (payload_end > total_filesize)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+
+            if (section == SECTION_ATTRIBUTES) {
+                size_t num_elements;
+                readBinaryPOD(input, num_elements);
+                if (num_elements != cur_element_count)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                enableAttributes();
+                std::vector<attributetype> attributes;
+                for (size_t i = 0; i < num_elements; i++) {
+                    uint32_t num_attributes;
+                    readBinaryPOD(input, num_attributes);
+                    attributes.resize(num_attributes);
+                    input.read((char *) attributes.data(), num_attributes * sizeof(attributetype));
+                    element_attributes_[i] = attributes;
+                    registerAttributes(i);
+                }
+            } else if (section == SECTION_NAMESPACES) {
+                size_t num_elements;
+                readBinaryPOD(input, num_elements);
+                if (num_elements != cur_element_count)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                enableNamespaces();
+                input.read((char *) element_namespaces_.data(), num_elements * sizeof(namespacetype));
+                size_t num_namespaces;
+                readBinaryPOD(input, num_namespaces);
+                for (size_t i = 0; i < num_namespaces; i++) {
+                    namespacetype ns;
+                    NamespaceRoot root;
+                    readBinaryPOD(input, ns);
+                    readBinaryPOD(input, root.enterpoint_node);
+                    readBinaryPOD(input, root.maxlevel);
+                    root.element_count = 0;
+                    namespace_roots_[ns] = root;
+                }
+                for (size_t i = 0; i < num_elements; i++) {
+                    if (element_namespaces_[i] != DEFAULT_NAMESPACE)
+                        namespace_roots_.at(element_namespaces_[i]).element_count++;
+                }
+            } else if (section == SECTION_NEIGHBOR_CODES) {
+                uint32_t type;
+                size_t dim;
+                readBinaryPOD(input, type);
+                readBinaryPOD(input, neighbor_codes_rerank_);
+                readBinaryPOD(input, dim);
+                if (type != NEIGHBOR_CODES_SQ4 || dim * sizeof(float) != data_size_)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                std::vector<float> min_values(dim), steps(dim);
+                input.read((char *) min_values.data(), dim * sizeof(float));
+                input.read((char *) steps.data(), dim * sizeof(float));
+                if (!input)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                neighbor_quantizer_.setParameters(dim, min_values.data(), steps.data());
+                storeNeighborCodes((NeighborCodeType) type);
+            }
+            input.seekg(payload_end, input.beg);
+        }
+        if (input.tellg() != total_filesize)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+    }
+
+    bool useAsyncIO() const {
+#if defined(_WIN32)
+        return false;
+#else
+        return io_queue_depth_ > 0 && cur_element_count > 0;
+#endif
+    }
+
+
+    // records per request of the asynchronous transfers of LAYOUT_SPLIT, converted in the request buffers
+    size_t getLevel0AsyncChunk() const {
+#if defined(_WIN32)
+        return LEVEL0_RECORDS_CHUNK;
+#else
+        return std::max(AsyncIO::DEFAULT_CHUNK_SIZE / size_data_per_element_, (size_t) 1);
+#endif
+    }
+
+
+    // writes the base layer records at position of the saved index file
+    void saveLevel0Async(const std::string &location, std::streampos position) const {
+#if !defined(_WIN32)
+        size_t size = cur_element_count * size_data_per_element_;
+        if (level0_.layout == LAYOUT_INTERLEAVED) {
+            writeFileAsync(location, (std::streamoff) position, data_level0_memory_, size, io_queue_depth_);
+            return;
+        }
+        writeFileChunks(location, (std::streamoff) position, size, getLevel0AsyncChunk() * size_data_per_element_,
+            [&](size_t begin, char *records, size_t length) {
+                getLevel0Records(records, begin / size_data_per_element_, length / size_data_per_element_);
+            }, io_queue_depth_);
+#endif
+    }
+
+
+    void loadLevel0Async(const std::string &location, std::streampos position) {
+#if !defined(_WIN32)
+        size_t size = cur_element_count * size_data_per_element_;
+        if (level0_.layout == LAYOUT_INTERLEAVED) {
+            readFileAsync(location, (std::streamoff) position, data_level0_memory_, size, io_queue_depth_);
+            return;
+        }
+        readFileChunks(location, (std::streamoff) position, size, getLevel0AsyncChunk() * size_data_per_element_,
+            [&](size_t begin, const char *records, size_t length) {
+                setLevel0Records(records, begin / size_data_per_element_, length / size_data_per_element_);
+            }, io_queue_depth_);
+#endif
+    }
+
+
+    /*
+    * Compacts the index into an immutable FrozenHNSW (see frozen_index.h) without locks, label map
+    * or deletion marks: the deleted elements are dropped and their links replaced by their live neighbors.
+    * The index must not be modified during the call.
+    */
+    std::unique_ptr<FrozenHNSW<dist_t>> freeze() const;
+
+
+    void saveIndex(const std::string &location) {
+        std::ofstream output(location, std::ios::binary);
+        std::streampos position;
+
+        writeBinaryPOD(output, offsetLevel0_);
+        writeBinaryPOD(output, max_elements_);
+        writeBinaryPOD(output, cur_element_count);
+        writeBinaryPOD(output, size_data_per_element_);
+        writeBinaryPOD(output, label_offset_);
+        writeBinaryPOD(output, offsetData_);
+        writeBinaryPOD(output, maxlevel_);
+        writeBinaryPOD(output, enterpoint_node_);
+        writeBinaryPOD(output, maxM_);
+
+        writeBinaryPOD(output, maxM0_);
         writeBinaryPOD(output, M_);
         writeBinaryPOD(output, mult_);
         writeBinaryPOD(output, ef_construction_);
 
-        output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+        std::streampos level0_position = output.tellp();
+        bool async_level0 = useAsyncIO();
+        if (async_level0) {
+            // written once the stream is closed, the link lists follow
+            output.seekp(level0_position + (std::streamoff) (cur_element_count * size_data_per_element_));
+        } else if (level0_.layout == LAYOUT_INTERLEAVED) {
+            output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+        } else {
+            std::vector<char> records(LEVEL0_RECORDS_CHUNK * size_data_per_element_);
+            for (size_t i = 0; i < cur_element_count; i += LEVEL0_RECORDS_CHUNK) {
+                size_t count = std::min((size_t) LEVEL0_RECORDS_CHUNK, cur_element_count - i);
+                getLevel0Records(records.data(), i, count);
+                output.write(records.data(), count * size_data_per_element_);
+            }
+        }
 
+        // the upper layers are gathered to be written at once
+        std::vector<char> link_lists(cur_element_count * sizeof(unsigned int) + link_arena_.allocated());
+        char *link_list = link_lists.data();
         for (size_t i = 0; i < cur_element_count; i++) {
             unsigned int linkListSize = element_levels_[i] > 0 ? size_links_per_element_ * element_levels_[i] : 0;
-            writeBinaryPOD(output, linkListSize);
+            memcpy(link_list, &linkListSize, sizeof(unsigned int));
+            link_list += sizeof(unsigned int);
             if (linkListSize)
-                output.write(linkLists_[i], linkListSize);
+                memcpy(link_list, linkLists_[i], linkListSize);
+            link_list += linkListSize;
         }
+        output.write(link_lists.data(), link_list - link_lists.data());
+        std::string extensions = serializeExtensions();
+        output.write(extensions.data(), extensions.size());
         output.close();
+        if (async_level0)
+            saveLevel0Async(location, level0_position);
     }
 
 
@@ -769,48 +1716,91 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         }
 
         // throw exception if it either corrupted or old index
-        if (input.tellg() != total_filesize)
+        if (input.tellg() > total_filesize)
             throw std::runtime_error("Index seems to be corrupted or unsupported");
+        if (input.tellg() != total_filesize) {
+            uint32_t magic = 0;
+            readBinaryPOD(input, magic);
+            if (magic != EXTENSIONS_MAGIC)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+        }
 
         input.clear();
         /// Optional check end
 
         input.seekg(pos, input.beg);
 
-        data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory: loadIndex failed to allocate level0");
-        input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
-
         size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
 
         size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
+
+        // the codes are rebuilt by loadExtensions when the index was saved with them
+        neighbor_code_type_ = NEIGHBOR_CODES_NONE;
+        neighbor_code_size_ = 0;
+        level0_ = allocateLevel0(max_elements, level0_block_, vectors_block_, labels_block_);
+        data_level0_memory_ = level0_block_.data();
+        if (useAsyncIO()) {
+            std::streampos level0_position = input.tellg();
+            loadLevel0Async(location, level0_position);
+            input.seekg(level0_position + (std::streamoff) (cur_element_count * size_data_per_element_));
+        } else if (level0_.layout == LAYOUT_INTERLEAVED) {
+            input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
+        } else {
+            std::vector<char> records(LEVEL0_RECORDS_CHUNK * size_data_per_element_);
+            for (size_t i = 0; i < cur_element_count; i += LEVEL0_RECORDS_CHUNK) {
+                size_t count = std::min((size_t) LEVEL0_RECORDS_CHUNK, cur_element_count - i);
+                input.read(records.data(), count * size_data_per_element_);
+                setLevel0Records(records.data(), i, count);
+            }
+        }
         std::vector<std::mutex>(max_elements).swap(link_list_locks_);
         std::vector<std::mutex>(MAX_LABEL_OPERATION_LOCKS).swap(label_op_locks_);
 
         visited_list_pool_.reset(new VisitedListPool(1, max_elements));
+        concurrent_visited_list_pool_.reset(new ConcurrentVisitedListPool(0, max_elements));
 
-        linkLists_ = (char **) malloc(sizeof(void *) * max_elements);
-        if (linkLists_ == nullptr)
-            throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklists");
+        link_lists_block_.allocate(sizeof(void *) * max_elements, page_mode_, numa_interleave_);
+        linkLists_ = (char **) link_lists_block_.data();
+        link_arena_.setPageMode(page_mode_, numa_interleave_);
         element_levels_ = std::vector<int>(max_elements);
         revSize_ = 1.0 / mult_;
         ef_ = 10;
+
+        // the upper layers and the extensions after them are read at once, the link lists are copied to one chunk
+        std::streampos link_lists_position = input.tellg();
+        std::vector<char> link_lists((size_t) (total_filesize - link_lists_position));
+        input.read(link_lists.data(), link_lists.size());
+        size_t link_lists_size = 0;
+        size_t position = 0;
+        for (size_t i = 0; i < cur_element_count; i++) {
+            if (position + sizeof(unsigned int) > link_lists.size())
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            unsigned int linkListSize;
+            memcpy(&linkListSize, link_lists.data() + position, sizeof(unsigned int));
+            position += sizeof(unsigned int) + linkListSize;
+            link_lists_size += (linkListSize + MemoryArena::ALIGNMENT - 1) / MemoryArena::ALIGNMENT * MemoryArena::ALIGNMENT;
+        }
+        if (position > link_lists.size())
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        link_arena_.reserve(link_lists_size);
+        position = 0;
         for (size_t i = 0; i < cur_element_count; i++) {
             label_lookup_[getExternalLabel(i)] = i;
             unsigned int linkListSize;
-            readBinaryPOD(input, linkListSize);
+            memcpy(&linkListSize, link_lists.data() + position, sizeof(unsigned int));
+            position += sizeof(unsigned int);
             if (linkListSize == 0) {
                 element_levels_[i] = 0;
                 linkLists_[i] = nullptr;
             } else {
                 element_levels_[i] = linkListSize / size_links_per_element_;
-                linkLists_[i] = (char *) malloc(linkListSize);
-                if (linkLists_[i] == nullptr)
-                    throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklist");
-                input.read(linkLists_[i], linkListSize);
+                linkLists_[i] = link_arena_.allocate(linkListSize);
+                memcpy(linkLists_[i], link_lists.data() + position, linkListSize);
+                position += linkListSize;
             }
         }
+        input.clear();
+        input.seekg(link_lists_position + (std::streamoff) position);
 
         for (size_t i = 0; i < cur_element_count; i++) {
             if (isMarkedDeleted(i)) {
@@ -819,6 +1809,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             }
         }
 
+        loadExtensions(input, total_filesize);
+
         input.close();
 
         return;
@@ -950,11 +1942,179 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    void enableAttributes() {
+        std::unique_lock <std::shared_timed_mutex> lock(attribute_lock_);
+        if (!attribute_aware_) {
+            element_attributes_.resize(max_elements_);
+            attribute_aware_ = true;
+        }
+    }
+
+
+    /*
+    * Adds the element to the filters of its attributes, the first element of an attribute becomes its entry point.
+    */
+    void registerAttributes(tableint internal_id) {
+        std::unique_lock <std::shared_timed_mutex> lock(attribute_lock_);
+        for (attributetype attribute : element_attributes_[internal_id]) {
+            auto filter = attribute_filters_.find(attribute);
+            if (filter == attribute_filters_.end()) {
+                filter = attribute_filters_.emplace(attribute, BitsetFilterFunctor(max_elements_, BitsetFilterFunctor::INTERNAL_IDS)).first;
+                attribute_entry_points_[attribute] = internal_id;
+            }
+            filter->second.set(internal_id);
+        }
+    }
+
+
+    void unregisterAttributes(tableint internal_id) {
+        std::unique_lock <std::shared_timed_mutex> lock(attribute_lock_);
+        for (attributetype attribute : element_attributes_[internal_id]) {
+            auto filter = attribute_filters_.find(attribute);
+            if (filter == attribute_filters_.end())
+                continue;
+            filter->second.reset(internal_id);
+            if (filter->second.count() == 0) {
+                attribute_filters_.erase(filter);
+                attribute_entry_points_.erase(attribute);
+            } else if (attribute_entry_points_[attribute] == internal_id) {
+                attribute_entry_points_[attribute] = filter->second.findFirst();
+            }
+        }
+    }
+
+
+    /*
+    * Replaces the attributes of an element. Not safe to call concurrently with insertions linked to this element.
+    */
+    void setElementAttributes(tableint internal_id, const std::vector<attributetype> &attributes) {
+        enableAttributes();
+        unregisterAttributes(internal_id);
+        std::vector<attributetype> sorted_attributes(attributes);
+        std::sort(sorted_attributes.begin(), sorted_attributes.end());
+        sorted_attributes.erase(std::unique(sorted_attributes.begin(), sorted_attributes.end()), sorted_attributes.end());
+        element_attributes_[internal_id] = sorted_attributes;
+        registerAttributes(internal_id);
+    }
+
+
+    std::vector<attributetype> getAttributesByLabel(labeltype label) const {
+        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+        auto search = label_lookup_.find(label);
+        if (search == label_lookup_.end() || isMarkedDeleted(search->second)) {
+            throw std::runtime_error("Label not found");
+        }
+        tableint internal_id = search->second;
+        lock_table.unlock();
+        return attribute_aware_ ? element_attributes_[internal_id] : std::vector<attributetype>();
+    }
+
+
+    void enableNamespaces() {
+        std::unique_lock <std::mutex> lock(namespace_lock_);
+        if (!namespaces_enabled_) {
+            element_namespaces_.resize(max_elements_, (namespacetype) DEFAULT_NAMESPACE);
+            namespaces_enabled_ = true;
+        }
+    }
+
+
+    inline namespacetype getElementNamespace(tableint internal_id) const {
+        return namespaces_enabled_ ? element_namespaces_[internal_id] : DEFAULT_NAMESPACE;
+    }
+
+
+    /*
+    * Returns the root of a non-default namespace, nullptr if the namespace has no elements yet.
+    * Roots never move, the pointer stays valid until the index is cleared.
+    */
+    const NamespaceRoot *findNamespaceRoot(namespacetype ns) const {
+        std::unique_lock <std::mutex> lock(namespace_lock_);
+        auto root = namespace_roots_.find(ns);
+        return root == namespace_roots_.end() ? nullptr : &root->second;
+    }
+
+
+    NamespaceRoot *getOrCreateNamespaceRoot(namespacetype ns) {
+        std::unique_lock <std::mutex> lock(namespace_lock_);
+        auto root = namespace_roots_.find(ns);
+        if (root == namespace_roots_.end()) {
+            NamespaceRoot empty_root = {(tableint) -1, -1, 0};
+            root = namespace_roots_.emplace(ns, empty_root).first;
+        }
+        return &root->second;
+    }
+
+
+    size_t getNamespaceElementCount(namespacetype ns) const {
+        if (ns == DEFAULT_NAMESPACE) {
+            size_t count = cur_element_count;
+            std::unique_lock <std::mutex> lock(namespace_lock_);
+            for (auto &root : namespace_roots_)
+                count -= root.second.element_count;
+            return count;
+        }
+        const NamespaceRoot *root = findNamespaceRoot(ns);
+        return root ? root->element_count : 0;
+    }
+
+
+    std::vector<namespacetype> getNamespaces() const {
+        std::vector<namespacetype> namespaces;
+        std::unique_lock <std::mutex> lock(namespace_lock_);
+        for (auto &root : namespace_roots_)
+            namespaces.push_back(root.first);
+        std::sort(namespaces.begin(), namespaces.end());
+        return namespaces;
+    }
+
+
+    /*
+    * Adds point to a namespace (e.g. a tenant). Every namespace is a separate graph with its own
+    * entry point: its elements are only linked to each other and searchKnnInNamespace only visits them.
+    * All namespaces share the storage, the locks and the visited list pool of the index.
+    * Labels are unique across namespaces, a label cannot be moved to another namespace by an update.
+    */
+    void addPointToNamespace(const void *data_point, labeltype label, namespacetype ns, bool replace_deleted = false) {
+        if (ns != DEFAULT_NAMESPACE)
+            enableNamespaces();
+        addPoint(data_point, label, replace_deleted, nullptr, ns);
+    }
+
+
+    /*
+    * Adds point with a set of attribute ids (e.g. tenant or category tags). Such elements are linked so that
+    * the elements sharing an attribute stay connected, which keeps searchKnnWithAttribute accurate for rare attributes.
+    * Updating an existing point replaces its attributes.
+    */
+    void addPointWithAttributes(
+        const void *data_point,
+        labeltype label,
+        const std::vector<attributetype> &attributes,
+        bool replace_deleted = false,
+        namespacetype ns = DEFAULT_NAMESPACE) {
+        enableAttributes();
+        if (ns != DEFAULT_NAMESPACE)
+            enableNamespaces();
+        addPoint(data_point, label, replace_deleted, &attributes, ns);
+    }
+
+
     /*
     * Adds point. Updates the point if it is already in the index.
     * If replacement of deleted elements is enabled: replaces previously deleted point if any, updating it with new point
     */
     void addPoint(const void *data_point, labeltype label, bool replace_deleted = false) {
+        addPoint(data_point, label, replace_deleted, nullptr);
+    }
+
+
+    void addPoint(
+        const void *data_point,
+        labeltype label,
+        bool replace_deleted,
+        const std::vector<attributetype> *attributes,
+        namespacetype ns = DEFAULT_NAMESPACE) {
         if ((allow_replace_deleted_ == false) && (replace_deleted == true)) {
             throw std::runtime_error("Replacement of deleted elements is disabled in constructor");
         }
@@ -962,15 +2122,21 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
         if (!replace_deleted) {
-            addPoint(data_point, label, -1);
+            addPoint(data_point, label, -1, attributes, ns);
             return;
         }
-        // check if there is vacant place
+        // check if there is vacant place, with namespaces only the elements of the same namespace can be replaced
         tableint internal_id_replaced;
         std::unique_lock <std::mutex> lock_deleted_elements(deleted_elements_lock);
-        bool is_vacant_place = !deleted_elements.empty();
+        bool is_vacant_place = false;
+        for (tableint deleted_id : deleted_elements) {
+            if (getElementNamespace(deleted_id) == ns) {
+                internal_id_replaced = deleted_id;
+                is_vacant_place = true;
+                break;
+            }
+        }
         if (is_vacant_place) {
-            internal_id_replaced = *deleted_elements.begin();
             deleted_elements.erase(internal_id_replaced);
         }
         lock_deleted_elements.unlock();
@@ -978,7 +2144,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // if there is no vacant place then add or update point
         // else add point to vacant place
         if (!is_vacant_place) {
-            addPoint(data_point, label, -1);
+            addPoint(data_point, label, -1, attributes, ns);
         } else {
             // we assume that there are no concurrent operations on deleted element
             labeltype label_replaced = getExternalLabel(internal_id_replaced);
@@ -990,6 +2156,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             lock_table.unlock();
 
             unmarkDeletedInternal(internal_id_replaced);
+            if (attribute_aware_)
+                setElementAttributes(internal_id_replaced, attributes ? *attributes : std::vector<attributetype>());
             updatePoint(data_point, internal_id_replaced, 1.0);
         }
     }
@@ -998,11 +2166,15 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     void updatePoint(const void *dataPoint, tableint internalId, float updateNeighborProbability) {
         // update the feature vector associated with existing point with new vector
         memcpy(getDataByInternalId(internalId), dataPoint, data_size_);
+        if (neighbor_code_size_)
+            refreshLinkingNeighborCodes(internalId);
 
-        int maxLevelCopy = maxlevel_;
-        tableint entryPointCopy = enterpoint_node_;
+        namespacetype ns = getElementNamespace(internalId);
+        const NamespaceRoot *root = ns == DEFAULT_NAMESPACE ? nullptr : findNamespaceRoot(ns);
+        int maxLevelCopy = root ? root->maxlevel : maxlevel_;
+        tableint entryPointCopy = root ? root->enterpoint_node : enterpoint_node_;
         // If point to be updated is entry point and graph just contains single element then just return.
-        if (entryPointCopy == internalId && cur_element_count == 1)
+        if (entryPointCopy == internalId && getNamespaceElementCount(ns) == 1)
             return;
 
         int elemLevel = element_levels_[internalId];
@@ -1053,7 +2225,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                 }
 
                 // Retrieve neighbours using heuristic and set connections.
-                getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_);
+                getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_, neigh);
 
                 {
                     std::unique_lock <std::mutex> lock(link_list_locks_[neigh]);
@@ -1066,6 +2238,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                         data[idx] = candidates.top().second;
                         candidates.pop();
                     }
+                    if (layer == 0 && neighbor_code_size_)
+                        refreshNeighborCodes(neigh);
                 }
             }
         }
@@ -1142,6 +2316,49 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Adds the candidates found by a filtered search from the entry point of each attribute
+    * of the new element, so that its base layer links can include elements sharing the attribute.
+    */
+    void addAttributeCandidates(
+        tableint cur_c,
+        const void *data_point,
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates) {
+        const std::vector<attributetype> &attributes = element_attributes_[cur_c];
+        if (attributes.empty())
+            return;
+
+        std::unordered_set<tableint> present;
+        std::vector<std::pair<dist_t, tableint>> merged;
+        while (!top_candidates.empty()) {
+            present.insert(top_candidates.top().second);
+            merged.push_back(top_candidates.top());
+            top_candidates.pop();
+        }
+        for (attributetype attribute : attributes) {
+            // held during the search: the filter can be erased or set by other insertions
+            std::shared_lock <std::shared_timed_mutex> lock(attribute_lock_);
+            auto filter = attribute_filters_.find(attribute);
+            if (filter == attribute_filters_.end())
+                continue;
+            tableint ep_id = attribute_entry_points_.at(attribute);
+            BitsetFilterFunctor *attribute_filter = &filter->second;
+            // the graphs of the namespaces are not linked to each other
+            if (getElementNamespace(ep_id) != getElementNamespace(cur_c))
+                continue;
+
+            auto attribute_candidates = searchBaseLayerST<false, false>(ep_id, data_point, ef_construction_, attribute_filter);
+            while (!attribute_candidates.empty()) {
+                if (present.insert(attribute_candidates.top().second).second)
+                    merged.push_back(attribute_candidates.top());
+                attribute_candidates.pop();
+            }
+        }
+        for (auto &candidate : merged)
+            top_candidates.push(candidate);
+    }
+
+
     std::vector<tableint> getConnectionsWithLock(tableint internalId, int level) {
         std::unique_lock <std::mutex> lock(link_list_locks_[internalId]);
         unsigned int *data = get_linklist_at_level(internalId, level);
@@ -1153,7 +2370,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
-    tableint addPoint(const void *data_point, labeltype label, int level) {
+    tableint addPoint(
+        const void *data_point,
+        labeltype label,
+        int level,
+        const std::vector<attributetype> *attributes = nullptr,
+        namespacetype ns = DEFAULT_NAMESPACE) {
         tableint cur_c = 0;
         {
             // Checking if the element with the same label already exists
@@ -1162,6 +2384,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             auto search = label_lookup_.find(label);
             if (search != label_lookup_.end()) {
                 tableint existingInternalId = search->second;
+                if (getElementNamespace(existingInternalId) != ns) {
+                    throw std::runtime_error("The label already exists in another namespace");
+                }
                 if (allow_replace_deleted_) {
                     if (isMarkedDeleted(existingInternalId)) {
                         throw std::runtime_error("Can't use addPoint to update deleted elements if replacement of deleted elements is enabled.");
@@ -1172,6 +2397,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                 if (isMarkedDeleted(existingInternalId)) {
                     unmarkDeletedInternal(existingInternalId);
                 }
+                if (attributes)
+                    setElementAttributes(existingInternalId, *attributes);
                 updatePoint(data_point, existingInternalId, 1.0);
 
                 return existingInternalId;
@@ -1186,6 +2413,21 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             label_lookup_[label] = cur_c;
         }
 
+        // the graph of the namespace
+        NamespaceRoot *root = nullptr;
+        if (ns != DEFAULT_NAMESPACE) {
+            if (!namespaces_enabled_)
+                enableNamespaces();
+            root = getOrCreateNamespaceRoot(ns);
+            element_namespaces_[cur_c] = ns;
+            std::unique_lock <std::mutex> lock(namespace_lock_);
+            root->element_count++;
+        } else if (namespaces_enabled_) {
+            element_namespaces_[cur_c] = DEFAULT_NAMESPACE;
+        }
+        int &maxlevel = root ? root->maxlevel : maxlevel_;
+        tableint &enterpoint_node = root ? root->enterpoint_node : enterpoint_node_;
+
         std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
         int curlevel = getRandomLevel(mult_);
         if (level > 0)
@@ -1194,23 +2436,27 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         element_levels_[cur_c] = curlevel;
 
         std::unique_lock <std::mutex> templock(global);
-        int maxlevelcopy = maxlevel_;
+        int maxlevelcopy = maxlevel;
         if (curlevel <= maxlevelcopy)
             templock.unlock();
-        tableint currObj = enterpoint_node_;
-        tableint enterpoint_copy = enterpoint_node_;
+        tableint currObj = enterpoint_node;
+        tableint enterpoint_copy = enterpoint_node;
 
-        memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+        memset(get_linklist0(cur_c), 0, size_links_level0_);
 
         // Initialisation of the data and label
         memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
         memcpy(getDataByInternalId(cur_c), data_point, data_size_);
 
+        if (attributes && !attributes->empty()) {
+            std::vector<attributetype> sorted_attributes(*attributes);
+            std::sort(sorted_attributes.begin(), sorted_attributes.end());
+            sorted_attributes.erase(std::unique(sorted_attributes.begin(), sorted_attributes.end()), sorted_attributes.end());
+            element_attributes_[cur_c] = sorted_attributes;
+        }
+
         if (curlevel) {
-            linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
-            if (linkLists_[cur_c] == nullptr)
-                throw std::runtime_error("Not enough memory: addPoint failed to allocate linklist");
-            memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+            linkLists_[cur_c] = link_arena_.allocate(size_links_per_element_ * curlevel);
         }
 
         if ((signed)currObj != -1) {
@@ -1253,99 +2499,463 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     if (top_candidates.size() > ef_construction_)
                         top_candidates.pop();
                 }
+                if (level == 0 && attribute_aware_)
+                    addAttributeCandidates(cur_c, data_point, top_candidates);
                 currObj = mutuallyConnectNewElement(data_point, cur_c, top_candidates, level, false);
             }
         } else {
             // Do nothing for the first element
-            enterpoint_node_ = 0;
-            maxlevel_ = curlevel;
+            enterpoint_node = cur_c;
+            maxlevel = curlevel;
         }
+        if (attribute_aware_ && !element_attributes_[cur_c].empty())
+            registerAttributes(cur_c);
 
         // Releasing lock for the maximum level
         if (curlevel > maxlevelcopy) {
-            enterpoint_node_ = cur_c;
-            maxlevel_ = curlevel;
+            enterpoint_node = cur_c;
+            maxlevel = curlevel;
         }
         return cur_c;
     }
 
 
-    std::priority_queue<std::pair<dist_t, labeltype >>
-    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
-        std::priority_queue<std::pair<dist_t, labeltype >> result;
-        if (cur_element_count == 0) return result;
+    /*
+    * Builds the index from num_elements vectors with the Vamana algorithm of DiskANN instead of addPoint.
+    * The elements form a single layer with up to maxM0_ links: the graph starts random and is refined by
+    * two passes over the elements in random order, first with alpha 1 then with alpha. Each element is linked
+    * to the RobustPrune of its links and of the candidates found by a search from the medoid with ef_construction_,
+    * and the reverse links that overflow are pruned the same way. An alpha above 1 keeps longer edges, which
+    * shortens the searches. The result is a regular index without upper layers, searched from the medoid,
+    * saved in the same format and open to later insertions. The index must be empty.
+    */
+    void buildVamana(const void *data, const labeltype *labels, size_t num_elements, float alpha = 1.2f,
+                     size_t num_threads = 1) {
+        if (alpha < 1)
+            throw std::runtime_error("The Vamana alpha must be at least 1");
+        storeFlatElements(data, labels, num_elements, "Vamana");
+        if (num_elements == 0)
+            return;
 
-        tableint currObj = enterpoint_node_;
-        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
+        // random initial links
+        size_t degree = std::min(maxM0_, num_elements - 1);
+        for (tableint i = 0; i < num_elements; i++) {
+            std::default_random_engine rng(100 + i);
+            linklistsizeint *ll = get_linklist0(i);
+            tableint *links = (tableint *) (ll + 1);
+            size_t size = 0;
+            while (size < degree) {
+                tableint candidate = (tableint) (rng() % num_elements);
+                if (candidate != i && std::find(links, links + size, candidate) == links + size)
+                    links[size++] = candidate;
+            }
+            setListCount(ll, size);
+        }
 
-        for (int level = maxlevel_; level > 0; level--) {
-            bool changed = true;
-            while (changed) {
-                changed = false;
-                unsigned int *data;
+        std::vector<tableint> order(num_elements);
+        for (tableint i = 0; i < num_elements; i++)
+            order[i] = i;
+        std::default_random_engine rng(100);
+        std::shuffle(order.begin(), order.end(), rng);
+        for (float pass_alpha : {1.0f, alpha}) {
+            parallelBuild(num_elements, num_threads, [&](size_t i) { linkVamana(order[i], pass_alpha); });
+        }
+        if (neighbor_code_size_) {
+            for (tableint i = 0; i < num_elements; i++)
+                refreshNeighborCodes(i);
+        }
+    }
 
-                data = (unsigned int *) get_linklist(currObj, level);
-                int size = getListCount(data);
-                metric_hops++;
-                metric_distance_computations+=size;
 
-                tableint *datal = (tableint *) (data + 1);
-                for (int i = 0; i < size; i++) {
-                    tableint cand = datal[i];
-                    if (cand < 0 || cand > max_elements_)
-                        throw std::runtime_error("cand error");
-                    dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
+    /*
+    * Builds the index from num_elements vectors and an approximate kNN graph of them instead of addPoint,
+    * e.g. the graph of NN-Descent (ann::build_nnd in cpp/include/nnd.hpp), which is several times cheaper to
+    * compute than the searches of the insertions. knn holds k neighbors per element, given as positions in
+    * data and sorted closest first. Each list is pruned by the heuristic with alpha down to maxM0_ links,
+    * then the reverse links are added and pruned the same way when they overflow, as in buildVamana.
+    * The result is a single layer searched from the medoid, saved in the same format and open to later
+    * insertions. The index must be empty.
+    */
+    void buildFromKnnGraph(const void *data, const labeltype *labels, size_t num_elements,
+                           const tableint *knn, size_t k, float alpha = 1.2f, size_t num_threads = 1) {
+        if (alpha < 1)
+            throw std::runtime_error("The pruning alpha must be at least 1");
+        for (size_t i = 0; i < num_elements * k; i++) {
+            if (knn[i] >= num_elements)
+                throw std::runtime_error("The kNN graph refers to an element out of range");
+        }
+        storeFlatElements(data, labels, num_elements, "kNN graph");
+        if (num_elements == 0)
+            return;
 
-                    if (d < curdist) {
-                        curdist = d;
-                        currObj = cand;
-                        changed = true;
-                    }
-                }
+        // the pruned lists are computed from the kNN graph only, then the reverse links are merged in
+        std::vector<tableint> pruned(num_elements * maxM0_);
+        std::vector<size_t> pruned_size(num_elements);
+        parallelBuild(num_elements, num_threads, [&](size_t i) {
+            const char *data_point = getDataByInternalId(i);
+            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+            for (size_t j = 0; j < k; j++) {
+                tableint neighbor = knn[i * k + j];
+                if (neighbor != i)
+                    candidates.emplace(fstdistfunc_(data_point, getDataByInternalId(neighbor), dist_func_param_), neighbor);
+            }
+            getNeighborsByHeuristic2(candidates, maxM0_, i, alpha);
+            size_t size = 0;
+            while (!candidates.empty()) {
+                pruned[i * maxM0_ + size++] = candidates.top().second;
+                candidates.pop();
             }
+            pruned_size[i] = size;
+            linklistsizeint *ll = get_linklist0(i);
+            setListCount(ll, size);
+            memcpy(ll + 1, &pruned[i * maxM0_], size * sizeof(tableint));
+        });
+        parallelBuild(num_elements, num_threads, [&](size_t i) {
+            for (size_t j = 0; j < pruned_size[i]; j++)
+                addReverseLink(pruned[i * maxM0_ + j], i, alpha);
+        });
+        if (neighbor_code_size_) {
+            for (tableint i = 0; i < num_elements; i++)
+                refreshNeighborCodes(i);
         }
+    }
 
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-        bool bare_bone_search = !num_deleted_ && !isIdAllowed;
-        if (bare_bone_search) {
-            top_candidates = searchBaseLayerST<true>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
-        } else {
-            top_candidates = searchBaseLayerST<false>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
+
+    // stores the elements of a bulk construction at level 0 without links, the entry point is the medoid
+    void storeFlatElements(const void *data, const labeltype *labels, size_t num_elements, const std::string &builder) {
+        if (cur_element_count != 0)
+            throw std::runtime_error("The " + builder + " construction needs an empty index");
+        if (num_elements > max_elements_)
+            throw std::runtime_error("The number of elements exceeds the specified limit");
+        if (attribute_aware_ || namespaces_enabled_)
+            throw std::runtime_error("The " + builder + " construction does not support attributes and namespaces");
+
+        const char *vectors = (const char *) data;
+        for (size_t i = 0; i < num_elements; i++) {
+            if (label_lookup_.count(labels[i])) {
+                label_lookup_.clear();
+                throw std::runtime_error("Duplicate label in the " + builder + " construction");
+            }
+            tableint id = (tableint) i;
+            label_lookup_[labels[i]] = id;
+            element_levels_[id] = 0;
+            linkLists_[id] = nullptr;
+            memset(get_linklist0(id), 0, size_links_level0_);
+            memcpy(getExternalLabeLp(id), &labels[i], sizeof(labeltype));
+            memcpy(getDataByInternalId(id), vectors + i * data_size_, data_size_);
         }
+        cur_element_count = num_elements;
+        if (num_elements == 0)
+            return;
+        enterpoint_node_ = findMedoid();
+        maxlevel_ = 0;
+    }
 
-        while (top_candidates.size() > k) {
-            top_candidates.pop();
+
+    // runs fn(i) for i in [0, num_elements) on num_threads threads, rethrows the last exception
+    template <typename Function>
+    void parallelBuild(size_t num_elements, size_t num_threads, Function fn) {
+        std::atomic<size_t> next{0};
+        std::exception_ptr last_exception = nullptr;
+        std::mutex exception_lock;
+        auto worker = [&]() {
+            try {
+                for (size_t i = next++; i < num_elements; i = next++)
+                    fn(i);
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(exception_lock);
+                last_exception = std::current_exception();
+                next = num_elements;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < num_threads; t++)
+            threads.push_back(std::thread(worker));
+        worker();
+        for (auto &thread : threads)
+            thread.join();
+        if (last_exception)
+            std::rethrow_exception(last_exception);
+    }
+
+
+    // element closest to the mean of the vectors, the first element when they are not float
+    tableint findMedoid() const {
+        if (!std::is_same<dist_t, float>::value || data_size_ % sizeof(float) != 0)
+            return 0;
+        size_t dim = data_size_ / sizeof(float);
+        std::vector<double> sum(dim, 0);
+        for (tableint i = 0; i < cur_element_count; i++) {
+            const float *v = (const float *) getDataByInternalId(i);
+            for (size_t d = 0; d < dim; d++)
+                sum[d] += v[d];
         }
-        while (top_candidates.size() > 0) {
-            std::pair<dist_t, tableint> rez = top_candidates.top();
-            result.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(rez.second)));
-            top_candidates.pop();
+        std::vector<float> mean(dim);
+        for (size_t d = 0; d < dim; d++)
+            mean[d] = (float) (sum[d] / cur_element_count);
+        tableint medoid = 0;
+        dist_t best_dist = std::numeric_limits<dist_t>::max();
+        for (tableint i = 0; i < cur_element_count; i++) {
+            dist_t d = fstdistfunc_(mean.data(), getDataByInternalId(i), dist_func_param_);
+            if (d < best_dist) {
+                best_dist = d;
+                medoid = i;
+            }
         }
-        return result;
+        return medoid;
     }
 
 
-    std::vector<std::pair<dist_t, labeltype >>
-    searchStopConditionClosest(
-        const void *query_data,
-        BaseSearchStopCondition<dist_t>& stop_condition,
-        BaseFilterFunctor* isIdAllowed = nullptr) const {
-        std::vector<std::pair<dist_t, labeltype >> result;
-        if (cur_element_count == 0) return result;
+    // one step of the Vamana construction: links the element to the pruned candidates and back
+    void linkVamana(tableint cur_c, float alpha) {
+        const void *data_point = getDataByInternalId(cur_c);
+        auto found = searchBaseLayer(enterpoint_node_, data_point, 0);
 
-        tableint currObj = enterpoint_node_;
-        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+        std::vector<tableint> candidate_ids;
+        while (!found.empty()) {
+            if (found.top().second != cur_c) {
+                candidates.push(found.top());
+                candidate_ids.push_back(found.top().second);
+            }
+            found.pop();
+        }
+        for (tableint neighbor : getConnectionsWithLock(cur_c, 0)) {
+            if (std::find(candidate_ids.begin(), candidate_ids.end(), neighbor) == candidate_ids.end())
+                candidates.emplace(fstdistfunc_(data_point, getDataByInternalId(neighbor), dist_func_param_), neighbor);
+        }
+        getNeighborsByHeuristic2(candidates, maxM0_, cur_c, alpha);
 
-        for (int level = maxlevel_; level > 0; level--) {
-            bool changed = true;
-            while (changed) {
-                changed = false;
-                unsigned int *data;
+        std::vector<tableint> neighbors;
+        while (!candidates.empty()) {
+            neighbors.push_back(candidates.top().second);
+            candidates.pop();
+        }
+        {
+            std::unique_lock<std::mutex> lock(link_list_locks_[cur_c]);
+            linklistsizeint *ll = get_linklist0(cur_c);
+            setListCount(ll, neighbors.size());
+            memcpy(ll + 1, neighbors.data(), neighbors.size() * sizeof(tableint));
+        }
 
-                data = (unsigned int *) get_linklist(currObj, level);
-                int size = getListCount(data);
+        for (tableint neighbor : neighbors)
+            addReverseLink(neighbor, cur_c, alpha);
+    }
+
+
+    // links neighbor back to cur_c, the links of neighbor are pruned with alpha when they overflow
+    void addReverseLink(tableint neighbor, tableint cur_c, float alpha) {
+        std::unique_lock<std::mutex> lock(link_list_locks_[neighbor]);
+        linklistsizeint *ll = get_linklist0(neighbor);
+        size_t size = getListCount(ll);
+        tableint *links = (tableint *) (ll + 1);
+        if (std::find(links, links + size, cur_c) != links + size)
+            return;
+        if (size < maxM0_) {
+            links[size] = cur_c;
+            setListCount(ll, size + 1);
+            return;
+        }
+        const char *neighbor_data = getDataByInternalId(neighbor);
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> reverse;
+        reverse.emplace(fstdistfunc_(getDataByInternalId(cur_c), neighbor_data, dist_func_param_), cur_c);
+        for (size_t j = 0; j < size; j++)
+            reverse.emplace(fstdistfunc_(getDataByInternalId(links[j]), neighbor_data, dist_func_param_), links[j]);
+        getNeighborsByHeuristic2(reverse, maxM0_, neighbor, alpha);
+        size = 0;
+        while (!reverse.empty()) {
+            links[size++] = reverse.top().second;
+            reverse.pop();
+        }
+        setListCount(ll, size);
+    }
+
+
+    /*
+    * Chooses where the searches start. ENTRY_MEDOID and ENTRY_ROUTER need float vectors.
+    * The medoid is the element closest to the mean of the vectors. ENTRY_DIVERSE picks num_entries
+    * elements by farthest point sampling, ENTRY_ROUTER trains num_entries k-means centroids on a sample
+    * and maps each one to its closest element. Every search compares the query with all the entries,
+    * which are stored contiguously, and descends the upper layers from the closest one, starting at its level.
+    * The entries are computed from the current elements and are not saved with the index, call again
+    * after large changes. Not thread-safe with any other operation on the index.
+    */
+    void setEntryStrategy(EntryStrategy strategy, size_t num_entries = 16) {
+        if ((strategy == ENTRY_MEDOID || strategy == ENTRY_ROUTER) &&
+            (!std::is_same<dist_t, float>::value || data_size_ % sizeof(float) != 0))
+            throw std::runtime_error("The medoid and router entries need float vectors");
+        entry_strategy_ = strategy;
+        entry_points_.clear();
+        entry_vectors_.clear();
+        if (strategy == ENTRY_HIERARCHY || cur_element_count == 0 || (signed) enterpoint_node_ == -1)
+            return;
+
+        size_t num_elements = cur_element_count;
+        num_entries = std::max(std::min(num_entries, num_elements), (size_t) 1);
+        std::vector<tableint> sample = sampleEntryCandidates();
+        if (strategy == ENTRY_MEDOID) {
+            size_t dim = data_size_ / sizeof(float);
+            std::vector<double> sum(dim, 0);
+            size_t count = 0;
+            for (tableint i = 0; i < num_elements; i++) {
+                if (isMarkedDeleted(i))
+                    continue;
+                const float *v = (const float *) getDataByInternalId(i);
+                for (size_t d = 0; d < dim; d++)
+                    sum[d] += v[d];
+                count++;
+            }
+            std::vector<float> mean(dim);
+            for (size_t d = 0; d < dim; d++)
+                mean[d] = (float) (sum[d] / std::max(count, (size_t) 1));
+            addEntryPoint(findClosestElement(mean.data()));
+        } else if (strategy == ENTRY_DIVERSE) {
+            // farthest point sampling from the entry point of the hierarchy
+            std::vector<dist_t> min_dist(sample.size(), std::numeric_limits<dist_t>::max());
+            tableint entry = enterpoint_node_;
+            for (size_t e = 0; e < num_entries; e++) {
+                addEntryPoint(entry);
+                size_t farthest = 0;
+                for (size_t i = 0; i < sample.size(); i++) {
+                    dist_t d = fstdistfunc_(getDataByInternalId(entry), getDataByInternalId(sample[i]), dist_func_param_);
+                    min_dist[i] = std::min(min_dist[i], d);
+                    if (min_dist[i] > min_dist[farthest])
+                        farthest = i;
+                }
+                if (!(min_dist[farthest] > 0))
+                    break;
+                entry = sample[farthest];
+            }
+        } else {
+            trainEntryRouter(sample, num_entries);
+        }
+    }
+
+
+    EntryStrategy getEntryStrategy() const { return entry_strategy_; }
+
+
+    // internal ids of the entries, empty for ENTRY_HIERARCHY
+    const std::vector<tableint> &getEntryPoints() const { return entry_points_; }
+
+
+    /*
+    * Chooses how the searches reach the base layer from their entry (see setEntryStrategy).
+    * NAVIGATION_FLAT replaces the upper layers by a flat graph over the level 1 elements: their vectors and
+    * level 1 links are copied to contiguous tables, the search walks it greedily from the entry without
+    * following the per-element link list pointers. The table is built from the current graph and not saved,
+    * call again after insertions. NAVIGATION_NONE starts the base layer search at the entry, which with
+    * ENTRY_ROUTER reduces the navigation to the table of centroids. Not thread-safe with any other operation.
+    */
+    void setNavigation(Navigation navigation) {
+        navigation_ = navigation;
+        nav_ids_.clear();
+        nav_vectors_.clear();
+        nav_links_.clear();
+        if (navigation == NAVIGATION_FLAT)
+            buildNavigationTable();
+    }
+
+
+    Navigation getNavigation() const { return navigation_; }
+
+
+    size_t getNavigationTableSize() const { return nav_ids_.size(); }
+
+
+    // bytes of the flat navigation tables
+    size_t getNavigationMemory() const {
+        return nav_ids_.size() * sizeof(tableint) + nav_vectors_.size() + nav_links_.size() * sizeof(tableint);
+    }
+
+
+    // bytes of the upper layer link lists, which the flat navigation does not read
+    size_t getUpperLayersMemory() const { return link_arena_.allocated(); }
+
+
+    /*
+    * Greedy search through the upper layers, returns the entry point for the base layer.
+    */
+    tableint searchUpperLayers(const void *query_data) const {
+        if (entry_points_.empty() && navigation_ == NAVIGATION_HIERARCHY)
+            return searchUpperLayers(query_data, enterpoint_node_, maxlevel_);
+        tableint entry = entry_points_.empty() ? enterpoint_node_ : selectEntryPoint(query_data);
+        if (navigation_ == NAVIGATION_FLAT)
+            return searchNavigationTable(query_data, entry);
+        if (navigation_ == NAVIGATION_NONE)
+            return entry;
+        return searchUpperLayers(query_data, entry, element_levels_[entry]);
+    }
+
+
+    // greedy search of the flat navigation graph, from the entry when it is in the table
+    tableint searchNavigationTable(const void *query_data, tableint entry) const {
+        auto it = std::lower_bound(nav_ids_.begin(), nav_ids_.end(), entry);
+        if (it == nav_ids_.end() || *it != entry)
+            return entry;
+        size_t current = it - nav_ids_.begin();
+        size_t stride = maxM_ + 1;
+        dist_t current_dist = fstdistfunc_(query_data, &nav_vectors_[current * data_size_], dist_func_param_);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const tableint *links = &nav_links_[current * stride];
+            size_t size = links[0];
+            metric_hops++;
+            metric_distance_computations += size;
+#ifdef USE_SSE
+            if (size > 0)
+                _mm_prefetch(&nav_vectors_[links[1] * data_size_], _MM_HINT_T0);
+#endif
+            for (size_t i = 1; i <= size; i++) {
+#ifdef USE_SSE
+                if (i < size)
+                    _mm_prefetch(&nav_vectors_[links[i + 1] * data_size_], _MM_HINT_T0);
+#endif
+                dist_t d = fstdistfunc_(query_data, &nav_vectors_[links[i] * data_size_], dist_func_param_);
+                if (d < current_dist) {
+                    current_dist = d;
+                    current = links[i];
+                    changed = true;
+                }
+            }
+        }
+        return nav_ids_[current];
+    }
+
+
+    // the closest entry to the query, one pass over the contiguous entry vectors
+    tableint selectEntryPoint(const void *query_data) const {
+        const char *vectors = entry_vectors_.data();
+        size_t best = 0;
+        dist_t best_dist = std::numeric_limits<dist_t>::max();
+        for (size_t i = 0; i < entry_points_.size(); i++) {
+#ifdef USE_SSE
+            _mm_prefetch(vectors + (i + 1) * data_size_, _MM_HINT_T0);
+#endif
+            dist_t d = fstdistfunc_(query_data, vectors + i * data_size_, dist_func_param_);
+            if (d < best_dist) {
+                best_dist = d;
+                best = i;
+            }
+        }
+        metric_distance_computations += entry_points_.size();
+        return entry_points_[best];
+    }
+
+
+    tableint searchUpperLayers(const void *query_data, tableint enterpoint_node, int maxlevel) const {
+        tableint currObj = enterpoint_node;
+        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node), dist_func_param_);
+
+        for (int level = maxlevel; level > 0; level--) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                unsigned int *data;
+
+                data = (unsigned int *) get_linklist(currObj, level);
+                int size = getListCount(data);
                 metric_hops++;
                 metric_distance_computations+=size;
 
@@ -1364,6 +2974,637 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                 }
             }
         }
+        return currObj;
+    }
+
+
+    // packs the level 1 elements, in id order, with their vectors and level 1 links
+    void buildNavigationTable() {
+        nav_ids_.clear();
+        for (tableint i = 0; i < cur_element_count; i++) {
+            if (element_levels_[i] > 0)
+                nav_ids_.push_back(i);
+        }
+        size_t stride = maxM_ + 1;
+        nav_vectors_.resize(nav_ids_.size() * data_size_);
+        nav_links_.assign(nav_ids_.size() * stride, 0);
+        for (size_t i = 0; i < nav_ids_.size(); i++) {
+            memcpy(&nav_vectors_[i * data_size_], getDataByInternalId(nav_ids_[i]), data_size_);
+            linklistsizeint *ll = get_linklist(nav_ids_[i], 1);
+            size_t size = getListCount(ll);
+            tableint *links = (tableint *) (ll + 1);
+            tableint *nav_links = &nav_links_[i * stride];
+            for (size_t j = 0; j < size; j++) {
+                // the level 1 neighbors have a level of at least 1
+                auto it = std::lower_bound(nav_ids_.begin(), nav_ids_.end(), links[j]);
+                if (it == nav_ids_.end() || *it != links[j])
+                    throw std::runtime_error("Level 1 link to an element of level 0");
+                nav_links[++nav_links[0]] = (tableint) (it - nav_ids_.begin());
+            }
+        }
+    }
+
+
+    void addEntryPoint(tableint internal_id, const char *vector = nullptr) {
+        if (vector == nullptr)
+            vector = getDataByInternalId(internal_id);
+        entry_points_.push_back(internal_id);
+        entry_vectors_.insert(entry_vectors_.end(), vector, vector + data_size_);
+    }
+
+
+    // non-deleted elements, a random subset of ENTRY_SAMPLE_SIZE of them for large indexes
+    std::vector<tableint> sampleEntryCandidates() const {
+        std::vector<tableint> sample;
+        for (tableint i = 0; i < cur_element_count; i++) {
+            if (!isMarkedDeleted(i))
+                sample.push_back(i);
+        }
+        if (sample.size() > ENTRY_SAMPLE_SIZE) {
+            std::default_random_engine rng(100);
+            std::shuffle(sample.begin(), sample.end(), rng);
+            sample.resize((size_t) ENTRY_SAMPLE_SIZE);
+        }
+        if (sample.empty())
+            sample.push_back(enterpoint_node_);
+        return sample;
+    }
+
+
+    // closest element to a vector found with a search of the hierarchy, deleted elements included if nothing else
+    tableint findClosestElement(const void *vector) const {
+        tableint ep = searchUpperLayers(vector, enterpoint_node_, maxlevel_);
+        auto candidates = searchBaseLayerST<false>(ep, vector, std::max(ef_construction_, (size_t) 1), nullptr);
+        while (candidates.size() > 1)
+            candidates.pop();
+        return candidates.empty() ? ep : candidates.top().second;
+    }
+
+
+    // k-means over the sample, the centroids start at sampled elements
+    void trainEntryRouter(const std::vector<tableint> &sample, size_t num_centroids) {
+        size_t dim = data_size_ / sizeof(float);
+        num_centroids = std::min(num_centroids, sample.size());
+        std::vector<tableint> seeds(sample);
+        std::default_random_engine rng(100);
+        std::shuffle(seeds.begin(), seeds.end(), rng);
+        std::vector<float> centroids(num_centroids * dim);
+        for (size_t c = 0; c < num_centroids; c++)
+            memcpy(&centroids[c * dim], getDataByInternalId(seeds[c]), data_size_);
+
+        std::vector<size_t> assignment(sample.size());
+        std::vector<float> sums(num_centroids * dim);
+        std::vector<size_t> counts(num_centroids);
+        for (size_t iteration = 0; iteration < (size_t) ENTRY_ROUTER_ITERATIONS; iteration++) {
+            for (size_t i = 0; i < sample.size(); i++) {
+                const char *v = getDataByInternalId(sample[i]);
+                dist_t best_dist = std::numeric_limits<dist_t>::max();
+                for (size_t c = 0; c < num_centroids; c++) {
+                    dist_t d = fstdistfunc_(v, &centroids[c * dim], dist_func_param_);
+                    if (d < best_dist) {
+                        best_dist = d;
+                        assignment[i] = c;
+                    }
+                }
+            }
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < sample.size(); i++) {
+                const float *v = (const float *) getDataByInternalId(sample[i]);
+                float *sum = &sums[assignment[i] * dim];
+                for (size_t d = 0; d < dim; d++)
+                    sum[d] += v[d];
+                counts[assignment[i]]++;
+            }
+            // an empty cluster keeps its centroid
+            for (size_t c = 0; c < num_centroids; c++) {
+                if (counts[c] == 0)
+                    continue;
+                for (size_t d = 0; d < dim; d++)
+                    centroids[c * dim + d] = sums[c * dim + d] / counts[c];
+            }
+        }
+        for (size_t c = 0; c < num_centroids; c++)
+            addEntryPoint(findClosestElement(&centroids[c * dim]), (const char *) &centroids[c * dim]);
+    }
+
+
+    /*
+    * Chooses the search strategy from the selectivity of a bitset filter.
+    * The cost of the graph search is estimated as ef * maxM0_ / selectivity distance computations,
+    * the cost of the scan is the number of allowed elements.
+    */
+    FilteredSearchPlan planFilteredSearch(const BitsetFilterFunctor &bitset, size_t ef) const {
+        size_t num_elements = cur_element_count;
+        if (num_elements == 0)
+            return PLAN_GRAPH;
+        double allowed = (double) std::min(bitset.count(), num_elements);
+        double selectivity = allowed / num_elements;
+        if (allowed * allowed <= filter_brute_force_factor_ * ef * maxM0_ * num_elements)
+            return PLAN_BRUTE_FORCE;
+        if (selectivity < filter_two_hop_selectivity_)
+            return PLAN_TWO_HOP;
+        if (selectivity < filter_expand_ef_selectivity_)
+            return PLAN_EXPANDED_EF;
+        return PLAN_GRAPH;
+    }
+
+
+    /*
+    * Calls fn(internal_id) for the live elements of namespace ns allowed by the bitset until fn returns false,
+    * iterating over the set bits only. The labels of a LABEL_IDS bitset are resolved in batches
+    * of FILTER_LOOKUP_BATCH under label_lookup_lock, fn runs without the lock.
+    */
+    template<typename Fn>
+    void forEachAllowedElement(const BitsetFilterFunctor &bitset, namespacetype ns, Fn fn) const {
+        size_t num_words = (bitset.size() + 63) / 64;
+        const uint64_t *words = bitset.words();
+        std::vector<tableint> batch;
+        batch.reserve(FILTER_LOOKUP_BATCH);
+        size_t w = 0;
+        uint64_t word = num_words ? words[0] : 0;
+        while (w < num_words) {
+            batch.clear();
+            std::unique_lock <std::mutex> lock_table(label_lookup_lock, std::defer_lock);
+            if (!bitset.isInternal())
+                lock_table.lock();
+            while (batch.size() < FILTER_LOOKUP_BATCH) {
+                if (!word) {
+                    if (++w == num_words)
+                        break;
+                    word = words[w];
+                    continue;
+                }
+                size_t id = w * 64 + countTrailingZeros(word);
+                word &= word - 1;
+                if (bitset.isInternal()) {
+                    if (id < cur_element_count)
+                        batch.push_back(id);
+                } else {
+                    auto search = label_lookup_.find(id);
+                    if (search != label_lookup_.end())
+                        batch.push_back(search->second);
+                }
+            }
+            if (lock_table.owns_lock())
+                lock_table.unlock();
+
+            for (tableint internal_id : batch) {
+                if (isMarkedDeleted(internal_id) || getElementNamespace(internal_id) != ns)
+                    continue;
+                if (!fn(internal_id))
+                    return;
+            }
+        }
+    }
+
+
+    // true if the bitset allows more than num live elements of namespace ns
+    bool allowsMoreElements(const BitsetFilterFunctor &bitset, size_t num, namespacetype ns) const {
+        if (bitset.count() <= num)
+            return false;
+        size_t num_allowed = 0;
+        forEachAllowedElement(bitset, ns, [&](tableint) {
+            return ++num_allowed <= num;
+        });
+        return num_allowed > num;
+    }
+
+
+    /*
+    * Exact search over the elements of namespace ns allowed by the bitset, see forEachAllowedElement.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBruteForceFiltered(const void *query_data, size_t k, const BitsetFilterFunctor &bitset, namespacetype ns) const {
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        long num_computations = 0;
+        forEachAllowedElement(bitset, ns, [&](tableint internal_id) {
+            dist_t dist = fstdistfunc_(query_data, getDataByInternalId(internal_id), dist_func_param_);
+            num_computations++;
+            if (top_candidates.size() < k || dist < top_candidates.top().first) {
+                top_candidates.emplace(dist, internal_id);
+                if (top_candidates.size() > k)
+                    top_candidates.pop();
+            }
+            return true;
+        });
+        metric_base_distance_computations += num_computations;
+        return top_candidates;
+    }
+
+
+    /*
+    * Graph search restricted to the allowed elements (ACORN-style predicate subgraph traversal):
+    * the neighborhood of a node is its allowed neighbors plus the allowed neighbors of its
+    * filtered-out neighbors. Filtered-out neighbors are only traversed while fewer than ef
+    * allowed elements are found, so the predicate subgraph does not have to be connected.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerTwoHop(tableint ep_id, const void *data_point, size_t ef, const BitsetFilterFunctor &bitset) const {
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+
+        dist_t ep_dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
+        dist_t lowerBound = std::numeric_limits<dist_t>::max();
+        if (!isMarkedDeleted(ep_id) && isAllowedInternal(ep_id, nullptr, &bitset)) {
+            top_candidates.emplace(ep_dist, ep_id);
+            lowerBound = ep_dist;
+        }
+        candidate_set.emplace(-ep_dist, ep_id);
+        visited_array[ep_id] = visited_array_tag;
+
+        std::vector<tableint> neighborhood;
+        std::vector<tableint> navigation;
+        neighborhood.reserve(maxM0_ * maxM0_);
+        navigation.reserve(maxM0_);
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            if ((-current_node_pair.first) > lowerBound && top_candidates.size() == ef) {
+                break;
+            }
+            candidate_set.pop();
+
+            // collect allowed 1-hop and 2-hop neighbors
+            neighborhood.clear();
+            navigation.clear();
+            linklistsizeint *data = get_linklist0(current_node_pair.second);
+            size_t size = getListCount(data);
+            tableint *datal = (tableint *) (data + 1);
+            for (size_t j = 0; j < size; j++) {
+                tableint candidate_id = datal[j];
+                if (visited_array[candidate_id] == visited_array_tag) continue;
+                visited_array[candidate_id] = visited_array_tag;
+                if (isAllowedInternal(candidate_id, nullptr, &bitset)) {
+                    neighborhood.push_back(candidate_id);
+                    continue;
+                }
+                if (top_candidates.size() < ef)
+                    navigation.push_back(candidate_id);
+                linklistsizeint *data2 = get_linklist0(candidate_id);
+                size_t size2 = getListCount(data2);
+                tableint *datal2 = (tableint *) (data2 + 1);
+                for (size_t l = 0; l < size2; l++) {
+                    tableint candidate_id2 = datal2[l];
+                    if (visited_array[candidate_id2] == visited_array_tag) continue;
+                    if (!isAllowedInternal(candidate_id2, nullptr, &bitset)) continue;
+                    visited_array[candidate_id2] = visited_array_tag;
+                    neighborhood.push_back(candidate_id2);
+                }
+            }
+            metric_base_hops++;
+            metric_base_distance_computations += neighborhood.size() + navigation.size();
+
+            for (size_t j = 0; j < navigation.size(); j++) {
+                tableint candidate_id = navigation[j];
+                dist_t dist = fstdistfunc_(data_point, getDataByInternalId(candidate_id), dist_func_param_);
+                candidate_set.emplace(-dist, candidate_id);
+            }
+            for (size_t j = 0; j < neighborhood.size(); j++) {
+                tableint candidate_id = neighborhood[j];
+#ifdef USE_SSE
+                if (j + 1 < neighborhood.size())
+                    _mm_prefetch(getDataByInternalId(neighborhood[j + 1]), _MM_HINT_T0);
+#endif
+                dist_t dist = fstdistfunc_(data_point, getDataByInternalId(candidate_id), dist_func_param_);
+                if (top_candidates.size() < ef || lowerBound > dist) {
+                    candidate_set.emplace(-dist, candidate_id);
+                    if (!isMarkedDeleted(candidate_id))
+                        top_candidates.emplace(dist, candidate_id);
+                    if (top_candidates.size() > ef)
+                        top_candidates.pop();
+                    if (!top_candidates.empty())
+                        lowerBound = top_candidates.top().first;
+                }
+            }
+        }
+
+        visited_list_pool_->releaseVisitedList(vl);
+        return top_candidates;
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        return searchKnn(query_data, k, isIdAllowed, nullptr);
+    }
+
+
+    /*
+    * Same as searchKnn, additionally reports the plan that produced the result.
+    * Bitset filters go through the filtered search planner, other filters always use the graph search.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, FilteredSearchPlan *plan) const {
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        // the default graph is empty when all the elements are in other namespaces
+        if (cur_element_count == 0 || (signed) enterpoint_node_ == -1) return result;
+
+        auto top_candidates = searchKnnInternal(query_data, k, isIdAllowed, -1, plan);
+        return getLabeledResult(top_candidates, k);
+    }
+
+
+    /*
+    * Searches the graph of a namespace, only the elements of the namespace are visited.
+    * The filtered search planner is not used here, filters are checked during the graph search.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnInNamespace(const void *query_data, size_t k, namespacetype ns, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        if (ns == DEFAULT_NAMESPACE)
+            return searchKnn(query_data, k, isIdAllowed);
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        const NamespaceRoot *root = findNamespaceRoot(ns);
+        if (!root || (signed) root->enterpoint_node == -1) return result;
+
+        tableint currObj = searchUpperLayers(query_data, root->enterpoint_node, root->maxlevel);
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        bool bare_bone_search = !num_deleted_ && !isIdAllowed;
+        if (bare_bone_search) {
+            top_candidates = searchBaseLayerST<true>(currObj, query_data, std::max(ef_, k), isIdAllowed);
+        } else {
+            top_candidates = searchBaseLayerST<false>(currObj, query_data, std::max(ef_, k), isIdAllowed);
+        }
+        return getLabeledResult(top_candidates, k);
+    }
+
+
+    /*
+    * Base layer search expanded by num_threads threads at once (intra-query parallelism): the calling thread
+    * and num_threads - 1 tasks of search_thread_pool_. The threads take up to PARALLEL_EXPAND_BATCH of the
+    * closest candidates from a shared frontier, mark the neighbors in a concurrent visited list, compute the
+    * distances without holding the lock and merge their batch into the shared results in one go.
+    * The search stops when no thread is expanding and the frontier cannot improve the results.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerParallel(
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        size_t num_threads,
+        BaseFilterFunctor* isIdAllowed = nullptr) const {
+        ConcurrentVisitedList *vl = concurrent_visited_list_pool_->getFreeVisitedList();
+        const BitsetFilterFunctor *bitset = asBitsetFilter(isIdAllowed);
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+        // guards top_candidates, candidate_set, lowerBound, num_busy, num_waiting, num_tasks and stop_search
+        std::mutex frontier_lock;
+        std::condition_variable frontier_cv;
+        size_t num_busy = 0;
+        size_t num_waiting = 0;
+        size_t num_tasks = num_threads - 1;  // pool tasks not finished yet
+        bool stop_search = false;
+        std::exception_ptr last_exception = nullptr;
+
+        dist_t lowerBound = std::numeric_limits<dist_t>::max();
+        dist_t ep_dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
+        if (!isMarkedDeleted(ep_id) && isAllowedInternal(ep_id, isIdAllowed, bitset)) {
+            top_candidates.emplace(ep_dist, ep_id);
+            lowerBound = ep_dist;
+        }
+        candidate_set.emplace(-ep_dist, ep_id);
+        vl->visit(ep_id);
+
+        auto worker = [&]() {
+            std::vector<tableint> expanded;
+            std::vector<std::pair<dist_t, tableint>> batch;
+            long num_hops = 0;
+            long num_computations = 0;
+            try {
+                std::unique_lock<std::mutex> lock(frontier_lock);
+                while (!stop_search) {
+                    expanded.clear();
+                    while (expanded.size() < PARALLEL_EXPAND_BATCH && !candidate_set.empty() &&
+                           (top_candidates.size() < ef || -candidate_set.top().first <= lowerBound)) {
+                        expanded.push_back(candidate_set.top().second);
+                        candidate_set.pop();
+                    }
+                    if (expanded.empty()) {
+                        if (num_busy == 0)
+                            break;
+                        // the threads still expanding can add closer candidates
+                        num_waiting++;
+                        frontier_cv.wait(lock);
+                        num_waiting--;
+                        continue;
+                    }
+                    bool results_full = top_candidates.size() >= ef;
+                    dist_t bound = lowerBound;
+                    num_busy++;
+                    lock.unlock();
+
+                    batch.clear();
+                    for (tableint current_node_id : expanded) {
+                        linklistsizeint *data = get_linklist0(current_node_id);
+                        size_t size = getListCount(data);
+                        tableint *datal = (tableint *) (data + 1);
+                        num_hops++;
+                        num_computations += size;
+#ifdef USE_SSE
+                        _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
+#endif
+                        for (size_t j = 0; j < size; j++) {
+                            tableint candidate_id = datal[j];
+#ifdef USE_SSE
+                            _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
+#endif
+                            if (!vl->visit(candidate_id))
+                                continue;
+                            dist_t dist = fstdistfunc_(data_point, getDataByInternalId(candidate_id), dist_func_param_);
+                            if (!results_full || dist < bound)
+                                batch.emplace_back(dist, candidate_id);
+                        }
+                    }
+
+                    lock.lock();
+                    for (auto &candidate : batch) {
+                        if (top_candidates.size() < ef || candidate.first < lowerBound) {
+                            candidate_set.emplace(-candidate.first, candidate.second);
+                            if (!isMarkedDeleted(candidate.second) && isAllowedInternal(candidate.second, isIdAllowed, bitset)) {
+                                top_candidates.emplace(candidate);
+                                if (top_candidates.size() > ef)
+                                    top_candidates.pop();
+                                lowerBound = top_candidates.top().first;
+                            }
+                        }
+                    }
+                    num_busy--;
+                    if (num_waiting)
+                        frontier_cv.notify_all();
+                }
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(frontier_lock);
+                last_exception = std::current_exception();
+                stop_search = true;
+            }
+            frontier_cv.notify_all();
+            metric_base_hops += num_hops;
+            metric_base_distance_computations += num_computations;
+        };
+
+        search_thread_pool_.reserve(num_threads - 1);
+        for (size_t i = 1; i < num_threads; i++) {
+            search_thread_pool_.submit([&]() {
+                worker();
+                std::unique_lock<std::mutex> lock(frontier_lock);
+                num_tasks--;
+                frontier_cv.notify_all();
+            });
+        }
+        worker();
+        {
+            // the tasks that start after the search ended return at once
+            std::unique_lock<std::mutex> lock(frontier_lock);
+            frontier_cv.wait(lock, [&] { return num_tasks == 0; });
+        }
+
+        concurrent_visited_list_pool_->releaseVisitedList(vl);
+        if (last_exception)
+            std::rethrow_exception(last_exception);
+        return top_candidates;
+    }
+
+
+    /*
+    * searchKnn with the base layer expanded by num_threads threads, for single queries with a large ef.
+    * num_threads <= 1 runs the regular searchKnn. The filtered search planner is not used,
+    * bitset filters fall back to the exact scan when the graph does not reach k allowed elements.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnParallel(const void *query_data, size_t k, size_t num_threads, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        if (num_threads <= 1)
+            return searchKnn(query_data, k, isIdAllowed);
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        if (cur_element_count == 0 || (signed) enterpoint_node_ == -1) return result;
+
+        tableint currObj = searchUpperLayers(query_data);
+        auto top_candidates = searchBaseLayerParallel(currObj, query_data, std::max(ef_, k), num_threads, isIdAllowed);
+        const BitsetFilterFunctor *bitset = asBitsetFilter(isIdAllowed);
+        if (bitset && top_candidates.size() < k && allowsMoreElements(*bitset, top_candidates.size(), DEFAULT_NAMESPACE))
+            top_candidates = searchBruteForceFiltered(query_data, k, *bitset, DEFAULT_NAMESPACE);
+        return getLabeledResult(top_candidates, k);
+    }
+
+
+    /*
+    * Searches among the elements that have the attribute, starting from the entry point of the attribute.
+    * Returns an empty result for an unknown attribute.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnWithAttribute(const void *query_data, size_t k, attributetype attribute, FilteredSearchPlan *plan = nullptr) const {
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        // held during the search: the filter can be erased or set by insertions and setElementAttributes
+        std::shared_lock <std::shared_timed_mutex> lock(attribute_lock_);
+        auto filter = attribute_filters_.find(attribute);
+        if (filter == attribute_filters_.end())
+            return result;
+        tableint ep_id = attribute_entry_points_.at(attribute);
+        // the bitset is tested inline, its non-const operator() is never called
+        BaseFilterFunctor *attribute_filter = const_cast<BitsetFilterFunctor *>(&filter->second);
+
+        auto top_candidates = searchKnnInternal(query_data, k, attribute_filter, ep_id, plan);
+        return getLabeledResult(top_candidates, k);
+    }
+
+
+    // base layer search of searchKnn with the early termination and the neighbor codes that are enabled
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerKnn(tableint ep_id, const void *query_data, size_t ef, size_t k, BaseFilterFunctor* isIdAllowed) const {
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        if (early_termination_patience_ || early_termination_distance_ratio_ > 0) {
+            PatienceSearchStopCondition<dist_t> stop_condition(
+                    k, ef, early_termination_patience_, early_termination_distance_ratio_);
+            if (neighbor_code_size_)
+                top_candidates = searchBaseLayerCodes(ep_id, query_data, ef, k, isIdAllowed, &stop_condition);
+            else
+                top_candidates = searchBaseLayerST<false, true, PatienceSearchStopCondition<dist_t>>(
+                        ep_id, query_data, ef, isIdAllowed, &stop_condition);
+            if (stop_condition.stoppedEarly())
+                metric_early_terminations++;
+        } else if (neighbor_code_size_) {
+            top_candidates = searchBaseLayerCodes(ep_id, query_data, ef, k, isIdAllowed);
+        } else if (!num_deleted_ && !isIdAllowed) {
+            top_candidates = searchBaseLayerST<true>(ep_id, query_data, ef, isIdAllowed);
+        } else {
+            top_candidates = searchBaseLayerST<false>(ep_id, query_data, ef, isIdAllowed);
+        }
+        return top_candidates;
+    }
+
+
+    /*
+    * Planned search returning internal ids. ep_id of -1 means descending from the enterpoint_node_
+    * through the upper layers, otherwise the base layer search starts from ep_id.
+    * Only the elements of the namespace of the start are returned, as the graph search only reaches them.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchKnnInternal(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, tableint ep_id, FilteredSearchPlan *plan) const {
+        size_t ef = std::max(ef_, k);
+        const BitsetFilterFunctor *bitset = asBitsetFilter(isIdAllowed);
+        FilteredSearchPlan search_plan = bitset ? planFilteredSearch(*bitset, ef) : PLAN_GRAPH;
+        namespacetype ns = (signed) ep_id == -1 ? DEFAULT_NAMESPACE : getElementNamespace(ep_id);
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        if (search_plan == PLAN_BRUTE_FORCE) {
+            top_candidates = searchBruteForceFiltered(query_data, k, *bitset, ns);
+        } else {
+            tableint currObj = (signed) ep_id == -1 ? searchUpperLayers(query_data) : ep_id;
+
+            if (search_plan == PLAN_TWO_HOP) {
+                top_candidates = searchBaseLayerTwoHop(currObj, query_data, ef, *bitset);
+            } else {
+                top_candidates = searchBaseLayerKnn(currObj, query_data, ef, k, isIdAllowed);
+                if (search_plan == PLAN_EXPANDED_EF) {
+                    while (top_candidates.size() < k && ef < bitset->count()) {
+                        ef *= 2;
+                        top_candidates = searchBaseLayerKnn(currObj, query_data, ef, k, isIdAllowed);
+                    }
+                }
+            }
+
+            // the graph did not reach enough allowed elements, deleted and unknown labels of the bitset do not count
+            if (bitset && top_candidates.size() < k && allowsMoreElements(*bitset, top_candidates.size(), ns)) {
+                search_plan = PLAN_BRUTE_FORCE;
+                top_candidates = searchBruteForceFiltered(query_data, k, *bitset, ns);
+            }
+        }
+        if (bitset)
+            metric_filtered_search_plans[search_plan]++;
+        if (plan)
+            *plan = search_plan;
+        return top_candidates;
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype >> getLabeledResult(
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates,
+        size_t k) const {
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        while (top_candidates.size() > k) {
+            top_candidates.pop();
+        }
+        while (top_candidates.size() > 0) {
+            std::pair<dist_t, tableint> rez = top_candidates.top();
+            result.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(rez.second)));
+            top_candidates.pop();
+        }
+        return result;
+    }
+
+
+    std::vector<std::pair<dist_t, labeltype >>
+    searchStopConditionClosest(
+        const void *query_data,
+        BaseSearchStopCondition<dist_t>& stop_condition,
+        BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<dist_t, labeltype >> result;
+        if (cur_element_count == 0 || (signed) enterpoint_node_ == -1) return result;
+
+        tableint currObj = searchUpperLayers(query_data);
 
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
         top_candidates = searchBaseLayerST<false>(currObj, query_data, 0, isIdAllowed, &stop_condition);
@@ -1381,6 +3622,356 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Returns the elements within radius of the query (closer first, at most max_results, 0 means no limit).
+    * The radius is in the units of the space distance (squared distance for L2Space).
+    * The base layer beam starts at ef_ and doubles while its farthest element is still within radius,
+    * the search stops once the closest unexpanded candidate is outside both the beam and the radius.
+    */
+    std::vector<std::pair<dist_t, labeltype >>
+    searchRange(const void *query_data, dist_t radius, size_t max_results = 0, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<dist_t, labeltype >> result;
+        if (cur_element_count == 0 || (signed) enterpoint_node_ == -1) return result;
+        if (max_results == 0)
+            max_results = std::numeric_limits<size_t>::max();
+
+        tableint ep_id = searchUpperLayers(query_data);
+        const BitsetFilterFunctor *bitset = asBitsetFilter(isIdAllowed);
+
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> beam;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+        std::vector<std::pair<dist_t, tableint>> in_range;
+        size_t ef = std::max(ef_, (size_t) 1);
+
+        dist_t ep_dist = fstdistfunc_(query_data, getDataByInternalId(ep_id), dist_func_param_);
+        beam.emplace(ep_dist, ep_id);
+        candidate_set.emplace(-ep_dist, ep_id);
+        visited_array[ep_id] = visited_array_tag;
+        if (ep_dist <= radius && !isMarkedDeleted(ep_id) && isAllowedInternal(ep_id, isIdAllowed, bitset))
+            in_range.emplace_back(ep_dist, ep_id);
+        dist_t lowerBound = ep_dist;
+
+        long num_hops = 0;
+        long num_computations = 0;
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            if (-current_node_pair.first > lowerBound && beam.size() >= ef)
+                break;
+            candidate_set.pop();
+
+            linklistsizeint *data = get_linklist0(current_node_pair.second);
+            size_t size = getListCount(data);
+            tableint *datal = (tableint *) (data + 1);
+            num_hops++;
+            num_computations += size;
+#ifdef USE_SSE
+            _mm_prefetch((char *) (visited_array + *datal), _MM_HINT_T0);
+            _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
+#endif
+            for (size_t j = 0; j < size; j++) {
+                tableint candidate_id = datal[j];
+#ifdef USE_SSE
+                _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
+                _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
+#endif
+                if (visited_array[candidate_id] == visited_array_tag) continue;
+                visited_array[candidate_id] = visited_array_tag;
+
+                dist_t dist = fstdistfunc_(query_data, getDataByInternalId(candidate_id), dist_func_param_);
+                if (dist <= radius && !isMarkedDeleted(candidate_id) && isAllowedInternal(candidate_id, isIdAllowed, bitset))
+                    in_range.emplace_back(dist, candidate_id);
+
+                if (beam.size() < ef || dist < lowerBound) {
+                    candidate_set.emplace(-dist, candidate_id);
+                    beam.emplace(dist, candidate_id);
+                    if (beam.size() > ef) {
+                        // the whole beam is inside the radius: grow it instead of dropping an element in range
+                        if (beam.top().first <= radius && in_range.size() < max_results)
+                            ef *= 2;
+                        else
+                            beam.pop();
+                    }
+                    lowerBound = beam.top().first;
+                }
+            }
+        }
+        visited_list_pool_->releaseVisitedList(vl);
+        metric_base_hops += num_hops;
+        metric_base_distance_computations += num_computations;
+
+        std::sort(in_range.begin(), in_range.end(), [](const std::pair<dist_t, tableint> &a, const std::pair<dist_t, tableint> &b) {
+            return a.first < b.first;
+        });
+        if (in_range.size() > max_results)
+            in_range.resize(max_results);
+        result.reserve(in_range.size());
+        for (auto &element : in_range)
+            result.emplace_back(element.first, getExternalLabel(element.second));
+        return result;
+    }
+
+
+    /*
+    * Renumbers the internal ids so that elements linked in the base layer get close ids,
+    * which makes the hops of the search touch fewer cache lines and pages of data_level0_memory_.
+    * The graph, the labels, the deletion marks, the attributes and the namespaces are kept, only the ids change.
+    * Not thread-safe with any other operation on the index.
+    */
+    void reorderIndex(ReorderStrategy strategy = REORDER_BFS) {
+        if (cur_element_count < 2)
+            return;
+        std::vector<tableint> order = computeReorderPermutation(strategy);
+        applyReorderPermutation(order);
+    }
+
+
+    /*
+    * Returns the new order of the elements: order[i] is the current internal id of the element
+    * that gets the internal id i.
+    */
+    std::vector<tableint> computeReorderPermutation(ReorderStrategy strategy) const {
+        size_t n = cur_element_count;
+        std::vector<tableint> order;
+        order.reserve(n);
+        std::vector<bool> placed(n, false);
+
+        // roots of the traversals: the entry points of the graphs, then the unreached elements
+        std::vector<tableint> roots;
+        if ((signed) enterpoint_node_ != -1)
+            roots.push_back(enterpoint_node_);
+        for (auto &root : namespace_roots_) {
+            if ((signed) root.second.enterpoint_node != -1)
+                roots.push_back(root.second.enterpoint_node);
+        }
+
+        if (strategy == REORDER_BFS || strategy == REORDER_RCM) {
+            std::vector<unsigned short int> degree(n);
+            for (tableint i = 0; i < n; i++)
+                degree[i] = getListCount(get_linklist0(i));
+            if (strategy == REORDER_RCM) {
+                // Cuthill-McKee starts from low degree elements
+                roots.clear();
+                for (tableint i = 0; i < n; i++)
+                    roots.push_back(i);
+                std::stable_sort(roots.begin(), roots.end(), [&degree](tableint a, tableint b) {
+                    return degree[a] < degree[b];
+                });
+            } else {
+                for (tableint i = 0; i < n; i++)
+                    roots.push_back(i);
+            }
+
+            std::vector<tableint> neighbors;
+            for (tableint root : roots) {
+                if (placed[root])
+                    continue;
+                size_t head = order.size();
+                order.push_back(root);
+                placed[root] = true;
+                while (head < order.size()) {
+                    linklistsizeint *ll = get_linklist0(order[head++]);
+                    size_t size = getListCount(ll);
+                    tableint *datal = (tableint *) (ll + 1);
+                    neighbors.assign(datal, datal + size);
+                    if (strategy == REORDER_RCM) {
+                        std::stable_sort(neighbors.begin(), neighbors.end(), [&degree](tableint a, tableint b) {
+                            return degree[a] < degree[b];
+                        });
+                    }
+                    for (tableint neighbor : neighbors) {
+                        if (!placed[neighbor]) {
+                            placed[neighbor] = true;
+                            order.push_back(neighbor);
+                        }
+                    }
+                }
+            }
+            if (strategy == REORDER_RCM)
+                std::reverse(order.begin(), order.end());
+            return order;
+        }
+
+        // Gorder: the next element maximizes the number of edges and common in-neighbors
+        // with the last `window` placed elements. Scores are kept in a bucket queue (unit heap).
+        const size_t window = 5;
+        const tableint none = std::numeric_limits<tableint>::max();
+        std::vector<size_t> in_offsets(n + 1, 0);
+        for (tableint i = 0; i < n; i++) {
+            linklistsizeint *ll = get_linklist0(i);
+            tableint *datal = (tableint *) (ll + 1);
+            for (size_t j = 0; j < getListCount(ll); j++)
+                in_offsets[datal[j] + 1]++;
+        }
+        for (size_t i = 0; i < n; i++)
+            in_offsets[i + 1] += in_offsets[i];
+        std::vector<tableint> in_edges(in_offsets[n]);
+        std::vector<size_t> in_fill(in_offsets.begin(), in_offsets.end() - 1);
+        for (tableint i = 0; i < n; i++) {
+            linklistsizeint *ll = get_linklist0(i);
+            tableint *datal = (tableint *) (ll + 1);
+            for (size_t j = 0; j < getListCount(ll); j++)
+                in_edges[in_fill[datal[j]]++] = i;
+        }
+
+        std::vector<size_t> key(n, 0);
+        std::vector<tableint> prev(n, none);
+        std::vector<tableint> next(n, none);
+        std::vector<tableint> bucket_head(1, none);
+        size_t top_key = 0;
+        auto unlink = [&](tableint u) {
+            if (prev[u] != none)
+                next[prev[u]] = next[u];
+            else
+                bucket_head[key[u]] = next[u];
+            if (next[u] != none)
+                prev[next[u]] = prev[u];
+        };
+        auto link = [&](tableint u) {
+            if (key[u] >= bucket_head.size())
+                bucket_head.resize(key[u] + 1, none);
+            prev[u] = none;
+            next[u] = bucket_head[key[u]];
+            if (next[u] != none)
+                prev[next[u]] = u;
+            bucket_head[key[u]] = u;
+            top_key = std::max(top_key, key[u]);
+        };
+        for (tableint i = n; i-- > 0;)
+            link(i);
+        auto bump = [&](tableint u, int delta) {
+            if (placed[u])
+                return;
+            unlink(u);
+            key[u] += delta;
+            link(u);
+        };
+        auto update_scores = [&](tableint v, int delta) {
+            linklistsizeint *ll = get_linklist0(v);
+            tableint *datal = (tableint *) (ll + 1);
+            for (size_t j = 0; j < getListCount(ll); j++)
+                bump(datal[j], delta);
+            for (size_t e = in_offsets[v]; e < in_offsets[v + 1]; e++) {
+                tableint parent = in_edges[e];
+                bump(parent, delta);
+                linklistsizeint *ll_parent = get_linklist0(parent);
+                tableint *datal_parent = (tableint *) (ll_parent + 1);
+                for (size_t j = 0; j < getListCount(ll_parent); j++) {
+                    if (datal_parent[j] != v)
+                        bump(datal_parent[j], delta);
+                }
+            }
+        };
+        auto place = [&](tableint v) {
+            unlink(v);
+            placed[v] = true;
+            order.push_back(v);
+            update_scores(v, 1);
+            if (order.size() > window)
+                update_scores(order[order.size() - window - 1], -1);
+        };
+
+        place(roots.empty() ? 0 : roots[0]);
+        while (order.size() < n) {
+            while (top_key > 0 && bucket_head[top_key] == none)
+                top_key--;
+            place(bucket_head[top_key]);
+        }
+        return order;
+    }
+
+
+    /*
+    * Moves the element with the internal id order[i] to the internal id i, see computeReorderPermutation.
+    */
+    void applyReorderPermutation(const std::vector<tableint> &order) {
+        size_t n = cur_element_count;
+        if (order.size() != n)
+            throw std::runtime_error("The permutation does not cover all the elements");
+        std::vector<tableint> new_id(n, std::numeric_limits<tableint>::max());
+        for (tableint i = 0; i < n; i++) {
+            if (order[i] >= n || new_id[order[i]] != std::numeric_limits<tableint>::max())
+                throw std::runtime_error("Invalid permutation of the elements");
+            new_id[order[i]] = i;
+        }
+
+        // base layer: records are moved and the links renamed
+        LargeMemoryBlock new_level0_block, new_vectors_block, new_labels_block;
+        Level0Arenas new_level0 = allocateLevel0(max_elements_, new_level0_block, new_vectors_block, new_labels_block);
+        for (tableint i = 0; i < n; i++) {
+            copyLevel0(level0_, order[i], new_level0, i, 1);
+            linklistsizeint *ll = get_linklist0(i, new_level0);
+            tableint *datal = (tableint *) (ll + 1);
+            for (size_t j = 0; j < getListCount(ll); j++)
+                datal[j] = new_id[datal[j]];
+        }
+        level0_block_.swap(new_level0_block);
+        vectors_block_.swap(new_vectors_block);
+        labels_block_.swap(new_labels_block);
+        level0_ = new_level0;
+        data_level0_memory_ = level0_block_.data();
+
+        // upper layers
+        std::vector<char *> old_link_lists(linkLists_, linkLists_ + n);
+        std::vector<int> old_levels(element_levels_.begin(), element_levels_.begin() + n);
+        for (tableint i = 0; i < n; i++) {
+            linkLists_[i] = old_link_lists[order[i]];
+            element_levels_[i] = old_levels[order[i]];
+            for (int level = 1; level <= element_levels_[i]; level++) {
+                linklistsizeint *ll = get_linklist(i, level);
+                tableint *datal = (tableint *) (ll + 1);
+                for (size_t j = 0; j < getListCount(ll); j++)
+                    datal[j] = new_id[datal[j]];
+            }
+        }
+        if ((signed) enterpoint_node_ != -1)
+            enterpoint_node_ = new_id[enterpoint_node_];
+        for (tableint &entry : entry_points_)
+            entry = new_id[entry];
+
+        for (auto &label_id : label_lookup_)
+            label_id.second = new_id[label_id.second];
+
+        std::unordered_set<tableint> old_deleted_elements;
+        old_deleted_elements.swap(deleted_elements);
+        for (tableint id : old_deleted_elements)
+            deleted_elements.insert(new_id[id]);
+
+        if (attribute_aware_) {
+            std::vector<std::vector<attributetype>> old_attributes(n);
+            for (tableint i = 0; i < n; i++)
+                old_attributes[i].swap(element_attributes_[i]);
+            for (tableint i = 0; i < n; i++)
+                element_attributes_[i].swap(old_attributes[order[i]]);
+            for (auto &entry : attribute_entry_points_)
+                entry.second = new_id[entry.second];
+            for (auto &filter : attribute_filters_) {
+                BitsetFilterFunctor renamed(max_elements_, BitsetFilterFunctor::INTERNAL_IDS);
+                for (tableint i = 0; i < n; i++) {
+                    if (filter.second.test(order[i]))
+                        renamed.set(i);
+                }
+                filter.second = renamed;
+            }
+        }
+
+        if (namespaces_enabled_) {
+            std::vector<namespacetype> old_namespaces(element_namespaces_.begin(), element_namespaces_.begin() + n);
+            for (tableint i = 0; i < n; i++)
+                element_namespaces_[i] = old_namespaces[order[i]];
+            for (auto &root : namespace_roots_) {
+                if ((signed) root.second.enterpoint_node != -1)
+                    root.second.enterpoint_node = new_id[root.second.enterpoint_node];
+            }
+        }
+        if (navigation_ == NAVIGATION_FLAT)
+            buildNavigationTable();
+    }
+
+
     void checkIntegrity() {
         int connections_checked = 0;
         std::vector <int > inbound_connections_num(cur_element_count, 0);
@@ -120,10 +120,34 @@ static bool AVX512Capable() {
 #include <vector>
 #include <iostream>
 #include <string.h>
+#include <stdint.h>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace hnswlib {
 typedef size_t labeltype;
 
+// index of the lowest set bit of a non-zero word
+inline unsigned int countTrailingZeros(uint64_t word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, word);
+#else
+    if (_BitScanForward(&index, (unsigned long) word))
+        return index;
+    _BitScanForward(&index, (unsigned long) (word >> 32));
+    index += 32;
+#endif
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
 // This can be extended to store state for filtering (e.g. from a std::set)
 class BaseFilterFunctor {
  public:
@@ -131,6 +155,80 @@ class BaseFilterFunctor {
     virtual ~BaseFilterFunctor() {};
 };
 
+/*
+* Dense bitmap filter over labels or over internal ids of an index.
+* The indexes recognize it and test the bit inline in the traversal loop instead of
+* calling the virtual operator(). With INTERNAL_IDS the label is not even fetched.
+* operator() interprets its argument in the bitmap's own id space.
+*/
+class BitsetFilterFunctor : public BaseFilterFunctor {
+ public:
+    enum IdSpace { LABEL_IDS, INTERNAL_IDS };
+
+    explicit BitsetFilterFunctor(size_t num_ids, IdSpace id_space = LABEL_IDS)
+        : id_space_(id_space), num_ids_(num_ids), num_set_(0), words_((num_ids + 63) / 64, 0) {}
+
+    void set(size_t id) {
+        if (id >= num_ids_)
+            throw std::runtime_error("Id is out of the bitset range");
+        uint64_t mask = (uint64_t) 1 << (id & 63);
+        if (!(words_[id >> 6] & mask)) {
+            words_[id >> 6] |= mask;
+            num_set_++;
+        }
+    }
+
+    // grows or shrinks the id range, bits beyond the new range are dropped
+    void resize(size_t num_ids) {
+        for (size_t id = num_ids; id < num_ids_; id++)
+            reset(id);
+        num_ids_ = num_ids;
+        words_.resize((num_ids + 63) / 64, 0);
+    }
+
+    void reset(size_t id) {
+        if (id >= num_ids_)
+            return;
+        uint64_t mask = (uint64_t) 1 << (id & 63);
+        if (words_[id >> 6] & mask) {
+            words_[id >> 6] &= ~mask;
+            num_set_--;
+        }
+    }
+
+    inline bool test(size_t id) const {
+        return id < num_ids_ && ((words_[id >> 6] >> (id & 63)) & 1);
+    }
+
+    // number of allowed ids
+    size_t count() const { return num_set_; }
+
+    // smallest allowed id, size() if there is none
+    size_t findFirst() const {
+        for (size_t w = 0; w < words_.size(); w++) {
+            if (words_[w])
+                return w * 64 + countTrailingZeros(words_[w]);
+        }
+        return num_ids_;
+    }
+
+    size_t size() const { return num_ids_; }
+
+    IdSpace idSpace() const { return id_space_; }
+
+    bool isInternal() const { return id_space_ == INTERNAL_IDS; }
+
+    const uint64_t *words() const { return words_.data(); }
+
+    bool operator()(hnswlib::labeltype id) { return test(id); }
+
+ private:
+    IdSpace id_space_;
+    size_t num_ids_;
+    size_t num_set_;
+    std::vector<uint64_t> words_;
+};
+
 template<typename dist_t>
 class BaseSearchStopCondition {
  public:
@@ -226,3 +324,8 @@ AlgorithmInterface<dist_t>::searchKnnCloserFirst(const void* query_data, size_t
 #include "stop_condition.h"
 #include "bruteforce.h"
 #include "hnswalg.h"
+#include "frozen_index.h"
+#include "numa_index.h"
+#if !defined(_WIN32)
+#include "disk_index.h"
+#endif
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "numa.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace hnswlib {
+
+// Pages backing the large blocks of an index
+enum PageMode {
+    PAGES_DEFAULT = 0,       // malloc
+    PAGES_TRANSPARENT_HUGE,  // anonymous mapping advised for transparent huge pages (MADV_HUGEPAGE)
+    PAGES_HUGE_2MB,          // explicit 2MB huge pages (MAP_HUGETLB), falls back to transparent huge pages
+    PAGES_HUGE_1GB,          // explicit 1GB huge pages (MAP_HUGETLB), falls back to transparent huge pages
+};
+
+static const size_t HUGE_PAGE_2MB = (size_t) 1 << 21;
+static const size_t HUGE_PAGE_1GB = (size_t) 1 << 30;
+
+inline size_t getSystemPageSize() {
+#if defined(__linux__)
+    return (size_t) sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+/*
+* A large memory block allocated with the requested page mode.
+* When huge pages cannot be used (not configured, not Linux) the block falls back to
+* transparent huge pages and then to malloc, mode() and pageSize() report what is in use.
+* With numa_interleave the pages are spread over the NUMA nodes with memory.
+* A non-zero alignment (power of two) aligns the start of the block also when it is malloc-ed.
+*/
+class LargeMemoryBlock {
+ public:
+    LargeMemoryBlock() {}
+
+    LargeMemoryBlock(const LargeMemoryBlock &) = delete;
+    LargeMemoryBlock &operator=(const LargeMemoryBlock &) = delete;
+
+    ~LargeMemoryBlock() { release(); }
+
+    // allocates size bytes, the previous content is released
+    void allocate(size_t size, PageMode mode, bool numa_interleave = false, size_t alignment = 0) {
+        release();
+        requested_mode_ = mode;
+        requested_numa_interleave_ = numa_interleave;
+        alignment_ = alignment;
+        size_ = size;
+#if defined(__linux__)
+        if (size > 0 && (mode == PAGES_HUGE_2MB || mode == PAGES_HUGE_1GB)) {
+            size_t page_size = mode == PAGES_HUGE_1GB ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+            if (mapHugeTLB(size, page_size)) {
+                mode_ = mode;
+                applyNumaPolicy();
+                return;
+            }
+        }
+        if (size > 0 && (mode != PAGES_DEFAULT || numa_interleave)) {
+            if (mapAnonymous(size, mode != PAGES_DEFAULT)) {
+                applyNumaPolicy();
+                return;
+            }
+        }
+#endif
+        if (alignment_) {
+            data_ = (char *) allocateAligned(size, alignment_);
+        } else {
+            data_ = (char *) malloc(size);
+        }
+        if (data_ == nullptr && size > 0)
+            throw std::runtime_error("Not enough memory");
+        mode_ = PAGES_DEFAULT;
+        page_size_ = getSystemPageSize();
+    }
+
+    // changes the size with the same page mode, keeps the first used_size bytes
+    void resize(size_t size, size_t used_size) {
+        if (mode_ == PAGES_DEFAULT && requested_mode_ == PAGES_DEFAULT && !requested_numa_interleave_ && !alignment_) {
+            char *data_new = (char *) realloc(data_, size);
+            if (data_new == nullptr && size > 0)
+                throw std::runtime_error("Not enough memory");
+            data_ = data_new;
+            size_ = size;
+            return;
+        }
+        LargeMemoryBlock block;
+        block.allocate(size, requested_mode_, requested_numa_interleave_, alignment_);
+        memcpy(block.data(), data_, std::min(used_size, size));
+        swap(block);
+    }
+
+    /*
+    * Maps a file read-only, the block must not be written. With PAGES_TRANSPARENT_HUGE the mapping
+    * is advised for transparent huge pages, which the kernel may not do for files. Explicit huge pages
+    * cannot map a file: with PAGES_HUGE_2MB and PAGES_HUGE_1GB, without mmap (not Linux) and when
+    * alignment is above the page size, the file is read into a block allocated with the page mode.
+    */
+    void mapFile(const std::string &location, size_t alignment = 64, PageMode mode = PAGES_DEFAULT) {
+        release();
+#if defined(__linux__)
+        if ((mode == PAGES_DEFAULT || mode == PAGES_TRANSPARENT_HUGE) && alignment <= getSystemPageSize()) {
+            int fd = open(location.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open file");
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                throw std::runtime_error("Cannot map an empty file");
+            }
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("Cannot map file");
+            data_ = (char *) data;
+            size_ = st.st_size;
+            mapped_size_ = st.st_size;
+            file_mapping_ = true;
+            alignment_ = 0;
+            requested_mode_ = mode;
+            requested_numa_interleave_ = false;
+            mode_ = PAGES_DEFAULT;
+            page_size_ = getSystemPageSize();
+#ifdef MADV_HUGEPAGE
+            if (mode == PAGES_TRANSPARENT_HUGE && madvise(data, mapped_size_, MADV_HUGEPAGE) == 0) {
+                mode_ = PAGES_TRANSPARENT_HUGE;
+                page_size_ = HUGE_PAGE_2MB;
+            }
+#endif
+            return;
+        }
+#endif
+        std::ifstream input(location, std::ios::binary | std::ios::ate);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open file");
+        size_t size = input.tellg();
+        allocate(size, mode, false, alignment);
+        input.seekg(0, input.beg);
+        input.read(data_, size);
+        if (!input)
+            throw std::runtime_error("Cannot read file");
+    }
+
+    void release() {
+#if defined(__linux__)
+        if (mapped_size_) {
+            munmap(data_, mapped_size_);
+        } else if (alignment_) {
+            freeAligned(data_);
+        } else {
+            free(data_);
+        }
+#else
+        if (alignment_) {
+            freeAligned(data_);
+        } else {
+            free(data_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        mapped_size_ = 0;
+        file_mapping_ = false;
+        numa_interleaved_ = false;
+    }
+
+    void swap(LargeMemoryBlock &other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(mapped_size_, other.mapped_size_);
+        std::swap(file_mapping_, other.file_mapping_);
+        std::swap(page_size_, other.page_size_);
+        std::swap(mode_, other.mode_);
+        std::swap(requested_mode_, other.requested_mode_);
+        std::swap(numa_interleaved_, other.numa_interleaved_);
+        std::swap(requested_numa_interleave_, other.requested_numa_interleave_);
+        std::swap(alignment_, other.alignment_);
+    }
+
+    char *data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+    // page mode in use, can differ from the requested one after a fallback
+    PageMode mode() const { return mode_; }
+
+    PageMode requestedMode() const { return requested_mode_; }
+
+    // size of the pages backing the block (requested size for transparent huge pages)
+    size_t pageSize() const { return page_size_; }
+
+    // true if the pages are interleaved over the NUMA nodes
+    bool numaInterleaved() const { return numa_interleaved_; }
+
+    // true if the block is a read-only mapping of a file, see mapFile
+    bool isFileMapping() const { return file_mapping_; }
+
+ private:
+    static void *allocateAligned(size_t size, size_t alignment) {
+        alignment = std::max(alignment, sizeof(void *));
+#if defined(_WIN32)
+        return _aligned_malloc(size, alignment);
+#else
+        void *data = nullptr;
+        if (posix_memalign(&data, alignment, size) != 0)
+            return nullptr;
+        return data;
+#endif
+    }
+
+    static void freeAligned(void *data) {
+#if defined(_WIN32)
+        _aligned_free(data);
+#else
+        free(data);
+#endif
+    }
+
+#if defined(__linux__)
+    bool mapHugeTLB(size_t size, size_t page_size) {
+#ifdef MAP_HUGETLB
+        size_t mapped_size = (size + page_size - 1) / page_size * page_size;
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        flags |= (page_size == HUGE_PAGE_1GB ? 30 : 21) << MAP_HUGE_SHIFT;
+#endif
+        void *data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (data == MAP_FAILED)
+            return false;
+        data_ = (char *) data;
+        mapped_size_ = mapped_size;
+        page_size_ = page_size;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // page aligned anonymous mapping, advised for transparent huge pages if requested and supported
+    bool mapAnonymous(size_t size, bool transparent_huge_pages) {
+        size_t alignment = transparent_huge_pages ? HUGE_PAGE_2MB : getSystemPageSize();
+        size_t mapped_size = (size + alignment - 1) / alignment * alignment;
+        void *data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            return false;
+        data_ = (char *) data;
+        mapped_size_ = mapped_size;
+        mode_ = PAGES_DEFAULT;
+        page_size_ = getSystemPageSize();
+#ifdef MADV_HUGEPAGE
+        if (transparent_huge_pages && madvise(data, mapped_size, MADV_HUGEPAGE) == 0) {
+            mode_ = PAGES_TRANSPARENT_HUGE;
+            page_size_ = HUGE_PAGE_2MB;
+        }
+#endif
+        return true;
+    }
+
+    void applyNumaPolicy() {
+        if (requested_numa_interleave_)
+            numa_interleaved_ = setNumaMemoryPolicy(data_, mapped_size_, getNumaNodes(), true);
+    }
+#endif
+
+    char *data_{nullptr};
+    size_t size_{0};
+    size_t mapped_size_{0};  // non-zero for mmap-ed blocks
+    bool file_mapping_{false};
+    size_t page_size_{0};
+    PageMode mode_{PAGES_DEFAULT};
+    PageMode requested_mode_{PAGES_DEFAULT};
+    bool numa_interleaved_{false};
+    bool requested_numa_interleave_{false};
+    size_t alignment_{0};
+};
+
+
+/*
+* Growable arena of small allocations carved out of large chunks allocated with the page mode.
+* The chunks never move, so the allocations keep their address, and are only released all together,
+* which replaces one malloc and one free per allocation. allocate is thread-safe.
+*/
+class MemoryArena {
+ public:
+    static const size_t DEFAULT_CHUNK_SIZE = (size_t) 4 << 20;
+    static const size_t ALIGNMENT = 8;
+
+    MemoryArena() {}
+
+    MemoryArena(const MemoryArena &) = delete;
+    MemoryArena &operator=(const MemoryArena &) = delete;
+
+    // pages of the next chunks
+    void setPageMode(PageMode mode, bool numa_interleave = false) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        mode_ = mode;
+        numa_interleave_ = numa_interleave;
+    }
+
+    // size zero-filled bytes aligned on ALIGNMENT
+    char *allocate(size_t size) {
+        size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (chunks_.empty() || chunk_used_ + size > chunks_.back()->size())
+            addChunk(std::max(size, (size_t) DEFAULT_CHUNK_SIZE));
+        char *data = chunks_.back()->data() + chunk_used_;
+        chunk_used_ += size;
+        allocated_ += size;
+        lock.unlock();
+        memset(data, 0, size);
+        return data;
+    }
+
+    // the next allocations of up to size bytes in total come from a single chunk
+    void reserve(size_t size) {
+        size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (chunks_.empty() || chunk_used_ + size > chunks_.back()->size())
+            addChunk(size);
+    }
+
+    void release() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunks_.clear();
+        chunk_used_ = 0;
+        allocated_ = 0;
+    }
+
+    // exchanges the chunks, not the page mode
+    void swap(MemoryArena &other) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::unique_lock<std::mutex> other_lock(other.mutex_);
+        chunks_.swap(other.chunks_);
+        std::swap(chunk_used_, other.chunk_used_);
+        std::swap(allocated_, other.allocated_);
+    }
+
+    // bytes handed out
+    size_t allocated() const { return allocated_; }
+
+    // bytes of the chunks
+    size_t capacity() const {
+        size_t capacity = 0;
+        for (auto &chunk : chunks_)
+            capacity += chunk->size();
+        return capacity;
+    }
+
+    size_t numChunks() const { return chunks_.size(); }
+
+    // size of the pages backing the first chunk, 0 without chunks
+    size_t pageSize() const { return chunks_.empty() ? 0 : chunks_.front()->pageSize(); }
+
+ private:
+    void addChunk(size_t size) {
+        std::unique_ptr<LargeMemoryBlock> chunk(new LargeMemoryBlock());
+        chunk->allocate(size, mode_, numa_interleave_, ALIGNMENT);
+        chunks_.push_back(std::move(chunk));
+        chunk_used_ = 0;
+    }
+
+    std::vector<std::unique_ptr<LargeMemoryBlock>> chunks_;
+    size_t chunk_used_{0};  // bytes allocated in the last chunk
+    size_t allocated_{0};
+    PageMode mode_{PAGES_DEFAULT};
+    bool numa_interleave_{false};
+    std::mutex mutex_;
+};
+}  // namespace hnswlib
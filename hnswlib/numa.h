@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+* NUMA helpers over the Linux system interface (sysfs, mbind, sched_setaffinity),
+* so no libnuma is needed. On other systems and on single node machines
+* there is one node and the placement calls do nothing.
+*/
+namespace hnswlib {
+
+#if defined(__linux__)
+static const int NUMA_MPOL_BIND = 2;        // MPOL_BIND of linux/mempolicy.h
+static const int NUMA_MPOL_INTERLEAVE = 3;  // MPOL_INTERLEAVE of linux/mempolicy.h
+#endif
+
+// parses a sysfs list like "0-3,8,10-11"
+inline std::vector<int> parseNumaList(const std::string &list) {
+    std::vector<int> ids;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; id++)
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+
+// ids of the NUMA nodes with memory, {0} when unknown
+inline std::vector<int> getNumaNodes() {
+    std::vector<int> nodes;
+#if defined(__linux__)
+    std::ifstream input("/sys/devices/system/node/has_memory");
+    std::string list;
+    if (input && std::getline(input, list))
+        nodes = parseNumaList(list);
+#endif
+    if (nodes.empty())
+        nodes.push_back(0);
+    return nodes;
+}
+
+
+inline size_t getNumaNodeCount() {
+    return getNumaNodes().size();
+}
+
+
+// cpus of the node, empty when unknown
+inline std::vector<int> getNumaNodeCpus(int node) {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    std::ifstream input("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (input && std::getline(input, list))
+        cpus = parseNumaList(list);
+#endif
+    return cpus;
+}
+
+
+// node of every cpu, indexed by cpu id, -1 for the cpus of no online node
+inline std::vector<int> getCpuNumaNodes() {
+    std::vector<int> cpu_nodes;
+#if defined(__linux__)
+    std::ifstream input("/sys/devices/system/node/online");
+    std::string list;
+    if (input && std::getline(input, list)) {
+        for (int node : parseNumaList(list)) {
+            for (int cpu : getNumaNodeCpus(node)) {
+                if ((size_t) cpu >= cpu_nodes.size())
+                    cpu_nodes.resize(cpu + 1, -1);
+                cpu_nodes[cpu] = node;
+            }
+        }
+    }
+#endif
+    return cpu_nodes;
+}
+
+
+/*
+* Node of the cpu the calling thread runs on, 0 when unknown. sched_getcpu goes through the vDSO
+* instead of a system call, the cpu to node table is read once.
+*/
+inline int getCurrentNumaNode() {
+#if defined(__linux__)
+    static const std::vector<int> cpu_nodes = getCpuNumaNodes();
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && (size_t) cpu < cpu_nodes.size() && cpu_nodes[cpu] >= 0)
+        return cpu_nodes[cpu];
+#endif
+    return 0;
+}
+
+
+// restricts the calling thread to the cpus of the node, returns false if it was not possible
+inline bool pinThreadToNumaNode(int node) {
+#if defined(__linux__)
+    std::vector<int> cpus = getNumaNodeCpus(node);
+    if (cpus.empty())
+        return false;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpu_set);
+    }
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
+
+
+/*
+* Sets the memory policy of the page aligned range [addr, addr + len) before its pages are touched:
+* interleaved over the nodes or bound to one node. Returns false if the policy was not applied.
+*/
+inline bool setNumaMemoryPolicy(void *addr, size_t len, const std::vector<int> &nodes, bool interleave) {
+#if defined(__linux__) && defined(SYS_mbind)
+    const size_t bits_per_word = 8 * sizeof(unsigned long);
+    int max_node = 0;
+    for (int node : nodes)
+        max_node = std::max(max_node, node);
+    std::vector<unsigned long> mask(max_node / bits_per_word + 1, 0);
+    for (int node : nodes)
+        mask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+    int mode = interleave ? NUMA_MPOL_INTERLEAVE : NUMA_MPOL_BIND;
+    return syscall(SYS_mbind, addr, len, mode, mask.data(), mask.size() * bits_per_word + 1, 0) == 0;
+#else
+    return false;
+#endif
+}
+}  // namespace hnswlib
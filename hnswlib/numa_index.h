@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace hnswlib {
+
+// queries processed by the threads of one NUMA node
+struct NumaNodeStats {
+    int node{0};
+    size_t num_threads{0};
+    size_t num_queries{0};
+    double seconds{0};  // from the start until the last thread of the node finished
+};
+
+
+/*
+* Read-only HierarchicalNSW replicated on every NUMA node with memory.
+* Each replica is loaded by a thread pinned to its node, so its pages are allocated
+* on that node (first touch), and the searches use the replica of the node they run on.
+* On a single node machine there is one replica and it behaves as the loaded index.
+* The replicas must not be modified, except through setEf and forEachReplica.
+*/
+template<typename dist_t>
+class NumaReplicatedIndex {
+ public:
+    NumaReplicatedIndex(
+        SpaceInterface<dist_t> *s,
+        const std::string &location,
+        PageMode page_mode = PAGES_DEFAULT)
+        : nodes_(getNumaNodes()) {
+        std::vector<int> cpu_nodes = getCpuNumaNodes();
+        cpu_replicas_.resize(cpu_nodes.size(), 0);
+        for (size_t cpu = 0; cpu < cpu_nodes.size(); cpu++) {
+            for (size_t r = 0; r < nodes_.size(); r++) {
+                if (nodes_[r] == cpu_nodes[cpu])
+                    cpu_replicas_[cpu] = r;
+            }
+        }
+        replicas_.resize(nodes_.size());
+        runOnNodes([&](size_t r) {
+            replicas_[r] = std::unique_ptr<HierarchicalNSW<dist_t>>(
+                new HierarchicalNSW<dist_t>(s, location, false, 0, false, page_mode));
+        });
+    }
+
+
+    size_t getNumReplicas() const { return replicas_.size(); }
+
+
+    int getReplicaNode(size_t r) const { return nodes_.at(r); }
+
+
+    HierarchicalNSW<dist_t> *getReplica(size_t r) const { return replicas_.at(r).get(); }
+
+
+    // replica allocated on the node, the first one for an unknown node
+    HierarchicalNSW<dist_t> *getReplicaForNode(int node) const {
+        for (size_t r = 0; r < nodes_.size(); r++) {
+            if (nodes_[r] == node)
+                return replicas_[r].get();
+        }
+        return replicas_[0].get();
+    }
+
+
+    // replica of the node of the cpu the calling thread runs on, from the cpu to replica table of the constructor
+    HierarchicalNSW<dist_t> *getLocalReplica() const {
+#if defined(__linux__)
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && (size_t) cpu < cpu_replicas_.size())
+            return replicas_[cpu_replicas_[cpu]].get();
+#endif
+        return replicas_[0].get();
+    }
+
+
+    void setEf(size_t ef) {
+        for (auto &replica : replicas_)
+            replica->setEf(ef);
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype>>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor *isIdAllowed = nullptr) const {
+        return getLocalReplica()->searchKnn(query_data, k, isIdAllowed);
+    }
+
+
+    std::vector<std::pair<dist_t, labeltype>>
+    searchKnnCloserFirst(const void *query_data, size_t k, BaseFilterFunctor *isIdAllowed = nullptr) const {
+        return getLocalReplica()->searchKnnCloserFirst(query_data, k, isIdAllowed);
+    }
+
+
+    // calls fn(replica) for every replica from a thread pinned to its node, so reallocations stay local
+    template<class Function>
+    void forEachReplica(Function fn) {
+        runOnNodes([&](size_t r) { fn(replicas_[r].get()); });
+    }
+
+
+    /*
+    * Calls fn(i, replica) for every i in [0, n) from threads_per_node threads pinned to each node,
+    * replica is the one of the thread's node. The threads take the next i from a shared counter,
+    * so faster nodes process more queries. Returns the work done per node.
+    */
+    template<class Function>
+    std::vector<NumaNodeStats> parallelFor(size_t n, size_t threads_per_node, Function fn) const {
+        threads_per_node = std::max(threads_per_node, (size_t) 1);
+        std::vector<NumaNodeStats> stats(nodes_.size());
+        std::vector<std::atomic<size_t>> num_queries(nodes_.size());
+        std::vector<std::atomic<size_t>> num_running(nodes_.size());
+        std::vector<std::chrono::steady_clock::time_point> end_times(nodes_.size());
+        for (size_t r = 0; r < nodes_.size(); r++) {
+            num_queries[r] = 0;
+            num_running[r] = threads_per_node;
+        }
+        std::atomic<size_t> current(0);
+        auto start_time = std::chrono::steady_clock::now();
+
+        runOnNodes([&](size_t r) {
+            HierarchicalNSW<dist_t> *replica = replicas_[r].get();
+            size_t count = 0;
+            while (true) {
+                size_t i = current.fetch_add(1);
+                if (i >= n)
+                    break;
+                fn(i, replica);
+                count++;
+            }
+            num_queries[r] += count;
+            if (--num_running[r] == 0)
+                end_times[r] = std::chrono::steady_clock::now();
+        }, threads_per_node, [&]() { current = n; });
+
+        for (size_t r = 0; r < nodes_.size(); r++) {
+            stats[r].node = nodes_[r];
+            stats[r].num_threads = threads_per_node;
+            stats[r].num_queries = num_queries[r];
+            stats[r].seconds = std::chrono::duration<double>(end_times[r] - start_time).count();
+        }
+        return stats;
+    }
+
+ private:
+    // runs fn(r) on threads_per_node threads pinned to the node of each replica r, rethrows the first exception
+    template<class Function>
+    void runOnNodes(Function fn, size_t threads_per_node = 1) const {
+        runOnNodes(fn, threads_per_node, []() {});
+    }
+
+
+    template<class Function, class StopFunction>
+    void runOnNodes(Function fn, size_t threads_per_node, StopFunction stop) const {
+        std::vector<std::thread> threads;
+        std::exception_ptr lastException = nullptr;
+        std::mutex lastExceptMutex;
+        for (size_t r = 0; r < nodes_.size(); r++) {
+            for (size_t t = 0; t < threads_per_node; t++) {
+                threads.push_back(std::thread([&, r] {
+                    try {
+                        // without a cpu list the thread runs anywhere and the replica is still usable
+                        pinThreadToNumaNode(nodes_[r]);
+                        fn(r);
+                    } catch (...) {
+                        std::unique_lock<std::mutex> lastExcepLock(lastExceptMutex);
+                        lastException = std::current_exception();
+                        stop();
+                    }
+                }));
+            }
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        if (lastException) {
+            std::rethrow_exception(lastException);
+        }
+    }
+
+    std::vector<int> nodes_;
+    std::vector<size_t> cpu_replicas_;  // replica of every cpu, the first one for the cpus of nodes without memory
+    std::vector<std::unique_ptr<HierarchicalNSW<dist_t>>> replicas_;
+};
+}  // namespace hnswlib
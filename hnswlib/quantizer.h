@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* 4-bit scalar quantizer of float vectors, two dimensions per byte.
+* Each dimension is mapped to 16 levels between its minimum and maximum over the training vectors.
+* Training is incremental (reset, observe every vector, finish) so it can stream over the data.
+*/
+class ScalarQuantizer4 {
+ public:
+    // starts a training over vectors of dim dimensions
+    void reset(size_t dim) {
+        dim_ = dim;
+        min_values_.assign(dim, std::numeric_limits<float>::max());
+        max_values_.assign(dim, std::numeric_limits<float>::lowest());
+        steps_.assign(dim, 0);
+        observed_ = 0;
+    }
+
+
+    void observe(const float *v) {
+        for (size_t d = 0; d < dim_; d++) {
+            min_values_[d] = std::min(min_values_[d], v[d]);
+            max_values_[d] = std::max(max_values_[d], v[d]);
+        }
+        observed_++;
+    }
+
+
+    void finish() {
+        for (size_t d = 0; d < dim_; d++) {
+            if (observed_ == 0)
+                min_values_[d] = max_values_[d] = 0;
+            steps_[d] = (max_values_[d] - min_values_[d]) / 15;
+        }
+        max_values_.clear();
+    }
+
+
+    // restores a trained quantizer, min_values and steps have dim values
+    void setParameters(size_t dim, const float *min_values, const float *steps) {
+        dim_ = dim;
+        min_values_.assign(min_values, min_values + dim);
+        steps_.assign(steps, steps + dim);
+        max_values_.clear();
+    }
+
+
+    size_t dim() const { return dim_; }
+
+
+    size_t codeSize() const { return (dim_ + 1) / 2; }
+
+
+    const float *minValues() const { return min_values_.data(); }
+
+
+    const float *steps() const { return steps_.data(); }
+
+
+    void encode(const float *v, unsigned char *code) const {
+        memset(code, 0, codeSize());
+        for (size_t d = 0; d < dim_; d++) {
+            int c = 0;
+            if (steps_[d] > 0) {
+                c = (int) std::lround((v[d] - min_values_[d]) / steps_[d]);
+                c = std::min(std::max(c, 0), 15);
+            }
+            code[d / 2] |= (unsigned char) (c << (4 * (d % 2)));
+        }
+    }
+
+
+    void decode(const unsigned char *code, float *v) const {
+        const float *min_values = min_values_.data();
+        const float *steps = steps_.data();
+        size_t pairs = dim_ / 2;
+        for (size_t i = 0; i < pairs; i++) {
+            v[2 * i] = min_values[2 * i] + (code[i] & 15) * steps[2 * i];
+            v[2 * i + 1] = min_values[2 * i + 1] + (code[i] >> 4) * steps[2 * i + 1];
+        }
+        if (dim_ % 2)
+            v[2 * pairs] = min_values[2 * pairs] + (code[pairs] & 15) * steps[2 * pairs];
+    }
+
+ private:
+    size_t dim_{0};
+    size_t observed_{0};
+    std::vector<float> min_values_;
+    std::vector<float> max_values_;  // only during the training
+    std::vector<float> steps_;
+};
+}  // namespace hnswlib
@@ -273,4 +273,91 @@ class EpsilonSearchStopCondition : public BaseSearchStopCondition<dist_t> {
 
     ~EpsilonSearchStopCondition() {}
 };
+
+
+/*
+* Adaptive early termination for k-NN search (patience based stopping).
+* Besides the usual ef bound, the search stops when the k closest results have not
+* changed during the last `patience` expansions, or when the closest unexpanded candidate
+* is farther than distance_ratio times the current k-th distance (for non-negative distances).
+* patience = 0 or distance_ratio = 0 disable the corresponding rule.
+* The class is final, so the search templated on it calls it without virtual dispatch.
+*/
+template<typename dist_t>
+class PatienceSearchStopCondition final : public BaseSearchStopCondition<dist_t> {
+    size_t k_;
+    size_t max_num_candidates_;
+    size_t patience_;
+    float distance_ratio_;
+    size_t curr_num_items_;
+    size_t expansions_without_change_;
+    bool stopped_early_;
+    std::priority_queue<dist_t> top_k_distances_;
+
+ public:
+    PatienceSearchStopCondition(size_t k, size_t max_num_candidates, size_t patience, float distance_ratio = 0) {
+        assert(k <= max_num_candidates);
+        k_ = k;
+        max_num_candidates_ = max_num_candidates;
+        patience_ = patience;
+        distance_ratio_ = distance_ratio;
+        curr_num_items_ = 0;
+        expansions_without_change_ = 0;
+        stopped_early_ = false;
+    }
+
+    void add_point_to_result(labeltype, const void *, dist_t dist) override {
+        curr_num_items_ += 1;
+        if (top_k_distances_.size() < k_ || dist < top_k_distances_.top()) {
+            top_k_distances_.push(dist);
+            if (top_k_distances_.size() > k_)
+                top_k_distances_.pop();
+            expansions_without_change_ = 0;
+        }
+    }
+
+    void remove_point_from_result(labeltype, const void *, dist_t) override {
+        curr_num_items_ -= 1;
+    }
+
+    bool should_stop_search(dist_t candidate_dist, dist_t lowerBound) override {
+        if (candidate_dist > lowerBound && curr_num_items_ == max_num_candidates_) {
+            // new candidate can't improve found results
+            return true;
+        }
+        if (top_k_distances_.size() == k_) {
+            if (patience_ && expansions_without_change_ >= patience_) {
+                stopped_early_ = true;
+                return true;
+            }
+            if (distance_ratio_ > 0 && candidate_dist > distance_ratio_ * top_k_distances_.top()) {
+                stopped_early_ = true;
+                return true;
+            }
+        }
+        expansions_without_change_ += 1;
+        return false;
+    }
+
+    bool should_consider_candidate(dist_t candidate_dist, dist_t lowerBound) override {
+        bool flag_consider_candidate = curr_num_items_ < max_num_candidates_ || lowerBound > candidate_dist;
+        return flag_consider_candidate;
+    }
+
+    bool should_remove_extra() override {
+        bool flag_remove_extra = curr_num_items_ > max_num_candidates_;
+        return flag_remove_extra;
+    }
+
+    void filter_results(std::vector<std::pair<dist_t, labeltype >> &candidates) override {
+        while (candidates.size() > k_) {
+            candidates.pop_back();
+        }
+    }
+
+    // true if the last search was stopped by the patience or the distance ratio rule
+    bool stoppedEarly() const { return stopped_early_; }
+
+    ~PatienceSearchStopCondition() {}
+};
 }  // namespace hnswlib
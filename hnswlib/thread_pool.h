@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* Persistent threads running the tasks of the intra-query parallel searches, so that a query does not
+* create and join threads. The pool only grows, its threads are joined when it is destroyed.
+* Tasks run in submission order and must not wait for tasks submitted after them.
+*/
+class SearchThreadPool {
+ public:
+    SearchThreadPool() = default;
+
+    SearchThreadPool(const SearchThreadPool &) = delete;
+    SearchThreadPool &operator=(const SearchThreadPool &) = delete;
+
+    ~SearchThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+
+    // grows the pool to at least num_threads threads
+    void reserve(size_t num_threads) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (workers_.size() < num_threads)
+            workers_.push_back(std::thread(&SearchThreadPool::workerLoop, this));
+    }
+
+
+    size_t numThreads() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return workers_.size();
+    }
+
+
+    void submit(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        work_cv_.notify_one();
+    }
+
+ private:
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_{false};
+};
+}  // namespace hnswlib
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <string.h>
 #include <deque>
@@ -29,50 +30,90 @@ class VisitedList {
 
     ~VisitedList() { delete[] mass; }
 };
+
+/*
+* Visited list shared by the threads of one parallel search.
+* visit() marks the element and returns true for exactly one of the threads.
+*/
+class ConcurrentVisitedList {
+ public:
+    vl_type curV;
+    std::atomic<vl_type> *mass;
+    unsigned int numelements;
+
+    ConcurrentVisitedList(int numelements1) {
+        curV = -1;
+        numelements = numelements1;
+        mass = new std::atomic<vl_type>[numelements];
+        for (unsigned int i = 0; i < numelements; i++)
+            mass[i].store(0, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        curV++;
+        if (curV == 0) {
+            for (unsigned int i = 0; i < numelements; i++)
+                mass[i].store(0, std::memory_order_relaxed);
+            curV++;
+        }
+    }
+
+    inline bool visit(unsigned int id) {
+        if (mass[id].load(std::memory_order_relaxed) == curV)
+            return false;
+        return mass[id].exchange(curV, std::memory_order_relaxed) != curV;
+    }
+
+    ~ConcurrentVisitedList() { delete[] mass; }
+};
 ///////////////////////////////////////////////////////////
 //
 // Class for multi-threaded pool-management of VisitedLists
 //
 /////////////////////////////////////////////////////////
 
-class VisitedListPool {
-    std::deque<VisitedList *> pool;
+template<typename visited_list_t>
+class BasicVisitedListPool {
+    std::deque<visited_list_t *> pool;
     std::mutex poolguard;
     int numelements;
 
  public:
-    VisitedListPool(int initmaxpools, int numelements1) {
+    BasicVisitedListPool(int initmaxpools, int numelements1) {
         numelements = numelements1;
         for (int i = 0; i < initmaxpools; i++)
-            pool.push_front(new VisitedList(numelements));
+            pool.push_front(new visited_list_t(numelements));
     }
 
-    VisitedList *getFreeVisitedList() {
-        VisitedList *rez;
+    visited_list_t *getFreeVisitedList() {
+        visited_list_t *rez;
         {
             std::unique_lock <std::mutex> lock(poolguard);
             if (pool.size() > 0) {
                 rez = pool.front();
                 pool.pop_front();
             } else {
-                rez = new VisitedList(numelements);
+                rez = new visited_list_t(numelements);
             }
         }
         rez->reset();
         return rez;
     }
 
-    void releaseVisitedList(VisitedList *vl) {
+    void releaseVisitedList(visited_list_t *vl) {
         std::unique_lock <std::mutex> lock(poolguard);
         pool.push_front(vl);
     }
 
-    ~VisitedListPool() {
+    ~BasicVisitedListPool() {
         while (pool.size()) {
-            VisitedList *rez = pool.front();
+            visited_list_t *rez = pool.front();
             pool.pop_front();
             delete rez;
         }
     }
 };
+
+typedef BasicVisitedListPool<VisitedList> VisitedListPool;
+typedef BasicVisitedListPool<ConcurrentVisitedList> ConcurrentVisitedListPool;
 }  // namespace hnswlib
@@ -0,0 +1,176 @@
+#include "dataset.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace profiler {
+
+    namespace {
+        bool has_extension(const std::string &path, const std::string &extension) {
+            return path.size() >= extension.size() &&
+                   path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+        }
+
+        // magic, version, header length, then a python dict with descr, fortran_order and shape
+        void read_npy_header(std::ifstream &input, const std::string &path, VectorFormat &format) {
+            char magic[8];
+            input.read(magic, sizeof(magic));
+            if (!input || memcmp(magic, "\x93NUMPY", 6) != 0)
+                throw std::runtime_error("Invalid npy file " + path);
+            uint32_t header_len = 0;
+            if (magic[6] == 1) {
+                uint16_t len = 0;
+                input.read((char *) &len, sizeof(len));
+                header_len = len;
+            } else {
+                input.read((char *) &header_len, sizeof(header_len));
+            }
+            std::string header(header_len, ' ');
+            input.read(header.data(), header_len);
+            if (!input)
+                throw std::runtime_error("Invalid npy file " + path);
+            format.data_offset = input.tellg();
+
+            if (header.find("'fortran_order': True") != std::string::npos)
+                throw std::runtime_error("Fortran order npy file " + path);
+            if (header.find("'<f4'") != std::string::npos) {
+                format.type = VectorType::Float32;
+            } else if (header.find("'|u1'") != std::string::npos) {
+                format.type = VectorType::Uint8;
+            } else if (header.find("'<i4'") != std::string::npos) {
+                format.type = VectorType::Int32;
+            } else {
+                throw std::runtime_error("Unsupported npy type of " + path);
+            }
+
+            size_t shape = header.find("'shape'");
+            size_t open = header.find('(', shape);
+            size_t close = header.find(')', open);
+            if (shape == std::string::npos || open == std::string::npos || close == std::string::npos)
+                throw std::runtime_error("Invalid npy shape of " + path);
+            std::vector<int64_t> dims;
+            std::string values = header.substr(open + 1, close - open - 1);
+            for (size_t pos = 0; pos < values.size();) {
+                size_t next = values.find(',', pos);
+                if (next == std::string::npos)
+                    next = values.size();
+                std::string value = values.substr(pos, next - pos);
+                if (value.find_first_of("0123456789") != std::string::npos)
+                    dims.push_back(std::stoll(value));
+                pos = next + 1;
+            }
+            if (dims.size() != 2)
+                throw std::runtime_error("npy file " + path + " is not a 2-d array");
+            format.size = dims[0];
+            format.dim = dims[1];
+        }
+    } // namespace
+
+
+    VectorFormat read_vector_format(const std::string &path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input)
+            throw std::runtime_error("Cannot open file " + path);
+        input.seekg(0, std::ios::end);
+        int64_t file_size = input.tellg();
+        input.seekg(0, std::ios::beg);
+
+        VectorFormat format;
+        if (has_extension(path, ".npy")) {
+            read_npy_header(input, path, format);
+        } else if (has_extension(path, ".fvecs") || has_extension(path, ".bvecs") || has_extension(path, ".ivecs")) {
+            format.type = has_extension(path, ".fvecs") ? VectorType::Float32
+                        : has_extension(path, ".bvecs") ? VectorType::Uint8 : VectorType::Int32;
+            int32_t dim = 0;
+            input.read((char *) &dim, sizeof(dim));
+            if (!input || dim <= 0)
+                throw std::runtime_error("Invalid vector file " + path);
+            format.dim = dim;
+            format.record_header = sizeof(int32_t);
+            if (file_size % format.record_size() != 0)
+                throw std::runtime_error("Truncated vector file " + path);
+            format.size = file_size / format.record_size();
+        } else if (has_extension(path, ".fbin") || has_extension(path, ".u8bin") || has_extension(path, ".ibin")) {
+            format.type = has_extension(path, ".fbin") ? VectorType::Float32
+                        : has_extension(path, ".u8bin") ? VectorType::Uint8 : VectorType::Int32;
+            uint32_t header[2] = {0, 0};
+            input.read((char *) header, sizeof(header));
+            if (!input || header[1] == 0)
+                throw std::runtime_error("Invalid vector file " + path);
+            format.size = header[0];
+            format.dim = header[1];
+            format.data_offset = sizeof(header);
+        } else {
+            throw std::runtime_error("Unsupported vector file " + path);
+        }
+        if (format.data_offset + format.size * format.record_size() > file_size)
+            throw std::runtime_error("Truncated vector file " + path);
+        return format;
+    }
+
+
+    StreamVectorReader::StreamVectorReader(const std::string &path)
+        : VectorReader(path), input_(path, std::ios::binary) {
+        if (!input_)
+            throw std::runtime_error("Cannot open file " + path);
+    }
+
+
+    const char *StreamVectorReader::load_records(int64_t begin, int64_t count) {
+        buffer_.resize(count * format_.record_size());
+        input_.clear();
+        input_.seekg(format_.data_offset + begin * format_.record_size());
+        input_.read(buffer_.data(), buffer_.size());
+        if (!input_)
+            throw std::runtime_error("Cannot read vectors of " + path_);
+        return buffer_.data();
+    }
+
+
+    MappedVectorReader::MappedVectorReader(const std::string &path) : VectorReader(path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat file " + path);
+        }
+        mapping_size_ = st.st_size;
+        if (mapping_size_ > 0) {
+            void *mapping = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Cannot map file " + path);
+            }
+            mapping_ = (char *) mapping;
+        }
+        close(fd);
+    }
+
+
+    MappedVectorReader::~MappedVectorReader() {
+        if (mapping_)
+            munmap(mapping_, mapping_size_);
+    }
+
+
+    const char *MappedVectorReader::data() const {
+        return format_.record_header == 0 ? mapping_ + format_.data_offset : nullptr;
+    }
+
+
+    const char *MappedVectorReader::load_records(int64_t begin, int64_t) {
+        return mapping_ + format_.data_offset + begin * format_.record_size();
+    }
+
+
+    std::unique_ptr<VectorReader> open_vector_reader(const std::string &path, bool use_mmap) {
+        if (use_mmap)
+            return std::make_unique<MappedVectorReader>(path);
+        return std::make_unique<StreamVectorReader>(path);
+    }
+
+} // namespace profiler
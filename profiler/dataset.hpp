@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace profiler {
+
+    // element types of the vector files
+    enum class VectorType {
+        Float32,
+        Uint8,
+        Int32,
+    };
+
+    inline size_t vector_type_size(VectorType type) {
+        return type == VectorType::Uint8 ? 1 : 4;
+    }
+
+    template<typename data_t>
+    constexpr bool is_vector_type(VectorType type) {
+        return (type == VectorType::Float32 && std::is_same_v<data_t, float>) ||
+               (type == VectorType::Uint8 && std::is_same_v<data_t, uint8_t>) ||
+               (type == VectorType::Int32 && std::is_same_v<data_t, int32_t>);
+    }
+
+    /*
+     * Layout of a vector file, from its extension:
+     *   .npy                   2-d C-order array of float32, uint8 or int32
+     *   .fvecs .bvecs .ivecs   records of an int32 dimension followed by dim float32, uint8 or int32
+     *   .fbin .u8bin .ibin     uint32 number of vectors and dimension, then the float32, uint8 or int32 vectors
+     * The ground truth files of the benchmarks are .ivecs (texmex) or .ibin (big-ann, the ids come first).
+     */
+    struct VectorFormat {
+        VectorType type{VectorType::Float32};
+        int64_t size{0};
+        int64_t dim{0};
+        int64_t data_offset{0}; // bytes before the first record
+        int64_t record_header{0}; // bytes before the values of a record
+
+        int64_t record_size() const { return record_header + dim * vector_type_size(type); }
+    };
+
+    VectorFormat read_vector_format(const std::string &path);
+
+    /*
+     * Reads the vectors of a file in ranges, so that files larger than the memory are never materialized.
+     * StreamVectorReader reads every range from the file, MappedVectorReader maps the file and
+     * serves the files without record headers in place.
+     */
+    class VectorReader {
+    public:
+        explicit VectorReader(const std::string &path) : path_(path), format_(read_vector_format(path)) {}
+
+        virtual ~VectorReader() = default;
+
+        int64_t size() const { return format_.size; }
+
+        int64_t dim() const { return format_.dim; }
+
+        VectorType type() const { return format_.type; }
+
+        // the vectors one after the other in the type of the file, nullptr if they are not mapped without headers
+        virtual const char *data() const { return nullptr; }
+
+        // reads the vectors [begin, begin + count) converted to data_t, one after the other
+        template<typename data_t>
+        void read(int64_t begin, int64_t count, data_t *out) {
+            if (begin < 0 || count < 0 || begin + count > size())
+                throw std::runtime_error("Vectors out of the range of " + path_);
+            const char *records = load_records(begin, count);
+            for (int64_t i = 0; i < count; i++) {
+                const char *record = records + i * format_.record_size() + format_.record_header;
+                data_t *row = out + i * format_.dim;
+                switch (format_.type) {
+                    case VectorType::Float32:
+                        convert_row((const float *) record, row);
+                        break;
+                    case VectorType::Uint8:
+                        convert_row((const uint8_t *) record, row);
+                        break;
+                    case VectorType::Int32:
+                        convert_row((const int32_t *) record, row);
+                        break;
+                }
+            }
+        }
+
+        /*
+         * The vectors [begin, begin + count) as data_t: in place when the file is mapped and stores data_t,
+         * otherwise read into buffer.
+         */
+        template<typename data_t>
+        const data_t *view(int64_t begin, int64_t count, std::vector<data_t> &buffer) {
+            if (data() && is_vector_type<data_t>(format_.type))
+                return (const data_t *) data() + begin * format_.dim;
+            buffer.resize(count * format_.dim);
+            read(begin, count, buffer.data());
+            return buffer.data();
+        }
+
+    protected:
+        // count records from begin, valid until the next call
+        virtual const char *load_records(int64_t begin, int64_t count) = 0;
+
+        std::string path_;
+        VectorFormat format_;
+
+    private:
+        template<typename src_t, typename data_t>
+        void convert_row(const src_t *record, data_t *row) const {
+            for (int64_t j = 0; j < format_.dim; j++) {
+                src_t value;
+                memcpy(&value, record + j, sizeof(src_t));
+                row[j] = (data_t) value;
+            }
+        }
+    };
+
+
+    class StreamVectorReader : public VectorReader {
+    public:
+        explicit StreamVectorReader(const std::string &path);
+
+    protected:
+        const char *load_records(int64_t begin, int64_t count) override;
+
+    private:
+        std::ifstream input_;
+        std::vector<char> buffer_;
+    };
+
+
+    class MappedVectorReader : public VectorReader {
+    public:
+        explicit MappedVectorReader(const std::string &path);
+
+        ~MappedVectorReader() override;
+
+        const char *data() const override;
+
+    protected:
+        const char *load_records(int64_t begin, int64_t count) override;
+
+    private:
+        char *mapping_{nullptr};
+        size_t mapping_size_{0};
+    };
+
+
+    std::unique_ptr<VectorReader> open_vector_reader(const std::string &path, bool use_mmap);
+
+} // namespace profiler
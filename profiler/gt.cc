@@ -0,0 +1,192 @@
+#include "cnpy.h"
+#include "dataset.hpp"
+#include "hnswlib/hnswlib.h"
+#include "spdlog/spdlog.h"
+#include "utils.hpp"
+
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <oneapi/tbb/blocked_range2d.h>
+#include <oneapi/tbb/global_control.h>
+#include <oneapi/tbb/parallel_for.h>
+using namespace profiler;
+
+// base vectors of a task: its queries keep one TopKSelector over all of them
+constexpr int64_t kSliceSize = 64 * hnswlib::BRUTEFORCE_DATA_BLOCK;
+
+
+void normalize_rows(float *data, int64_t num, int64_t dim)
+{
+    oneapi::tbb::parallel_for((int64_t)0, num, [&](int64_t i) {
+        float *row = data + i * dim;
+        float norm = std::sqrt(hnswlib::dotProductFloat(row, row, dim));
+        float scale = 1.0f / (norm + 1e-30f);
+        for (int64_t j = 0; j < dim; j++)
+            row[j] *= scale;
+    });
+}
+
+
+/*
+ * Exact top k of every query, the base vectors are streamed in chunks of chunk_size.
+ * The distances of a (query block, base slice) tile come from the blocked dot product kernels of
+ * BruteforceSearch; the k + BRUTEFORCE_RERANK closest of a slice are re-ranked with the distance function
+ * of the space while the chunk is in memory, then merged into the top k of the query.
+ * data_t is the type of the vectors of the space: float, or uint8_t for L2SpaceI.
+ */
+template<typename data_t, typename dist_t>
+void build_ground_truth(const GroundTruthConfig &config, hnswlib::SpaceInterface<dist_t> &space,
+                        hnswlib::BruteforceMetric metric)
+{
+    std::unique_ptr<VectorReader> base = open_vector_reader(config.base_path, config.mmap);
+    std::unique_ptr<VectorReader> query = open_vector_reader(config.query_path, false);
+    int64_t dim = base->dim();
+    int64_t num_queries = query->size();
+    int64_t k = config.k;
+    if (query->dim() != dim) {
+        spdlog::error("feature dimension {} and query dimension {} doesn't match", dim, query->dim());
+        exit(-1);
+    }
+    if (k <= 0 || k > base->size()) {
+        spdlog::error("top k should be between 1 and the {} base vectors", base->size());
+        exit(-1);
+    }
+    if (base->size() > std::numeric_limits<int>::max()) {
+        spdlog::error("the ids of the {} base vectors do not fit the int32 ground truth", base->size());
+        exit(-1);
+    }
+    spdlog::info("Base={} Queries={} Dim={} K={}", base->size(), num_queries, dim, k);
+    bool normalize = config.space == "cosine";
+    hnswlib::DISTFUNC<dist_t> dist_func = space.get_dist_func();
+    void *dist_func_param = space.get_dist_func_param();
+    size_t vector_size = dim * sizeof(float);
+
+    // the kernels read float vectors, the distance function the vectors of the space
+    std::vector<float> query_feats(num_queries * dim);
+    query->read(0, num_queries, query_feats.data());
+    if (normalize)
+        normalize_rows(query_feats.data(), num_queries, dim);
+    std::vector<data_t> queries(num_queries * dim);
+    if constexpr (std::is_same_v<data_t, float>) {
+        queries = query_feats;
+    } else {
+        query->read(0, num_queries, queries.data());
+    }
+    std::vector<float> query_norms(num_queries);
+    for (int64_t i = 0; i < num_queries; i++)
+        query_norms[i] = hnswlib::dotProductFloat(query_feats.data() + i * dim, query_feats.data() + i * dim, dim);
+
+    std::vector<hnswlib::TopKSelector<float>> top(num_queries);
+    for (auto &t : top)
+        t.reset(k);
+    std::vector<std::mutex> locks(num_queries);
+
+    int64_t chunk_size = std::min(std::max(config.chunk_size, (int64_t)1), base->size());
+    std::vector<data_t> chunk_buffer;
+    std::vector<float> chunk_feats;
+    std::vector<float> chunk_norms(chunk_size);
+
+    Timer timer;
+    timer.start();
+    for (int64_t chunk_begin = 0; chunk_begin < base->size(); chunk_begin += chunk_size)
+    {
+        // in place in a mapped file, the normalized or converted vectors are copies
+        int64_t count = std::min(chunk_size, base->size() - chunk_begin);
+        const data_t *chunk = base->view(chunk_begin, count, chunk_buffer);
+        const float *feats;
+        if constexpr (std::is_same_v<data_t, float>) {
+            if (normalize) {
+                chunk_feats.assign(chunk, chunk + count * dim);
+                normalize_rows(chunk_feats.data(), count, dim);
+                chunk = chunk_feats.data();
+            }
+            feats = chunk;
+        } else {
+            chunk_feats.assign(chunk, chunk + count * dim);
+            feats = chunk_feats.data();
+        }
+        oneapi::tbb::parallel_for((int64_t)0, count, [&](int64_t i) {
+            chunk_norms[i] = hnswlib::dotProductFloat(feats + i * dim, feats + i * dim, dim);
+        });
+
+        oneapi::tbb::parallel_for(
+            oneapi::tbb::blocked_range2d<int64_t>(0, num_queries, hnswlib::BRUTEFORCE_QUERY_BLOCK, 0, count, kSliceSize),
+            [&](const oneapi::tbb::blocked_range2d<int64_t> &r) {
+                int64_t query_begin = r.rows().begin();
+                size_t block_size = std::min((size_t)r.rows().size(), hnswlib::BRUTEFORCE_QUERY_BLOCK);
+                std::vector<float> distances(block_size * hnswlib::BRUTEFORCE_DATA_BLOCK);
+                std::vector<hnswlib::TopKSelector<float>> selectors(block_size);
+                for (int64_t q_begin = query_begin; q_begin < r.rows().end(); q_begin += block_size) {
+                    size_t num_block = std::min((int64_t)block_size, r.rows().end() - q_begin);
+                    for (size_t i = 0; i < num_block; i++)
+                        selectors[i].reset(k + hnswlib::BRUTEFORCE_RERANK);
+                    for (int64_t first = r.cols().begin(); first < r.cols().end(); first += hnswlib::BRUTEFORCE_DATA_BLOCK) {
+                        size_t num_data = std::min((int64_t)hnswlib::BRUTEFORCE_DATA_BLOCK, r.cols().end() - first);
+                        hnswlib::computeDistanceTile<float>(metric, nullptr, nullptr, vector_size,
+                                                            (const char *) (query_feats.data() + q_begin * dim), num_block,
+                                                            query_norms.data() + q_begin,
+                                                            (const char *) (feats + first * dim), num_data, vector_size,
+                                                            chunk_norms.data() + first,
+                                                            distances.data(), hnswlib::BRUTEFORCE_DATA_BLOCK);
+                        for (size_t i = 0; i < num_block; i++)
+                            selectors[i].pushBlock(distances.data() + i * hnswlib::BRUTEFORCE_DATA_BLOCK, num_data, first,
+                                                   [](size_t) { return true; });
+                    }
+                    for (size_t i = 0; i < num_block; i++) {
+                        int64_t q = q_begin + i;
+                        std::vector<std::pair<float, size_t>> candidates = selectors[i].finish();
+                        for (auto &candidate : candidates)
+                            candidate.first = (float) dist_func(queries.data() + q * dim, chunk + candidate.second * dim,
+                                                                dist_func_param);
+                        std::lock_guard<std::mutex> lock(locks[q]);
+                        for (auto &candidate : candidates)
+                            top[q].push(candidate.first, chunk_begin + candidate.second);
+                    }
+                }
+            });
+        spdlog::info("Processed {} / {} base vectors", chunk_begin + count, base->size());
+    }
+    timer.end();
+    spdlog::info("SearchTime={0:.2f} secs", timer.seconds());
+
+    std::vector<int> ids(num_queries * k);
+    std::vector<float> dists(num_queries * k);
+    for (int64_t q = 0; q < num_queries; q++)
+    {
+        const auto &result = top[q].finish();
+        for (int64_t i = 0; i < k; i++) {
+            dists[q * k + i] = result[i].first;
+            ids[q * k + i] = (int) result[i].second;
+        }
+    }
+    std::vector<size_t> shape{(size_t) num_queries, (size_t) k};
+    cnpy::npy_save(config.truth_out, ids.data(), shape);
+    spdlog::info("Ground truth written to {}", config.truth_out);
+    if (!config.distances_out.empty()) {
+        cnpy::npy_save(config.distances_out, dists.data(), shape);
+        spdlog::info("Distances written to {}", config.distances_out);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    GroundTruthConfig config = get_gt_config(argc, argv);
+    oneapi::tbb::global_control global_limit(oneapi::tbb::global_control::max_allowed_parallelism, config.num_threads);
+    int64_t dim = read_vector_format(config.base_path).dim;
+    if (config.space == "ip" || config.space == "cosine") {
+        hnswlib::InnerProductSpace space(dim);
+        build_ground_truth<float, float>(config, space, hnswlib::BRUTEFORCE_IP);
+    } else if (config.space == "l2") {
+        hnswlib::L2Space space(dim);
+        build_ground_truth<float, float>(config, space, hnswlib::BRUTEFORCE_L2);
+    } else if (config.space == "l2uint8") {
+        hnswlib::L2SpaceI space(dim);
+        build_ground_truth<uint8_t, int>(config, space, hnswlib::BRUTEFORCE_L2);
+    } else {
+        spdlog::error("Unsupported space {}", config.space);
+        exit(-1);
+    }
+    return 0;
+}
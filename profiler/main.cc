@@ -1,25 +1,39 @@
-#include "cnpy.h"
+#include "dataset.hpp"
 #include "hnswlib/hnswlib.h"
+#include "hnsw.hpp"
+#include "nnd.hpp"
 #include "spdlog/spdlog.h"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
 #include <numeric>
 #include <span>
 #include <oneapi/tbb/global_control.h>
 #include <oneapi/tbb/info.h>
 #include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/task_arena.h>
 using namespace profiler;
 
 
-template<typename space_t, typename dist_t>
-void benchmark(HNSWConfig config){
-    typedef std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> ResultType;
+// queries and ground truth ids (num_queries x truth_k), read whole
+template<typename data_t>
+struct QuerySet {
+    std::vector<data_t> queries;
+    std::vector<int> truth;
+    int64_t num_queries{0};
+    int64_t truth_k{0};
+};
+
 
-    cnpy::NpyArray feat, query, truth;
-    feat = cnpy::npy_load(config.feat_path);
-    config.max_elements = feat.shape[0];
-    config.dim = feat.shape[1];
-    
+template<typename data_t>
+QuerySet<data_t> load_query_set(const HNSWConfig &config)
+{
+    QuerySet<data_t> ret;
     if (config.query_path.empty() != config.truth_path.empty()){
         spdlog::error("query and ground truth should be both provided (or not provided)");
         exit(-1);
@@ -27,35 +41,248 @@ void benchmark(HNSWConfig config){
 
     if (!config.query_path.empty())
     {
-        query = cnpy::npy_load(config.query_path);
-        if (feat.shape[1] != query.shape[1]) {
-            spdlog::error("feature dimension {} and query dimension {} doesn't match", feat.shape[1], query.shape[1]);
+        std::unique_ptr<VectorReader> query = open_vector_reader(config.query_path, false);
+        if (config.dim != query->dim()) {
+            spdlog::error("feature dimension {} and query dimension {} doesn't match", config.dim, query->dim());
             exit(-1);
         }
+        ret.num_queries = query->size();
+        ret.queries.resize(ret.num_queries * config.dim);
+        query->read(0, ret.num_queries, ret.queries.data());
     }
 
     if (!config.truth_path.empty())
     {
-        truth = cnpy::npy_load(config.truth_path);
-        if (query.shape[0] != truth.shape[0]) {
-            spdlog::error("query elements {} and ground truth elements {} doesn't match", query.shape[0], truth.shape[0]);
+        std::unique_ptr<VectorReader> truth = open_vector_reader(config.truth_path, false);
+        if (ret.num_queries != truth->size()) {
+            spdlog::error("query elements {} and ground truth elements {} doesn't match", ret.num_queries, truth->size());
             exit(-1);
         }
-        if (config.k > truth.shape[1]) {
+        if (config.k > truth->dim()) {
             spdlog::error("top k is larger than elements in the ground truth");
             exit(-1);
         }
+        ret.truth_k = truth->dim();
+        ret.truth.resize(ret.num_queries * ret.truth_k);
+        truth->read(0, ret.num_queries, ret.truth.data());
     }
+    return ret;
+}
+
+
+// fraction of the top k of the ground truth found by the searches
+template<typename data_t, typename result_t>
+double compute_recall(const QuerySet<data_t> &query_set, const std::vector<result_t> &results, int64_t k)
+{
+    int64_t num_queries = query_set.num_queries;
+    std::vector<int> matched(num_queries);
+    auto ground_truths = std::span(query_set.truth);
+
+    oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, num_queries),
+                              [&](const oneapi::tbb::blocked_range<int64_t> &r)
+                              {
+                                  for (int64_t i = r.begin(); i < r.end(); i++)
+                                  {
+                                      auto search_result = results.at(i);
+                                      auto ground_truth = ground_truths.subspan(i * query_set.truth_k, k);
+                                      while (!search_result.empty()){
+                                          auto p = search_result.top();
+                                          for (auto gt: ground_truth) {
+                                              if (gt == p.second) {
+                                                  matched.at(i)++;
+                                                  break;
+                                              }
+                                          }
+                                          search_result.pop();
+                                      }
+                                  }
+                              });
+    int64_t total_matched = std::accumulate(matched.begin(), matched.end(), 0ll);
+    return 1.0 * total_matched / (k * num_queries);
+}
+
+
+/*
+ * Sweep mode: the index is searched for every (threads, k, ef) of the config, with warmup untimed runs of
+ * the queries then trials timed runs. search_all(threads, ef, k, results, latencies) runs all the queries
+ * and fills their latencies in microseconds; count_metrics() returns the hops and distance computations
+ * of the index so far.
+ */
+template<typename data_t, typename result_t, typename search_t, typename metrics_t>
+void run_sweep(const HNSWConfig &config, const QuerySet<data_t> &query_set, search_t search_all, metrics_t count_metrics)
+{
+    int64_t num_queries = query_set.num_queries;
+    std::vector<int> threads_list = config.sweep_threads.empty() ? std::vector<int>{(int) config.num_threads} : config.sweep_threads;
+    std::vector<int> k_list = config.sweep_k.empty() ? std::vector<int>{(int) config.k} : config.sweep_k;
+    if (num_queries == 0)
+    {
+        spdlog::error("the sweep mode needs queries and ground truth");
+        exit(-1);
+    }
+    if (config.trials < 1 || config.warmup < 0)
+    {
+        spdlog::error("the sweep mode needs at least one trial");
+        exit(-1);
+    }
+    for (int k : k_list)
+    {
+        if (k < 1 || k > query_set.truth_k)
+        {
+            spdlog::error("top k {} is not between 1 and the {} elements of the ground truth", k, query_set.truth_k);
+            exit(-1);
+        }
+    }
+
+    std::vector<SweepPoint> points;
+    std::vector<result_t> results(num_queries);
+    std::vector<double> latencies(num_queries);
+    for (int threads : threads_list)
+    {
+        for (int k : k_list)
+        {
+            for (int ef : config.sweep_ef)
+            {
+                for (int64_t w = 0; w < config.warmup; w++)
+                    search_all(threads, ef, k, results, latencies);
+
+                std::vector<double> trial_qps;
+                std::vector<double> trial_latencies;
+                auto before = count_metrics();
+                for (int64_t t = 0; t < config.trials; t++)
+                {
+                    Timer timer;
+                    timer.start();
+                    search_all(threads, ef, k, results, latencies);
+                    timer.end();
+                    trial_qps.push_back(num_queries / timer.seconds());
+                    trial_latencies.insert(trial_latencies.end(), latencies.begin(), latencies.end());
+                }
+                auto after = count_metrics();
+
+                std::sort(trial_qps.begin(), trial_qps.end());
+                std::sort(trial_latencies.begin(), trial_latencies.end());
+                auto percentile = [&](double p) {
+                    size_t rank = (size_t) std::ceil(p * trial_latencies.size());
+                    return trial_latencies[std::min(std::max<size_t>(rank, 1), trial_latencies.size()) - 1];
+                };
+                double num_searches = 1.0 * num_queries * config.trials;
+                SweepPoint point;
+                point.ef = ef;
+                point.k = k;
+                point.threads = threads;
+                point.recall = compute_recall(query_set, results, k);
+                point.qps = trial_qps[trial_qps.size() / 2];
+                point.p50_us = percentile(0.50);
+                point.p95_us = percentile(0.95);
+                point.p99_us = percentile(0.99);
+                point.mean_us = std::accumulate(trial_latencies.begin(), trial_latencies.end(), 0.0) / trial_latencies.size();
+                point.hops = (after.first - before.first) / num_searches;
+                point.dists = (after.second - before.second) / num_searches;
+                points.push_back(point);
+                spdlog::info("Sweep threads={} k={} ef={} Recall={:.2f}% QPS={:.2f} P50={:.1f}us P99={:.1f}us QHops={:.2f} QDist={:.2f}",
+                             threads, k, ef, point.recall * 100, point.qps, point.p50_us, point.p99_us, point.hops, point.dists);
+            }
+        }
+    }
+    if (!config.sweep_out.empty())
+    {
+        write_sweep(config, num_queries, points);
+        spdlog::info("Sweep written to {}", config.sweep_out);
+    }
+}
+
+
+// data_t is the type of the vectors of the space: float, or uint8_t for L2SpaceI
+template<typename space_t, typename dist_t, typename data_t>
+void benchmark(HNSWConfig config){
+    typedef std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> ResultType;
+
+    // the base vectors are streamed (or mapped with --mmap), never loaded whole by the hnsw builder
+    std::unique_ptr<VectorReader> feat = open_vector_reader(config.feat_path, config.mmap);
+    config.max_elements = feat->size();
+    config.dim = feat->dim();
+    spdlog::info("FeatMapped={}", feat->data() != nullptr);
+
+    QuerySet<data_t> query_set = load_query_set<data_t>(config);
 
     space_t space(config.dim);
     hnswlib::HierarchicalNSW<dist_t> *alg_hnsw{nullptr};
 
+    hnswlib::PageMode page_mode = hnswlib::PAGES_DEFAULT;
+    if (config.huge_pages == "thp") {
+        page_mode = hnswlib::PAGES_TRANSPARENT_HUGE;
+    } else if (config.huge_pages == "2mb") {
+        page_mode = hnswlib::PAGES_HUGE_2MB;
+    } else if (config.huge_pages == "1gb") {
+        page_mode = hnswlib::PAGES_HUGE_1GB;
+    } else if (config.huge_pages != "none") {
+        spdlog::error("Unsupported huge pages option {}", config.huge_pages);
+        exit(-1);
+    }
+
+    if (config.numa != "none" && config.numa != "interleave" && config.numa != "replicate") {
+        spdlog::error("Unsupported NUMA option {}", config.numa);
+        exit(-1);
+    }
+    spdlog::info("NumaNodes={}", hnswlib::getNumaNodeCount());
+
+    typedef typename hnswlib::HierarchicalNSW<dist_t>::Level0Layout Level0Layout;
+    Level0Layout layout;
+    if (config.layout == "interleaved") {
+        layout = Level0Layout::LAYOUT_INTERLEAVED;
+    } else if (config.layout == "split") {
+        layout = Level0Layout::LAYOUT_SPLIT;
+    } else {
+        spdlog::error("Unsupported layout {}", config.layout);
+        exit(-1);
+    }
+
+    typedef typename hnswlib::HierarchicalNSW<dist_t>::NeighborCodeType NeighborCodeType;
+    NeighborCodeType neighbor_codes;
+    if (config.neighbor_codes == "none") {
+        neighbor_codes = NeighborCodeType::NEIGHBOR_CODES_NONE;
+    } else if (config.neighbor_codes == "sq4" && std::is_same<dist_t, float>::value) {
+        neighbor_codes = NeighborCodeType::NEIGHBOR_CODES_SQ4;
+    } else {
+        spdlog::error("Unsupported neighbor codes {} for space {}", config.neighbor_codes, config.space);
+        exit(-1);
+    }
+
+    typedef typename hnswlib::HierarchicalNSW<dist_t>::EntryStrategy EntryStrategy;
+    EntryStrategy entry_strategy;
+    if (config.entry == "hierarchy") {
+        entry_strategy = EntryStrategy::ENTRY_HIERARCHY;
+    } else if (config.entry == "diverse") {
+        entry_strategy = EntryStrategy::ENTRY_DIVERSE;
+    } else if (config.entry == "medoid" && std::is_same<dist_t, float>::value) {
+        entry_strategy = EntryStrategy::ENTRY_MEDOID;
+    } else if (config.entry == "router" && std::is_same<dist_t, float>::value) {
+        entry_strategy = EntryStrategy::ENTRY_ROUTER;
+    } else {
+        spdlog::error("Unsupported entry strategy {} for space {}", config.entry, config.space);
+        exit(-1);
+    }
+
+    typedef typename hnswlib::HierarchicalNSW<dist_t>::Navigation Navigation;
+    Navigation navigation;
+    if (config.navigation == "hierarchy") {
+        navigation = Navigation::NAVIGATION_HIERARCHY;
+    } else if (config.navigation == "flat") {
+        navigation = Navigation::NAVIGATION_FLAT;
+    } else if (config.navigation == "none") {
+        navigation = Navigation::NAVIGATION_NONE;
+    } else {
+        spdlog::error("Unsupported navigation {}", config.navigation);
+        exit(-1);
+    }
+
     Timer timer;
     timer.start();
+    spdlog::info("Engine=hnswlib");
 
     if (!config.index_path.empty())
     {
-        alg_hnsw = new hnswlib::HierarchicalNSW<dist_t>(&space, config.index_path);
+        alg_hnsw = new hnswlib::HierarchicalNSW<dist_t>(&space, config.index_path, false, 0, false, page_mode);
         config.max_elements = alg_hnsw->max_elements_;
         config.M = alg_hnsw->M_;
         config.ef_construction = alg_hnsw->ef_construction_;
@@ -65,82 +292,387 @@ void benchmark(HNSWConfig config){
         alg_hnsw = new hnswlib::HierarchicalNSW<dist_t>(&space,
                                                           config.max_elements,
                                                           config.M,
-                                                          config.ef_construction);
+                                                          config.ef_construction,
+                                                          100,
+                                                          false,
+                                                          page_mode);
 
-        oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, config.max_elements),
-                                  [&](const oneapi::tbb::blocked_range<int64_t> &r)
-                                  {
-                                      for (int64_t i = r.begin(); i < r.end(); i++)
-                                      {
-                                          alg_hnsw->addPoint((void *)(feat.data<dist_t>() + config.dim * i), i);
-                                      }
-                                  });
+        // the single layer builders need all the vectors: in place when mapped, read otherwise
+        std::vector<data_t> feat_buffer;
+        if (config.builder == "vamana")
+        {
+            const data_t *feat_data = feat->view(0, config.max_elements, feat_buffer);
+            std::vector<hnswlib::labeltype> labels(config.max_elements);
+            std::iota(labels.begin(), labels.end(), 0);
+            alg_hnsw->buildVamana(feat_data, labels.data(), config.max_elements, config.alpha, config.num_threads);
+        }
+        else if (config.builder == "nnd")
+        {
+            ann::NNDParam param;
+            param.k = config.knn_k > 0 ? config.knn_k : 2 * config.M;
+            param.num_iterations = config.nnd_iterations;
+            param.sample_size = std::min(param.sample_size, param.k);
+            const data_t *feat_data = feat->view(0, config.max_elements, feat_buffer);
+            ann::Matrix2D<data_t> data(config.max_elements, config.dim, const_cast<data_t *>(feat_data));
+            auto dist_func = space.get_dist_func();
+            void *dist_func_param = space.get_dist_func_param();
+            int64_t num_updates = 0;
+            Timer nnd_timer;
+            nnd_timer.start();
+            auto knn = ann::build_nnd(param, data, [&](const data_t *a, const data_t *b, int) {
+                return (float) dist_func(a, b, dist_func_param);
+            }, &num_updates);
+            nnd_timer.end();
+            spdlog::info("NNDTime={} secs", nnd_timer.seconds());
+            spdlog::info("NNDUpdates={}", num_updates);
+
+            std::vector<hnswlib::labeltype> labels(config.max_elements);
+            std::iota(labels.begin(), labels.end(), 0);
+            static_assert(sizeof(ann::id_t) == sizeof(hnswlib::tableint));
+            alg_hnsw->buildFromKnnGraph(feat_data, labels.data(), config.max_elements,
+                                        (const hnswlib::tableint *) knn.indices.data(), param.k, config.alpha, config.num_threads);
+        }
+        else if (config.builder == "hnsw")
+        {
+            int64_t chunk_size = std::max<int64_t>(config.chunk_size, 1);
+            for (int64_t begin = 0; begin < config.max_elements; begin += chunk_size)
+            {
+                int64_t count = std::min(chunk_size, config.max_elements - begin);
+                const data_t *chunk = feat->view(begin, count, feat_buffer);
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, count),
+                                          [&](const oneapi::tbb::blocked_range<int64_t> &r)
+                                          {
+                                              for (int64_t i = r.begin(); i < r.end(); i++)
+                                              {
+                                                  alg_hnsw->addPoint((void *)(chunk + config.dim * i), begin + i);
+                                              }
+                                          });
+            }
+        }
+        else
+        {
+            spdlog::error("Unsupported builder {}", config.builder);
+            exit(-1);
+        }
     }
     timer.end();
     spdlog::info("BuildTime={} secs", timer.seconds());
+    spdlog::info("Builder={}", config.index_path.empty() ? config.builder : "loaded");
+    if (config.numa == "interleave")
+    {
+        spdlog::info("NumaInterleaved={}", alg_hnsw->setNumaInterleave(true));
+    }
+    spdlog::info("Level0PageSize={} KB", alg_hnsw->getLevel0PageSize() / 1024);
+    spdlog::info("LinkListsPageSize={} KB", alg_hnsw->getLinkListsPageSize() / 1024);
+
+    if (config.reorder != "none")
+    {
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::ReorderStrategy ReorderStrategy;
+        ReorderStrategy strategy;
+        if (config.reorder == "bfs") {
+            strategy = ReorderStrategy::REORDER_BFS;
+        } else if (config.reorder == "rcm") {
+            strategy = ReorderStrategy::REORDER_RCM;
+        } else if (config.reorder == "gorder") {
+            strategy = ReorderStrategy::REORDER_GORDER;
+        } else {
+            spdlog::error("Unsupported reorder strategy {}", config.reorder);
+            exit(-1);
+        }
+        timer.start();
+        alg_hnsw->reorderIndex(strategy);
+        timer.end();
+        spdlog::info("ReorderTime={} secs", timer.seconds());
+    }
+
+    if (layout != Level0Layout::LAYOUT_INTERLEAVED)
+    {
+        timer.start();
+        alg_hnsw->setLevel0Layout(layout);
+        timer.end();
+        spdlog::info("LayoutTime={} secs", timer.seconds());
+    }
+    if (neighbor_codes != NeighborCodeType::NEIGHBOR_CODES_NONE)
+    {
+        timer.start();
+        alg_hnsw->setNeighborCodes(neighbor_codes, config.rerank);
+        timer.end();
+        spdlog::info("NeighborCodesTime={} secs", timer.seconds());
+    }
+    spdlog::info("Level0Layout={}", alg_hnsw->getLevel0Layout() == Level0Layout::LAYOUT_SPLIT ? "split" : "interleaved");
+    spdlog::info("NeighborCodeSize={} bytes", alg_hnsw->getNeighborCodeSize());
+    if (entry_strategy != EntryStrategy::ENTRY_HIERARCHY)
+    {
+        timer.start();
+        alg_hnsw->setEntryStrategy(entry_strategy, config.num_entries);
+        timer.end();
+        spdlog::info("EntryTime={} secs", timer.seconds());
+    }
+    spdlog::info("EntryStrategy={}", config.entry);
+    spdlog::info("EntryPoints={}", alg_hnsw->getEntryPoints().size());
+    if (navigation != Navigation::NAVIGATION_HIERARCHY)
+    {
+        timer.start();
+        alg_hnsw->setNavigation(navigation);
+        timer.end();
+        spdlog::info("NavigationTime={} secs", timer.seconds());
+    }
+    spdlog::info("Navigation={}", config.navigation);
+    spdlog::info("NavigationElements={}", alg_hnsw->getNavigationTableSize());
+    spdlog::info("NavigationMemory={0:.2f} MB", alg_hnsw->getNavigationMemory() / 1e6);
+    spdlog::info("UpperLayersMemory={0:.2f} MB", alg_hnsw->getUpperLayersMemory() / 1e6);
 
-    if (!config.index_out.empty() && config.index_path.empty())
+    if (!config.index_out.empty() && (config.index_path.empty() || config.reorder != "none"))
     {
         alg_hnsw->saveIndex(config.index_out);
     }
 
-    // search kNN and evaluation
-    if (query.num_vals > 0)
+    // one read-only copy of the index per NUMA node, loaded from the saved index
+    std::unique_ptr<hnswlib::NumaReplicatedIndex<dist_t>> alg_replicated;
+    std::vector<hnswlib::HierarchicalNSW<dist_t> *> searched_indexes = {alg_hnsw};
+    if (config.numa == "replicate")
     {
-        int64_t num_queries = query.shape[0];
-        alg_hnsw->setEf(config.ef);
+        std::string replica_path = config.index_out;
+        if (replica_path.empty() && config.reorder == "none")
+        {
+            replica_path = config.index_path;
+        }
+        bool temporary = replica_path.empty();
+        if (temporary)
+        {
+            replica_path = "/tmp/hnsw_profiler_replica.bin";
+            alg_hnsw->saveIndex(replica_path);
+        }
+        timer.start();
+        alg_replicated.reset(new hnswlib::NumaReplicatedIndex<dist_t>(&space, replica_path, page_mode));
+        if (temporary)
+        {
+            std::remove(replica_path.c_str());
+        }
+        if (layout != Level0Layout::LAYOUT_INTERLEAVED)
+        {
+            alg_replicated->forEachReplica([&](hnswlib::HierarchicalNSW<dist_t> *replica)
+                                           { replica->setLevel0Layout(layout); });
+        }
+        if (neighbor_codes != NeighborCodeType::NEIGHBOR_CODES_NONE)
+        {
+            alg_replicated->forEachReplica([&](hnswlib::HierarchicalNSW<dist_t> *replica)
+                                           { replica->setNeighborCodes(neighbor_codes, config.rerank); });
+        }
+        if (entry_strategy != EntryStrategy::ENTRY_HIERARCHY)
+        {
+            alg_replicated->forEachReplica([&](hnswlib::HierarchicalNSW<dist_t> *replica)
+                                           { replica->setEntryStrategy(entry_strategy, config.num_entries); });
+        }
+        if (navigation != Navigation::NAVIGATION_HIERARCHY)
+        {
+            alg_replicated->forEachReplica([&](hnswlib::HierarchicalNSW<dist_t> *replica)
+                                           { replica->setNavigation(navigation); });
+        }
+        timer.end();
+        spdlog::info("ReplicationTime={} secs", timer.seconds());
+        spdlog::info("NumaReplicas={}", alg_replicated->getNumReplicas());
+        searched_indexes.clear();
+        for (size_t r = 0; r < alg_replicated->getNumReplicas(); r++)
+        {
+            searched_indexes.push_back(alg_replicated->getReplica(r));
+        }
+    }
 
-        std::vector<ResultType> results(num_queries);
+    // out-of-core copy of the index, searched instead of the index in memory
+    std::unique_ptr<hnswlib::DiskIndex<dist_t>> alg_disk;
+    if (!config.disk_index.empty())
+    {
+        if (config.numa == "replicate")
+        {
+            spdlog::error("The disk index cannot be replicated");
+            exit(-1);
+        }
         timer.start();
-        oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, num_queries),
-                                  [&](const oneapi::tbb::blocked_range<int64_t> &r)
-                                  {
-                                      for (int64_t i = r.begin(); i < r.end(); i++)
-                                      {
-                                          results.at(i) = alg_hnsw->searchKnn(query.data<dist_t>() + i * config.dim, config.k);
-                                      }
-                                  });
+        hnswlib::DiskIndex<dist_t>::build(*alg_hnsw, config.disk_index);
         timer.end();
-        double search_time = timer.seconds();
-        spdlog::info("SearchTime={0:.2f} secs", search_time);
-        spdlog::info("QPS={0:.2f}", num_queries / search_time);
+        spdlog::info("DiskBuildTime={} secs", timer.seconds());
+        alg_disk.reset(new hnswlib::DiskIndex<dist_t>(&space, config.disk_index, config.direct_io));
+        alg_disk->setBeamWidth(config.beam_width);
+        spdlog::info("DirectIO={}", alg_disk->isDirectIO());
+        spdlog::info("IOEngine={}", alg_disk->getIOEngine() == hnswlib::AsyncIO::ENGINE_IO_URING ? "io_uring" : "thread_pool");
+        spdlog::info("DiskMemory={0:.2f} MB", alg_disk->getMemoryUsage() / 1e6);
+    }
 
-        std::vector<int> matched(num_queries);
-        auto ground_truths = std::span(truth.data<int >(), truth.num_vals);
+    if (!config.sweep_ef.empty())
+    {
+        // every query timed on its own, the threads of a point run in their own arena
+        auto elapsed_us = [](std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto search_all = [&](int threads, int ef, int k, std::vector<ResultType> &results, std::vector<double> &latencies)
+        {
+            const data_t *queries = query_set.queries.data();
+            if (alg_replicated)
+            {
+                alg_replicated->setEf(ef);
+                size_t threads_per_node = std::max<size_t>(1, threads / alg_replicated->getNumReplicas());
+                alg_replicated->parallelFor(query_set.num_queries, threads_per_node,
+                                            [&](size_t i, hnswlib::HierarchicalNSW<dist_t> *replica)
+                                            {
+                                                auto start = std::chrono::steady_clock::now();
+                                                results.at(i) = replica->searchKnn(queries + i * config.dim, k);
+                                                latencies.at(i) = elapsed_us(start);
+                                            });
+                return;
+            }
+            if (alg_disk)
+                alg_disk->setEf(ef);
+            else
+                alg_hnsw->setEf(ef);
+            oneapi::tbb::task_arena arena(threads);
+            arena.execute([&] {
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, query_set.num_queries),
+                                          [&](const oneapi::tbb::blocked_range<int64_t> &r)
+                                          {
+                                              for (int64_t i = r.begin(); i < r.end(); i++)
+                                              {
+                                                  auto start = std::chrono::steady_clock::now();
+                                                  results.at(i) = alg_disk ? alg_disk->searchKnn(queries + i * config.dim, k)
+                                                                           : alg_hnsw->searchKnn(queries + i * config.dim, k);
+                                                  latencies.at(i) = elapsed_us(start);
+                                              }
+                                          });
+            });
+        };
+        // hops and distance computations of all the layers, the reranking included
+        auto count_metrics = [&]()
+        {
+            long hops = 0;
+            long dists = 0;
+            if (alg_disk)
+            {
+                hops = alg_disk->metric_hops;
+                dists = alg_disk->metric_distance_computations + alg_disk->metric_full_distance_computations;
+                return std::make_pair(hops, dists);
+            }
+            for (auto index : searched_indexes)
+            {
+                hops += index->metric_hops + index->metric_base_hops;
+                dists += index->metric_distance_computations + index->metric_base_distance_computations +
+                         index->metric_rerank_distance_computations;
+            }
+            return std::make_pair(hops, dists);
+        };
+        run_sweep<data_t, ResultType>(config, query_set, search_all, count_metrics);
+        return;
+    }
 
-        oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, num_queries),
-                                  [&](const oneapi::tbb::blocked_range<int64_t> &r)
-                                  {
-                                      for (int64_t i = r.begin(); i < r.end(); i++)
+    // search kNN and evaluation
+    if (query_set.num_queries > 0)
+    {
+        int64_t num_queries = query_set.num_queries;
+        const data_t *queries = query_set.queries.data();
+        std::vector<ResultType> results(num_queries);
+        double search_time = 0;
+        // queries and busy time per NUMA node
+        std::map<int, std::pair<size_t, double>> node_queries;
+        if (alg_replicated)
+        {
+            alg_replicated->setEf(config.ef);
+            size_t threads_per_node = std::max<size_t>(1, config.num_threads / alg_replicated->getNumReplicas());
+            timer.start();
+            auto stats = alg_replicated->parallelFor(num_queries, threads_per_node,
+                                                     [&](size_t i, hnswlib::HierarchicalNSW<dist_t> *replica)
+                                                     {
+                                                         results.at(i) = replica->searchKnn(queries + i * config.dim, config.k);
+                                                     });
+            timer.end();
+            search_time = timer.seconds();
+            for (auto &node_stats : stats)
+            {
+                node_queries[node_stats.node] = {node_stats.num_queries, node_stats.seconds};
+            }
+        }
+        else if (alg_disk)
+        {
+            alg_disk->setEf(config.ef);
+            timer.start();
+            oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, num_queries),
+                                      [&](const oneapi::tbb::blocked_range<int64_t> &r)
                                       {
-                                          auto search_result = results.at(i);
-                                          auto ground_truth = ground_truths.subspan(i * truth.shape[1], config.k);
-                                          while (!search_result.empty()){
-                                              auto p = search_result.top();
-                                              for (auto gt: ground_truth) {
-                                                  if (gt == p.second) {
-                                                      matched.at(i)++;
-                                                      break;
-                                                  }
-                                              }
-                                              search_result.pop();
+                                          for (int64_t i = r.begin(); i < r.end(); i++)
+                                          {
+                                              results.at(i) = alg_disk->searchKnn(queries + i * config.dim, config.k);
                                           }
-                                      }
-                                  });
-        int64_t total_matched = std::accumulate(matched.begin(), matched.end(), 0ll);
-        double recall = 1.0 * total_matched / (config.k * num_queries);
+                                      });
+            timer.end();
+            search_time = timer.seconds();
+        }
+        else
+        {
+            alg_hnsw->setEf(config.ef);
+            std::vector<int> query_nodes(num_queries);
+            timer.start();
+            oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int64_t>(0, num_queries),
+                                      [&](const oneapi::tbb::blocked_range<int64_t> &r)
+                                      {
+                                          for (int64_t i = r.begin(); i < r.end(); i++)
+                                          {
+                                              results.at(i) = alg_hnsw->searchKnn(queries + i * config.dim, config.k);
+                                              query_nodes.at(i) = hnswlib::getCurrentNumaNode();
+                                          }
+                                      });
+            timer.end();
+            search_time = timer.seconds();
+            for (int node : query_nodes)
+            {
+                node_queries[node].first++;
+                node_queries[node].second = search_time;
+            }
+        }
+        spdlog::info("SearchTime={0:.2f} secs", search_time);
+        spdlog::info("QPS={0:.2f}", num_queries / search_time);
+        for (auto &node : node_queries)
+        {
+            spdlog::info("Node{0}Queries={1}", node.first, node.second.first);
+            spdlog::info("Node{0}QPS={1:.2f}", node.first, node.second.first / node.second.second);
+        }
+
+        double recall = compute_recall(query_set, results, config.k);
         spdlog::info("Recall={0:.2f}%", recall * 100);
 
-        long num_upper_hops = alg_hnsw->metric_hops;
-        long num_base_hops = alg_hnsw->metric_base_hops;
+        long num_upper_hops = 0;
+        long num_base_hops = 0;
+        long num_upper_dist = 0;
+        long num_base_dist = 0;
+        long num_rerank_dist = 0;
+        for (auto index : searched_indexes)
+        {
+            num_upper_hops += index->metric_hops;
+            num_base_hops += index->metric_base_hops;
+            num_upper_dist += index->metric_distance_computations;
+            num_base_dist += index->metric_base_distance_computations;
+            num_rerank_dist += index->metric_rerank_distance_computations;
+        }
+        if (alg_disk)
+        {
+            // the upper layers are searched on the codes, the base layer reads one record per expanded candidate
+            num_upper_hops = num_upper_dist = 0;
+            num_base_hops = alg_disk->metric_hops;
+            num_base_dist = alg_disk->metric_distance_computations;
+            num_rerank_dist = alg_disk->metric_full_distance_computations;
+            spdlog::info("DiskReads={}", alg_disk->metric_disk_reads.load());
+            spdlog::info("QDiskReads={0:.2f}", 1.0 * alg_disk->metric_disk_reads / num_queries);
+            spdlog::info("DiskReadBytes={0:.2f} MB", 1.0 * alg_disk->metric_disk_reads * alg_disk->getHeader().record_span / 1e6);
+        }
         long num_total_hops = num_upper_hops + num_base_hops;
 
-        long num_upper_dist = alg_hnsw->metric_distance_computations;
-        long num_base_dist = alg_hnsw->metric_base_distance_computations;
-        long num_total_dist = num_upper_dist + num_base_dist;
+        long num_total_dist = num_upper_dist + num_base_dist + num_rerank_dist;
 
         float upper_memory = 1.0 * num_upper_dist * config.dim * sizeof(dist_t) / 1e6;
-        float base_memory = 1.0 * num_base_dist * config.dim * sizeof(dist_t) / 1e6;
+        // with neighbor codes the base layer distances read codes, only the reranking reads vectors
+        size_t base_read_size = alg_hnsw->getNeighborCodeSize() ? alg_hnsw->getNeighborCodeSize() : config.dim * sizeof(dist_t);
+        if (alg_disk)
+        {
+            base_read_size = (config.dim + 1) / 2;
+        }
+        float base_memory = (1.0 * num_base_dist * base_read_size + 1.0 * num_rerank_dist * config.dim * sizeof(dist_t)) / 1e6;
         float total_memory = upper_memory + base_memory;
 
         spdlog::info("UpperHops={}", num_upper_hops);
@@ -148,28 +680,128 @@ void benchmark(HNSWConfig config){
 
         spdlog::info("UpperDist={}", num_upper_dist);
         spdlog::info("BaseDist={}", num_base_dist);
+        spdlog::info("RerankDist={}", num_rerank_dist);
         
         spdlog::info("UpperRead={0:.2f} MB", upper_memory);
         spdlog::info("TotalRead={0:.2f} MB", base_memory);
         spdlog::info("Throughput={0:.2f} MB/s", total_memory / search_time);
 
-        spdlog::info("QHops={0:.2f}", 1.0 * num_total_hops / query.shape[0]);
-        spdlog::info("QDist={0:.2f}", 1.0 * num_total_dist / query.shape[0]);
-        spdlog::info("QRead={0:.2f} MB", total_memory / query.shape[0]);
+        spdlog::info("QHops={0:.2f}", 1.0 * num_total_hops / num_queries);
+        spdlog::info("QDist={0:.2f}", 1.0 * num_total_dist / num_queries);
+        spdlog::info("QRead={0:.2f} MB", total_memory / num_queries);
+    }
+
+
+}
+
+// the same build and search measured on ann::HNSW, which freezes the index into contiguous NSWGraph layers
+template<typename data_t, ann::DistanceType distance_type>
+void benchmark_ann(HNSWConfig config){
+    std::unique_ptr<VectorReader> feat = open_vector_reader(config.feat_path, config.mmap);
+    config.max_elements = feat->size();
+    config.dim = feat->dim();
+    if (!config.index_path.empty() || config.builder != "hnsw")
+    {
+        spdlog::error("The annlib engine builds its own index with the hnsw builder");
+        exit(-1);
+    }
+    if (!config.sweep_ef.empty())
+    {
+        spdlog::error("The sweep mode runs on the hnswlib engine");
+        exit(-1);
+    }
+    spdlog::info("Engine=annlib");
+    spdlog::info("AnnDataType={}", config.ann_data_type);
+
+    // the annlib index is built from all the vectors, converted to data_t
+    std::vector<data_t> feat_data(config.max_elements * config.dim);
+    feat->read(0, config.max_elements, feat_data.data());
+    ann::Matrix2D<data_t> data(config.max_elements, config.dim, feat_data.data());
+    ann::HNSW<data_t, distance_type, true> index;
+    index.SetBuildConfig(ann::HNSWBuildConfig{(ann::id_t) config.ef_construction, (ann::id_t) config.M});
+
+    Timer timer;
+    timer.start();
+    index.BuildIndex(data);
+    timer.end();
+    spdlog::info("BuildTime={} secs", timer.seconds());
+    spdlog::info("Layers={}", index.GetNumLayers());
+    spdlog::info("IndexMemory={0:.2f} MB", index.GetMemoryUsage() / 1e6);
+
+    if (config.query_path.empty() || config.truth_path.empty())
+    {
+        return;
     }
+    QuerySet<data_t> query_set = load_query_set<data_t>(config);
+    int64_t num_queries = query_set.num_queries;
+    ann::Matrix2D<data_t> queries(num_queries, config.dim, query_set.queries.data());
 
+    ann::HNSWSearchConfig search_config{(ann::id_t) config.ef, (ann::id_t) config.k};
+    timer.start();
+    auto results = index.SearchKnnBatch(search_config, queries);
+    timer.end();
+    double search_time = timer.seconds();
+    spdlog::info("SearchTime={0:.2f} secs", search_time);
+    spdlog::info("QPS={0:.2f}", num_queries / search_time);
 
+    int64_t total_matched = 0;
+    auto ground_truths = std::span(query_set.truth);
+    for (int64_t i = 0; i < num_queries; i++)
+    {
+        auto ground_truth = ground_truths.subspan(i * query_set.truth_k, config.k);
+        while (!results[i].empty())
+        {
+            total_matched += std::find(ground_truth.begin(), ground_truth.end(), results[i].top().second) != ground_truth.end();
+            results[i].pop();
+        }
+    }
+    spdlog::info("Recall={0:.2f}%", 100.0 * total_matched / (config.k * num_queries));
+
+    long num_upper_hops = 0;
+    long num_upper_dist = 0;
+    for (int l = 1; l < index.GetNumLayers(); l++)
+    {
+        num_upper_hops += index.GetNumHops(l);
+        num_upper_dist += index.GetNumDists(l);
+    }
+    long num_base_hops = index.GetNumHops(0);
+    long num_base_dist = index.GetNumDists(0);
+    spdlog::info("UpperHops={}", num_upper_hops);
+    spdlog::info("BaseHops={}", num_base_hops);
+    spdlog::info("UpperDist={}", num_upper_dist);
+    spdlog::info("BaseDist={}", num_base_dist);
+    spdlog::info("QHops={0:.2f}", 1.0 * (num_upper_hops + num_base_hops) / num_queries);
+    spdlog::info("QDist={0:.2f}", 1.0 * (num_upper_dist + num_base_dist) / num_queries);
 }
 
+
 int main(int argc, char *argv[])
 {
     HNSWConfig config = get_hnsw_config(argc, argv);
-    oneapi::tbb::global_control global_limit(oneapi::tbb::global_control::max_allowed_parallelism, config.num_threads);
+    // the arenas of a sweep can use more threads than --num_threads
+    int64_t max_threads = config.num_threads;
+    for (int threads : config.sweep_threads)
+        max_threads = std::max<int64_t>(max_threads, threads);
+    oneapi::tbb::global_control global_limit(oneapi::tbb::global_control::max_allowed_parallelism, max_threads);
+    if (config.engine == "annlib") {
+        bool fp16 = config.ann_data_type == "float16";
+        if (config.space == "ip") {
+            fp16 ? benchmark_ann<float16, ann::DistanceType::Ip>(config) : benchmark_ann<float, ann::DistanceType::Ip>(config);
+        } else if (config.space == "l2") {
+            fp16 ? benchmark_ann<float16, ann::DistanceType::L2>(config) : benchmark_ann<float, ann::DistanceType::L2>(config);
+        } else if (config.space == "l2uint8") {
+            benchmark_ann<uint8_t, ann::DistanceType::L2>(config);
+        }
+        return 0;
+    } else if (config.engine != "hnswlib") {
+        spdlog::error("Unsupported engine {}", config.engine);
+        exit(-1);
+    }
     if (config.space == "ip") {
-        benchmark<hnswlib::InnerProductSpace, float>(config);
+        benchmark<hnswlib::InnerProductSpace, float, float>(config);
     } else if (config.space == "l2") {
-        benchmark<hnswlib::L2Space, float>(config);
+        benchmark<hnswlib::L2Space, float, float>(config);
     } else if (config.space == "l2uint8") {
-        benchmark<hnswlib::L2SpaceI, int>(config);
+        benchmark<hnswlib::L2SpaceI, int, uint8_t>(config);
     }
 }
\ No newline at end of file
@@ -1,22 +1,53 @@
 #include "argparse.hpp"
 #include "utils.hpp"
 
+#include <fstream>
+
 namespace profiler {
     HNSWConfig get_hnsw_config(int argc, char *argv[]) {
         HNSWConfig config;
         argparse::ArgumentParser program("HNSW profiler");
-        program.add_argument("--space").help("one of l2, ip, or l2uint8").required();
+        program.add_argument("--space").help("one of l2, ip, or l2uint8 (uint8 vectors)").required();
         program.add_argument("--M").help(" maximum number of outgoing connections in the graph").scan<'i', int>().required();
         program.add_argument("--ef_construction").help("priority queue capacity during the index construction").scan<'i', int>().required();
 
+        program.add_argument("--engine").help("index benchmarked: hnswlib (HierarchicalNSW) or annlib (ann::HNSW, frozen NSWGraph layers)").default_value("hnswlib");
+        program.add_argument("--ann_data_type").help("vectors of the annlib engine for the float spaces: float or float16").default_value("float");
+        program.add_argument("--builder").help("construction of the index: hnsw, vamana (single layer, RobustPrune) or nnd (pruned NN-Descent kNN graph)").default_value("hnsw");
+        program.add_argument("--alpha").help("pruning relaxation of the vamana and nnd builders").scan<'g', double>().default_value(1.2);
+        program.add_argument("--knn_k").help("neighbors per element of the NN-Descent graph, 0 for 2 * M").scan<'i', int>().default_value(0);
+        program.add_argument("--nnd_iterations").help("maximum rounds of NN-Descent").scan<'i', int>().default_value(10);
+
+        program.add_argument("--huge_pages").help("pages backing the index: none, thp, 2mb or 1gb").default_value("none");
+        program.add_argument("--numa").help("NUMA placement of the index: none, interleave or replicate (one copy per node)").default_value("none");
+        program.add_argument("--layout").help("storage of the base layer: interleaved or split (separate link list and vector arenas)").default_value("interleaved");
+        program.add_argument("--neighbor_codes").help("compressed neighbor codes stored with the link lists: none or sq4").default_value("none");
+        program.add_argument("--rerank").help("candidates reranked with the full vectors when searching on the codes, 0 for ef").scan<'i', int>().default_value(0);
+        program.add_argument("--disk_index").help("write the out-of-core index to this path and search it instead of the index in memory").default_value("");
+        program.add_argument("--beam_width").help("records read per step of the out-of-core search").scan<'i', int>().default_value(4);
+        program.add_argument("--direct_io").help("read the out-of-core index with O_DIRECT").default_value(false).implicit_value(true);
+
         program.add_argument("--ef").help("priority queue capacity during the index construction").scan<'i', int>().required();
         program.add_argument("--num_threads").help("capacity of the index").scan<'i', int>().required();
         program.add_argument("--k").help("top k search index").scan<'i', int>().required();
+        program.add_argument("--reorder").help("reorder the index before the search: none, bfs, rcm or gorder").default_value("none");
+        program.add_argument("--entry").help("where the searches start: hierarchy, medoid, diverse or router").default_value("hierarchy");
+        program.add_argument("--num_entries").help("entries of the diverse and router strategies").scan<'i', int>().default_value(16);
+        program.add_argument("--navigation").help("from the entry to the base layer: hierarchy (upper layers), flat (table of the level 1 graph) or none").default_value("hierarchy");
 
-        program.add_argument("--feat_path").help("path to the feature file").required();
+        program.add_argument("--sweep_ef").help("sweep mode: search the index with every ef of the list").nargs(argparse::nargs_pattern::at_least_one).scan<'i', int>();
+        program.add_argument("--sweep_k").help("top k of the sweep, --k when not given").nargs(argparse::nargs_pattern::at_least_one).scan<'i', int>();
+        program.add_argument("--sweep_threads").help("threads of the sweep, --num_threads when not given").nargs(argparse::nargs_pattern::at_least_one).scan<'i', int>();
+        program.add_argument("--warmup").help("untimed runs of the queries before the trials of a sweep point").scan<'i', int>().default_value(1);
+        program.add_argument("--trials").help("timed runs of the queries per sweep point").scan<'i', int>().default_value(3);
+        program.add_argument("--sweep_out").help("sweep results, csv or json (.json)").default_value("");
+
+        program.add_argument("--feat_path").help("path to the feature file (.npy, .fvecs, .bvecs, .fbin or .u8bin)").required();
+        program.add_argument("--mmap").help("map the feature file instead of reading it").default_value(false).implicit_value(true);
+        program.add_argument("--chunk_size").help("feature vectors read at a time by the hnsw builder").scan<'i', int>().default_value(1 << 20);
         program.add_argument("--index_path").help("path to the graph index file").default_value("");
         program.add_argument("--query_path").help("path to the query feature file").default_value("");
-        program.add_argument("--truth_path").help("path to the ground truth file").default_value("");
+        program.add_argument("--truth_path").help("path to the ground truth ids (.npy, .ivecs or .ibin)").default_value("");
 
         program.add_argument("--index_out").help("index output directory").default_value("");
         program.add_argument("--profile_out").help("profile output directory").default_value("/tmp/out.log");
@@ -25,12 +56,38 @@ namespace profiler {
         config.space = program.get<std::string>("--space");
         config.M = program.get<int>("--M");
         config.ef_construction = program.get<int>("--ef_construction");
+        config.engine = program.get<std::string>("--engine");
+        config.ann_data_type = program.get<std::string>("--ann_data_type");
+        config.builder = program.get<std::string>("--builder");
+        config.alpha = program.get<double>("--alpha");
+        config.knn_k = program.get<int>("--knn_k");
+        config.nnd_iterations = program.get<int>("--nnd_iterations");
+        config.huge_pages = program.get<std::string>("--huge_pages");
+        config.numa = program.get<std::string>("--numa");
+        config.layout = program.get<std::string>("--layout");
+        config.neighbor_codes = program.get<std::string>("--neighbor_codes");
+        config.rerank = program.get<int>("--rerank");
+        config.disk_index = program.get<std::string>("--disk_index");
+        config.beam_width = program.get<int>("--beam_width");
+        config.direct_io = program.get<bool>("--direct_io");
 
         config.ef = program.get<int>("--ef");
         config.num_threads = program.get<int>("--num_threads");
         config.k = program.get<int>("--k");
+        config.reorder = program.get<std::string>("--reorder");
+        config.entry = program.get<std::string>("--entry");
+        config.num_entries = program.get<int>("--num_entries");
+        config.navigation = program.get<std::string>("--navigation");
+        config.sweep_ef = program.present<std::vector<int>>("--sweep_ef").value_or(std::vector<int>{});
+        config.sweep_k = program.present<std::vector<int>>("--sweep_k").value_or(std::vector<int>{});
+        config.sweep_threads = program.present<std::vector<int>>("--sweep_threads").value_or(std::vector<int>{});
+        config.warmup = program.get<int>("--warmup");
+        config.trials = program.get<int>("--trials");
+        config.sweep_out = program.get<std::string>("--sweep_out");
 
         config.feat_path = program.get<std::string>("--feat_path");
+        config.mmap = program.get<bool>("--mmap");
+        config.chunk_size = program.get<int>("--chunk_size");
         config.index_path = program.get<std::string>("--index_path");
         config.query_path = program.get<std::string>("--query_path");
         config.truth_path = program.get<std::string>("--truth_path");
@@ -40,4 +97,83 @@ namespace profiler {
 
         return config;
     };
+
+    namespace {
+        std::string json_string(const std::string &value) {
+            std::string ret = "\"";
+            for (char c : value) {
+                if (c == '"' || c == '\\')
+                    ret += '\\';
+                ret += c;
+            }
+            return ret + "\"";
+        }
+    } // namespace
+
+    void write_sweep(const HNSWConfig &config, int64_t num_queries, const std::vector<SweepPoint> &points) {
+        std::ofstream output(config.sweep_out);
+        if (!output)
+            throw std::runtime_error("Cannot open file " + config.sweep_out);
+        output.precision(6);
+        output << std::fixed;
+        bool json = config.sweep_out.size() >= 5 && config.sweep_out.compare(config.sweep_out.size() - 5, 5, ".json") == 0;
+        if (json) {
+            output << "{\n  \"config\": {"
+                   << "\"feat_path\": " << json_string(config.feat_path)
+                   << ", \"space\": " << json_string(config.space)
+                   << ", \"builder\": " << json_string(config.index_path.empty() ? config.builder : "loaded")
+                   << ", \"M\": " << config.M
+                   << ", \"ef_construction\": " << config.ef_construction
+                   << ", \"num_queries\": " << num_queries
+                   << ", \"warmup\": " << config.warmup
+                   << ", \"trials\": " << config.trials << "},\n  \"points\": [";
+            for (size_t i = 0; i < points.size(); i++) {
+                const SweepPoint &p = points[i];
+                output << (i ? ",\n" : "\n") << "    {\"ef\": " << p.ef << ", \"k\": " << p.k << ", \"threads\": " << p.threads
+                       << ", \"recall\": " << p.recall << ", \"qps\": " << p.qps
+                       << ", \"p50_us\": " << p.p50_us << ", \"p95_us\": " << p.p95_us << ", \"p99_us\": " << p.p99_us
+                       << ", \"mean_us\": " << p.mean_us << ", \"hops\": " << p.hops << ", \"dists\": " << p.dists << "}";
+            }
+            output << "\n  ]\n}\n";
+        } else {
+            output << "builder,M,ef_construction,ef,k,threads,recall,qps,p50_us,p95_us,p99_us,mean_us,hops,dists\n";
+            for (const SweepPoint &p : points) {
+                output << (config.index_path.empty() ? config.builder : "loaded") << "," << config.M << "," << config.ef_construction
+                       << "," << p.ef << "," << p.k << "," << p.threads << "," << p.recall << "," << p.qps
+                       << "," << p.p50_us << "," << p.p95_us << "," << p.p99_us << "," << p.mean_us
+                       << "," << p.hops << "," << p.dists << "\n";
+            }
+        }
+    }
+
+    GroundTruthConfig get_gt_config(int argc, char *argv[]) {
+        GroundTruthConfig config;
+        argparse::ArgumentParser program("Ground truth builder");
+        program.add_argument("--space").help("one of l2, ip, cosine or l2uint8").required();
+        program.add_argument("--k").help("neighbors written per query").scan<'i', int>().required();
+        program.add_argument("--num_threads").help("threads computing the distances").scan<'i', int>().required();
+        program.add_argument("--chunk_size").help("base vectors in memory at a time").scan<'i', int>().default_value(1 << 20);
+        program.add_argument("--mmap").help("map the base file instead of reading it").default_value(false).implicit_value(true);
+
+        program.add_argument("--base_path").help("path to the base vectors (.npy, .fvecs, .bvecs, .fbin or .u8bin)").required();
+        program.add_argument("--query_path").help("path to the query vectors (.npy, .fvecs, .bvecs, .fbin or .u8bin)").required();
+
+        program.add_argument("--truth_out").help("ids of the neighbors (int32 .npy, the truth_path of the profiler)").required();
+        program.add_argument("--distances_out").help("distances of the neighbors (float32 .npy)").default_value("");
+        program.parse_args(argc, argv);
+
+        config.space = program.get<std::string>("--space");
+        config.k = program.get<int>("--k");
+        config.num_threads = program.get<int>("--num_threads");
+        config.chunk_size = program.get<int>("--chunk_size");
+        config.mmap = program.get<bool>("--mmap");
+
+        config.base_path = program.get<std::string>("--base_path");
+        config.query_path = program.get<std::string>("--query_path");
+
+        config.truth_out = program.get<std::string>("--truth_out");
+        config.distances_out = program.get<std::string>("--distances_out");
+
+        return config;
+    };
 } // namespace profiler
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include "timer.hpp"
 
@@ -28,16 +29,44 @@ namespace profiler {
         int64_t M; // parameter that defines the maximum number of outgoing connections in the graph.
         int64_t ef_construction; // parameter that controls speed/accuracy trade-off during the index construction.
         int64_t max_elements; //  capacity of the index
+        std::string engine; // index benchmarked: hnswlib or annlib
+        std::string ann_data_type; // vectors of the annlib engine for the float spaces: float or float16
+        std::string builder; // construction of the index: hnsw (addPoint), vamana or nnd
+        double alpha; // pruning relaxation of the vamana and nnd builders
+        int64_t knn_k; // neighbors per element of the NN-Descent graph, 0 for 2 * M
+        int64_t nnd_iterations; // maximum rounds of NN-Descent
+        std::string huge_pages; // pages backing the index: none, thp, 2mb or 1gb
+        std::string numa; // NUMA placement of the index: none, interleave or replicate
+        std::string layout; // storage of the base layer: interleaved or split
+        std::string neighbor_codes; // codes stored with the link lists: none or sq4
+        int64_t rerank; // candidates reranked with the full vectors when searching on the codes, 0 for ef
+        std::string disk_index; // path of the out-of-core index written from the index and searched instead of it
+        int64_t beam_width; // records read per step of the out-of-core search
+        bool direct_io; // read the out-of-core index with O_DIRECT
 
         // query time parameters:
         int64_t ef;
         int64_t num_threads;
         int64_t k;
+        std::string reorder; // reordering of the index before the search: none, bfs, rcm or gorder
+        std::string entry; // where the searches start: hierarchy, medoid, diverse or router
+        int64_t num_entries; // entries of the diverse and router strategies
+        std::string navigation; // from the entry to the base layer: hierarchy, flat or none
 
-        std::string feat_path;
+        // sweep mode, the same index searched for every (threads, k, ef):
+        std::vector<int> sweep_ef; // empty for a single run with ef
+        std::vector<int> sweep_k; // empty for k
+        std::vector<int> sweep_threads; // empty for num_threads
+        int64_t warmup; // untimed runs of the queries before the trials of a point
+        int64_t trials; // timed runs of the queries per point
+        std::string sweep_out; // results of the points: csv, or json when the path ends with .json
+
+        std::string feat_path; // .npy, .fvecs, .bvecs, .fbin or .u8bin
+        bool mmap; // map the feature file instead of reading it
+        int64_t chunk_size; // feature vectors read at a time by the hnsw builder
         std::string index_path;
         std::string query_path;
-        std::string truth_path;
+        std::string truth_path; // .npy, .ivecs or .ibin ids
 
         std::string index_out;
         std::string profile_out;
@@ -49,4 +78,37 @@ namespace profiler {
 
     HNSWConfig get_hnsw_config(int argc, char *argv[]);
 
+    // one point of a sweep, the latencies are per query in microseconds, hops and dists per query
+    struct SweepPoint {
+        int64_t ef;
+        int64_t k;
+        int64_t threads;
+        double recall;
+        double qps; // median of the trials
+        double p50_us;
+        double p95_us;
+        double p99_us;
+        double mean_us;
+        double hops;
+        double dists;
+    };
+
+    void write_sweep(const HNSWConfig &config, int64_t num_queries, const std::vector<SweepPoint> &points);
+
+    struct GroundTruthConfig {
+        std::string space; // name of the space (can be one of "l2", "ip", "cosine" or "l2uint8").
+        int64_t k; // neighbors written per query.
+        int64_t num_threads;
+        int64_t chunk_size; // base vectors in memory at a time.
+        bool mmap; // map the base file instead of reading it.
+
+        std::string base_path; // .npy, .fvecs, .bvecs, .fbin or .u8bin
+        std::string query_path;
+
+        std::string truth_out; // ids (int32, queries x k), closer first
+        std::string distances_out; // distances (float32, queries x k)
+    };
+
+    GroundTruthConfig get_gt_config(int argc, char *argv[]);
+
 } // namespace profiler
@@ -94,6 +94,78 @@ class CustomFilterFunctor: public hnswlib::BaseFilterFunctor {
 };
 
 
+/*
+ * Converts the `filter` argument of knn_query into a filter functor:
+ *  - a python callable is wrapped into CustomFilterFunctor, every call re-acquires the GIL
+ *  - a numpy bool mask indexed by label becomes a label bitset
+ *  - an array of allowed labels is passed to `make_ids_filter`, which builds a bitset over internal ids
+ * The bitsets are checked inline in the search loop and do not touch python.
+ */
+template<typename MakeIdsFilter>
+inline std::unique_ptr<hnswlib::BaseFilterFunctor> get_filter_functor(const py::object& filter, MakeIdsFilter make_ids_filter) {
+    if (filter.is_none()) {
+        return nullptr;
+    }
+    if (PyCallable_Check(filter.ptr())) {
+        return std::unique_ptr<hnswlib::BaseFilterFunctor>(
+            new CustomFilterFunctor(filter.cast<std::function<bool(hnswlib::labeltype)>>()));
+    }
+    py::array filter_array = py::array::ensure(filter);
+    if (!filter_array || filter_array.ndim() != 1) {
+        throw std::runtime_error("Filter must be a callable, a 1D boolean mask over labels or a 1D array of allowed labels");
+    }
+    if (filter_array.dtype().kind() == 'b') {
+        py::array_t < bool, py::array::c_style | py::array::forcecast > mask(filter_array);
+        std::unique_ptr<hnswlib::BitsetFilterFunctor> bitset(new hnswlib::BitsetFilterFunctor(mask.size()));
+        for (size_t i = 0; i < (size_t) mask.size(); i++) {
+            if (mask.data()[i]) {
+                bitset->set(i);
+            }
+        }
+        return std::unique_ptr<hnswlib::BaseFilterFunctor>(bitset.release());
+    }
+    py::array_t < hnswlib::labeltype, py::array::c_style | py::array::forcecast > ids(filter_array);
+    return std::unique_ptr<hnswlib::BaseFilterFunctor>(
+        new hnswlib::BitsetFilterFunctor(make_ids_filter(ids.data(), ids.size())));
+}
+
+
+/*
+ * Converts the per-query results of a range search into (list of label arrays, list of distance arrays).
+ */
+template<typename dist_t>
+inline py::object range_results_to_lists(const std::vector<std::vector<std::pair<dist_t, hnswlib::labeltype>>>& results) {
+    py::list labels;
+    py::list distances;
+    for (auto& result : results) {
+        py::array_t<hnswlib::labeltype> result_labels(result.size());
+        py::array_t<dist_t> result_distances(result.size());
+        hnswlib::labeltype* labels_ptr = result_labels.mutable_data();
+        dist_t* distances_ptr = result_distances.mutable_data();
+        for (size_t i = 0; i < result.size(); i++) {
+            distances_ptr[i] = result[i].first;
+            labels_ptr[i] = result[i].second;
+        }
+        labels.append(result_labels);
+        distances.append(result_distances);
+    }
+    return py::make_tuple(labels, distances);
+}
+
+
+inline hnswlib::PageMode get_page_mode(const std::string& huge_pages) {
+    if (huge_pages == "none")
+        return hnswlib::PAGES_DEFAULT;
+    if (huge_pages == "thp")
+        return hnswlib::PAGES_TRANSPARENT_HUGE;
+    if (huge_pages == "2mb")
+        return hnswlib::PAGES_HUGE_2MB;
+    if (huge_pages == "1gb")
+        return hnswlib::PAGES_HUGE_1GB;
+    throw std::runtime_error("huge_pages must be one of none, thp, 2mb, or 1gb.");
+}
+
+
 inline void get_input_array_shapes(const py::buffer_info& buffer, size_t* rows, size_t* features) {
     if (buffer.ndim != 2 && buffer.ndim != 1) {
         char msg[256];
@@ -194,12 +266,14 @@ class Index {
         size_t M,
         size_t efConstruction,
         size_t random_seed,
-        bool allow_replace_deleted) {
+        bool allow_replace_deleted,
+        const std::string &huge_pages) {
         if (appr_alg) {
             throw std::runtime_error("The index is already initiated.");
         }
         cur_l = 0;
-        appr_alg = new hnswlib::HierarchicalNSW<dist_t>(l2space, maxElements, M, efConstruction, random_seed, allow_replace_deleted);
+        appr_alg = new hnswlib::HierarchicalNSW<dist_t>(l2space, maxElements, M, efConstruction, random_seed, allow_replace_deleted,
+                                                        get_page_mode(huge_pages));
         index_inited = true;
         ep_added = false;
         appr_alg->ef_ = default_ef;
@@ -218,6 +292,32 @@ class Index {
         this->num_threads_default = num_threads;
     }
 
+
+    void setEarlyTermination(size_t patience, float distance_ratio) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        appr_alg->setEarlyTermination(patience, distance_ratio);
+    }
+
+
+    void setFilteredSearchPlanner(double brute_force_factor, double two_hop_selectivity, double expand_ef_selectivity) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        appr_alg->setFilteredSearchPlanner(brute_force_factor, two_hop_selectivity, expand_ef_selectivity);
+    }
+
+
+    py::dict getFilteredSearchStats() const {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef hnswlib::HierarchicalNSW<dist_t> Alg;
+        return py::dict(
+            "graph"_a = (long) appr_alg->metric_filtered_search_plans[Alg::PLAN_GRAPH],
+            "expanded_ef"_a = (long) appr_alg->metric_filtered_search_plans[Alg::PLAN_EXPANDED_EF],
+            "two_hop"_a = (long) appr_alg->metric_filtered_search_plans[Alg::PLAN_TWO_HOP],
+            "brute_force"_a = (long) appr_alg->metric_filtered_search_plans[Alg::PLAN_BRUTE_FORCE]);
+    }
+
     size_t indexFileSize() const {
         return appr_alg->indexFileSize();
     }
@@ -227,12 +327,13 @@ class Index {
     }
 
 
-    void loadIndex(const std::string &path_to_index, size_t max_elements, bool allow_replace_deleted) {
+    void loadIndex(const std::string &path_to_index, size_t max_elements, bool allow_replace_deleted, const std::string &huge_pages) {
+      hnswlib::PageMode page_mode = get_page_mode(huge_pages);
       if (appr_alg) {
           std::cerr << "Warning: Calling load_index for an already inited index. Old index is being deallocated." << std::endl;
           delete appr_alg;
       }
-      appr_alg = new hnswlib::HierarchicalNSW<dist_t>(l2space, path_to_index, false, max_elements, allow_replace_deleted);
+      appr_alg = new hnswlib::HierarchicalNSW<dist_t>(l2space, path_to_index, false, max_elements, allow_replace_deleted, page_mode);
       cur_l = appr_alg->cur_element_count;
       index_inited = true;
     }
@@ -248,7 +349,13 @@ class Index {
     }
 
 
-    void addItems(py::object input, py::object ids_ = py::none(), int num_threads = -1, bool replace_deleted = false) {
+    void addItems(
+        py::object input,
+        py::object ids_ = py::none(),
+        int num_threads = -1,
+        bool replace_deleted = false,
+        py::object attributes_ = py::none(),
+        hnswlib::namespacetype namespace_id = 0) {
         py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
         auto buffer = items.request();
         if (num_threads <= 0)
@@ -267,6 +374,20 @@ class Index {
 
         std::vector<size_t> ids = get_input_ids_and_check_shapes(ids_, rows);
 
+        // attributes: a sequence with an iterable of attribute ids for every element
+        std::vector<std::vector<hnswlib::attributetype>> attributes;
+        if (!attributes_.is_none()) {
+            attributes = attributes_.cast<std::vector<std::vector<hnswlib::attributetype>>>();
+            if (attributes.size() != rows)
+                throw std::runtime_error("The number of attribute sets must match the number of vectors");
+        }
+        auto add_point = [&](const void* vector_data, size_t id, size_t row) {
+            if (attributes.empty())
+                appr_alg->addPointToNamespace(vector_data, id, namespace_id, replace_deleted);
+            else
+                appr_alg->addPointWithAttributes(vector_data, id, attributes[row], replace_deleted, namespace_id);
+        };
+
         {
             int start = 0;
             if (!ep_added) {
@@ -277,7 +398,7 @@ class Index {
                     normalize_vector(vector_data, norm_array.data());
                     vector_data = norm_array.data();
                 }
-                appr_alg->addPoint((void*)vector_data, (size_t)id, replace_deleted);
+                add_point((void*)vector_data, (size_t)id, 0);
                 start = 1;
                 ep_added = true;
             }
@@ -286,7 +407,7 @@ class Index {
             if (normalize == false) {
                 ParallelFor(start, rows, num_threads, [&](size_t row, size_t threadId) {
                     size_t id = ids.size() ? ids.at(row) : (cur_l + row);
-                    appr_alg->addPoint((void*)items.data(row), (size_t)id, replace_deleted);
+                    add_point((void*)items.data(row), (size_t)id, row);
                     });
             } else {
                 std::vector<float> norm_array(num_threads * dim);
@@ -296,7 +417,7 @@ class Index {
                     normalize_vector((float*)items.data(row), (norm_array.data() + start_idx));
 
                     size_t id = ids.size() ? ids.at(row) : (cur_l + row);
-                    appr_alg->addPoint((void*)(norm_array.data() + start_idx), (size_t)id, replace_deleted);
+                    add_point((void*)(norm_array.data() + start_idx), (size_t)id, row);
                     });
             }
             cur_l += rows;
@@ -304,6 +425,79 @@ class Index {
     }
 
 
+    void buildVamana(py::object input, py::object ids_ = py::none(), float alpha = 1.2f, int num_threads = -1) {
+        py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
+        auto buffer = items.request();
+        if (num_threads <= 0)
+            num_threads = num_threads_default;
+
+        size_t rows, features;
+        get_input_array_shapes(buffer, &rows, &features);
+
+        if (features != dim)
+            throw std::runtime_error("Wrong dimensionality of the vectors");
+
+        std::vector<size_t> ids = get_input_ids_and_check_shapes(ids_, rows);
+        std::vector<hnswlib::labeltype> labels(rows);
+        for (size_t row = 0; row < rows; row++)
+            labels[row] = ids.size() ? ids.at(row) : (cur_l + row);
+
+        std::vector<float> normalized;
+        const float* vectors = (const float*) items.data();
+        if (normalize) {
+            normalized.resize(rows * dim);
+            for (size_t row = 0; row < rows; row++)
+                normalize_vector((float*) items.data(row), normalized.data() + row * dim);
+            vectors = normalized.data();
+        }
+        {
+            py::gil_scoped_release l;
+            appr_alg->buildVamana(vectors, labels.data(), rows, alpha, num_threads);
+        }
+        cur_l += rows;
+        ep_added = rows > 0;
+    }
+
+
+    void buildFromKnnGraph(py::object input, py::object knn_, py::object ids_ = py::none(), float alpha = 1.2f, int num_threads = -1) {
+        py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
+        auto buffer = items.request();
+        py::array_t < hnswlib::tableint, py::array::c_style | py::array::forcecast > knn(knn_);
+        auto knn_buffer = knn.request();
+        if (num_threads <= 0)
+            num_threads = num_threads_default;
+
+        size_t rows, features;
+        get_input_array_shapes(buffer, &rows, &features);
+
+        if (features != dim)
+            throw std::runtime_error("Wrong dimensionality of the vectors");
+        if (knn_buffer.ndim != 2 || (size_t) knn_buffer.shape[0] != rows)
+            throw std::runtime_error("The kNN graph must be a 2D array with a row per vector");
+        size_t k = knn_buffer.shape[1];
+
+        std::vector<size_t> ids = get_input_ids_and_check_shapes(ids_, rows);
+        std::vector<hnswlib::labeltype> labels(rows);
+        for (size_t row = 0; row < rows; row++)
+            labels[row] = ids.size() ? ids.at(row) : (cur_l + row);
+
+        std::vector<float> normalized;
+        const float* vectors = (const float*) items.data();
+        if (normalize) {
+            normalized.resize(rows * dim);
+            for (size_t row = 0; row < rows; row++)
+                normalize_vector((float*) items.data(row), normalized.data() + row * dim);
+            vectors = normalized.data();
+        }
+        {
+            py::gil_scoped_release l;
+            appr_alg->buildFromKnnGraph(vectors, labels.data(), rows, knn.data(), k, alpha, num_threads);
+        }
+        cur_l += rows;
+        ep_added = rows > 0;
+    }
+
+
     py::object getData(py::object ids_ = py::none(), std::string return_type = "numpy") {
         std::vector<std::string> return_types{"numpy", "list"};
         if (std::find(std::begin(return_types), std::end(return_types), return_type) == std::end(return_types)) {
@@ -381,7 +575,7 @@ class Index {
 
         memset(link_list_npy, 0, link_npy_size);
 
-        memcpy(data_level0_npy, appr_alg->data_level0_memory_, level0_npy_size);
+        appr_alg->getLevel0Records(data_level0_npy, 0, appr_alg->cur_element_count);
         memcpy(element_levels_npy, appr_alg->element_levels_.data(), appr_alg->element_levels_.size() * sizeof(int));
 
         for (size_t i = 0; i < appr_alg->cur_element_count; i++) {
@@ -428,6 +622,7 @@ class Index {
             "has_deletions"_a = (bool)appr_alg->num_deleted_,
             "size_links_per_element"_a = appr_alg->size_links_per_element_,
             "allow_replace_deleted"_a = appr_alg->allow_replace_deleted_,
+            "level0_layout"_a = (int) appr_alg->getLevel0Layout(),
 
             "label_lookup_external"_a = py::array_t<hnswlib::labeltype>(
                 { appr_alg->label_lookup_.size() },  // shape
@@ -529,6 +724,9 @@ class Index {
         assert_true(appr_alg->offsetLevel0_ == d["offset_level0"].cast<size_t>(), "Invalid value of offsetLevel0_ ");
         assert_true(appr_alg->max_elements_ == d["max_elements"].cast<size_t>(), "Invalid value of max_elements_ ");
 
+        if (d.contains("level0_layout")) {
+            appr_alg->setLevel0Layout((typename hnswlib::HierarchicalNSW<dist_t>::Level0Layout) d["level0_layout"].cast<int>());
+        }
         appr_alg->cur_element_count = d["cur_element_count"].cast<size_t>();
 
         assert_true(appr_alg->size_data_per_element_ == d["size_data_per_element"].cast<size_t>(), "Invalid value of size_data_per_element_ ");
@@ -574,7 +772,7 @@ class Index {
                 link_npy_size += linkListSize;
         }
 
-        memcpy(appr_alg->data_level0_memory_, data_level0_npy.data(), data_level0_npy.nbytes());
+        appr_alg->setLevel0Records(data_level0_npy.data(), 0, appr_alg->cur_element_count);
 
         for (size_t i = 0; i < appr_alg->max_elements_; i++) {
             size_t linkListSize = appr_alg->element_levels_[i] > 0 ? appr_alg->size_links_per_element_ * appr_alg->element_levels_[i] : 0;
@@ -613,7 +811,10 @@ class Index {
         py::object input,
         size_t k = 1,
         int num_threads = -1,
-        const std::function<bool(hnswlib::labeltype)>& filter = nullptr) {
+        py::object filter = py::none(),
+        py::object attribute = py::none(),
+        hnswlib::namespacetype namespace_id = 0,
+        int search_threads = 1) {
         py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
         auto buffer = items.request();
         hnswlib::labeltype* data_numpy_l;
@@ -623,6 +824,29 @@ class Index {
         if (num_threads <= 0)
             num_threads = num_threads_default;
 
+        if (!filter.is_none() && !attribute.is_none())
+            throw std::runtime_error("filter and attribute cannot be used together");
+        if (namespace_id != 0 && !attribute.is_none())
+            throw std::runtime_error("namespace and attribute cannot be used together");
+        if (search_threads > 1 && (namespace_id != 0 || !attribute.is_none()))
+            throw std::runtime_error("search_threads cannot be used with namespace or attribute");
+        std::unique_ptr<hnswlib::BaseFilterFunctor> idFilter = get_filter_functor(filter,
+            [this](const hnswlib::labeltype* ids, size_t num_ids) {
+                return appr_alg->createInternalIdFilter(ids, num_ids);
+            });
+        hnswlib::BaseFilterFunctor* p_idFilter = idFilter.get();
+        bool use_attribute = !attribute.is_none();
+        hnswlib::attributetype attribute_id = use_attribute ? attribute.cast<hnswlib::attributetype>() : 0;
+        auto search = [&](const void* query_data) {
+            if (use_attribute)
+                return appr_alg->searchKnnWithAttribute(query_data, k, attribute_id);
+            if (namespace_id != 0)
+                return appr_alg->searchKnnInNamespace(query_data, k, namespace_id, p_idFilter);
+            if (search_threads > 1)
+                return appr_alg->searchKnnParallel(query_data, k, search_threads, p_idFilter);
+            return appr_alg->searchKnn(query_data, k, p_idFilter);
+        };
+
         {
             py::gil_scoped_release l;
             get_input_array_shapes(buffer, &rows, &features);
@@ -635,14 +859,11 @@ class Index {
             data_numpy_l = new hnswlib::labeltype[rows * k];
             data_numpy_d = new dist_t[rows * k];
 
-            // Warning: search with a filter works slow in python in multithreaded mode. For best performance set num_threads=1
-            CustomFilterFunctor idFilter(filter);
-            CustomFilterFunctor* p_idFilter = filter ? &idFilter : nullptr;
-
+            // Warning: search with a callable filter works slow in python in multithreaded mode.
+            // For best performance set num_threads=1 or pass a boolean mask / an array of allowed ids
             if (normalize == false) {
                 ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
-                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = appr_alg->searchKnn(
-                        (void*)items.data(row), k, p_idFilter);
+                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = search((void*)items.data(row));
                     if (result.size() != k)
                         throw std::runtime_error(
                             "Cannot return the results in a contiguous 2D array. Probably ef or M is too small");
@@ -661,8 +882,7 @@ class Index {
                     size_t start_idx = threadId * dim;
                     normalize_vector((float*)items.data(row), (norm_array.data() + start_idx));
 
-                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = appr_alg->searchKnn(
-                        (void*)(norm_array.data() + start_idx), k, p_idFilter);
+                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = search((void*)(norm_array.data() + start_idx));
                     if (result.size() != k)
                         throw std::runtime_error(
                             "Cannot return the results in a contiguous 2D array. Probably ef or M is too small");
@@ -697,6 +917,50 @@ class Index {
     }
 
 
+    py::object rangeQuery(
+        py::object input,
+        dist_t radius,
+        size_t max_results = 0,
+        int num_threads = -1,
+        py::object filter = py::none()) {
+        py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
+        auto buffer = items.request();
+        size_t rows, features;
+
+        if (num_threads <= 0)
+            num_threads = num_threads_default;
+
+        std::unique_ptr<hnswlib::BaseFilterFunctor> idFilter = get_filter_functor(filter,
+            [this](const hnswlib::labeltype* ids, size_t num_ids) {
+                return appr_alg->createInternalIdFilter(ids, num_ids);
+            });
+        hnswlib::BaseFilterFunctor* p_idFilter = idFilter.get();
+        std::vector<std::vector<std::pair<dist_t, hnswlib::labeltype>>> results;
+
+        {
+            py::gil_scoped_release l;
+            get_input_array_shapes(buffer, &rows, &features);
+
+            if (rows <= num_threads * 4) {
+                num_threads = 1;
+            }
+
+            results.resize(rows);
+            std::vector<float> norm_array(normalize ? num_threads * features : 0);
+            ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
+                const void* query_data = items.data(row);
+                if (normalize) {
+                    size_t start_idx = threadId * dim;
+                    normalize_vector((float*)items.data(row), (norm_array.data() + start_idx));
+                    query_data = norm_array.data() + start_idx;
+                }
+                results[row] = appr_alg->searchRange(query_data, radius, max_results, p_idFilter);
+            });
+        }
+        return range_results_to_lists(results);
+    }
+
+
     void markDeleted(size_t label) {
         appr_alg->markDelete(label);
     }
@@ -712,6 +976,146 @@ class Index {
     }
 
 
+    py::dict getPageSize() const {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        return py::dict(
+            "level0"_a = appr_alg->getLevel0PageSize(),
+            "link_lists"_a = appr_alg->getLinkListsPageSize());
+    }
+
+
+    void setLevel0Layout(const std::string &layout) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        if (layout == "interleaved") {
+            appr_alg->setLevel0Layout(hnswlib::HierarchicalNSW<dist_t>::LAYOUT_INTERLEAVED);
+        } else if (layout == "split") {
+            appr_alg->setLevel0Layout(hnswlib::HierarchicalNSW<dist_t>::LAYOUT_SPLIT);
+        } else {
+            throw std::runtime_error("layout must be one of interleaved or split.");
+        }
+    }
+
+
+    std::string getLevel0Layout() const {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        return appr_alg->getLevel0Layout() == hnswlib::HierarchicalNSW<dist_t>::LAYOUT_SPLIT ? "split" : "interleaved";
+    }
+
+
+    void setNeighborCodes(const std::string &codes, size_t rerank) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        if (codes == "none") {
+            appr_alg->setNeighborCodes(hnswlib::HierarchicalNSW<dist_t>::NEIGHBOR_CODES_NONE, rerank);
+        } else if (codes == "sq4") {
+            appr_alg->setNeighborCodes(hnswlib::HierarchicalNSW<dist_t>::NEIGHBOR_CODES_SQ4, rerank);
+        } else {
+            throw std::runtime_error("codes must be one of none or sq4.");
+        }
+    }
+
+
+    bool setNumaInterleave(bool numa_interleave) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        return appr_alg->setNumaInterleave(numa_interleave);
+    }
+
+
+    void reorderIndex(const std::string &strategy) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::ReorderStrategy ReorderStrategy;
+        ReorderStrategy reorder_strategy;
+        if (strategy == "bfs") {
+            reorder_strategy = ReorderStrategy::REORDER_BFS;
+        } else if (strategy == "rcm") {
+            reorder_strategy = ReorderStrategy::REORDER_RCM;
+        } else if (strategy == "gorder") {
+            reorder_strategy = ReorderStrategy::REORDER_GORDER;
+        } else {
+            throw std::runtime_error("Reorder strategy must be one of bfs, rcm, or gorder.");
+        }
+        py::gil_scoped_release l;
+        appr_alg->reorderIndex(reorder_strategy);
+    }
+
+
+    void setEntryStrategy(const std::string &strategy, size_t num_entries) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::EntryStrategy EntryStrategy;
+        EntryStrategy entry_strategy;
+        if (strategy == "hierarchy") {
+            entry_strategy = EntryStrategy::ENTRY_HIERARCHY;
+        } else if (strategy == "medoid") {
+            entry_strategy = EntryStrategy::ENTRY_MEDOID;
+        } else if (strategy == "diverse") {
+            entry_strategy = EntryStrategy::ENTRY_DIVERSE;
+        } else if (strategy == "router") {
+            entry_strategy = EntryStrategy::ENTRY_ROUTER;
+        } else {
+            throw std::runtime_error("Entry strategy must be one of hierarchy, medoid, diverse, or router.");
+        }
+        py::gil_scoped_release l;
+        appr_alg->setEntryStrategy(entry_strategy, num_entries);
+    }
+
+
+    std::string getEntryStrategy() const {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::EntryStrategy EntryStrategy;
+        switch (appr_alg->getEntryStrategy()) {
+        case EntryStrategy::ENTRY_MEDOID:
+            return "medoid";
+        case EntryStrategy::ENTRY_DIVERSE:
+            return "diverse";
+        case EntryStrategy::ENTRY_ROUTER:
+            return "router";
+        default:
+            return "hierarchy";
+        }
+    }
+
+
+    void setNavigation(const std::string &navigation) {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::Navigation Navigation;
+        Navigation index_navigation;
+        if (navigation == "hierarchy") {
+            index_navigation = Navigation::NAVIGATION_HIERARCHY;
+        } else if (navigation == "flat") {
+            index_navigation = Navigation::NAVIGATION_FLAT;
+        } else if (navigation == "none") {
+            index_navigation = Navigation::NAVIGATION_NONE;
+        } else {
+            throw std::runtime_error("Navigation must be one of hierarchy, flat, or none.");
+        }
+        py::gil_scoped_release l;
+        appr_alg->setNavigation(index_navigation);
+    }
+
+
+    std::string getNavigation() const {
+        if (!index_inited)
+            throw std::runtime_error("Index not inited");
+        typedef typename hnswlib::HierarchicalNSW<dist_t>::Navigation Navigation;
+        switch (appr_alg->getNavigation()) {
+        case Navigation::NAVIGATION_FLAT:
+            return "flat";
+        case Navigation::NAVIGATION_NONE:
+            return "none";
+        default:
+            return "hierarchy";
+        }
+    }
+
+
     size_t getMaxElements() const {
         return appr_alg->max_elements_;
     }
@@ -831,6 +1235,46 @@ class BFIndex {
     }
 
 
+    py::object rangeQuery(
+        py::object input,
+        dist_t radius,
+        size_t max_results = 0,
+        int num_threads = -1,
+        py::object filter = py::none()) {
+        py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
+        auto buffer = items.request();
+        size_t rows, features;
+
+        if (num_threads <= 0)
+            num_threads = num_threads_default;
+
+        std::unique_ptr<hnswlib::BaseFilterFunctor> idFilter = get_filter_functor(filter,
+            [this](const hnswlib::labeltype* ids, size_t num_ids) {
+                return alg->createInternalIdFilter(ids, num_ids);
+            });
+        hnswlib::BaseFilterFunctor* p_idFilter = idFilter.get();
+        std::vector<std::vector<std::pair<dist_t, hnswlib::labeltype>>> results;
+
+        {
+            py::gil_scoped_release l;
+            get_input_array_shapes(buffer, &rows, &features);
+
+            results.resize(rows);
+            std::vector<float> norm_array(normalize ? num_threads * features : 0);
+            ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
+                const void* query_data = items.data(row);
+                if (normalize) {
+                    size_t start_idx = threadId * dim;
+                    normalize_vector((float*)items.data(row), (norm_array.data() + start_idx));
+                    query_data = norm_array.data() + start_idx;
+                }
+                results[row] = alg->searchRange(query_data, radius, max_results, p_idFilter);
+            });
+        }
+        return range_results_to_lists(results);
+    }
+
+
     void saveIndex(const std::string &path_to_index) {
         alg->saveIndex(path_to_index);
     }
@@ -851,7 +1295,7 @@ class BFIndex {
         py::object input,
         size_t k = 1,
         int num_threads = -1,
-        const std::function<bool(hnswlib::labeltype)>& filter = nullptr) {
+        py::object filter = py::none()) {
         py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
         auto buffer = items.request();
         hnswlib::labeltype *data_numpy_l;
@@ -861,6 +1305,12 @@ class BFIndex {
         if (num_threads <= 0)
             num_threads = num_threads_default;
 
+        std::unique_ptr<hnswlib::BaseFilterFunctor> idFilter = get_filter_functor(filter,
+            [this](const hnswlib::labeltype* ids, size_t num_ids) {
+                return alg->createInternalIdFilter(ids, num_ids);
+            });
+        hnswlib::BaseFilterFunctor* p_idFilter = idFilter.get();
+
         {
             py::gil_scoped_release l;
             get_input_array_shapes(buffer, &rows, &features);
@@ -868,17 +1318,22 @@ class BFIndex {
             data_numpy_l = new hnswlib::labeltype[rows * k];
             data_numpy_d = new dist_t[rows * k];
 
-            CustomFilterFunctor idFilter(filter);
-            CustomFilterFunctor* p_idFilter = filter ? &idFilter : nullptr;
-
-            ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
-                std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = alg->searchKnn(
-                    (void*)items.data(row), k, p_idFilter);
-                for (int i = k - 1; i >= 0; i--) {
-                    auto& result_tuple = result.top();
-                    data_numpy_d[row * k + i] = result_tuple.first;
-                    data_numpy_l[row * k + i] = result_tuple.second;
-                    result.pop();
+            // every thread searches whole blocks of queries
+            size_t block_size = hnswlib::BRUTEFORCE_QUERY_BLOCK;
+            size_t num_blocks = (rows + block_size - 1) / block_size;
+            ParallelFor(0, num_blocks, num_threads, [&](size_t block, size_t threadId) {
+                size_t begin = block * block_size;
+                size_t count = std::min(block_size, rows - begin);
+                std::vector<std::priority_queue<std::pair<dist_t, hnswlib::labeltype >>> results =
+                    alg->searchKnnBatch((void*)items.data(begin), count, k, p_idFilter);
+                for (size_t j = 0; j < count; j++) {
+                    size_t row = begin + j;
+                    for (int i = k - 1; i >= 0; i--) {
+                        auto& result_tuple = results[j].top();
+                        data_numpy_d[row * k + i] = result_tuple.first;
+                        data_numpy_l[row * k + i] = result_tuple.second;
+                        results[j].pop();
+                    }
                 }
             });
         }
@@ -921,33 +1376,86 @@ PYBIND11_PLUGIN(hnswlib) {
             py::arg("M") = 16,
             py::arg("ef_construction") = 200,
             py::arg("random_seed") = 100,
-            py::arg("allow_replace_deleted") = false)
+            py::arg("allow_replace_deleted") = false,
+            py::arg("huge_pages") = "none")
         .def("knn_query",
             &Index<float>::knnQuery_return_numpy,
             py::arg("data"),
             py::arg("k") = 1,
             py::arg("num_threads") = -1,
+            py::arg("filter") = py::none(),
+            py::arg("attribute") = py::none(),
+            py::arg("namespace") = 0,
+            py::arg("search_threads") = 1)
+        .def("range_query",
+            &Index<float>::rangeQuery,
+            py::arg("data"),
+            py::arg("radius"),
+            py::arg("max_results") = 0,
+            py::arg("num_threads") = -1,
             py::arg("filter") = py::none())
         .def("add_items",
             &Index<float>::addItems,
             py::arg("data"),
             py::arg("ids") = py::none(),
             py::arg("num_threads") = -1,
-            py::arg("replace_deleted") = false)
+            py::arg("replace_deleted") = false,
+            py::arg("attributes") = py::none(),
+            py::arg("namespace") = 0)
+        .def("build_vamana",
+            &Index<float>::buildVamana,
+            py::arg("data"),
+            py::arg("ids") = py::none(),
+            py::arg("alpha") = 1.2f,
+            py::arg("num_threads") = -1)
+        .def("build_from_knn_graph",
+            &Index<float>::buildFromKnnGraph,
+            py::arg("data"),
+            py::arg("knn"),
+            py::arg("ids") = py::none(),
+            py::arg("alpha") = 1.2f,
+            py::arg("num_threads") = -1)
         .def("get_items", &Index<float>::getData, py::arg("ids") = py::none(), py::arg("return_type") = "numpy")
         .def("get_ids_list", &Index<float>::getIdsList)
         .def("set_ef", &Index<float>::set_ef, py::arg("ef"))
         .def("set_num_threads", &Index<float>::set_num_threads, py::arg("num_threads"))
+        .def("set_filtered_search_planner",
+            &Index<float>::setFilteredSearchPlanner,
+            py::arg("brute_force_factor") = 1.0,
+            py::arg("two_hop_selectivity") = 0.05,
+            py::arg("expand_ef_selectivity") = 0.5)
+        .def("set_early_termination",
+            &Index<float>::setEarlyTermination,
+            py::arg("patience") = 0,
+            py::arg("distance_ratio") = 0.0f)
+        .def("get_filtered_search_stats", &Index<float>::getFilteredSearchStats)
+        .def("get_namespaces", [](const Index<float> & index) {
+            return index.index_inited ? index.appr_alg->getNamespaces() : std::vector<hnswlib::namespacetype>();
+        })
+        .def("get_namespace_count", [](const Index<float> & index, hnswlib::namespacetype namespace_id) {
+            return index.index_inited ? index.appr_alg->getNamespaceElementCount(namespace_id) : 0;
+        }, py::arg("namespace"))
         .def("index_file_size", &Index<float>::indexFileSize)
         .def("save_index", &Index<float>::saveIndex, py::arg("path_to_index"))
         .def("load_index",
             &Index<float>::loadIndex,
             py::arg("path_to_index"),
             py::arg("max_elements") = 0,
-            py::arg("allow_replace_deleted") = false)
+            py::arg("allow_replace_deleted") = false,
+            py::arg("huge_pages") = "none")
+        .def("get_page_size", &Index<float>::getPageSize)
+        .def("set_numa_interleave", &Index<float>::setNumaInterleave, py::arg("enable") = true)
+        .def("set_layout", &Index<float>::setLevel0Layout, py::arg("layout"))
+        .def("get_layout", &Index<float>::getLevel0Layout)
+        .def("set_neighbor_codes", &Index<float>::setNeighborCodes, py::arg("codes") = "sq4", py::arg("rerank") = 0)
         .def("mark_deleted", &Index<float>::markDeleted, py::arg("label"))
         .def("unmark_deleted", &Index<float>::unmarkDeleted, py::arg("label"))
         .def("resize_index", &Index<float>::resizeIndex, py::arg("new_size"))
+        .def("reorder_index", &Index<float>::reorderIndex, py::arg("strategy") = "bfs")
+        .def("set_entry_strategy", &Index<float>::setEntryStrategy, py::arg("strategy") = "medoid", py::arg("num_entries") = 16)
+        .def("get_entry_strategy", &Index<float>::getEntryStrategy)
+        .def("set_navigation", &Index<float>::setNavigation, py::arg("navigation") = "flat")
+        .def("get_navigation", &Index<float>::getNavigation)
         .def("get_max_elements", &Index<float>::getMaxElements)
         .def("get_current_count", &Index<float>::getCurrentCount)
         .def_readonly("space", &Index<float>::space_name)
@@ -999,6 +1507,13 @@ PYBIND11_PLUGIN(hnswlib) {
             py::arg("num_threads") = -1,
             py::arg("filter") = py::none())
         .def("add_items", &BFIndex<float>::addItems, py::arg("data"), py::arg("ids") = py::none())
+        .def("range_query",
+            &BFIndex<float>::rangeQuery,
+            py::arg("data"),
+            py::arg("radius"),
+            py::arg("max_results") = 0,
+            py::arg("num_threads") = -1,
+            py::arg("filter") = py::none())
         .def("delete_vector", &BFIndex<float>::deleteVector, py::arg("label"))
         .def("set_num_threads", &BFIndex<float>::set_num_threads, py::arg("num_threads"))
         .def("save_index", &BFIndex<float>::saveIndex, py::arg("path_to_index"))
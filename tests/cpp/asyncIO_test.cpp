@@ -0,0 +1,186 @@
+// This is a test file for testing the asynchronous I/O queue and its use by the index files
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+
+std::string read_file(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+
+void test_queue(hnswlib::AsyncIO::Engine engine) {
+    std::string path = "async_io_test.bin";
+    size_t size = (5 << 20) + 123;
+    std::vector<char> data(size);
+    std::mt19937 rng(47);
+    for (auto& c : data) c = (char) rng();
+    std::ofstream(path, std::ios::binary).write(data.data(), 1);
+
+    // chunked write and read with more chunks than the queue depth
+    hnswlib::AsyncIO io(4, engine);
+    std::cout << "engine " << io.engine() << std::endl;
+    assert(engine == hnswlib::AsyncIO::ENGINE_AUTO || io.engine() == engine);
+    int fd = open(path.c_str(), O_RDWR);
+    assert(fd >= 0);
+    io.writeFile(fd, 0, data.data(), size, 100000);
+    assert(read_file(path) == std::string(data.data(), size));
+    std::vector<char> read(size);
+    io.readFile(fd, 0, read.data(), size, 65536);
+    assert(read == data);
+
+    // random reads into a registered buffer, collected as they complete
+    size_t num_requests = 100;
+    size_t request_size = 4096;
+    std::vector<char> buffer(num_requests * request_size);
+    bool registered = io.registerBuffers({{buffer.data(), buffer.size()}});
+    std::cout << "registered buffers " << registered << std::endl;
+    assert(registered == io.hasRegisteredBuffers());
+    std::vector<hnswlib::IORequest> requests(num_requests);
+    for (size_t i = 0; i < num_requests; i++) {
+        uint64_t offset = rng() % (size - request_size);
+        requests[i] = hnswlib::IORequest(hnswlib::IORequest::READ, fd, buffer.data() + i * request_size,
+                                         request_size, offset, 0);
+    }
+    io.submit(requests.data(), num_requests);
+    assert(io.pending() == num_requests);
+    std::vector<hnswlib::IORequest*> completed;
+    while (io.pending()) {
+        size_t pending = io.pending();
+        size_t appended = io.poll(completed, 3);
+        assert(appended >= std::min(pending, (size_t) 3));
+        assert(io.pending() == pending - appended);
+    }
+    assert(completed.size() == num_requests);
+    for (size_t i = 0; i < num_requests; i++) {
+        assert(requests[i].result == (int64_t) request_size);
+        assert(memcmp(requests[i].buffer, data.data() + requests[i].offset, request_size) == 0);
+    }
+    io.unregisterBuffers();
+
+    // short read at the end of the file, errors are reported in the result
+    hnswlib::IORequest tail(hnswlib::IORequest::READ, fd, read.data(), 1000, size - 100);
+    hnswlib::IORequest bad(hnswlib::IORequest::READ, -1, read.data(), 1000, 0);
+    io.submit(&tail);
+    io.submit(&bad);
+    completed.clear();
+    io.poll(completed, 2);
+    assert(completed.size() == 2 && io.pending() == 0);
+    assert(tail.result == 100);
+    assert(memcmp(read.data(), data.data() + size - 100, 100) == 0);
+    assert(bad.result == -EBADF);
+    bool thrown = false;
+    try {
+        io.run(&bad, 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    close(fd);
+
+    // chunk callbacks
+    std::vector<char> chunked(size, 0);
+    size_t chunks = 0;
+    hnswlib::readFileChunks(path, 10, size - 10, 300000, [&](size_t begin, const char* chunk, size_t length) {
+        memcpy(chunked.data() + 10 + begin, chunk, length);
+        chunks++;
+    }, 3);
+    assert(chunks == (size - 10 + 299999) / 300000);
+    assert(memcmp(chunked.data() + 10, data.data() + 10, size - 10) == 0);
+    hnswlib::writeFileChunks(path, 0, size, 70000, [&](size_t begin, char* chunk, size_t length) {
+        for (size_t i = 0; i < length; i++) chunk[i] = (char) (begin + i);
+    });
+    std::string written = read_file(path);
+    for (size_t i = 0; i < size; i++) assert(written[i] == (char) i);
+
+    std::remove(path.c_str());
+}
+
+
+void test_index_files() {
+    int d = 16;
+    idx_t n = 20000;
+    std::vector<float> data(n * d);
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib;
+    for (auto& v : data) v = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    HNSW* alg_hnsw = new HNSW(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw->markDelete(3);
+
+    // the asynchronous transfers give the file of the streams, for both layouts
+    std::string stream_path = "async_io_test_stream.bin";
+    std::string async_path = "async_io_test_async.bin";
+    assert(alg_hnsw->getIOQueueDepth() == 0);  // the streams until a queue depth is set
+    alg_hnsw->saveIndex(stream_path);
+    std::string stream_file = read_file(stream_path);
+    for (auto layout : {HNSW::LAYOUT_INTERLEAVED, HNSW::LAYOUT_SPLIT}) {
+        alg_hnsw->setLevel0Layout(layout);
+        alg_hnsw->setIOQueueDepth(8);
+        alg_hnsw->saveIndex(async_path);
+        assert(read_file(async_path) == stream_file);
+
+        HNSW* alg_loaded = new HNSW(&space);
+        alg_loaded->setLevel0Layout(layout);
+        alg_loaded->setIOQueueDepth(8);
+        alg_loaded->loadIndex(async_path, &space);
+        assert(alg_loaded->cur_element_count == n);
+        assert(alg_loaded->isMarkedDeleted(alg_loaded->label_lookup_[3]));
+        for (idx_t i = 0; i < n; i += 97) {
+            assert(alg_loaded->getDataByLabel<float>(i) == alg_hnsw->getDataByLabel<float>(i));
+        }
+        alg_loaded->setIOQueueDepth(0);
+        alg_loaded->saveIndex(async_path);
+        assert(read_file(async_path) == stream_file);
+        delete alg_loaded;
+    }
+
+    // the disk index reads give the same results with both engines
+    std::string disk_path = "async_io_test.disk";
+    hnswlib::DiskIndex<float>::build(*alg_hnsw, disk_path);
+    hnswlib::DiskIndex<float> alg_disk(&space, disk_path);
+    alg_disk.setEf(50);
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (idx_t j = 0; j < 50; j++) {
+        results.push_back(alg_disk.searchKnnCloserFirst(data.data() + j * d, 10));
+        assert(results.back()[0].second == j || j == 3);
+    }
+    alg_disk.setIOEngine(hnswlib::AsyncIO::ENGINE_THREAD_POOL);
+    assert(alg_disk.getIOEngine() == hnswlib::AsyncIO::ENGINE_THREAD_POOL);
+    for (idx_t j = 0; j < 50; j++) {
+        assert(alg_disk.searchKnnCloserFirst(data.data() + j * d, 10) == results[j]);
+    }
+
+    std::remove(stream_path.c_str());
+    std::remove(async_path.c_str());
+    std::remove(disk_path.c_str());
+    delete alg_hnsw;
+}
+
+}  // namespace
+
+int main() {
+    test_queue(hnswlib::AsyncIO::ENGINE_AUTO);
+    test_queue(hnswlib::AsyncIO::ENGINE_THREAD_POOL);
+    test_index_files();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,204 @@
+// This is a test file for testing the attribute-aware construction and search
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using Plan = hnswlib::HierarchicalNSW<float>::FilteredSearchPlan;
+
+const size_t num_rare_attributes = 100;
+const hnswlib::attributetype common_attribute = 1000;
+
+std::vector<hnswlib::attributetype> get_attributes(size_t i) {
+    std::vector<hnswlib::attributetype> attributes = {(hnswlib::attributetype) (i % num_rare_attributes)};
+    if (i % 2 == 0)
+        attributes.push_back(common_attribute);
+    return attributes;
+}
+
+float attribute_recall(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    const std::vector<float>& query,
+    int d,
+    size_t k,
+    hnswlib::attributetype attribute,
+    size_t n) {
+    hnswlib::BitsetFilterFunctor label_filter(n);
+    for (size_t i = 0; i < n; i++) {
+        auto attributes = get_attributes(i);
+        if (std::find(attributes.begin(), attributes.end(), attribute) != attributes.end())
+            label_filter.set(i);
+    }
+
+    size_t nq = query.size() / d;
+    size_t correct = 0;
+    size_t total = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        Plan plan;
+        auto res = alg_hnsw->searchKnnWithAttribute(p, k, attribute, &plan);
+        // the graph search alone has to find k elements, the scan fallback is not used
+        assert(plan == Plan::PLAN_GRAPH);
+        auto gt = alg_brute->searchKnnCloserFirst(p, k, &label_filter);
+        assert(res.size() == gt.size());
+        while (!res.empty()) {
+            idx_t label = res.top().second;
+            assert(label_filter.test(label));
+            for (auto& r : gt) {
+                if (r.second == label) {
+                    correct++;
+                    break;
+                }
+            }
+            res.pop();
+        }
+        total += gt.size();
+    }
+    return (float) correct / total;
+}
+
+
+// searches of an attribute while insertions set its filter and updates erase and recreate it
+void test_concurrent_updates(hnswlib::SpaceInterface<float>* space, const std::vector<float>& data, int d, idx_t n) {
+    const hnswlib::attributetype toggled_attribute = 5000;
+    hnswlib::HierarchicalNSW<float> alg_hnsw(space, n, 8, 50);
+    size_t num_initial = n / 2;
+    for (size_t i = 0; i < num_initial; ++i) {
+        alg_hnsw.addPointWithAttributes(data.data() + d * i, i, get_attributes(i));
+    }
+    alg_hnsw.setEf(20);
+
+    std::thread writer([&]() {
+        for (size_t i = num_initial; i < n; ++i) {
+            alg_hnsw.addPointWithAttributes(data.data() + d * i, i, get_attributes(i));
+            // label 0 is the only element of toggled_attribute, every other update erases its filter
+            std::vector<hnswlib::attributetype> attributes = {0};
+            if (i % 2)
+                attributes.push_back(toggled_attribute);
+            alg_hnsw.addPointWithAttributes(data.data(), 0, attributes);
+        }
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&, t]() {
+            for (size_t i = 0; i < 500; ++i) {
+                const void* p = data.data() + d * ((i * 7 + t) % n);
+                for (auto attribute : {(hnswlib::attributetype) 3, toggled_attribute, common_attribute}) {
+                    auto res = alg_hnsw.searchKnnWithAttribute(p, 5, attribute);
+                    assert(res.size() <= 5);
+                    if (attribute == toggled_attribute)
+                        assert(res.empty() || (res.size() == 1 && res.top().second == 0));
+                }
+            }
+        });
+    }
+    writer.join();
+    for (auto& reader : readers)
+        reader.join();
+    assert(alg_hnsw.searchKnnWithAttribute(data.data(), 5, toggled_attribute).size() == 1);
+}
+
+}  // namespace
+
+int main() {
+    int d = 8;
+    idx_t n = 5000;
+    idx_t nq = 20;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 8, 100);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, i);
+        alg_hnsw->addPointWithAttributes(data.data() + d * i, i, get_attributes(i));
+    }
+    alg_hnsw->setEf(50);
+    // only the graph search, so the connectivity of the attribute subgraphs is tested
+    alg_hnsw->setFilteredSearchPlanner(0, 0, 0);
+
+    std::vector<hnswlib::attributetype> tested_attributes = {0, 7, 42, 99, common_attribute};
+    for (auto attribute : tested_attributes) {
+        float recall = attribute_recall(alg_hnsw, alg_brute, query, d, k, attribute, n);
+        std::cout << "attribute " << attribute << " recall " << recall << std::endl;
+        assert(recall >= 0.9f);
+    }
+
+    // unknown attribute
+    assert(alg_hnsw->searchKnnWithAttribute(query.data(), k, 12345).empty());
+
+    // attributes are saved with the index
+    std::string path = "attribute_search_test.bin";
+    alg_hnsw->saveIndex(path);
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    std::fseek(f, 0, SEEK_END);
+    assert((size_t) std::ftell(f) == alg_hnsw->indexFileSize());
+    std::fclose(f);
+
+    hnswlib::HierarchicalNSW<float>* alg_hnsw_loaded = new hnswlib::HierarchicalNSW<float>(&space, path);
+    alg_hnsw_loaded->setEf(50);
+    alg_hnsw_loaded->setFilteredSearchPlanner(0, 0, 0);
+    assert(alg_hnsw_loaded->getAttributesByLabel(3) == alg_hnsw->getAttributesByLabel(3));
+    for (auto attribute : tested_attributes) {
+        for (size_t j = 0; j < nq; ++j) {
+            const void* p = query.data() + j * d;
+            auto res = alg_hnsw->searchKnnWithAttribute(p, k, attribute);
+            auto res_loaded = alg_hnsw_loaded->searchKnnWithAttribute(p, k, attribute);
+            assert(res.size() == res_loaded.size());
+            while (!res.empty()) {
+                assert(res.top() == res_loaded.top());
+                res.pop();
+                res_loaded.pop();
+            }
+        }
+    }
+
+    // updating a point replaces its attributes
+    alg_hnsw->addPointWithAttributes(data.data(), 0, {7});
+    assert(alg_hnsw->getAttributesByLabel(0) == std::vector<hnswlib::attributetype>{7});
+    auto res = alg_hnsw->searchKnnWithAttribute(data.data(), 1, 7);
+    assert(res.size() == 1 && res.top().second == 0);
+
+    // an index without attributes is saved in the original format
+    hnswlib::HierarchicalNSW<float>* alg_plain = new hnswlib::HierarchicalNSW<float>(&space, n);
+    for (size_t i = 0; i < 100; ++i) {
+        alg_plain->addPoint(data.data() + d * i, i);
+    }
+    assert(alg_plain->serializeExtensions().empty());
+
+    test_concurrent_updates(&space, data, d, 1000);
+
+    std::remove(path.c_str());
+    delete alg_brute;
+    delete alg_hnsw;
+    delete alg_hnsw_loaded;
+    delete alg_plain;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
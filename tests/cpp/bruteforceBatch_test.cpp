@@ -0,0 +1,192 @@
+// This is a test file for testing the blocked multi-query search of BruteforceSearch
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickDivisibleByThree : public hnswlib::BaseFilterFunctor {
+ public:
+    bool operator()(idx_t label_id) {
+        return label_id % 3 == 0;
+    }
+};
+
+
+// top k by sorting all the distances computed with the distance function of the space
+template<typename dist_t, typename data_t>
+std::vector<std::pair<dist_t, idx_t>> exact_knn(
+    hnswlib::SpaceInterface<dist_t>* space,
+    const std::vector<data_t>& data,
+    const std::vector<idx_t>& labels,
+    const data_t* query,
+    size_t d,
+    size_t k,
+    hnswlib::BaseFilterFunctor* filter) {
+    std::vector<std::pair<dist_t, idx_t>> all;
+    for (size_t i = 0; i < labels.size(); i++) {
+        if (filter && !(*filter)(labels[i]))
+            continue;
+        all.emplace_back(space->get_dist_func()(query, data.data() + i * d, space->get_dist_func_param()), labels[i]);
+    }
+    std::sort(all.begin(), all.end());
+    all.resize(std::min(k, all.size()));
+    return all;
+}
+
+
+template<typename dist_t, typename data_t>
+void check_batch(hnswlib::SpaceInterface<dist_t>* space, size_t d, size_t n, size_t nq, size_t k,
+                 hnswlib::BruteforceMetric metric) {
+    std::mt19937 rng(47);
+    std::uniform_int_distribution<> distrib(0, 255);
+    std::vector<data_t> data(n * d);
+    std::vector<data_t> query(nq * d);
+    for (auto& v : data) v = distrib(rng) / (std::is_same<data_t, float>::value ? 255.0 : 1.0);
+    for (auto& v : query) v = distrib(rng) / (std::is_same<data_t, float>::value ? 255.0 : 1.0);
+    std::vector<idx_t> labels(n);
+    for (idx_t i = 0; i < n; i++) labels[i] = 5 * i + 1;
+
+    hnswlib::BruteforceSearch<dist_t> alg_brute(space, n);
+    assert(alg_brute.metric_ == metric);
+    for (size_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, labels[i]);
+    }
+
+    PickDivisibleByThree pick_divisible_by_three;
+    for (hnswlib::BaseFilterFunctor* filter : {(hnswlib::BaseFilterFunctor*) nullptr,
+                                               (hnswlib::BaseFilterFunctor*) &pick_divisible_by_three}) {
+        auto results = alg_brute.searchKnnBatch(query.data(), nq, k, filter);
+        assert(results.size() == nq);
+        for (size_t j = 0; j < nq; j++) {
+            auto gt = exact_knn<dist_t, data_t>(space, data, labels, query.data() + j * d, d, k, filter);
+            assert(results[j].size() == gt.size());
+            size_t t = gt.size();
+            while (!results[j].empty()) {
+                // the same distances, the labels can only differ between equal distances
+                assert(results[j].top().first == gt[--t].first);
+                results[j].pop();
+            }
+            auto single = alg_brute.searchKnnCloserFirst(query.data() + j * d, k, filter);
+            assert(single.size() == gt.size());
+            for (size_t i = 0; i < gt.size(); i++)
+                assert(single[i].first == gt[i].first);
+        }
+    }
+}
+
+
+void test_metrics() {
+    for (size_t d : {4, 13, 16, 100}) {
+        hnswlib::L2Space l2space(d);
+        check_batch<float, float>(&l2space, d, 1500, 70, 10, hnswlib::BRUTEFORCE_L2);
+        hnswlib::InnerProductSpace ipspace(d);
+        check_batch<float, float>(&ipspace, d, 1500, 70, 10, hnswlib::BRUTEFORCE_IP);
+        hnswlib::L2SpaceI l2spacei(d);
+        check_batch<int, unsigned char>(&l2spacei, d, 1500, 70, 10, hnswlib::BRUTEFORCE_GENERIC);
+    }
+    // more neighbors than elements
+    hnswlib::L2Space space(8);
+    check_batch<float, float>(&space, 8, 50, 5, 80, hnswlib::BRUTEFORCE_L2);
+}
+
+
+void test_updates() {
+    int d = 16;
+    size_t n = 2000;
+    size_t k = 5;
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib;
+    std::vector<float> data(n * d);
+    for (auto& v : data) v = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (size_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+    // the norms follow the moves of removePoint and the updates of addPoint
+    for (size_t i = 0; i < n; i += 2) {
+        alg_brute.removePoint(i);
+    }
+    alg_brute.addPoint(data.data(), 1);
+    auto res = alg_brute.searchKnnCloserFirst(data.data(), k);
+    assert(res[0].second == 1 && res[0].first == 0);
+    for (size_t i = 3; i < n; i += 2) {
+        res = alg_brute.searchKnnCloserFirst(data.data() + d * i, k);
+        assert(res[0].second == i && res[0].first == 0);
+    }
+
+    std::string path = "bruteforceBatch_test.bin";
+    alg_brute.saveIndex(path);
+    hnswlib::BruteforceSearch<float> alg_loaded(&space, path);
+    assert(alg_loaded.metric_ == hnswlib::BRUTEFORCE_L2);
+    for (size_t i = 3; i < n; i += 2) {
+        assert(alg_loaded.searchKnnCloserFirst(data.data() + d * i, k) ==
+               alg_brute.searchKnnCloserFirst(data.data() + d * i, k));
+    }
+    std::remove(path.c_str());
+}
+
+
+void test_speed() {
+    int d = 128;
+    size_t n = 20000;
+    size_t nq = 256;
+    size_t k = 10;
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib;
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    for (auto& v : data) v = distrib(rng);
+    for (auto& v : query) v = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (size_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto results = alg_brute.searchKnnBatch(query.data(), nq, k);
+    double batch_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // one distance at a time, as searchKnn did before
+    start = std::chrono::steady_clock::now();
+    size_t matched = 0;
+    for (size_t j = 0; j < nq; j++) {
+        std::priority_queue<std::pair<float, idx_t>> top;
+        for (size_t i = 0; i < n; i++) {
+            float dist = space.get_dist_func()(query.data() + j * d, data.data() + i * d, space.get_dist_func_param());
+            if (top.size() < k || dist < top.top().first) {
+                top.emplace(dist, i);
+                if (top.size() > k)
+                    top.pop();
+            }
+        }
+        matched += top.top() == results[j].top();
+    }
+    double single_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "batch " << batch_time << "s one at a time " << single_time << "s" << std::endl;
+    assert(matched == nq);
+}
+
+}  // namespace
+
+int main() {
+    test_metrics();
+    test_updates();
+    test_speed();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,184 @@
+// This is a test file for testing the out-of-core search on the disk index
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using DiskIndex = hnswlib::DiskIndex<float>;
+
+class PickDivisibleByThree : public hnswlib::BaseFilterFunctor {
+ public:
+    bool operator()(idx_t label_id) {
+        return label_id % 3 == 0;
+    }
+};
+
+
+std::string read_file(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+
+// recall of the search, whose distances are computed on the full vectors read from the file
+template<typename Index>
+float recall(
+    Index* alg_disk,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    hnswlib::SpaceInterface<float>* space,
+    const std::vector<float>& data,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    auto search = [&](const float* p) {
+        auto res = alg_disk->searchKnnCloserFirst(p, k);
+        assert(res.size() == k);
+        for (auto& r : res)
+            assert(r.first == space->get_dist_func()(p, data.data() + r.second * d, space->get_dist_func_param()));
+        return res;
+    };
+    return test_utils::search_recall(search, alg_brute, query, d, k);
+}
+
+
+// the visited set of a search grows past its expected size and is emptied by reset
+void test_visited_set() {
+    hnswlib::DiskVisitedSet visited;
+    for (int round = 0; round < 2; round++) {
+        visited.reset(10);
+        for (hnswlib::tableint id = 0; id < 100000; id += 7)
+            assert(visited.insert(id));
+        for (hnswlib::tableint id = 0; id < 100000; id++)
+            assert(visited.insert(id) == (id % 7 != 0));
+    }
+}
+
+
+void test_disk_index(int d, idx_t n, bool direct_io) {
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d, 16, 200);
+
+    // built from the index in memory or streamed from its saved file, with the same content
+    std::string index_path = "disk_index_test.bin";
+    std::string disk_path = "disk_index_test.disk";
+    std::string streamed_path = "disk_index_test_streamed.disk";
+    alg_hnsw->saveIndex(index_path);
+    DiskIndex::build(*alg_hnsw, disk_path);
+    DiskIndex::build(index_path, streamed_path);
+    std::string disk_file = read_file(disk_path);
+    assert(disk_file == read_file(streamed_path));
+    std::remove(streamed_path.c_str());
+    // the split layout gives the same records
+    alg_hnsw->setLevel0Layout(HNSW::LAYOUT_SPLIT);
+    DiskIndex::build(*alg_hnsw, streamed_path);
+    assert(disk_file == read_file(streamed_path));
+    std::remove(streamed_path.c_str());
+
+    DiskIndex* alg_disk = new DiskIndex(&space, disk_path, direct_io);
+    std::cout << "dimension " << d << " direct io " << alg_disk->isDirectIO()
+              << " memory " << alg_disk->getMemoryUsage() << " file " << disk_file.size() << std::endl;
+    const hnswlib::DiskIndexHeader& header = alg_disk->getHeader();
+    assert(alg_disk->getCurrentElementCount() == n);
+    assert(header.record_span % hnswlib::DISK_SECTOR_SIZE == 0);
+    assert(disk_file.size() > header.memory_offset);
+    for (hnswlib::tableint i = 0; i < n; i++) {
+        size_t offset = alg_disk->getRecordSpanOffset(i);
+        assert(offset % hnswlib::DISK_SECTOR_SIZE == 0);
+        assert(alg_disk->getRecordOffsetInSpan(i) + header.record_size <= header.record_span);
+        // the record of the saved index format, read at its position in the file
+        const char* record = disk_file.data() + offset + alg_disk->getRecordOffsetInSpan(i);
+        idx_t label;
+        memcpy(&label, record + header.label_offset, sizeof(idx_t));
+        assert(label == alg_hnsw->getExternalLabel(i));
+        assert(memcmp(record + header.offset_data, alg_hnsw->getDataByInternalId(i), d * sizeof(float)) == 0);
+    }
+    assert(alg_disk->getMemoryUsage() < disk_file.size() / 2);
+
+    // close to the index in memory, the codes only drive the navigation
+    alg_hnsw->setEf(100);
+    alg_disk->setEf(100);
+    float recall_memory = recall(alg_hnsw, alg_brute, &space, data, query, d, k);
+    float recall_disk = recall(alg_disk, alg_brute, &space, data, query, d, k);
+    std::cout << "recall memory " << recall_memory << " disk " << recall_disk
+              << " reads per query " << (float) alg_disk->metric_disk_reads / nq
+              << " hops per query " << (float) alg_disk->metric_hops / nq << std::endl;
+    assert(recall_disk >= recall_memory - 0.05f);
+
+    // a larger beam reads as many records in fewer steps
+    alg_disk->setBeamWidth(1);
+    long reads = alg_disk->metric_disk_reads;
+    long hops = alg_disk->metric_hops;
+    assert(recall(alg_disk, alg_brute, &space, data, query, d, k) >= recall_memory - 0.05f);
+    long hops_narrow = alg_disk->metric_hops - hops;
+    assert(alg_disk->metric_disk_reads - reads == hops_narrow);
+    alg_disk->setBeamWidth(8);
+    hops = alg_disk->metric_hops;
+    assert(recall(alg_disk, alg_brute, &space, data, query, d, k) >= recall_memory - 0.05f);
+    assert(alg_disk->metric_hops - hops < hops_narrow / 4);
+
+    // deleted elements and filters
+    for (idx_t label = 0; label < n; label += 2) {
+        alg_hnsw->markDelete(label);
+    }
+    DiskIndex::build(*alg_hnsw, disk_path);
+    delete alg_disk;
+    alg_disk = new DiskIndex(&space, disk_path, direct_io);
+    alg_disk->setEf(100);
+    PickDivisibleByThree filter;
+    for (size_t j = 0; j < nq; ++j) {
+        for (auto& r : alg_disk->searchKnnCloserFirst(query.data() + j * d, k))
+            assert(r.second % 2 == 1);
+        auto res = alg_disk->searchKnnCloserFirst(query.data() + j * d, k, &filter);
+        assert(!res.empty());
+        for (auto& r : res)
+            assert(r.second % 2 == 1 && r.second % 3 == 0);
+    }
+
+    // read-only
+    bool thrown = false;
+    try {
+        alg_disk->addPoint(data.data(), n);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::remove(index_path.c_str());
+    std::remove(disk_path.c_str());
+    delete alg_disk;
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+}  // namespace
+
+int main() {
+    test_visited_set();
+    // several records per sector
+    test_disk_index(16, 5000, false);
+    // records spanning several sectors
+    test_disk_index(1100, 2000, true);
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
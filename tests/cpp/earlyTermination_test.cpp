@@ -0,0 +1,112 @@
+// This is a test file for testing the adaptive early termination of the search
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+struct SearchStats {
+    float recall;
+    long distance_computations;
+};
+
+SearchStats search_stats(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    size_t nq = query.size() / d;
+    size_t correct = 0;
+    long start_computations = alg_hnsw->metric_base_distance_computations;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto res = alg_hnsw->searchKnnCloserFirst(p, k);
+        auto gt = alg_brute->searchKnnCloserFirst(p, k);
+        assert(res.size() == k);
+        for (auto& r : res) {
+            if (std::find(gt.begin(), gt.end(), r) != gt.end())
+                correct++;
+        }
+    }
+    return {(float) correct / (nq * k), alg_hnsw->metric_base_distance_computations - start_computations};
+}
+
+}  // namespace
+
+int main() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 16, 100);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, i);
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw->setEf(200);
+
+    SearchStats regular = search_stats(alg_hnsw, alg_brute, query, d, k);
+    std::cout << "regular: recall " << regular.recall
+              << " distance computations " << regular.distance_computations << std::endl;
+
+    // the patience rule cuts the tail of the search
+    alg_hnsw->setEarlyTermination(3 * k);
+    SearchStats patience = search_stats(alg_hnsw, alg_brute, query, d, k);
+    std::cout << "patience: recall " << patience.recall
+              << " distance computations " << patience.distance_computations
+              << " early terminations " << alg_hnsw->metric_early_terminations << std::endl;
+    assert(patience.distance_computations < regular.distance_computations);
+    assert(patience.recall >= regular.recall - 0.05f);
+    assert(alg_hnsw->metric_early_terminations > 0);
+
+    // the distance ratio rule alone
+    alg_hnsw->setEarlyTermination(0, 1.5f);
+    SearchStats ratio = search_stats(alg_hnsw, alg_brute, query, d, k);
+    std::cout << "distance ratio: recall " << ratio.recall
+              << " distance computations " << ratio.distance_computations << std::endl;
+    assert(ratio.distance_computations < regular.distance_computations);
+    assert(ratio.recall >= regular.recall - 0.05f);
+
+    // disabling restores the regular search
+    alg_hnsw->setEarlyTermination(0, 0);
+    SearchStats disabled = search_stats(alg_hnsw, alg_brute, query, d, k);
+    assert(disabled.distance_computations == regular.distance_computations);
+
+    // the stop condition can also be used directly
+    hnswlib::PatienceSearchStopCondition<float> stop_condition(k, 200, 3 * k);
+    auto res = alg_hnsw->searchStopConditionClosest(query.data(), stop_condition);
+    assert(res.size() == k);
+    assert(std::is_sorted(res.begin(), res.end()));
+
+    delete alg_brute;
+    delete alg_hnsw;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,211 @@
+// This is a test file for testing the entry strategies of the search
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <set>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using test_utils::recall;
+
+// the closest of the entries to the query
+hnswlib::tableint closest_entry(HNSW* alg_hnsw, const float* p) {
+    hnswlib::tableint best = alg_hnsw->getEntryPoints()[0];
+    for (auto entry : alg_hnsw->getEntryPoints()) {
+        if (alg_hnsw->fstdistfunc_(p, alg_hnsw->getDataByInternalId(entry), alg_hnsw->dist_func_param_) <
+            alg_hnsw->fstdistfunc_(p, alg_hnsw->getDataByInternalId(best), alg_hnsw->dist_func_param_))
+            best = entry;
+    }
+    return best;
+}
+
+
+void test_entry_strategies() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 200;
+    size_t k = 10;
+    size_t num_clusters = 20;
+
+    // clustered data, the queries are drawn from the same clusters
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib;
+    std::normal_distribution<float> noise(0, 0.05f);
+    std::vector<float> centers(num_clusters * d);
+    for (auto& v : centers) v = distrib(rng);
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::vector<size_t> clusters(n + nq);
+    for (idx_t i = 0; i < n + nq; i++) {
+        float* v = i < n ? &data[i * d] : &query[(i - n) * d];
+        clusters[i] = rng() % num_clusters;
+        for (int j = 0; j < d; j++) v[j] = centers[clusters[i] * d + j] + noise(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d);
+    alg_hnsw->setEf(50);
+    assert(alg_hnsw->getEntryStrategy() == HNSW::ENTRY_HIERARCHY);
+    assert(alg_hnsw->getEntryPoints().empty());
+
+    alg_hnsw->metric_hops = 0;
+    float recall_hierarchy = recall(alg_hnsw, alg_brute, query, d, k);
+    long hops_hierarchy = alg_hnsw->metric_hops;
+    std::cout << "hierarchy recall " << recall_hierarchy << " upper hops " << hops_hierarchy << std::endl;
+
+    // the medoid is the element closest to the mean
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_MEDOID);
+    assert(alg_hnsw->getEntryPoints().size() == 1);
+    std::vector<float> mean(d, 0);
+    for (idx_t i = 0; i < n; i++)
+        for (int j = 0; j < d; j++) mean[j] += data[i * d + j] / n;
+    idx_t medoid = alg_brute->searchKnn(mean.data(), 1).top().second;
+    hnswlib::tableint medoid_id = alg_hnsw->getEntryPoints()[0];
+    assert(alg_hnsw->getExternalLabel(medoid_id) == medoid);
+    // every descent starts at the medoid, without navigation the base layer search does
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        assert(alg_hnsw->searchUpperLayers(p) == alg_hnsw->searchUpperLayers(p, medoid_id, alg_hnsw->element_levels_[medoid_id]));
+    }
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_NONE);
+    for (idx_t j = 0; j < nq; j++)
+        assert(alg_hnsw->searchUpperLayers(query.data() + j * d) == medoid_id);
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_HIERARCHY);
+
+    // the diverse entries start from the entry point of the hierarchy and are distinct
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_DIVERSE, 8);
+    std::vector<hnswlib::tableint> entries = alg_hnsw->getEntryPoints();
+    assert(entries.size() == 8);
+    assert(entries[0] == alg_hnsw->enterpoint_node_);
+    assert(std::set<hnswlib::tableint>(entries.begin(), entries.end()).size() == 8);
+    // each entry is the element farthest from the entries before it, all the elements are sampled
+    std::vector<float> min_dist(n, std::numeric_limits<float>::max());
+    for (size_t e = 0; e + 1 < entries.size(); e++) {
+        for (hnswlib::tableint i = 0; i < n; i++) {
+            min_dist[i] = std::min(min_dist[i], alg_hnsw->fstdistfunc_(alg_hnsw->getDataByInternalId(entries[e]),
+                                   alg_hnsw->getDataByInternalId(i), alg_hnsw->dist_func_param_));
+        }
+        assert(std::max_element(min_dist.begin(), min_dist.end()) - min_dist.begin() == entries[e + 1]);
+    }
+    // a search starts at the closest entry
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_NONE);
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        assert(alg_hnsw->searchUpperLayers(p) == closest_entry(alg_hnsw, p));
+    }
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_HIERARCHY);
+
+    for (auto strategy : {HNSW::ENTRY_MEDOID, HNSW::ENTRY_DIVERSE, HNSW::ENTRY_ROUTER}) {
+        alg_hnsw->setEntryStrategy(strategy, num_clusters);
+        assert(alg_hnsw->getEntryStrategy() == strategy);
+        alg_hnsw->metric_hops = 0;
+        float recall_strategy = recall(alg_hnsw, alg_brute, query, d, k);
+        long hops = alg_hnsw->metric_hops;
+        std::cout << "strategy " << strategy << " entries " << alg_hnsw->getEntryPoints().size()
+                  << " recall " << recall_strategy << " upper hops " << hops << std::endl;
+        // a single medoid is a poor start between separated clusters
+        assert(recall_strategy >= recall_hierarchy - (strategy == HNSW::ENTRY_MEDOID ? 0.05f : 0.02f));
+        // the router entries are close to the queries, the descent is shorter
+        if (strategy == HNSW::ENTRY_ROUTER)
+            assert(hops < hops_hierarchy);
+    }
+
+    // the router sends most queries to an entry of their own cluster, the hierarchy starts at one element
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_ROUTER, num_clusters);
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_NONE);
+    size_t same_cluster = 0;
+    for (idx_t j = 0; j < nq; j++) {
+        hnswlib::tableint entry = alg_hnsw->searchUpperLayers(query.data() + j * d);
+        assert(std::find(alg_hnsw->getEntryPoints().begin(), alg_hnsw->getEntryPoints().end(), entry) !=
+               alg_hnsw->getEntryPoints().end());
+        same_cluster += clusters[alg_hnsw->getExternalLabel(entry)] == clusters[n + j];
+    }
+    size_t same_cluster_hierarchy = 0;
+    for (idx_t j = 0; j < nq; j++)
+        same_cluster_hierarchy += clusters[alg_hnsw->getExternalLabel(alg_hnsw->enterpoint_node_)] == clusters[n + j];
+    std::cout << "entries in the cluster of the query, router " << same_cluster << " hierarchy "
+              << same_cluster_hierarchy << " of " << nq << std::endl;
+    assert(same_cluster >= nq * 3 / 4);
+    assert(same_cluster > 4 * same_cluster_hierarchy);
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_HIERARCHY);
+
+    // the entries follow the renumbering and are reset by a load
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_DIVERSE, 8);
+    std::vector<idx_t> entry_labels;
+    for (auto entry : alg_hnsw->getEntryPoints())
+        entry_labels.push_back(alg_hnsw->getExternalLabel(entry));
+    alg_hnsw->reorderIndex(HNSW::REORDER_BFS);
+    for (size_t i = 0; i < entry_labels.size(); i++)
+        assert(alg_hnsw->getExternalLabel(alg_hnsw->getEntryPoints()[i]) == entry_labels[i]);
+    assert(recall(alg_hnsw, alg_brute, query, d, k) >= recall_hierarchy - 0.02f);
+    std::string path = "entry_strategy_test.bin";
+    alg_hnsw->saveIndex(path);
+    alg_hnsw->loadIndex(path, &space);
+    assert(alg_hnsw->getEntryStrategy() == HNSW::ENTRY_HIERARCHY);
+    assert(alg_hnsw->getEntryPoints().empty());
+    std::remove(path.c_str());
+
+    // deleted elements are not searched from the medoid
+    for (idx_t label = 0; label < n; label += 2) {
+        alg_hnsw->markDelete(label);
+    }
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_MEDOID);
+    for (size_t j = 0; j < nq; ++j) {
+        for (auto& r : alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k))
+            assert(r.second % 2 == 1);
+    }
+
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+
+void test_integer_space() {
+    int d = 8;
+    idx_t n = 2000;
+    std::vector<unsigned char> data(n * d);
+    std::mt19937 rng(47);
+    for (auto& v : data) v = (unsigned char) rng();
+
+    hnswlib::L2SpaceI space(d);
+    hnswlib::HierarchicalNSW<int> alg_hnsw(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+    }
+    // only the diverse entries are computed without the float vectors
+    alg_hnsw.setEntryStrategy(hnswlib::HierarchicalNSW<int>::ENTRY_DIVERSE, 4);
+    assert(alg_hnsw.getEntryPoints().size() == 4);
+    for (idx_t i = 0; i < n; i += 50) {
+        auto res = alg_hnsw.searchKnn(data.data() + d * i, 1);
+        assert(res.top().first == 0);
+    }
+    bool thrown = false;
+    try {
+        alg_hnsw.setEntryStrategy(hnswlib::HierarchicalNSW<int>::ENTRY_ROUTER);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+}  // namespace
+
+int main() {
+    test_entry_strategies();
+    test_integer_space();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
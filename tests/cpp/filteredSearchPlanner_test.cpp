@@ -0,0 +1,145 @@
+// This is a test file for testing the filtered search planner
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using Plan = hnswlib::HierarchicalNSW<float>::FilteredSearchPlan;
+
+// fraction of the exact filtered results found by the index
+float test_plan(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    hnswlib::BitsetFilterFunctor& bitset,
+    const std::vector<float>& query,
+    int d,
+    size_t k,
+    Plan expected_plan) {
+    size_t nq = query.size() / d;
+    size_t correct = 0;
+    size_t total = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        Plan plan;
+        auto res = alg_hnsw->searchKnn(p, k, &bitset, &plan);
+        assert(plan == expected_plan);
+        auto gt = alg_brute->searchKnnCloserFirst(p, k, &bitset);
+        assert(res.size() == gt.size());
+
+        std::vector<idx_t> gt_labels;
+        for (auto& r : gt) gt_labels.push_back(r.second);
+        while (!res.empty()) {
+            idx_t label = res.top().second;
+            assert(bitset.test(label));
+            if (std::find(gt_labels.begin(), gt_labels.end(), label) != gt_labels.end())
+                correct++;
+            res.pop();
+        }
+        total += gt.size();
+    }
+    return total ? (float) correct / total : 1.0f;
+}
+
+}  // namespace
+
+int main() {
+    int d = 8;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 16, 100);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, i);
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw->setEf(20);
+    // the default cost model scans up to sqrt(ef * maxM0 * n) ~ 1800 elements, lower it to reach all plans
+    alg_hnsw->setFilteredSearchPlanner(0.001, 0.05, 0.5);
+
+    // 0.5% -> scan, 2% -> two-hop, 20% -> expanded ef, 100% -> graph
+    struct Case { size_t divisor; Plan plan; float min_recall; };
+    std::vector<Case> cases = {
+        {200, Plan::PLAN_BRUTE_FORCE, 1.0f},
+        {50, Plan::PLAN_TWO_HOP, 0.8f},
+        {5, Plan::PLAN_EXPANDED_EF, 0.8f},
+        {1, Plan::PLAN_GRAPH, 0.8f},
+    };
+    for (auto& c : cases) {
+        hnswlib::BitsetFilterFunctor bitset(n);
+        for (size_t i = 0; i < n; i += c.divisor) {
+            bitset.set(i);
+        }
+        float recall = test_plan(alg_hnsw, alg_brute, bitset, query, d, k, c.plan);
+        std::cout << "selectivity " << (float) bitset.count() / n << " plan " << c.plan
+                  << " recall " << recall << std::endl;
+        assert(recall >= c.min_recall);
+        assert(alg_hnsw->metric_filtered_search_plans[c.plan] == (long) nq);
+
+        // the same filter in the internal id space
+        std::vector<idx_t> allowed;
+        for (size_t i = 0; i < n; i += c.divisor) allowed.push_back(i);
+        hnswlib::BitsetFilterFunctor internal_bitset = alg_hnsw->createInternalIdFilter(allowed.data(), allowed.size());
+        for (size_t j = 0; j < nq; ++j) {
+            const void* p = query.data() + j * d;
+            Plan plan;
+            alg_hnsw->searchKnn(p, k, &internal_bitset, &plan);
+            assert(plan == c.plan);
+            assert(alg_hnsw->searchKnnCloserFirst(p, k, &internal_bitset) ==
+                   alg_hnsw->searchKnnCloserFirst(p, k, &bitset));
+        }
+    }
+
+    // the planner only handles bitset filters, disabled planner always runs the graph search
+    alg_hnsw->setFilteredSearchPlanner(0, 0, 0);
+    hnswlib::BitsetFilterFunctor sparse(n);
+    sparse.set(n / 2);
+    Plan plan;
+    auto res = alg_hnsw->searchKnn(query.data(), k, &sparse, &plan);
+    assert(res.size() == 1 && res.top().second == n / 2);
+    assert(plan == Plan::PLAN_GRAPH || plan == Plan::PLAN_BRUTE_FORCE);
+
+    // deleted and unknown labels of the bitset do not send a complete graph search to the exact scan
+    hnswlib::BitsetFilterFunctor with_missing(2 * n);
+    for (size_t i = 0; i < 6; i++) with_missing.set(i);
+    for (size_t i = n; i < n + 100; i++) with_missing.set(i);
+    alg_hnsw->markDelete(5);
+    alg_hnsw->setEf(n);
+    res = alg_hnsw->searchKnn(query.data(), k, &with_missing, &plan);
+    assert(res.size() == 5);
+    assert(plan == Plan::PLAN_GRAPH);
+    while (!res.empty()) {
+        assert(res.top().second < 5);
+        res.pop();
+    }
+
+    delete alg_brute;
+    delete alg_hnsw;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,230 @@
+// This is a test file for testing the immutable index created by HierarchicalNSW::freeze
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using FrozenHNSW = hnswlib::FrozenHNSW<float>;
+using test_utils::recall;
+
+class PickDivisibleByThree : public hnswlib::BaseFilterFunctor {
+ public:
+    bool operator()(idx_t label_id) {
+        return label_id % 3 == 0;
+    }
+};
+
+
+void check_structure(const FrozenHNSW& frozen, size_t max_m, size_t max_m0) {
+    size_t count = frozen.getCurrentElementCount();
+    assert(frozen.getLevelSize(0) == count);
+    assert(frozen.getEnterpointNode() < frozen.getLevelSize(frozen.getMaxLevel()));
+    for (int level = 0; level <= frozen.getMaxLevel(); level++) {
+        size_t level_size = frozen.getLevelSize(level);
+        assert(level_size > 0);
+        if (level > 0)
+            assert(level_size <= frozen.getLevelSize(level - 1));
+        for (hnswlib::tableint i = 0; i < level_size; i++) {
+            const hnswlib::tableint* links = frozen.getLinks(i, level);
+            assert(links[0] <= (level == 0 ? max_m0 : max_m));
+            for (size_t j = 1; j <= links[0]; j++) {
+                assert(links[j] < level_size);
+                assert(links[j] != i);
+            }
+        }
+    }
+    assert(frozen.getLevelSize(frozen.getMaxLevel() + 1) == 0);
+}
+
+
+// a copy of the file with the bytes of value at offset must be rejected
+template<typename T>
+void check_corrupted(hnswlib::SpaceInterface<float>* space, const std::string& path, size_t offset, T value) {
+    std::ifstream input(path, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    assert(offset + sizeof(T) <= file.size());
+    memcpy(file.data() + offset, &value, sizeof(T));
+    std::string corrupted_path = path + ".corrupted";
+    std::ofstream output(corrupted_path, std::ios::binary);
+    output.write(file.data(), file.size());
+    output.close();
+    for (bool use_mmap : {true, false}) {
+        bool thrown = false;
+        try {
+            FrozenHNSW loaded(space, corrupted_path, use_mmap);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    std::remove(corrupted_path.c_str());
+}
+
+
+void test_frozen_index() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 200;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+    std::vector<idx_t> labels(n);
+    for (idx_t i = 0; i < n; i++) labels[i] = 2 * i;
+
+    hnswlib::L2Space space(d);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d, 16, 100, labels);
+    alg_hnsw->setEf(50);
+
+    // without deletions the search follows the same links as the index
+    std::unique_ptr<FrozenHNSW> frozen = alg_hnsw->freeze();
+    assert(frozen->getCurrentElementCount() == n);
+    assert(frozen->getMaxLevel() == alg_hnsw->maxlevel_);
+    assert(frozen->getEf() == 50);
+    check_structure(*frozen, alg_hnsw->maxM_, alg_hnsw->maxM0_);
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        assert(frozen->searchKnnCloserFirst(p, k) == alg_hnsw->searchKnnCloserFirst(p, k));
+    }
+    for (idx_t i = 0; i < n; i += 97) {
+        assert(frozen->getDataByLabel<float>(2 * i) == alg_hnsw->getDataByLabel<float>(2 * i));
+        assert(frozen->getExternalLabel(frozen->getInternalId(2 * i)) == 2 * i);
+        assert(frozen->getInternalId(2 * i + 1) == hnswlib::FROZEN_NO_ID);
+    }
+
+    // the deleted elements are dropped
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    for (idx_t i = 0; i < n; i++) {
+        if (i % 5 == 0) {
+            alg_hnsw->markDelete(2 * i);
+        } else {
+            alg_brute->addPoint(data.data() + d * i, 2 * i);
+        }
+    }
+    frozen = alg_hnsw->freeze();
+    size_t live = n - n / 5;
+    assert(frozen->getCurrentElementCount() == live);
+    check_structure(*frozen, alg_hnsw->maxM_, alg_hnsw->maxM0_);
+    bool thrown = false;
+    try {
+        frozen->getDataByLabel<float>(0);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    float recall_hnsw = recall(alg_hnsw, alg_brute, query, d, k);
+    float recall_frozen = recall(frozen.get(), alg_brute, query, d, k);
+    std::cout << "hnsw recall " << recall_hnsw << " frozen recall " << recall_frozen
+              << " memory " << frozen->getMemoryUsage() << std::endl;
+    assert(recall_frozen >= recall_hnsw - 0.02f);
+
+    PickDivisibleByThree pick_divisible_by_three;
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        auto res = frozen->searchKnnCloserFirst(p, k);
+        assert(res.size() == k);
+        for (auto& r : res)
+            assert((r.second / 2) % 5 != 0);
+        res = frozen->searchKnnCloserFirst(p, k, &pick_divisible_by_three);
+        assert(res.size() == k);
+        for (auto& r : res)
+            assert(r.second % 3 == 0 && (r.second / 2) % 5 != 0);
+    }
+
+    // saved and opened mapped or read, with the same searches
+    std::string path = "frozenIndex_test.bin";
+    frozen->saveIndex(path);
+    for (bool use_mmap : {true, false}) {
+        FrozenHNSW loaded(&space, path, use_mmap);
+        assert(loaded.getMemoryUsage() == frozen->getMemoryUsage());
+        assert(loaded.getCurrentElementCount() == live);
+        check_structure(loaded, alg_hnsw->maxM_, alg_hnsw->maxM0_);
+        loaded.setEf(50);
+        for (idx_t j = 0; j < nq; j++) {
+            const float* p = query.data() + j * d;
+            assert(loaded.searchKnnCloserFirst(p, k) == frozen->searchKnnCloserFirst(p, k));
+        }
+        assert(loaded.getDataByLabel<float>(2) == frozen->getDataByLabel<float>(2));
+        thrown = false;
+        try {
+            loaded.addPoint(data.data(), 1);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // the page mode applies to the mapping, explicit huge pages read the file
+    FrozenHNSW loaded_transparent(&space, path, true, hnswlib::PAGES_TRANSPARENT_HUGE);
+    assert(loaded_transparent.isMapped());
+    FrozenHNSW loaded_huge(&space, path, true, hnswlib::PAGES_HUGE_2MB);
+    assert(!loaded_huge.isMapped());
+    loaded_huge.setEf(50);
+    assert(loaded_huge.searchKnnCloserFirst(query.data(), k) == frozen->searchKnnCloserFirst(query.data(), k));
+
+    // the sections and the ids are checked against the element count and the file size
+    hnswlib::FrozenIndexHeader header;
+    std::ifstream header_input(path, std::ios::binary);
+    header_input.read((char*) &header, sizeof(header));
+    header_input.close();
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, enterpoint_node), (uint64_t) live);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, element_count), (uint64_t) live + 1);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, vectors_offset), header.file_size);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, labels_offset), header.file_size - 64);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, labels_offset), header.labels_offset + 1);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, maxlevel), (int64_t) 1000000);
+    check_corrupted(&space, path, offsetof(hnswlib::FrozenIndexHeader, file_size), header.file_size + 64);
+    hnswlib::FrozenLevel level0;
+    header_input.open(path, std::ios::binary);
+    header_input.seekg(header.levels_offset);
+    header_input.read((char*) &level0, sizeof(level0));
+    header_input.close();
+    size_t link_offset = level0.links_offset + sizeof(hnswlib::tableint);
+    check_corrupted(&space, path, link_offset, (hnswlib::tableint) live);
+    check_corrupted(&space, path, level0.links_offset, (hnswlib::tableint) level0.stride);
+    check_corrupted(&space, path, header.sorted_ids_offset, (hnswlib::tableint) live);
+
+    // the file must match the space
+    hnswlib::L2Space other_space(d + 1);
+    thrown = false;
+    try {
+        FrozenHNSW loaded(&other_space, path);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove(path.c_str());
+
+    // an empty index
+    HNSW* alg_empty = new HNSW(&space, 10);
+    frozen = alg_empty->freeze();
+    assert(frozen->getCurrentElementCount() == 0);
+    assert(frozen->searchKnn(query.data(), k).empty());
+
+    delete alg_empty;
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+}  // namespace
+
+int main() {
+    test_frozen_index();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
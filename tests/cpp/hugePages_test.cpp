@@ -0,0 +1,105 @@
+// This is a test file for testing the huge page backed allocation of the index
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+std::vector<std::vector<std::pair<float, idx_t>>> search_all(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (size_t j = 0; j < query.size() / d; ++j) {
+        results.push_back(alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    return results;
+}
+
+}  // namespace
+
+int main() {
+    int d = 16;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float>* alg_default = new hnswlib::HierarchicalNSW<float>(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_default->addPoint(data.data() + d * i, i);
+    }
+    assert(alg_default->getLevel0PageMode() == hnswlib::PAGES_DEFAULT);
+    assert(alg_default->getLevel0PageSize() == hnswlib::getSystemPageSize());
+    auto results = search_all(alg_default, query, d, k);
+
+    std::vector<hnswlib::PageMode> modes = {
+        hnswlib::PAGES_TRANSPARENT_HUGE, hnswlib::PAGES_HUGE_2MB, hnswlib::PAGES_HUGE_1GB};
+    for (hnswlib::PageMode mode : modes) {
+        // the index is built on the requested pages or on a fallback
+        hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(
+            &space, n / 2, 16, 200, 100, false, mode);
+        for (size_t i = 0; i < n / 2; ++i) {
+            alg_hnsw->addPoint(data.data() + d * i, i);
+        }
+        // resizing keeps the page mode
+        alg_hnsw->resizeIndex(n);
+        for (size_t i = n / 2; i < n; ++i) {
+            alg_hnsw->addPoint(data.data() + d * i, i);
+        }
+        std::cout << "requested mode " << mode << " level0 mode " << alg_hnsw->getLevel0PageMode()
+                  << " page size " << alg_hnsw->getLevel0PageSize()
+                  << " link lists page size " << alg_hnsw->getLinkListsPageSize() << std::endl;
+        assert(alg_hnsw->getLevel0PageMode() == mode ||
+               alg_hnsw->getLevel0PageMode() == hnswlib::PAGES_TRANSPARENT_HUGE ||
+               alg_hnsw->getLevel0PageMode() == hnswlib::PAGES_DEFAULT);
+        assert(alg_hnsw->getLevel0PageSize() >= hnswlib::getSystemPageSize());
+        assert(search_all(alg_hnsw, query, d, k) == results);
+
+        // the load path allocates with the page mode as well
+        std::string path = "huge_pages_test.bin";
+        alg_hnsw->saveIndex(path);
+        hnswlib::HierarchicalNSW<float>* alg_loaded = new hnswlib::HierarchicalNSW<float>(
+            &space, path, false, 0, false, mode);
+        assert(alg_loaded->getLevel0PageMode() == alg_hnsw->getLevel0PageMode());
+        assert(search_all(alg_loaded, query, d, k) == results);
+        std::remove(path.c_str());
+
+        delete alg_hnsw;
+        delete alg_loaded;
+    }
+
+    // an existing index is moved to huge pages and back
+    alg_default->setPageMode(hnswlib::PAGES_TRANSPARENT_HUGE);
+    assert(search_all(alg_default, query, d, k) == results);
+    alg_default->setPageMode(hnswlib::PAGES_DEFAULT);
+    assert(alg_default->getLevel0PageMode() == hnswlib::PAGES_DEFAULT);
+    assert(search_all(alg_default, query, d, k) == results);
+    delete alg_default;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,192 @@
+// This is a test file for testing the construction of the base layer from a kNN graph
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using test_utils::recall;
+
+std::vector<hnswlib::tableint> get_links(HNSW* alg_hnsw, hnswlib::tableint i) {
+    hnswlib::linklistsizeint* ll = alg_hnsw->get_linklist0(i);
+    hnswlib::tableint* links = (hnswlib::tableint*) (ll + 1);
+    return std::vector<hnswlib::tableint>(links, links + alg_hnsw->getListCount(ll));
+}
+
+
+// fraction of the exact nearest neighbors of each element that are linked to it in the base layer
+float knn_coverage(HNSW* alg_hnsw, const std::vector<hnswlib::tableint>& knn, size_t knn_k, size_t num_neighbors) {
+    size_t n = alg_hnsw->cur_element_count;
+    size_t covered = 0;
+    for (hnswlib::tableint i = 0; i < n; i++) {
+        std::vector<hnswlib::tableint> links = get_links(alg_hnsw, alg_hnsw->label_lookup_.at(3 * i));
+        for (size_t j = 0; j < num_neighbors; j++) {
+            hnswlib::tableint neighbor = alg_hnsw->label_lookup_.at(3 * knn[i * knn_k + j]);
+            covered += std::find(links.begin(), links.end(), neighbor) != links.end();
+        }
+    }
+    return (float) covered / (n * num_neighbors);
+}
+
+
+// number of elements reached from the entry point through the base layer
+size_t reachable(HNSW* alg_hnsw) {
+    std::vector<bool> visited(alg_hnsw->cur_element_count, false);
+    std::vector<hnswlib::tableint> stack = {alg_hnsw->enterpoint_node_};
+    visited[alg_hnsw->enterpoint_node_] = true;
+    size_t count = 1;
+    while (!stack.empty()) {
+        hnswlib::tableint current = stack.back();
+        stack.pop_back();
+        for (auto neighbor : get_links(alg_hnsw, current)) {
+            if (!visited[neighbor]) {
+                visited[neighbor] = true;
+                stack.push_back(neighbor);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+
+void test_knn_graph() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 200;
+    size_t k = 10;
+    size_t knn_k = 32;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+    std::vector<idx_t> labels(n);
+    for (idx_t i = 0; i < n; i++) labels[i] = 3 * i;
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d, labels);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d, 16, 100, labels);
+    alg_hnsw->setEf(50);
+    float recall_hnsw = recall(alg_hnsw, alg_brute, query, d, k);
+
+    // the exact kNN graph as positions in data, then a noisy one as an approximate builder gives
+    std::vector<hnswlib::tableint> knn(n * knn_k);
+    for (idx_t i = 0; i < n; i++) {
+        auto res = alg_brute->searchKnnCloserFirst(data.data() + d * i, knn_k + 1);
+        size_t size = 0;
+        for (auto& r : res) {
+            if (r.second != labels[i] && size < knn_k) knn[i * knn_k + size++] = r.second / 3;
+        }
+    }
+    std::vector<hnswlib::tableint> knn_noisy = knn;
+    for (idx_t i = 0; i < n; i++) {
+        for (size_t j = knn_k / 2; j < knn_k; j++) knn_noisy[i * knn_k + j] = rng() % n;
+    }
+
+    float coverage_hnsw = knn_coverage(alg_hnsw, knn, knn_k, k);
+    float coverage_exact = 0;
+    for (auto* graph : {&knn, &knn_noisy}) {
+        HNSW* alg_knn = new HNSW(&space, n, 16, 100);
+        alg_knn->buildFromKnnGraph(data.data(), labels.data(), n, graph->data(), knn_k, 1.2f, 4);
+        alg_knn->checkIntegrity();
+        assert(alg_knn->getCurrentElementCount() == n);
+        assert(alg_knn->maxlevel_ == 0);
+        for (hnswlib::tableint i = 0; i < n; i++) {
+            assert(alg_knn->getExternalLabel(i) == labels[i]);
+            hnswlib::linklistsizeint* ll = alg_knn->get_linklist0(i);
+            size_t size = alg_knn->getListCount(ll);
+            assert(size > 0 && size <= alg_knn->maxM0_);
+            hnswlib::tableint* links = (hnswlib::tableint*) (ll + 1);
+            assert(std::find(links, links + size, i) == links + size);
+        }
+        // the closest neighbor always survives the pruning
+        for (hnswlib::tableint i = 0; i < n; i++) {
+            hnswlib::linklistsizeint* ll = alg_knn->get_linklist0(i);
+            hnswlib::tableint* links = (hnswlib::tableint*) (ll + 1);
+            size_t size = alg_knn->getListCount(ll);
+            if (graph == &knn)
+                assert(std::find(links, links + size, knn[i * knn_k]) != links + size);
+        }
+        // every link comes from the kNN graph, in one direction or the other
+        for (hnswlib::tableint i = 0; i < n; i++) {
+            const hnswlib::tableint* row = graph->data() + i * knn_k;
+            for (auto neighbor : get_links(alg_knn, i)) {
+                const hnswlib::tableint* neighbor_row = graph->data() + neighbor * knn_k;
+                assert(std::find(row, row + knn_k, neighbor) != row + knn_k ||
+                       std::find(neighbor_row, neighbor_row + knn_k, i) != neighbor_row + knn_k);
+            }
+        }
+        // the base layer is connected and links most of the nearest neighbors
+        assert(reachable(alg_knn) == n);
+        float coverage = knn_coverage(alg_knn, knn, knn_k, k);
+        std::cout << (graph == &knn ? "exact" : "noisy") << " kNN graph coverage of the " << k
+                  << " nearest neighbors " << coverage << " hnsw " << coverage_hnsw << std::endl;
+        // the pruned kNN graph keeps more of them than the insertions, fewer when the graph is noisy
+        assert(coverage > coverage_hnsw);
+        if (graph == &knn_noisy)
+            assert(coverage < coverage_exact);
+        coverage_exact = coverage;
+
+        alg_knn->setEf(50);
+        float recall_knn = recall(alg_knn, alg_brute, query, d, k);
+        std::cout << (graph == &knn ? "exact" : "noisy") << " kNN graph recall " << recall_knn
+                  << " hnsw recall " << recall_hnsw << std::endl;
+        assert(recall_knn >= recall_hnsw - 0.03f);
+
+        // saved in the index format and open to insertions
+        std::string path = "knn_graph_build_test.bin";
+        alg_knn->saveIndex(path);
+        HNSW* alg_loaded = new HNSW(&space, path, false, n + 100);
+        for (idx_t i = 0; i < 100; i++) {
+            alg_loaded->addPoint(data.data() + d * i, 3 * n + i);
+        }
+        for (idx_t i = 0; i < 100; i++) {
+            assert(alg_loaded->searchKnn(data.data() + d * i, 1).top().first == 0);
+        }
+        std::remove(path.c_str());
+        delete alg_loaded;
+        delete alg_knn;
+    }
+
+    // only into an empty index, with neighbors in range
+    bool thrown = false;
+    try {
+        alg_hnsw->buildFromKnnGraph(data.data(), labels.data(), n, knn.data(), knn_k);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    HNSW* alg_empty = new HNSW(&space, n, 16, 100);
+    knn_noisy[5] = n;
+    thrown = false;
+    try {
+        alg_empty->buildFromKnnGraph(data.data(), labels.data(), n, knn_noisy.data(), knn_k);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(alg_empty->getCurrentElementCount() == 0);
+
+    delete alg_empty;
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+}  // namespace
+
+int main() {
+    test_knn_graph();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,166 @@
+// This is a test file for testing the arena holding the upper layer link lists
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+
+std::string read_file(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+
+void test_arena() {
+    hnswlib::MemoryArena arena;
+    assert(arena.numChunks() == 0 && arena.allocated() == 0);
+
+    // zero-filled aligned allocations keep their address when chunks are added
+    std::vector<std::pair<char*, size_t>> allocations;
+    std::mt19937 rng(47);
+    for (size_t i = 0; i < 20000; i++) {
+        size_t size = 1 + rng() % 1000;
+        char* data = arena.allocate(size);
+        assert((size_t) data % hnswlib::MemoryArena::ALIGNMENT == 0);
+        for (size_t j = 0; j < size; j++) assert(data[j] == 0);
+        memset(data, (char) i, size);
+        allocations.push_back({data, size});
+    }
+    assert(arena.numChunks() > 1);
+    assert(arena.allocated() <= arena.capacity());
+    for (size_t i = 0; i < allocations.size(); i++) {
+        for (size_t j = 0; j < allocations[i].second; j++) assert(allocations[i].first[j] == (char) i);
+    }
+
+    // a reservation is served from one chunk
+    arena.release();
+    assert(arena.numChunks() == 0 && arena.allocated() == 0);
+    arena.reserve(100 * 64);
+    char* first = arena.allocate(64);
+    for (size_t i = 1; i < 100; i++) assert(arena.allocate(64) == first + i * 64);
+    assert(arena.numChunks() == 1 && arena.capacity() == 100 * 64);
+
+    // concurrent allocations do not overlap
+    hnswlib::MemoryArena shared;
+    size_t num_threads = 4;
+    size_t per_thread = 50000;
+    std::vector<std::vector<char*>> thread_allocations(num_threads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < per_thread; i++) {
+                char* data = shared.allocate(64);
+                memset(data, (char) t, 64);
+                thread_allocations[t].push_back(data);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    assert(shared.allocated() == num_threads * per_thread * 64);
+    for (size_t t = 0; t < num_threads; t++) {
+        for (char* data : thread_allocations[t])
+            for (size_t j = 0; j < 64; j++) assert(data[j] == (char) t);
+    }
+}
+
+
+void test_index() {
+    int d = 16;
+    idx_t n = 20000;
+    std::vector<float> data(n * d);
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib;
+    for (auto& v : data) v = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    HNSW* alg_hnsw = new HNSW(&space, n);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < n; i += 4) alg_hnsw->addPoint(data.data() + d * i, i);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    // the link lists of the upper layers are carved out of a few chunks
+    size_t upper_size = 0;
+    for (idx_t i = 0; i < n; i++) {
+        if (alg_hnsw->element_levels_[i] > 0) {
+            size_t size = alg_hnsw->size_links_per_element_ * alg_hnsw->element_levels_[i];
+            upper_size += (size + 7) / 8 * 8;
+        }
+    }
+    std::cout << "upper layers " << upper_size << " chunks " << alg_hnsw->link_arena_.numChunks() << std::endl;
+    assert(alg_hnsw->getUpperLayersMemory() == upper_size);
+    assert(alg_hnsw->link_arena_.numChunks() == 1 + upper_size / hnswlib::MemoryArena::DEFAULT_CHUNK_SIZE);
+
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (idx_t j = 0; j < n; j += 100) {
+        results.push_back(alg_hnsw->searchKnnCloserFirst(data.data() + j * d, 10));
+    }
+
+    // saved and loaded into a single chunk
+    std::string path = "link_arena_test.bin";
+    std::string path_loaded = "link_arena_test_loaded.bin";
+    alg_hnsw->saveIndex(path);
+    HNSW* alg_loaded = new HNSW(&space, path);
+    assert(alg_loaded->link_arena_.numChunks() == 1);
+    assert(alg_loaded->link_arena_.capacity() == upper_size);
+    for (idx_t i = 0; i < n; i++) {
+        assert(alg_loaded->element_levels_[i] == alg_hnsw->element_levels_[i]);
+        for (int level = 1; level <= alg_hnsw->element_levels_[i]; level++) {
+            assert(memcmp(alg_loaded->get_linklist(i, level), alg_hnsw->get_linklist(i, level),
+                          alg_hnsw->size_links_per_element_) == 0);
+        }
+    }
+    alg_loaded->saveIndex(path_loaded);
+    assert(read_file(path) == read_file(path_loaded));
+
+    // insertions after a load go to new chunks
+    HNSW* alg_replaced = new HNSW(&space, path, false, n + 1000);
+    for (idx_t i = 0; i < 1000; i++) {
+        alg_replaced->addPoint(data.data() + d * i, n + i);
+    }
+    assert(alg_replaced->link_arena_.numChunks() >= 2);
+    for (idx_t i = 0; i < 1000; i += 10) {
+        assert(alg_replaced->searchKnn(data.data() + d * i, 1).top().first == 0);
+    }
+
+    // a change of page mode compacts the link lists into one chunk
+    alg_hnsw->setPageMode(hnswlib::PAGES_TRANSPARENT_HUGE);
+    assert(alg_hnsw->link_arena_.numChunks() == 1);
+    assert(alg_hnsw->getUpperLayersMemory() == upper_size);
+    for (idx_t j = 0; j < n; j += 100) {
+        assert(alg_hnsw->searchKnnCloserFirst(data.data() + j * d, 10) == results[j / 100]);
+    }
+    alg_hnsw->saveIndex(path_loaded);
+    assert(read_file(path) == read_file(path_loaded));
+
+    std::remove(path.c_str());
+    std::remove(path_loaded.c_str());
+    delete alg_replaced;
+    delete alg_loaded;
+    delete alg_hnsw;
+}
+
+}  // namespace
+
+int main() {
+    test_arena();
+    test_index();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,174 @@
+// This is a test file for testing the namespaces of an index
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+const hnswlib::namespacetype num_namespaces = 20;
+const size_t namespace_size = 200;
+
+// labels [0, num_namespaces * namespace_size) belong to the namespaces 1..num_namespaces, the rest to the default one
+hnswlib::namespacetype get_namespace(idx_t label) {
+    return label < num_namespaces * namespace_size ? label / namespace_size + 1 : 0;
+}
+
+}  // namespace
+
+int main() {
+    int d = 8;
+    idx_t n = num_namespaces * namespace_size + 2000;
+    idx_t nq = 20;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 16, 100);
+    // interleave the namespaces
+    for (size_t j = 0; j < n; ++j) {
+        idx_t i = (j * 7919) % n;
+        alg_brute->addPoint(data.data() + d * i, i);
+        alg_hnsw->addPointToNamespace(data.data() + d * i, i, get_namespace(i));
+    }
+    alg_hnsw->setEf(20);
+
+    assert(alg_hnsw->getNamespaces().size() == num_namespaces);
+    assert(alg_hnsw->getNamespaceElementCount(1) == namespace_size);
+    assert(alg_hnsw->getNamespaceElementCount(0) == 2000);
+
+    // the graphs of the namespaces are not linked to each other
+    for (hnswlib::tableint i = 0; i < alg_hnsw->cur_element_count; i++) {
+        hnswlib::namespacetype ns = alg_hnsw->getElementNamespace(i);
+        assert(ns == get_namespace(alg_hnsw->getExternalLabel(i)));
+        for (int level = 0; level <= alg_hnsw->element_levels_[i]; level++) {
+            for (hnswlib::tableint neighbor : alg_hnsw->getConnectionsWithLock(i, level)) {
+                assert(alg_hnsw->getElementNamespace(neighbor) == ns);
+            }
+        }
+    }
+
+    for (hnswlib::namespacetype ns = 0; ns <= num_namespaces; ns++) {
+        std::vector<idx_t> allowed;
+        for (idx_t i = 0; i < n; i++) {
+            if (get_namespace(i) == ns) allowed.push_back(i);
+        }
+        hnswlib::BitsetFilterFunctor filter(n);
+        for (idx_t label : allowed) filter.set(label);
+
+        size_t correct = 0;
+        for (size_t j = 0; j < nq; ++j) {
+            const void* p = query.data() + j * d;
+            auto gt = alg_brute->searchKnnCloserFirst(p, k, &filter);
+            auto res = alg_hnsw->searchKnnInNamespace(p, k, ns);
+            assert(res.size() == k);
+            while (!res.empty()) {
+                assert(get_namespace(res.top().second) == ns);
+                for (auto& r : gt) {
+                    if (r.second == res.top().second) correct++;
+                }
+                res.pop();
+            }
+        }
+        float recall = (float) correct / (nq * k);
+        assert(recall >= 0.9f);
+    }
+    std::cout << "Namespace search is OK" << std::endl;
+
+    // a selective bitset over several namespaces: the exact scan of searchKnn only returns the default namespace
+    idx_t first_default = num_namespaces * namespace_size;
+    idx_t first_ns7 = 6 * namespace_size;
+    hnswlib::BitsetFilterFunctor mixed(n);
+    for (idx_t i = 0; i < 5; i++) {
+        mixed.set(first_default + i * 100);
+        mixed.set(first_ns7 + i * 10);
+    }
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        hnswlib::HierarchicalNSW<float>::FilteredSearchPlan plan;
+        auto res = alg_hnsw->searchKnn(p, k, &mixed, &plan);
+        assert(plan == hnswlib::HierarchicalNSW<float>::PLAN_BRUTE_FORCE);
+        auto res_parallel = alg_hnsw->searchKnnParallel(p, k, 4, &mixed);
+        for (auto* result : {&res, &res_parallel}) {
+            assert(result->size() == 5);
+            while (!result->empty()) {
+                assert(get_namespace(result->top().second) == 0);
+                result->pop();
+            }
+        }
+    }
+    // the same with the exact scan run after the graph search
+    alg_hnsw->setFilteredSearchPlanner(0, 0, 0);
+    auto res_fallback = alg_hnsw->searchKnn(query.data(), k, &mixed);
+    assert(res_fallback.size() == 5);
+    while (!res_fallback.empty()) {
+        assert(get_namespace(res_fallback.top().second) == 0);
+        res_fallback.pop();
+    }
+
+    // labels are unique across namespaces
+    bool thrown = false;
+    try {
+        alg_hnsw->addPointToNamespace(data.data(), 0, 5);
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // the namespaces are saved with the index
+    std::string path = "namespaces_test.bin";
+    alg_hnsw->saveIndex(path);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw_loaded = new hnswlib::HierarchicalNSW<float>(&space, path);
+    alg_hnsw_loaded->setEf(20);
+    assert(alg_hnsw_loaded->getNamespaces() == alg_hnsw->getNamespaces());
+    for (hnswlib::namespacetype ns = 0; ns <= num_namespaces; ns++) {
+        assert(alg_hnsw_loaded->getNamespaceElementCount(ns) == alg_hnsw->getNamespaceElementCount(ns));
+        auto res = alg_hnsw->searchKnnInNamespace(query.data(), k, ns);
+        auto res_loaded = alg_hnsw_loaded->searchKnnInNamespace(query.data(), k, ns);
+        assert(res.size() == res_loaded.size());
+        while (!res.empty()) {
+            assert(res.top() == res_loaded.top());
+            res.pop();
+            res_loaded.pop();
+        }
+    }
+    std::remove(path.c_str());
+
+    // an index with namespaces only
+    hnswlib::HierarchicalNSW<float>* alg_tenants = new hnswlib::HierarchicalNSW<float>(&space, 100);
+    for (size_t i = 0; i < 100; ++i) {
+        alg_tenants->addPointToNamespace(data.data() + d * i, i, 1 + i % 2);
+    }
+    assert(alg_tenants->searchKnn(query.data(), k).empty());
+    assert(alg_tenants->searchKnnInNamespace(query.data(), k, 2).size() == k);
+    assert(alg_tenants->searchKnnInNamespace(query.data(), k, 3).empty());
+
+    delete alg_brute;
+    delete alg_hnsw;
+    delete alg_hnsw_loaded;
+    delete alg_tenants;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,133 @@
+// This is a test file for testing the flat navigation and the search without upper layers
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using test_utils::recall;
+
+void test_navigation() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 200;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d);
+    alg_hnsw->setEf(50);
+    assert(alg_hnsw->getNavigation() == HNSW::NAVIGATION_HIERARCHY);
+    float recall_hierarchy = recall(alg_hnsw, alg_brute, query, d, k);
+
+    // the table holds the elements of level 1 and above
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_FLAT);
+    size_t upper_elements = 0;
+    for (idx_t i = 0; i < n; i++)
+        upper_elements += alg_hnsw->element_levels_[i] > 0;
+    assert(alg_hnsw->getNavigationTableSize() == upper_elements);
+    std::cout << "table elements " << upper_elements << " memory " << alg_hnsw->getNavigationMemory()
+              << " upper layers memory " << alg_hnsw->getUpperLayersMemory() << std::endl;
+
+    // the walk of the table is the greedy search of level 1 from the entry point, with as many hops
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        alg_hnsw->metric_hops = 0;
+        hnswlib::tableint nav_entry = alg_hnsw->searchUpperLayers(p);
+        long nav_hops = alg_hnsw->metric_hops;
+        alg_hnsw->metric_hops = 0;
+        assert(nav_entry == alg_hnsw->searchUpperLayers(p, alg_hnsw->enterpoint_node_, 1));
+        assert(nav_hops == alg_hnsw->metric_hops);
+        assert(alg_hnsw->element_levels_[nav_entry] > 0);
+    }
+    float recall_flat = recall(alg_hnsw, alg_brute, query, d, k);
+
+    // the base layer search from the entry point, and from the closest centroid of the router
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_NONE);
+    assert(alg_hnsw->getNavigationTableSize() == 0);
+    alg_hnsw->metric_hops = 0;
+    float recall_none = recall(alg_hnsw, alg_brute, query, d, k);
+    assert(alg_hnsw->metric_hops == 0);
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_ROUTER, 32);
+    float recall_router = recall(alg_hnsw, alg_brute, query, d, k);
+    std::cout << "recall hierarchy " << recall_hierarchy << " flat " << recall_flat
+              << " none " << recall_none << " router " << recall_router << std::endl;
+    assert(recall_flat >= recall_hierarchy - 0.02f);
+    assert(recall_none >= recall_hierarchy - 0.05f);
+    assert(recall_router >= recall_hierarchy - 0.02f);
+
+    // the table is rebuilt after a renumbering, reset by a load
+    alg_hnsw->setEntryStrategy(HNSW::ENTRY_HIERARCHY);
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_FLAT);
+    alg_hnsw->reorderIndex(HNSW::REORDER_RCM);
+    assert(alg_hnsw->getNavigationTableSize() == upper_elements);
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        assert(alg_hnsw->searchUpperLayers(p) == alg_hnsw->searchUpperLayers(p, alg_hnsw->enterpoint_node_, 1));
+    }
+    std::string path = "navigation_test.bin";
+    alg_hnsw->saveIndex(path);
+    alg_hnsw->loadIndex(path, &space);
+    assert(alg_hnsw->getNavigation() == HNSW::NAVIGATION_HIERARCHY);
+    assert(alg_hnsw->getNavigationTableSize() == 0);
+    std::remove(path.c_str());
+
+    // the flat navigation reads only its table: the searches do not change without the upper layer links
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_FLAT);
+    std::vector<hnswlib::tableint> nav_entries;
+    std::vector<std::vector<std::pair<float, idx_t>>> nav_results;
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        nav_entries.push_back(alg_hnsw->searchUpperLayers(p));
+        nav_results.push_back(alg_hnsw->searchKnnCloserFirst(p, k));
+    }
+    for (hnswlib::tableint i = 0; i < n; i++) {
+        for (int level = 1; level <= alg_hnsw->element_levels_[i]; level++)
+            alg_hnsw->setListCount(alg_hnsw->get_linklist(i, level), 0);
+    }
+    for (idx_t j = 0; j < nq; j++) {
+        const float* p = query.data() + j * d;
+        assert(alg_hnsw->searchUpperLayers(p) == nav_entries[j]);
+        assert(alg_hnsw->searchKnnCloserFirst(p, k) == nav_results[j]);
+    }
+    alg_hnsw->setNavigation(HNSW::NAVIGATION_HIERARCHY);
+    assert(alg_hnsw->searchUpperLayers(query.data()) == alg_hnsw->enterpoint_node_);
+
+    // insertions after the table is built are found through the base layer
+    HNSW* alg_partial = new HNSW(&space, n, 16, 100);
+    for (size_t i = 0; i < n / 2; ++i) {
+        alg_partial->addPoint(data.data() + d * i, i);
+    }
+    alg_partial->setNavigation(HNSW::NAVIGATION_FLAT);
+    for (size_t i = n / 2; i < n; ++i) {
+        alg_partial->addPoint(data.data() + d * i, i);
+    }
+    alg_partial->setEf(50);
+    assert(recall(alg_partial, alg_brute, query, d, k) >= recall_hierarchy - 0.05f);
+
+    delete alg_partial;
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+}  // namespace
+
+int main() {
+    test_navigation();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,188 @@
+// This is a test file for testing the search on the neighbor codes stored with the link lists
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+
+// recall of the search, whose reranked distances are exact
+float recall(
+    HNSW* alg_hnsw,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    hnswlib::SpaceInterface<float>* space,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    auto search = [&](const float* p) {
+        auto res = alg_hnsw->searchKnnCloserFirst(p, k);
+        for (auto& r : res) {
+            auto data = alg_hnsw->getDataByLabel<float>(r.second);
+            assert(r.first == space->get_dist_func()(p, data.data(), space->get_dist_func_param()));
+        }
+        return res;
+    };
+    return test_utils::search_recall(search, alg_brute, query, d, k);
+}
+
+
+// every stored code is the code of the current vector of the neighbor
+void check_codes(HNSW* alg_hnsw) {
+    std::vector<unsigned char> code(alg_hnsw->getNeighborCodeSize());
+    for (hnswlib::tableint i = 0; i < alg_hnsw->cur_element_count; i++) {
+        hnswlib::linklistsizeint* ll = alg_hnsw->get_linklist0(i);
+        hnswlib::tableint* data = (hnswlib::tableint*) (ll + 1);
+        for (size_t j = 0; j < alg_hnsw->getListCount(ll); j++) {
+            alg_hnsw->encodeNeighborCode(alg_hnsw->getDataByInternalId(data[j]), code.data());
+            assert(memcmp(code.data(), alg_hnsw->getNeighborCodes(i) + j * code.size(), code.size()) == 0);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    int d = 31;
+    idx_t n = 10000;
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d);
+    HNSW* alg_hnsw = new HNSW(&space, n, 16, 200);
+    for (size_t i = 0; i < n / 2; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw->setEf(100);
+    float recall_full = recall(alg_hnsw, alg_brute, &space, query, d, k);
+
+    // half of the index is inserted after the codes are enabled
+    alg_hnsw->setNeighborCodes(HNSW::NEIGHBOR_CODES_SQ4);
+    assert(alg_hnsw->getNeighborCodeType() == HNSW::NEIGHBOR_CODES_SQ4);
+    assert(alg_hnsw->getNeighborCodeSize() == 16);
+    assert(alg_hnsw->getLevel0Layout() == HNSW::LAYOUT_SPLIT);
+    for (size_t i = n / 2; i < n; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    check_codes(alg_hnsw);
+    alg_hnsw->setNeighborCodes(HNSW::NEIGHBOR_CODES_NONE);
+    recall_full = recall(alg_hnsw, alg_brute, &space, query, d, k);
+    alg_hnsw->setNeighborCodes(HNSW::NEIGHBOR_CODES_SQ4);
+
+    long full_computations = alg_hnsw->metric_rerank_distance_computations;
+    float recall_codes = recall(alg_hnsw, alg_brute, &space, query, d, k);
+    long reranked = alg_hnsw->metric_rerank_distance_computations - full_computations;
+    std::cout << "recall full vectors " << recall_full << " codes " << recall_codes
+              << " reranked per query " << (float) reranked / nq << std::endl;
+    assert(recall_codes >= recall_full - 0.05f);
+    assert(reranked == (long) (nq * 100));
+
+    // fewer reranked candidates
+    alg_hnsw->setNeighborCodes(HNSW::NEIGHBOR_CODES_SQ4, 30);
+    float recall_rerank_30 = recall(alg_hnsw, alg_brute, &space, query, d, k);
+    std::cout << "recall rerank 30 " << recall_rerank_30 << std::endl;
+    assert(recall_rerank_30 >= 0.8f);
+
+    // the early termination stops the search on the codes
+    alg_hnsw->setEarlyTermination(10);
+    long early_terminations = alg_hnsw->metric_early_terminations;
+    full_computations = alg_hnsw->metric_rerank_distance_computations;
+    float recall_early = recall(alg_hnsw, alg_brute, &space, query, d, k);
+    std::cout << "recall early termination " << recall_early << " stopped early "
+              << alg_hnsw->metric_early_terminations - early_terminations << std::endl;
+    assert(alg_hnsw->metric_early_terminations > early_terminations);
+    assert(alg_hnsw->metric_rerank_distance_computations > full_computations);
+    assert(recall_early >= 0.7f);
+    alg_hnsw->setEarlyTermination(0);
+
+    // updates, deletions and reordering keep the codes consistent, with the full refresh also in the
+    // lists linking to an updated element without a link back
+    alg_hnsw->setNeighborCodesFullRefresh(true);
+    hnswlib::tableint updated_id = alg_hnsw->label_lookup_.at(5);
+    auto updated_links = alg_hnsw->getConnectionsWithLock(updated_id, 0);
+    size_t num_one_way_links = 0;
+    for (hnswlib::tableint i = 0; i < alg_hnsw->cur_element_count; i++) {
+        auto links = alg_hnsw->getConnectionsWithLock(i, 0);
+        if (std::find(links.begin(), links.end(), updated_id) != links.end() &&
+            std::find(updated_links.begin(), updated_links.end(), i) == updated_links.end())
+            num_one_way_links++;
+    }
+    assert(num_one_way_links > 0);
+    alg_hnsw->addPoint(query.data(), 5);
+    check_codes(alg_hnsw);
+    alg_hnsw->markDelete(7);
+    for (size_t j = 0; j < nq; ++j) {
+        for (auto& r : alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k))
+            assert(r.second != 7);
+    }
+    alg_hnsw->reorderIndex();
+    check_codes(alg_hnsw);
+    alg_hnsw->unmarkDelete(7);
+    alg_hnsw->addPoint(data.data() + d * 5, 5);
+
+    check_codes(alg_hnsw);
+
+    // the quantizer is saved, the loaded index rebuilds the same codes
+    std::string path = "neighbor_codes_test.bin";
+    alg_hnsw->saveIndex(path);
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    std::fseek(f, 0, SEEK_END);
+    assert((size_t) std::ftell(f) == alg_hnsw->indexFileSize());
+    std::fclose(f);
+    HNSW* alg_loaded = new HNSW(&space, path);
+    std::remove(path.c_str());
+    assert(alg_loaded->getNeighborCodeType() == HNSW::NEIGHBOR_CODES_SQ4);
+    assert(alg_loaded->getLevel0Layout() == HNSW::LAYOUT_SPLIT);
+    assert(alg_loaded->neighbor_codes_rerank_ == 30);
+    check_codes(alg_loaded);
+    alg_loaded->setEf(100);
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_loaded->searchKnnCloserFirst(query.data() + j * d, k) ==
+               alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k));
+    }
+
+    // by default an update refreshes the lists within two hops of the element
+    alg_hnsw->setNeighborCodesFullRefresh(false);
+    updated_id = alg_hnsw->label_lookup_.at(9);
+    std::vector<hnswlib::tableint> nearby;
+    for (hnswlib::tableint one_hop : alg_hnsw->getConnectionsWithLock(updated_id, 0)) {
+        nearby.push_back(one_hop);
+        for (hnswlib::tableint two_hop : alg_hnsw->getConnectionsWithLock(one_hop, 0))
+            nearby.push_back(two_hop);
+    }
+    alg_hnsw->addPoint(query.data() + d, 9);
+    std::vector<unsigned char> code(alg_hnsw->getNeighborCodeSize());
+    alg_hnsw->encodeNeighborCode(alg_hnsw->getDataByInternalId(updated_id), code.data());
+    for (hnswlib::tableint i : nearby) {
+        auto links = alg_hnsw->getConnectionsWithLock(i, 0);
+        for (size_t j = 0; j < links.size(); j++) {
+            if (links[j] == updated_id)
+                assert(memcmp(code.data(), alg_hnsw->getNeighborCodes(i) + j * code.size(), code.size()) == 0);
+        }
+    }
+
+    // the interleaved layout has no room for the codes
+    alg_hnsw->setLevel0Layout(HNSW::LAYOUT_INTERLEAVED);
+    assert(alg_hnsw->getNeighborCodeType() == HNSW::NEIGHBOR_CODES_NONE);
+
+    delete alg_brute;
+    delete alg_hnsw;
+    delete alg_loaded;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,141 @@
+// This is a test file for testing the NUMA interleaved and replicated modes of the index
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+std::vector<std::vector<std::pair<float, idx_t>>> search_all(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (size_t j = 0; j < query.size() / d; ++j) {
+        results.push_back(alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    return results;
+}
+
+}  // namespace
+
+int main() {
+    int d = 16;
+    idx_t n = 5000;
+    idx_t nq = 200;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    std::vector<int> nodes = hnswlib::getNumaNodes();
+    assert(!nodes.empty());
+    assert(hnswlib::getNumaNodeCount() == nodes.size());
+    std::cout << "NUMA nodes " << nodes.size() << " current node " << hnswlib::getCurrentNumaNode() << std::endl;
+    assert(hnswlib::parseNumaList("0-2,5,7-8\n") == std::vector<int>({0, 1, 2, 5, 7, 8}));
+    std::vector<int> cpu_nodes = hnswlib::getCpuNumaNodes();
+    for (int node : nodes) {
+        for (int cpu : hnswlib::getNumaNodeCpus(node))
+            assert(cpu_nodes.at(cpu) == node);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n / 2);
+    for (size_t i = 0; i < n / 2; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    assert(!alg_hnsw->isNumaInterleaved());
+
+    // interleaving moves the data, also through a resize, the policy may be unavailable
+    bool interleaved = alg_hnsw->setNumaInterleave(true);
+    std::cout << "interleaved " << interleaved << std::endl;
+    assert(alg_hnsw->isNumaInterleaved() == interleaved);
+    alg_hnsw->resizeIndex(n);
+    assert(alg_hnsw->isNumaInterleaved() == interleaved);
+    for (size_t i = n / 2; i < n; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    auto results = search_all(alg_hnsw, query, d, k);
+    alg_hnsw->setNumaInterleave(false);
+    assert(!alg_hnsw->isNumaInterleaved());
+    assert(search_all(alg_hnsw, query, d, k) == results);
+
+    // one replica per node, each giving the results of the original index
+    std::string path = "numa_test.bin";
+    alg_hnsw->saveIndex(path);
+    hnswlib::NumaReplicatedIndex<float>* alg_replicated = new hnswlib::NumaReplicatedIndex<float>(&space, path);
+    std::remove(path.c_str());
+    assert(alg_replicated->getNumReplicas() == nodes.size());
+    alg_replicated->setEf(alg_hnsw->ef_);
+    for (size_t r = 0; r < alg_replicated->getNumReplicas(); r++) {
+        assert(alg_replicated->getReplicaNode(r) == nodes[r]);
+        assert(alg_replicated->getReplicaForNode(nodes[r]) == alg_replicated->getReplica(r));
+        assert(search_all(alg_replicated->getReplica(r), query, d, k) == results);
+    }
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_replicated->searchKnnCloserFirst(query.data() + j * d, k) == results[j]);
+    }
+
+    // pinned threads process every query exactly once
+    std::vector<std::atomic<int>> processed(nq);
+    for (auto& p : processed) p = 0;
+    std::vector<std::vector<std::pair<float, idx_t>>> results_pinned(nq);
+    std::atomic<size_t> num_local(0);
+    auto stats = alg_replicated->parallelFor(nq, 2, [&](size_t j, hnswlib::HierarchicalNSW<float>* replica) {
+        processed[j]++;
+        // the threads are pinned to the node of their replica when the cpus of the node are known
+        num_local += alg_replicated->getLocalReplica() == replica;
+        results_pinned[j] = replica->searchKnnCloserFirst(query.data() + j * d, k);
+    });
+    assert(stats.size() == nodes.size());
+    size_t total = 0;
+    for (auto& s : stats) {
+        std::cout << "node " << s.node << " threads " << s.num_threads << " queries " << s.num_queries
+                  << " seconds " << s.seconds << std::endl;
+        assert(s.num_threads == 2);
+        total += s.num_queries;
+    }
+    assert(total == nq);
+    std::cout << "queries on the local replica " << num_local << std::endl;
+    if (nodes.size() == 1)
+        assert(num_local == nq);
+    for (auto& p : processed) assert(p == 1);
+    assert(results_pinned == results);
+
+    // exceptions of the pinned threads are rethrown
+    bool thrown = false;
+    try {
+        alg_replicated->parallelFor(nq, 2, [&](size_t j, hnswlib::HierarchicalNSW<float>*) {
+            if (j == 10) throw std::runtime_error("query failed");
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    delete alg_replicated;
+    delete alg_hnsw;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,141 @@
+// This is a test file for testing the reordering of the internal ids
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using Strategy = hnswlib::HierarchicalNSW<float>::ReorderStrategy;
+
+// fraction of the base layer links between elements with close ids (e.g. on the same page)
+double local_link_fraction(hnswlib::HierarchicalNSW<float>* alg_hnsw) {
+    size_t num_local = 0;
+    size_t num_links = 0;
+    for (hnswlib::tableint i = 0; i < alg_hnsw->cur_element_count; i++) {
+        hnswlib::linklistsizeint* ll = alg_hnsw->get_linklist0(i);
+        hnswlib::tableint* datal = (hnswlib::tableint*) (ll + 1);
+        for (size_t j = 0; j < alg_hnsw->getListCount(ll); j++) {
+            if (std::abs((long) datal[j] - (long) i) <= 64)
+                num_local++;
+            num_links++;
+        }
+    }
+    return (double) num_local / num_links;
+}
+
+std::vector<std::vector<std::pair<float, idx_t>>> search_all(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (size_t j = 0; j < query.size() / d; ++j) {
+        results.push_back(alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    return results;
+}
+
+}  // namespace
+
+int main() {
+    int d = 8;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    std::vector<Strategy> strategies = {Strategy::REORDER_BFS, Strategy::REORDER_RCM, Strategy::REORDER_GORDER};
+    for (Strategy strategy : strategies) {
+        hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 16, 100, 100, true);
+        for (size_t i = 0; i < n; ++i) {
+            if (i % 10 == 0) {
+                alg_hnsw->addPointWithAttributes(data.data() + d * i, i, {(hnswlib::attributetype) (i % 3)});
+            } else if (i % 10 == 1) {
+                alg_hnsw->addPointToNamespace(data.data() + d * i, i, 1);
+            } else {
+                alg_hnsw->addPoint(data.data() + d * i, i);
+            }
+        }
+        for (size_t i = 5; i < n; i += 100) {
+            alg_hnsw->markDelete(i);
+        }
+        alg_hnsw->setEf(50);
+
+        auto results = search_all(alg_hnsw, query, d, k);
+        auto attribute_result = alg_hnsw->searchKnnWithAttribute(query.data(), k, 1);
+        auto namespace_result = alg_hnsw->searchKnnInNamespace(query.data(), k, 1);
+        double local = local_link_fraction(alg_hnsw);
+
+        alg_hnsw->reorderIndex(strategy);
+        alg_hnsw->checkIntegrity();
+        double reordered_local = local_link_fraction(alg_hnsw);
+        std::cout << "strategy " << strategy << " local links " << local << " -> " << reordered_local << std::endl;
+        assert(reordered_local > 2 * local);
+
+        // the same graph is traversed, only the ids are different
+        assert(search_all(alg_hnsw, query, d, k) == results);
+        auto reordered_attribute_result = alg_hnsw->searchKnnWithAttribute(query.data(), k, 1);
+        auto reordered_namespace_result = alg_hnsw->searchKnnInNamespace(query.data(), k, 1);
+        assert(reordered_attribute_result.size() == attribute_result.size());
+        while (!attribute_result.empty()) {
+            assert(attribute_result.top() == reordered_attribute_result.top());
+            attribute_result.pop();
+            reordered_attribute_result.pop();
+        }
+        assert(reordered_namespace_result.size() == namespace_result.size());
+        while (!namespace_result.empty()) {
+            assert(namespace_result.top() == reordered_namespace_result.top());
+            namespace_result.pop();
+            reordered_namespace_result.pop();
+        }
+
+        // labels, data, attributes and deletion marks follow the elements
+        for (size_t i = 0; i < n; i += 7) {
+            if (i % 100 == 5) continue;  // deleted
+            std::vector<float> element = alg_hnsw->getDataByLabel<float>(i);
+            assert(std::equal(element.begin(), element.end(), data.begin() + d * i));
+        }
+        assert(alg_hnsw->getAttributesByLabel(10) == std::vector<hnswlib::attributetype>{1});
+        assert(alg_hnsw->getNamespaceElementCount(1) == n / 10);
+        assert(alg_hnsw->getDeletedCount() == (n - 5 + 99) / 100);
+
+        // replacing deleted elements uses the renamed ids
+        alg_hnsw->addPoint(data.data(), n + 1, true);
+        assert(alg_hnsw->getDeletedCount() == (n - 5 + 99) / 100 - 1);
+
+        // the reordered index is saved and loaded as usual
+        std::string path = "reorder_index_test.bin";
+        alg_hnsw->saveIndex(path);
+        hnswlib::HierarchicalNSW<float>* alg_hnsw_loaded = new hnswlib::HierarchicalNSW<float>(&space, path);
+        alg_hnsw_loaded->setEf(50);
+        assert(search_all(alg_hnsw_loaded, query, d, k) == search_all(alg_hnsw, query, d, k));
+        std::remove(path.c_str());
+
+        delete alg_hnsw;
+        delete alg_hnsw_loaded;
+    }
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,122 @@
+// This is a test file for testing the intra-query parallel search
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+// recall of the parallel search, whose results pass the filter
+float recall(
+    hnswlib::HierarchicalNSW<float>* alg_hnsw,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    const std::vector<float>& query,
+    int d,
+    size_t k,
+    size_t num_threads,
+    hnswlib::BaseFilterFunctor* filter = nullptr) {
+    auto search = [&](const float* p) {
+        auto res = alg_hnsw->searchKnnParallel(p, k, num_threads, filter);
+        assert(res.size() == alg_brute->searchKnn(p, k, filter).size());
+        std::vector<std::pair<float, idx_t>> result;
+        while (!res.empty()) {
+            if (filter)
+                assert((*filter)(res.top().second));
+            result.push_back(res.top());
+            res.pop();
+        }
+        return result;
+    };
+    return test_utils::search_recall(search, alg_brute, query, d, k, filter);
+}
+
+}  // namespace
+
+int main() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = test_utils::build_hnsw(&space, data, d);
+    alg_hnsw->setEf(500);
+
+    // one thread is the regular search
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto res = alg_hnsw->searchKnnParallel(p, k, 1);
+        auto res_serial = alg_hnsw->searchKnn(p, k);
+        assert(res.size() == res_serial.size());
+        while (!res.empty()) {
+            assert(res.top() == res_serial.top());
+            res.pop();
+            res_serial.pop();
+        }
+    }
+
+    float serial_recall = recall(alg_hnsw, alg_brute, query, d, k, 1);
+    for (size_t num_threads : {2, 4, 8}) {
+        float parallel_recall = recall(alg_hnsw, alg_brute, query, d, k, num_threads);
+        std::cout << "threads " << num_threads << " recall " << parallel_recall
+                  << " (serial " << serial_recall << ")" << std::endl;
+        assert(parallel_recall >= serial_recall - 0.01f);
+    }
+    // the helper threads are created once and reused by the following queries
+    assert(alg_hnsw->search_thread_pool_.numThreads() == 7);
+
+    // concurrent queries share the pool
+    std::vector<std::thread> callers;
+    for (size_t t = 0; t < 4; t++) {
+        callers.emplace_back([&, t]() {
+            for (size_t j = t; j < nq; j += 4) {
+                const void* p = query.data() + j * d;
+                auto res = alg_hnsw->searchKnnParallel(p, k, 4);
+                auto gt = alg_brute->searchKnnCloserFirst(p, k);
+                size_t correct = 0;
+                while (!res.empty()) {
+                    if (std::find(gt.begin(), gt.end(), res.top()) != gt.end())
+                        correct++;
+                    res.pop();
+                }
+                assert(correct >= k - 2);
+            }
+        });
+    }
+    for (auto& caller : callers)
+        caller.join();
+    assert(alg_hnsw->search_thread_pool_.numThreads() == 7);
+
+    // filters and deleted elements
+    hnswlib::BitsetFilterFunctor even(n);
+    for (size_t i = 0; i < n; i += 2) {
+        even.set(i);
+    }
+    assert(recall(alg_hnsw, alg_brute, query, d, k, 4, &even) >= 0.95f);
+
+    for (size_t i = 0; i < n; i += 3) {
+        alg_hnsw->markDelete(i);
+        alg_brute->removePoint(i);
+    }
+    assert(recall(alg_hnsw, alg_brute, query, d, k, 4) >= 0.95f);
+
+    delete alg_brute;
+    delete alg_hnsw;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
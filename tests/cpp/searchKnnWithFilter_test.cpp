@@ -143,6 +143,73 @@ void test_none_filtering(hnswlib::BaseFilterFunctor& filter_func, size_t label_i
     delete alg_hnsw;
 }
 
+void test_bitset_filtering(size_t div_num, size_t label_id_start) {
+    int d = 4;
+    idx_t n = 100;
+    idx_t nq = 10;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute  = new hnswlib::BruteforceSearch<float>(&space, 2 * n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, 2 * n);
+    // compare the graph search only, the planner is tested in filteredSearchPlanner_test
+    alg_hnsw->setFilteredSearchPlanner(0, 0, 0);
+
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, label_id_start + i);
+        alg_hnsw->addPoint(data.data() + d * i, label_id_start + i);
+    }
+
+    PickDivisibleIds filter_func(div_num);
+    hnswlib::BitsetFilterFunctor label_bitset(label_id_start + n);
+    hnswlib::BitsetFilterFunctor brute_internal_bitset(n, hnswlib::BitsetFilterFunctor::INTERNAL_IDS);
+    std::vector<hnswlib::labeltype> allowed_labels;
+    for (size_t i = 0; i < n; ++i) {
+        hnswlib::labeltype label = label_id_start + i;
+        if (label % div_num == 0) {
+            label_bitset.set(label);
+            brute_internal_bitset.set(i);
+            allowed_labels.push_back(label);
+        }
+    }
+    hnswlib::BitsetFilterFunctor hnsw_internal_bitset =
+        alg_hnsw->createInternalIdFilter(allowed_labels.data(), allowed_labels.size());
+    assert(label_bitset.count() == allowed_labels.size());
+    assert(hnsw_internal_bitset.count() == allowed_labels.size());
+
+    // bitset filters must give exactly the same results as the equivalent functor
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto gd_brute = alg_brute->searchKnnCloserFirst(p, k, &filter_func);
+        assert(gd_brute == alg_brute->searchKnnCloserFirst(p, k, &label_bitset));
+        assert(gd_brute == alg_brute->searchKnnCloserFirst(p, k, &brute_internal_bitset));
+
+        auto gd_hnsw = alg_hnsw->searchKnnCloserFirst(p, k, &filter_func);
+        assert(gd_hnsw == alg_hnsw->searchKnnCloserFirst(p, k, &label_bitset));
+        assert(gd_hnsw == alg_hnsw->searchKnnCloserFirst(p, k, &hnsw_internal_bitset));
+        for (auto& res : gd_hnsw) {
+            assert((res.second % div_num) == 0);
+        }
+    }
+
+    delete alg_brute;
+    delete alg_hnsw;
+}
+
 }  // namespace
 
 class CustomFilterFunctor: public hnswlib::BaseFilterFunctor {
@@ -173,6 +240,10 @@ int main() {
     CustomFilterFunctor pickIdsDivisibleByThirteen({26, 39, 52, 65});
     test_some_filtering(pickIdsDivisibleByThirteen, 13, 21);
 
+    // bitset filters over labels and internal ids
+    test_bitset_filtering(3, 17);
+    test_bitset_filtering(7, 21);
+
     std::cout << "Test ok" << std::endl;
 
     return 0;
@@ -0,0 +1,124 @@
+// This is a test file for testing the range search
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+// all the elements within radius, closer first
+std::vector<std::pair<float, idx_t>> exact_range(
+    hnswlib::L2Space& space,
+    const std::vector<float>& data,
+    const void* query,
+    int d,
+    float radius) {
+    std::vector<std::pair<float, idx_t>> res;
+    size_t n = data.size() / d;
+    for (size_t i = 0; i < n; i++) {
+        float dist = space.get_dist_func()(query, data.data() + i * d, space.get_dist_func_param());
+        if (dist <= radius)
+            res.emplace_back(dist, i);
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+}  // namespace
+
+int main() {
+    int d = 8;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    // squared L2, about 1% of the points of a uniform cube are within this radius
+    float radius = 0.3f;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(&space, n);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, n, 16, 100);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, i);
+        alg_hnsw->addPoint(data.data() + d * i, i);
+    }
+    // the beam has to grow past ef to collect the whole range
+    alg_hnsw->setEf(10);
+
+    size_t correct = 0;
+    size_t total = 0;
+    size_t max_range = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto gt = exact_range(space, data, p, d, radius);
+        max_range = std::max(max_range, gt.size());
+
+        // brute force range search is exact
+        auto res_brute = alg_brute->searchRange(p, radius);
+        assert(res_brute == gt);
+
+        auto res = alg_hnsw->searchRange(p, radius);
+        assert(std::is_sorted(res.begin(), res.end()));
+        for (auto& r : res) {
+            assert(r.first <= radius);
+            if (std::find(gt.begin(), gt.end(), r) != gt.end())
+                correct++;
+        }
+        total += gt.size();
+
+        // the number of results is limited, the closest ones are kept
+        size_t max_results = 5;
+        auto res_limited = alg_brute->searchRange(p, radius, max_results);
+        assert(res_limited.size() == std::min(max_results, gt.size()));
+        assert(std::equal(res_limited.begin(), res_limited.end(), gt.begin()));
+        assert(alg_hnsw->searchRange(p, radius, max_results).size() <= max_results);
+    }
+    float recall = (float) correct / total;
+    std::cout << "range recall " << recall << " max range size " << max_range << std::endl;
+    assert(max_range > 10);
+    assert(recall >= 0.95f);
+
+    // filtered range search
+    hnswlib::BitsetFilterFunctor even(n);
+    for (size_t i = 0; i < n; i += 2) {
+        even.set(i);
+    }
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        for (auto& r : alg_hnsw->searchRange(p, radius, 0, &even))
+            assert(r.second % 2 == 0);
+        for (auto& r : alg_brute->searchRange(p, radius, 0, &even))
+            assert(r.second % 2 == 0);
+    }
+
+    // deleted elements are not returned, an empty radius finds the point itself
+    alg_hnsw->markDelete(0);
+    assert(alg_hnsw->searchRange(data.data(), 0).empty());
+    auto self = alg_hnsw->searchRange(data.data() + d, 0);
+    assert(self.size() == 1 && self[0].second == 1);
+
+    delete alg_brute;
+    delete alg_hnsw;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
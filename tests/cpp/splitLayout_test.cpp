@@ -0,0 +1,121 @@
+// This is a test file for testing the split layout of the base layer
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+
+std::vector<std::vector<std::pair<float, idx_t>>> search_all(
+    HNSW* alg_hnsw,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    std::vector<std::vector<std::pair<float, idx_t>>> results;
+    for (size_t j = 0; j < query.size() / d; ++j) {
+        results.push_back(alg_hnsw->searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    return results;
+}
+
+}  // namespace
+
+int main() {
+    int d = 13;  // the vectors are padded in the split layout
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    HNSW* alg_interleaved = new HNSW(&space, n);
+    HNSW* alg_split = new HNSW(&space, n / 2);
+    alg_split->setLevel0Layout(HNSW::LAYOUT_SPLIT);
+    assert(alg_split->getLevel0Layout() == HNSW::LAYOUT_SPLIT);
+    assert(alg_split->getVectorStride() == 64);
+    for (size_t i = 0; i < n; ++i) {
+        alg_interleaved->addPoint(data.data() + d * i, i);
+        if (i == n / 2) {
+            // resizing keeps the layout
+            alg_split->resizeIndex(n);
+        }
+        alg_split->addPoint(data.data() + d * i, i);
+    }
+    assert(alg_split->getLevel0Layout() == HNSW::LAYOUT_SPLIT);
+
+    // same graph, labels and vectors as the interleaved layout
+    for (size_t i = 0; i < n; i += 97) {
+        assert(alg_split->getExternalLabel(i) == i);
+        assert(alg_split->getDataByLabel<float>(i) == std::vector<float>(data.begin() + d * i, data.begin() + d * (i + 1)));
+        assert((size_t) alg_split->getDataByInternalId(i) % 64 == 0);
+        assert(alg_split->getListCount(alg_split->get_linklist0(i)) ==
+               alg_interleaved->getListCount(alg_interleaved->get_linklist0(i)));
+    }
+    auto results = search_all(alg_interleaved, query, d, k);
+    assert(search_all(alg_split, query, d, k) == results);
+
+    // the saved file does not depend on the layout
+    std::string path_interleaved = "split_layout_test_interleaved.bin";
+    std::string path_split = "split_layout_test_split.bin";
+    alg_interleaved->saveIndex(path_interleaved);
+    alg_split->saveIndex(path_split);
+    std::FILE* f_interleaved = std::fopen(path_interleaved.c_str(), "rb");
+    std::FILE* f_split = std::fopen(path_split.c_str(), "rb");
+    int c_interleaved, c_split;
+    do {
+        c_interleaved = std::fgetc(f_interleaved);
+        c_split = std::fgetc(f_split);
+        assert(c_interleaved == c_split);
+    } while (c_interleaved != EOF);
+    std::fclose(f_interleaved);
+    std::fclose(f_split);
+
+    // loading into the split layout
+    HNSW* alg_loaded = new HNSW(&space);
+    alg_loaded->setLevel0Layout(HNSW::LAYOUT_SPLIT);
+    alg_loaded->loadIndex(path_interleaved, &space);
+    assert(alg_loaded->getLevel0Layout() == HNSW::LAYOUT_SPLIT);
+    assert(search_all(alg_loaded, query, d, k) == results);
+
+    // reordering and switching back
+    alg_loaded->reorderIndex();
+    assert(search_all(alg_loaded, query, d, k) == results);
+    alg_loaded->setLevel0Layout(HNSW::LAYOUT_INTERLEAVED);
+    assert(search_all(alg_loaded, query, d, k) == results);
+
+    // deletions and updates
+    alg_split->markDelete(results[0][0].second);
+    assert(alg_split->searchKnnCloserFirst(query.data(), 1)[0].second != results[0][0].second);
+    alg_split->addPoint(query.data(), 0);
+    assert(alg_split->searchKnnCloserFirst(query.data(), 1)[0].second == 0);
+
+    std::remove(path_interleaved.c_str());
+    std::remove(path_split.c_str());
+    delete alg_interleaved;
+    delete alg_split;
+    delete alg_loaded;
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
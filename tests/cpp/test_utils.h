@@ -0,0 +1,103 @@
+// Helpers of the tests comparing an index with the exact search
+
+#pragma once
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace test_utils {
+
+using idx_t = hnswlib::labeltype;
+
+// count vectors of d uniform values in [0, 1)
+inline std::vector<float> random_vectors(size_t count, int d, std::mt19937& rng) {
+    std::uniform_real_distribution<> distrib;
+    std::vector<float> vectors(count * d);
+    for (auto& v : vectors) v = distrib(rng);
+    return vectors;
+}
+
+
+// label of vector i, i without labels
+inline idx_t label_of(const std::vector<idx_t>& labels, size_t i) {
+    return labels.empty() ? i : labels[i];
+}
+
+
+inline hnswlib::BruteforceSearch<float>* build_bruteforce(
+    hnswlib::SpaceInterface<float>* space,
+    const std::vector<float>& data,
+    int d,
+    const std::vector<idx_t>& labels = {}) {
+    size_t n = data.size() / d;
+    hnswlib::BruteforceSearch<float>* alg_brute = new hnswlib::BruteforceSearch<float>(space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute->addPoint(data.data() + d * i, label_of(labels, i));
+    }
+    return alg_brute;
+}
+
+
+// index built by inserting the vectors one by one
+inline hnswlib::HierarchicalNSW<float>* build_hnsw(
+    hnswlib::SpaceInterface<float>* space,
+    const std::vector<float>& data,
+    int d,
+    size_t M = 16,
+    size_t ef_construction = 100,
+    const std::vector<idx_t>& labels = {}) {
+    size_t n = data.size() / d;
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(space, n, M, ef_construction);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, label_of(labels, i));
+    }
+    return alg_hnsw;
+}
+
+
+/*
+* Fraction of the exact k nearest neighbors of the queries found by search(query), which returns
+* (distance, label) pairs like searchKnnCloserFirst. The filter is passed to the exact search.
+*/
+template<typename Search>
+float search_recall(
+    Search search,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    const std::vector<float>& query,
+    int d,
+    size_t k,
+    hnswlib::BaseFilterFunctor* filter = nullptr) {
+    size_t correct = 0;
+    size_t total = 0;
+    for (size_t j = 0; j < query.size() / d; ++j) {
+        const float* p = query.data() + j * d;
+        std::vector<std::pair<float, idx_t>> res = search(p);
+        auto gt = alg_brute->searchKnnCloserFirst(p, k, filter);
+        for (auto& r : res) {
+            for (auto& g : gt) {
+                if (g.second == r.second) {
+                    correct++;
+                    break;
+                }
+            }
+        }
+        total += gt.size();
+    }
+    return total ? (float) correct / total : 1.0f;
+}
+
+
+template<typename Index>
+float recall(
+    Index* alg,
+    hnswlib::BruteforceSearch<float>* alg_brute,
+    const std::vector<float>& query,
+    int d,
+    size_t k) {
+    return search_recall([&](const float* p) { return alg->searchKnnCloserFirst(p, k); }, alg_brute, query, d, k);
+}
+
+}  // namespace test_utils
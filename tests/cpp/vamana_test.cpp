@@ -0,0 +1,179 @@
+// This is a test file for testing the Vamana construction of the base layer
+
+#include "../../hnswlib/hnswlib.h"
+#include "test_utils.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <queue>
+#include <random>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+using HNSW = hnswlib::HierarchicalNSW<float>;
+using test_utils::recall;
+
+float distance(HNSW* alg_hnsw, hnswlib::tableint a, hnswlib::tableint b) {
+    return alg_hnsw->fstdistfunc_(alg_hnsw->getDataByInternalId(a), alg_hnsw->getDataByInternalId(b),
+                                  alg_hnsw->dist_func_param_);
+}
+
+
+// true if a kept element u closer to p than v has alpha * d(u, v) < d(p, v): RobustPrune drops v
+bool is_dominated(HNSW* alg_hnsw, hnswlib::tableint p, hnswlib::tableint v,
+                  const std::vector<hnswlib::tableint>& kept, float alpha) {
+    for (auto u : kept) {
+        if (u != v && distance(alg_hnsw, p, u) <= distance(alg_hnsw, p, v) &&
+            alpha * distance(alg_hnsw, u, v) < distance(alg_hnsw, p, v))
+            return true;
+    }
+    return false;
+}
+
+
+/*
+* Prunes the exact neighbors of element p with alpha, checks that the kept ones dominate each other
+* in no pair and dominate every dropped one, returns the number kept
+*/
+size_t check_robust_prune(HNSW* alg_hnsw, hnswlib::BruteforceSearch<float>* alg_brute, hnswlib::tableint p,
+                          size_t num_candidates, float alpha) {
+    typedef std::pair<float, hnswlib::tableint> Candidate;
+    std::priority_queue<Candidate, std::vector<Candidate>, HNSW::CompareByFirst> candidates;
+    std::vector<hnswlib::tableint> candidate_ids;
+    for (auto& r : alg_brute->searchKnnCloserFirst(alg_hnsw->getDataByInternalId(p), num_candidates + 1)) {
+        hnswlib::tableint id = alg_hnsw->label_lookup_.at(r.second);
+        if (id != p) {
+            candidates.emplace(r.first, id);
+            candidate_ids.push_back(id);
+        }
+    }
+    alg_hnsw->getNeighborsByHeuristic2(candidates, alg_hnsw->maxM0_, p, alpha);
+    std::vector<hnswlib::tableint> kept;
+    while (!candidates.empty()) {
+        kept.push_back(candidates.top().second);
+        candidates.pop();
+    }
+    assert(kept.size() > 0 && kept.size() <= alg_hnsw->maxM0_);
+    for (auto v : kept)
+        assert(!is_dominated(alg_hnsw, p, v, kept, alpha));
+    if (kept.size() < alg_hnsw->maxM0_) {
+        for (auto v : candidate_ids) {
+            if (std::find(kept.begin(), kept.end(), v) == kept.end())
+                assert(is_dominated(alg_hnsw, p, v, kept, alpha));
+        }
+    }
+    return kept.size();
+}
+
+
+void test_vamana() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 200;
+    size_t k = 10;
+
+    std::mt19937 rng(47);
+    std::vector<float> data = test_utils::random_vectors(n, d, rng);
+    std::vector<float> query = test_utils::random_vectors(nq, d, rng);
+    std::vector<idx_t> labels(n);
+    for (idx_t i = 0; i < n; i++) labels[i] = 3 * i;
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float>* alg_brute = test_utils::build_bruteforce(&space, data, d, labels);
+    HNSW* alg_hnsw = test_utils::build_hnsw(&space, data, d, 16, 100, labels);
+    alg_hnsw->setEf(50);
+    alg_hnsw->metric_base_hops = 0;
+    float recall_hnsw = recall(alg_hnsw, alg_brute, query, d, k);
+    long hops_hnsw = alg_hnsw->metric_base_hops;
+    std::cout << "hnsw recall " << recall_hnsw << " base hops " << hops_hnsw << std::endl;
+
+    std::vector<size_t> edges;
+    std::vector<double> edge_lengths;
+    std::vector<size_t> kept;
+    for (float alpha : {1.0f, 1.2f}) {
+        HNSW* alg_vamana = new HNSW(&space, n, 16, 100);
+        alg_vamana->buildVamana(data.data(), labels.data(), n, alpha, 4);
+        alg_vamana->checkIntegrity();
+        assert(alg_vamana->getCurrentElementCount() == n);
+        assert(alg_vamana->maxlevel_ == 0);
+        size_t num_edges = 0;
+        double edge_length = 0;
+        for (hnswlib::tableint i = 0; i < n; i++) {
+            assert(alg_vamana->element_levels_[i] == 0);
+            assert(alg_vamana->getExternalLabel(i) == labels[i]);
+            hnswlib::linklistsizeint* ll = alg_vamana->get_linklist0(i);
+            hnswlib::tableint* links = (hnswlib::tableint*) (ll + 1);
+            size_t size = alg_vamana->getListCount(ll);
+            assert(size > 0 && size <= alg_vamana->maxM0_);
+            num_edges += size;
+            for (size_t j = 0; j < size; j++)
+                edge_length += distance(alg_vamana, i, links[j]);
+        }
+        edges.push_back(num_edges);
+        edge_lengths.push_back(edge_length / num_edges);
+
+        // the pruning of the construction is RobustPrune with alpha
+        size_t num_kept = 0;
+        for (hnswlib::tableint i = 0; i < n; i += 50)
+            num_kept += check_robust_prune(alg_vamana, alg_brute, i, 4 * alg_vamana->maxM0_, alpha);
+        kept.push_back(num_kept);
+
+        alg_vamana->setEf(50);
+        alg_vamana->metric_base_hops = 0;
+        float recall_vamana = recall(alg_vamana, alg_brute, query, d, k);
+        long hops = alg_vamana->metric_base_hops;
+        std::cout << "alpha " << alpha << " edges " << num_edges << " mean edge length " << edge_lengths.back()
+                  << " kept by the pruning " << num_kept << " recall " << recall_vamana
+                  << " base hops " << hops << std::endl;
+        assert(recall_vamana >= recall_hnsw - 0.03f);
+
+        // saved in the index format and open to insertions
+        std::string path = "vamana_test.bin";
+        alg_vamana->saveIndex(path);
+        HNSW* alg_loaded = new HNSW(&space, path, false, n + 100);
+        alg_loaded->setEf(50);
+        for (idx_t j = 0; j < nq; j += 10) {
+            const float* p = query.data() + j * d;
+            assert(alg_loaded->searchKnnCloserFirst(p, k) == alg_vamana->searchKnnCloserFirst(p, k));
+        }
+        for (idx_t i = 0; i < 100; i++) {
+            alg_loaded->addPoint(data.data() + d * i, 3 * n + i);
+        }
+        for (idx_t i = 0; i < 100; i++) {
+            assert(alg_loaded->searchKnn(data.data() + d * i, 1).top().first == 0);
+        }
+        std::remove(path.c_str());
+        delete alg_loaded;
+        delete alg_vamana;
+    }
+    // the relaxed pruning keeps more links, and longer ones
+    assert(kept[1] > kept[0]);
+    assert(edges[1] > edges[0]);
+    assert(edge_lengths[1] > edge_lengths[0]);
+
+    // only into an empty index
+    bool thrown = false;
+    try {
+        alg_hnsw->buildVamana(data.data(), labels.data(), n);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    delete alg_hnsw;
+    delete alg_brute;
+}
+
+}  // namespace
+
+int main() {
+    test_vamana();
+
+    std::cout << "Test ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,49 @@
+import os
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class AttributeTestCase(unittest.TestCase):
+    def testAttributeSearch(self):
+        dim = 16
+        num_elements = 5000
+        num_attributes = 50
+
+        # Generating sample data, every element has a rare attribute and every second one a common attribute
+        data = np.float32(np.random.random((num_elements, dim)))
+        attributes = [[i % num_attributes] + ([1000] if i % 2 == 0 else []) for i in range(num_elements)]
+
+        hnsw_index = hnswlib.Index(space='l2', dim=dim)
+        bf_index = hnswlib.BFIndex(space='l2', dim=dim)
+        hnsw_index.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        bf_index.init_index(max_elements=num_elements)
+        hnsw_index.set_ef(50)
+
+        print("Adding %d elements with attributes" % (len(data)))
+        hnsw_index.add_items(data, attributes=attributes)
+        bf_index.add_items(data)
+
+        for attribute in [3, 1000]:
+            allowed = np.array([i for i in range(num_elements) if attribute in attributes[i]])
+            labels, distances = hnsw_index.knn_query(data[:100], k=10, attribute=attribute)
+            bf_labels, bf_distances = bf_index.knn_query(data[:100], k=10, filter=allowed)
+            self.assertTrue(np.all(np.isin(labels, allowed)))
+            recall = np.mean([len(np.intersect1d(labels[i], bf_labels[i])) / 10 for i in range(len(labels))])
+            self.assertGreater(recall, 0.9)
+
+        with self.assertRaises(RuntimeError):
+            hnsw_index.knn_query(data[:1], k=1, filter=np.arange(10), attribute=3)
+
+        # attributes are saved with the index
+        index_path = 'attribute_index.bin'
+        hnsw_index.save_index(index_path)
+        loaded_index = hnswlib.Index(space='l2', dim=dim)
+        loaded_index.load_index(index_path)
+        loaded_index.set_ef(50)
+        labels, distances = hnsw_index.knn_query(data[:100], k=10, attribute=3)
+        loaded_labels, loaded_distances = loaded_index.knn_query(data[:100], k=10, attribute=3)
+        self.assertTrue(np.array_equal(labels, loaded_labels))
+        os.remove(index_path)
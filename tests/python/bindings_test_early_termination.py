@@ -0,0 +1,44 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class EarlyTerminationTestCase(unittest.TestCase):
+    def testEarlyTermination(self):
+        dim = 16
+        num_elements = 10000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((100, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.set_ef(200)
+        p.add_items(data)
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data)
+        gt_labels, _ = bf.knn_query(queries, k)
+
+        def recall(labels):
+            return np.mean([len(np.intersect1d(labels[i], gt_labels[i])) / k for i in range(len(queries))])
+
+        labels, _ = p.knn_query(queries, k)
+        regular_recall = recall(labels)
+
+        p.set_early_termination(patience=3 * k)
+        labels, _ = p.knn_query(queries, k)
+        print("recall: regular %f, early termination %f" % (regular_recall, recall(labels)))
+        self.assertGreater(recall(labels), regular_recall - 0.05)
+
+        p.set_early_termination(patience=0, distance_ratio=1.5)
+        labels, _ = p.knn_query(queries, k)
+        self.assertGreater(recall(labels), regular_recall - 0.05)
+
+        p.set_early_termination()
+        labels, _ = p.knn_query(queries, k)
+        self.assertEqual(recall(labels), regular_recall)
@@ -0,0 +1,38 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class EntryStrategyTestCase(unittest.TestCase):
+    def testEntryStrategies(self):
+        dim = 16
+        num_elements = 5000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((100, dim)))
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data)
+        truth, _ = bf.knn_query(queries, k)
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.set_ef(50)
+        p.add_items(data)
+        p.mark_deleted(3)
+        self.assertEqual(p.get_entry_strategy(), 'hierarchy')
+
+        for strategy in ['medoid', 'diverse', 'router', 'hierarchy']:
+            p.set_entry_strategy(strategy, num_entries=8)
+            self.assertEqual(p.get_entry_strategy(), strategy)
+            labels, _ = p.knn_query(queries, k)
+            recall = np.mean([len(set(labels[i]) & set(truth[i])) / k for i in range(len(queries))])
+            self.assertGreater(recall, 0.9)
+            self.assertNotIn(3, p.knn_query(data[3], k)[0])
+
+        with self.assertRaises(RuntimeError):
+            p.set_entry_strategy('random')
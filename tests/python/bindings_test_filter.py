@@ -55,3 +55,23 @@ class RandomSelfTestCase(unittest.TestCase):
 
         labels, distances = bf_index.knn_query(data, k=1, filter=filter_function)
         self.assertEqual(np.mean(labels.reshape(-1) == np.arange(len(data))), .5)
+
+        print("Querying only even elements with a boolean mask and with an array of allowed ids")
+        # Bitset filters are checked inline in the search and do not need the GIL
+        mask = np.arange(num_elements) % 2 == 0
+        allowed_ids = np.arange(0, num_elements, 2)
+        for bitset_filter in [mask, allowed_ids]:
+            labels, distances = hnsw_index.knn_query(data, k=1, filter=bitset_filter)
+            self.assertAlmostEqual(np.mean(labels.reshape(-1) == np.arange(len(data))), .5, 3)
+            self.assertTrue(np.max(np.mod(labels, 2)) == 0)
+
+            labels, distances = bf_index.knn_query(data, k=1, filter=bitset_filter)
+            self.assertEqual(np.mean(labels.reshape(-1) == np.arange(len(data))), .5)
+
+        print("Querying a small fraction of the elements")
+        # Very selective filters are answered by scanning the allowed elements
+        allowed_ids = np.arange(0, num_elements, 500)
+        labels, distances = hnsw_index.knn_query(data[:100], k=10, filter=allowed_ids)
+        bf_labels, bf_distances = bf_index.knn_query(data[:100], k=10, filter=allowed_ids)
+        self.assertTrue(np.array_equal(np.sort(labels), np.sort(bf_labels)))
+        self.assertGreater(hnsw_index.get_filtered_search_stats()["brute_force"], 0)
@@ -0,0 +1,40 @@
+import os
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class HugePagesTestCase(unittest.TestCase):
+    def testHugePages(self):
+        dim = 16
+        num_elements = 5000
+
+        data = np.float32(np.random.random((num_elements, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.add_items(data)
+        labels, distances = p.knn_query(data, k=1)
+
+        index_path = 'huge_pages_index.bin'
+        p.save_index(index_path)
+
+        for huge_pages in ['thp', '2mb', '1gb']:
+            # without reserved huge pages the index falls back to transparent huge pages or regular pages
+            hp = hnswlib.Index(space='l2', dim=dim)
+            hp.init_index(max_elements=num_elements, ef_construction=100, M=16, huge_pages=huge_pages)
+            hp.add_items(data)
+            print("%s page size: %s" % (huge_pages, hp.get_page_size()))
+            self.assertGreaterEqual(hp.get_page_size()['level0'], 4096)
+            self.assertTrue(np.array_equal(hp.knn_query(data, k=1)[0], labels))
+
+            loaded = hnswlib.Index(space='l2', dim=dim)
+            loaded.load_index(index_path, huge_pages=huge_pages)
+            self.assertTrue(np.array_equal(loaded.knn_query(data, k=1)[0], labels))
+
+        with self.assertRaises(RuntimeError):
+            hnswlib.Index(space='l2', dim=dim).init_index(max_elements=10, huge_pages='4kb')
+
+        os.remove(index_path)
@@ -0,0 +1,47 @@
+import os
+import pickle
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class LayoutTestCase(unittest.TestCase):
+    def testSplitLayout(self):
+        dim = 13
+        num_elements = 5000
+
+        data = np.float32(np.random.random((num_elements, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        self.assertEqual(p.get_layout(), 'interleaved')
+        p.add_items(data[:num_elements // 2])
+
+        p.set_layout('split')
+        self.assertEqual(p.get_layout(), 'split')
+        p.add_items(data[num_elements // 2:], np.arange(num_elements // 2, num_elements))
+        labels, distances = p.knn_query(data, k=1)
+        self.assertGreater(np.mean(labels.reshape(-1) == np.arange(num_elements)), 0.99)
+        self.assertTrue(np.allclose(p.get_items([5, 6]), data[5:7]))
+
+        # the saved index does not depend on the layout
+        index_path = 'layout_index.bin'
+        p.save_index(index_path)
+        loaded = hnswlib.Index(space='l2', dim=dim)
+        loaded.load_index(index_path)
+        self.assertEqual(loaded.get_layout(), 'interleaved')
+        self.assertTrue(np.array_equal(loaded.knn_query(data, k=1)[0], labels))
+        os.remove(index_path)
+
+        # pickling keeps the layout
+        unpickled = pickle.loads(pickle.dumps(p))
+        self.assertEqual(unpickled.get_layout(), 'split')
+        self.assertTrue(np.array_equal(unpickled.knn_query(data, k=1)[0], labels))
+
+        p.set_layout('interleaved')
+        self.assertTrue(np.array_equal(p.knn_query(data, k=1)[0], labels))
+
+        with self.assertRaises(RuntimeError):
+            p.set_layout('columnar')
@@ -0,0 +1,42 @@
+import os
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class NamespaceTestCase(unittest.TestCase):
+    def testNamespaceSearch(self):
+        dim = 16
+        num_namespaces = 10
+        namespace_size = 300
+
+        data = np.float32(np.random.random((num_namespaces * namespace_size, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=len(data), ef_construction=100, M=16)
+        p.set_ef(50)
+
+        print("Adding %d namespaces" % num_namespaces)
+        for ns in range(1, num_namespaces + 1):
+            ids = np.arange((ns - 1) * namespace_size, ns * namespace_size)
+            p.add_items(data[ids], ids, namespace=ns)
+
+        self.assertEqual(p.get_namespaces(), list(range(1, num_namespaces + 1)))
+        self.assertEqual(p.get_namespace_count(3), namespace_size)
+
+        # every element finds itself in its namespace and the results stay in the namespace
+        for ns in range(1, num_namespaces + 1):
+            ids = np.arange((ns - 1) * namespace_size, ns * namespace_size)
+            labels, distances = p.knn_query(data[ids], k=5, namespace=ns)
+            self.assertAlmostEqual(np.mean(labels[:, 0] == ids), 1.0, 2)
+            self.assertTrue(np.all(labels // namespace_size == ns - 1))
+
+        # namespaces are saved with the index
+        index_path = 'namespace_index.bin'
+        p.save_index(index_path)
+        loaded = hnswlib.Index(space='l2', dim=dim)
+        loaded.load_index(index_path)
+        self.assertEqual(loaded.get_namespaces(), p.get_namespaces())
+        os.remove(index_path)
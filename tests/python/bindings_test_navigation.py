@@ -0,0 +1,43 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class NavigationTestCase(unittest.TestCase):
+    def testNavigation(self):
+        dim = 16
+        num_elements = 5000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((100, dim)))
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data)
+        truth, _ = bf.knn_query(queries, k)
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.set_ef(50)
+        p.add_items(data)
+        self.assertEqual(p.get_navigation(), 'hierarchy')
+
+        for navigation in ['flat', 'none', 'hierarchy']:
+            p.set_navigation(navigation)
+            self.assertEqual(p.get_navigation(), navigation)
+            labels, _ = p.knn_query(queries, k)
+            recall = np.mean([len(set(labels[i]) & set(truth[i])) / k for i in range(len(queries))])
+            self.assertGreater(recall, 0.9)
+
+        # the centroid table of the router leads directly to the base layer
+        p.set_entry_strategy('router', num_entries=32)
+        p.set_navigation('none')
+        labels, _ = p.knn_query(queries, k)
+        recall = np.mean([len(set(labels[i]) & set(truth[i])) / k for i in range(len(queries))])
+        self.assertGreater(recall, 0.9)
+
+        with self.assertRaises(RuntimeError):
+            p.set_navigation('random')
@@ -0,0 +1,43 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class NeighborCodesTestCase(unittest.TestCase):
+    def testNeighborCodes(self):
+        dim = 32
+        num_elements = 5000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        query = np.float32(np.random.random((100, dim)))
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data)
+        labels_bf, distances_bf = bf.knn_query(query, k)
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=200, M=16)
+        p.add_items(data[:num_elements // 2])
+        p.set_ef(100)
+
+        p.set_neighbor_codes('sq4')
+        self.assertEqual(p.get_layout(), 'split')
+        p.add_items(data[num_elements // 2:], np.arange(num_elements // 2, num_elements))
+        labels, distances = p.knn_query(query, k)
+        recall = np.mean([len(np.intersect1d(labels[i], labels_bf[i])) / k for i in range(len(query))])
+        print("recall with neighbor codes: %f" % recall)
+        self.assertGreater(recall, 0.9)
+
+        # the distances are exact after the rerank
+        self.assertTrue(np.allclose(distances[:, 0], np.sum((data[labels[:, 0]] - query) ** 2, axis=1), rtol=1e-4))
+
+        p.set_neighbor_codes('none')
+        p.set_neighbor_codes('sq4', rerank=20)
+        self.assertEqual(p.knn_query(query, k)[0].shape, (len(query), k))
+
+        with self.assertRaises(RuntimeError):
+            p.set_neighbor_codes('pq')
@@ -0,0 +1,32 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class NumaTestCase(unittest.TestCase):
+    def testNumaInterleave(self):
+        dim = 16
+        num_elements = 5000
+
+        data = np.float32(np.random.random((num_elements, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements // 2, ef_construction=100, M=16)
+        p.add_items(data[:num_elements // 2])
+        labels, distances = p.knn_query(data[:num_elements // 2], k=1)
+
+        # the policy is not available everywhere, the results do not change
+        interleaved = p.set_numa_interleave()
+        print("interleaved: %s" % interleaved)
+        self.assertTrue(np.array_equal(p.knn_query(data[:num_elements // 2], k=1)[0], labels))
+
+        p.resize_index(num_elements)
+        p.add_items(data[num_elements // 2:], np.arange(num_elements // 2, num_elements))
+        labels, distances = p.knn_query(data, k=1)
+        self.assertFalse(p.set_numa_interleave(False))
+        self.assertTrue(np.array_equal(p.knn_query(data, k=1)[0], labels))
+
+        with self.assertRaises(RuntimeError):
+            hnswlib.Index(space='l2', dim=dim).set_numa_interleave()
@@ -0,0 +1,52 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class RangeQueryTestCase(unittest.TestCase):
+    def testRangeQuery(self):
+        dim = 8
+        num_elements = 5000
+        radius = 0.3
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((50, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.set_ef(10)
+        p.add_items(data)
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data)
+
+        labels, distances = p.range_query(queries, radius)
+        bf_labels, bf_distances = bf.range_query(queries, radius)
+        self.assertEqual(len(labels), len(queries))
+
+        correct = 0
+        total = 0
+        for i in range(len(queries)):
+            # the brute force range is exact
+            exact = np.where(np.sum((data - queries[i]) ** 2, axis=1) <= radius)[0]
+            self.assertEqual(set(bf_labels[i]), set(exact))
+            self.assertTrue(np.all(distances[i] <= radius))
+            self.assertTrue(np.all(np.diff(distances[i]) >= 0))
+            correct += len(np.intersect1d(labels[i], exact))
+            total += len(exact)
+        print("range recall is :", correct / total)
+        self.assertGreater(correct / total, 0.95)
+
+        # the number of results is limited to the closest ones
+        labels, distances = bf.range_query(queries, radius, max_results=3)
+        for i in range(len(queries)):
+            self.assertLessEqual(len(labels[i]), 3)
+            self.assertTrue(np.array_equal(labels[i], bf_labels[i][:3]))
+
+        # filtered range query
+        labels, distances = p.range_query(queries, radius, filter=np.arange(0, num_elements, 2))
+        for i in range(len(queries)):
+            self.assertTrue(np.all(labels[i] % 2 == 0))
@@ -0,0 +1,35 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class ReorderTestCase(unittest.TestCase):
+    def testReorderIndex(self):
+        dim = 16
+        num_elements = 5000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((100, dim)))
+
+        for strategy in ['bfs', 'rcm', 'gorder']:
+            p = hnswlib.Index(space='l2', dim=dim)
+            p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+            p.set_ef(50)
+            p.add_items(data)
+            p.mark_deleted(3)
+
+            labels, distances = p.knn_query(queries, k)
+            p.reorder_index(strategy)
+
+            # the same graph is searched, only the internal ids differ
+            reordered_labels, reordered_distances = p.knn_query(queries, k)
+            self.assertTrue(np.array_equal(labels, reordered_labels))
+            self.assertTrue(np.allclose(distances, reordered_distances))
+            self.assertTrue(np.allclose(p.get_items([7]), data[[7]]))
+            self.assertNotIn(3, p.knn_query(data[3], k)[0])
+
+        with self.assertRaises(RuntimeError):
+            p.reorder_index('random')
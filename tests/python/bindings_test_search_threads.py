@@ -0,0 +1,27 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class SearchThreadsTestCase(unittest.TestCase):
+    def testSearchThreads(self):
+        dim = 16
+        num_elements = 10000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((20, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=16)
+        p.set_ef(1000)
+        p.add_items(data)
+
+        labels, distances = p.knn_query(queries, k, num_threads=1)
+        parallel_labels, parallel_distances = p.knn_query(queries, k, num_threads=1, search_threads=4)
+        self.assertGreater(np.mean(labels == parallel_labels), 0.99)
+
+        with self.assertRaises(RuntimeError):
+            p.knn_query(queries, k, namespace=1, search_threads=4)
@@ -0,0 +1,45 @@
+import os
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class VamanaTestCase(unittest.TestCase):
+    def testBuildVamana(self):
+        dim = 16
+        num_elements = 5000
+        k = 10
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((100, dim)))
+        ids = np.arange(num_elements) * 2
+
+        bf = hnswlib.BFIndex(space='l2', dim=dim)
+        bf.init_index(max_elements=num_elements)
+        bf.add_items(data, ids)
+        truth, _ = bf.knn_query(queries, k)
+
+        for alpha in [1.0, 1.2]:
+            p = hnswlib.Index(space='l2', dim=dim)
+            p.init_index(max_elements=num_elements + 10, ef_construction=100, M=16)
+            p.build_vamana(data, ids, alpha=alpha)
+            self.assertEqual(p.get_current_count(), num_elements)
+            p.set_ef(50)
+            labels, _ = p.knn_query(queries, k)
+            recall = np.mean([len(set(labels[i]) & set(truth[i])) / k for i in range(len(queries))])
+            self.assertGreater(recall, 0.9)
+
+            # saved in the index format and open to insertions
+            p.save_index('vamana_test.bin')
+            q = hnswlib.Index(space='l2', dim=dim)
+            q.load_index('vamana_test.bin', max_elements=num_elements + 10)
+            q.set_ef(50)
+            self.assertTrue(np.array_equal(q.knn_query(queries, k)[0], labels))
+            q.add_items(data[:10], np.arange(10) * 2 + 1)
+            self.assertEqual(q.knn_query(data[3], 1)[0][0][0] % 2, 0)
+            os.remove('vamana_test.bin')
+
+            with self.assertRaises(RuntimeError):
+                p.build_vamana(data, ids)